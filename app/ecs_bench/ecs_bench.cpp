@@ -0,0 +1,273 @@
+// 1M entity position update through the sparse set ECS, and the same through the archetype ECS.
+//
+// Every entity has a Position and a Velocity, every fourth one also has a Sprite. Times:
+//  - creating the entities and their components
+//  - integrating positions through a Position+Velocity view, the general path
+//  - integrating through the dense Position array alone, the single component fast path
+//  - a Position+Velocity+Sprite view, where the Sprite pool drives and is a quarter of the entities
+//  - deferring the destruction of every tenth entity and flushing
+// The archetype world gets the same entities, split into a Position+Velocity and a
+// Position+Velocity+Sprite archetype, and times:
+//  - integrating positions chunk by chunk through a Position+Velocity query
+//  - the Sprite query, which only visits the Sprite archetype's chunks
+//  - a change scan after moving only the sprites, which should skip every other chunk
+// and checks the results against a plain array baseline.
+//
+// Usage: ecs_bench [--entities N] [--frames N]
+
+#include "archetype.h"
+#include "ecs.h"
+#include "linalg.h"
+#include "timing.h"
+#include "tuke_engine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Position {
+  Vec3 p;
+};
+
+struct Velocity {
+  Vec3 v;
+};
+
+struct Sprite {
+  u32 texture;
+  f32 rotation;
+};
+
+static void print_timing(const char *name, const TimingAccumulator *timing, u32 num_entities) {
+  f64 mean_ms = timing_mean_ms(timing);
+  printf(
+      "%-26s mean %8.3f ms   min %8.3f ms   %6.2f ns/entity\n", name, mean_ms, ns_to_ms(timing->min_ns),
+      mean_ms * 1e6 / num_entities
+  );
+}
+
+int main(int argc, char **argv) {
+  u32 num_entities = 1000000;
+  u32 num_frames = 60;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc) {
+      num_entities = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      num_frames = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--entities N] [--frames N]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (num_entities >= MAX_NUM_ENTITY_SLOTS) {
+    fprintf(stderr, "main: at most %u entities\n", MAX_NUM_ENTITY_SLOTS - 1);
+    return 1;
+  }
+
+  const f32 dt = 1.0f / 60.0f;
+
+  World world = create_world(1024);
+  ComponentID position_id = WORLD_REGISTER_COMPONENT(&world, Position);
+  ComponentID velocity_id = WORLD_REGISTER_COMPONENT(&world, Velocity);
+  ComponentID sprite_id = WORLD_REGISTER_COMPONENT(&world, Sprite);
+
+  ArchetypeWorld archetype_world = create_archetype_world(1024);
+  ComponentID archetype_position_id = ARCHETYPE_WORLD_REGISTER_COMPONENT(&archetype_world, Position);
+  ComponentID archetype_velocity_id = ARCHETYPE_WORLD_REGISTER_COMPONENT(&archetype_world, Velocity);
+  ComponentID archetype_sprite_id = ARCHETYPE_WORLD_REGISTER_COMPONENT(&archetype_world, Sprite);
+  ComponentMask moving_mask = COMPONENT_BIT(archetype_position_id) | COMPONENT_BIT(archetype_velocity_id);
+  ComponentMask sprite_mask = moving_mask | COMPONENT_BIT(archetype_sprite_id);
+
+  EntityIndex *entities = (EntityIndex *)malloc(num_entities * sizeof(EntityIndex));
+  EntityIndex *archetype_entities = (EntityIndex *)malloc(num_entities * sizeof(EntityIndex));
+  Vec3 *baseline_positions = (Vec3 *)malloc(num_entities * sizeof(Vec3));
+  Vec3 *baseline_velocities = (Vec3 *)malloc(num_entities * sizeof(Vec3));
+
+  // Create
+  u64 t_start = get_time_ns();
+  for (u32 i = 0; i < num_entities; i++) {
+    EntityIndex e = world_create_entity(&world);
+    entities[i] = e;
+
+    Vec3 p = vec3((f32)(i % 1000), (f32)(i / 1000), 0.0f);
+    Vec3 v = vec3(sinf((f32)i), cosf((f32)i), 0.0f);
+    ((Position *)world_add_component(&world, e, position_id))->p = p;
+    ((Velocity *)world_add_component(&world, e, velocity_id))->v = v;
+    if (i % 4 == 0) {
+      ((Sprite *)world_add_component(&world, e, sprite_id))->texture = i;
+    }
+    baseline_positions[i] = p;
+    baseline_velocities[i] = v;
+  }
+  u64 create_ns = get_time_ns() - t_start;
+  printf("Entities:                  %u, %u with a Sprite\n", num_entities, world.pools[sprite_id].num_components);
+  printf("Create:                    %.3f ms\n", ns_to_ms(create_ns));
+
+  t_start = get_time_ns();
+  for (u32 i = 0; i < num_entities; i++) {
+    EntityIndex e = archetype_world_create_entity(&archetype_world, i % 4 == 0 ? sprite_mask : moving_mask);
+    archetype_entities[i] = e;
+    ((Position *)archetype_world_write_component(&archetype_world, e, archetype_position_id))->p =
+        baseline_positions[i];
+    ((Velocity *)archetype_world_write_component(&archetype_world, e, archetype_velocity_id))->v =
+        baseline_velocities[i];
+    if (i % 4 == 0) {
+      ((Sprite *)archetype_world_write_component(&archetype_world, e, archetype_sprite_id))->texture = i;
+    }
+  }
+  create_ns = get_time_ns() - t_start;
+  printf("Create archetype:          %.3f ms\n", ns_to_ms(create_ns));
+
+  TimingAccumulator baseline_timing = {};
+  TimingAccumulator view_timing = {};
+  TimingAccumulator dense_timing = {};
+  TimingAccumulator sparse_view_timing = {};
+  TimingAccumulator chunk_timing = {};
+  TimingAccumulator chunk_sprite_timing = {};
+
+  for (u32 frame = 0; frame < num_frames; frame++) {
+    // Plain arrays, what the ECS is up against
+    t_start = get_time_ns();
+    for (u32 i = 0; i < num_entities; i++) {
+      inc_v3(&baseline_positions[i], scale_v3(baseline_velocities[i], dt));
+    }
+    timing_accumulate(&baseline_timing, get_time_ns() - t_start);
+
+    // Position + Velocity view
+    t_start = get_time_ns();
+    ComponentID moving[] = {position_id, velocity_id};
+    WorldView view = world_view(&world, moving, ARRAY_SIZE(moving));
+    EntityIndex e;
+    void *components[2];
+    while (world_view_next(&view, &e, components)) {
+      Position *position = (Position *)components[0];
+      const Velocity *velocity = (const Velocity *)components[1];
+      inc_v3(&position->p, scale_v3(velocity->v, dt));
+    }
+    timing_accumulate(&view_timing, get_time_ns() - t_start);
+
+    // Dense positions only, a constant drift
+    t_start = get_time_ns();
+    u32 num_positions;
+    Position *positions = (Position *)world_component_array(&world, position_id, &num_positions);
+    for (u32 i = 0; i < num_positions; i++) {
+      positions[i].p.z += dt;
+    }
+    timing_accumulate(&dense_timing, get_time_ns() - t_start);
+
+    // Sprite driven view
+    t_start = get_time_ns();
+    ComponentID drawn[] = {position_id, velocity_id, sprite_id};
+    WorldView sprite_view = world_view(&world, drawn, ARRAY_SIZE(drawn));
+    void *sprite_components[3];
+    while (world_view_next(&sprite_view, &e, sprite_components)) {
+      Sprite *sprite = (Sprite *)sprite_components[2];
+      const Velocity *velocity = (const Velocity *)sprite_components[1];
+      sprite->rotation = atan2f(velocity->v.y, velocity->v.x);
+    }
+    timing_accumulate(&sparse_view_timing, get_time_ns() - t_start);
+
+    archetype_world_advance_version(&archetype_world);
+
+    // Position + Velocity chunks
+    t_start = get_time_ns();
+    ArchetypeQuery query = archetype_query(&archetype_world, moving_mask);
+    ArchetypeChunkView chunk;
+    while (archetype_query_next(&query, &chunk)) {
+      Position *positions = (Position *)archetype_chunk_write(&chunk, archetype_position_id);
+      const Velocity *velocities = (const Velocity *)archetype_chunk_read(&chunk, archetype_velocity_id);
+      for (u32 i = 0; i < chunk.count; i++) {
+        inc_v3(&positions[i].p, scale_v3(velocities[i].v, dt));
+      }
+    }
+    timing_accumulate(&chunk_timing, get_time_ns() - t_start);
+
+    // Sprite chunks
+    t_start = get_time_ns();
+    ArchetypeQuery sprite_query = archetype_query(&archetype_world, sprite_mask);
+    while (archetype_query_next(&sprite_query, &chunk)) {
+      Sprite *sprites = (Sprite *)archetype_chunk_write(&chunk, archetype_sprite_id);
+      const Velocity *velocities = (const Velocity *)archetype_chunk_read(&chunk, archetype_velocity_id);
+      for (u32 i = 0; i < chunk.count; i++) {
+        sprites[i].rotation = atan2f(velocities[i].v.y, velocities[i].v.x);
+      }
+    }
+    timing_accumulate(&chunk_sprite_timing, get_time_ns() - t_start);
+  }
+
+  print_timing("Baseline arrays", &baseline_timing, num_entities);
+  print_timing("View Position+Velocity", &view_timing, num_entities);
+  print_timing("Dense Position", &dense_timing, num_entities);
+  print_timing("View +Sprite (1/4 drive)", &sparse_view_timing, num_entities);
+  print_timing("Chunks Position+Velocity", &chunk_timing, num_entities);
+  print_timing("Chunks +Sprite", &chunk_sprite_timing, num_entities);
+
+  // The view and the baseline integrate the same velocities, z only holds the dense drift
+  f32 max_error = 0.0f;
+  for (u32 i = 0; i < num_entities; i++) {
+    const Position *position = WORLD_GET_COMPONENT(&world, entities[i], position_id, Position);
+    max_error = fmaxf(max_error, fabsf(position->p.x - baseline_positions[i].x));
+    max_error = fmaxf(max_error, fabsf(position->p.y - baseline_positions[i].y));
+  }
+  printf("Max error vs baseline:     %g\n", max_error);
+
+  f32 max_archetype_error = 0.0f;
+  for (u32 i = 0; i < num_entities; i++) {
+    const Position *position = (const Position *)archetype_world_read_component(
+        &archetype_world, archetype_entities[i], archetype_position_id
+    );
+    max_archetype_error = fmaxf(max_archetype_error, fabsf(position->p.x - baseline_positions[i].x));
+    max_archetype_error = fmaxf(max_archetype_error, fabsf(position->p.y - baseline_positions[i].y));
+  }
+  printf("Max archetype error:       %g\n", max_archetype_error);
+
+  // Move only the sprites, then scan for changed positions as a renderer would before re-uploading
+  u32 seen_version = archetype_world.version;
+  archetype_world_advance_version(&archetype_world);
+  ArchetypeQuery sprite_query = archetype_query(&archetype_world, sprite_mask);
+  ArchetypeChunkView chunk;
+  u32 num_sprite_chunks = 0;
+  while (archetype_query_next(&sprite_query, &chunk)) {
+    Position *positions = (Position *)archetype_chunk_write(&chunk, archetype_position_id);
+    for (u32 i = 0; i < chunk.count; i++) {
+      positions[i].p.z += dt;
+    }
+    num_sprite_chunks++;
+  }
+
+  t_start = get_time_ns();
+  ArchetypeQuery changed_query = archetype_query(&archetype_world, COMPONENT_BIT(archetype_position_id));
+  u32 num_chunks = 0;
+  u32 num_changed_chunks = 0;
+  while (archetype_query_next(&changed_query, &chunk)) {
+    num_chunks++;
+    num_changed_chunks += archetype_chunk_changed(&chunk, archetype_position_id, seen_version);
+  }
+  u64 changed_ns = get_time_ns() - t_start;
+  printf(
+      "Changed chunk scan:        %.3f ms, %u of %u chunks changed\n", ns_to_ms(changed_ns), num_changed_chunks,
+      num_chunks
+  );
+
+  // Deferred destroy of every tenth entity, as a system would while iterating
+  t_start = get_time_ns();
+  for (u32 i = 0; i < num_entities; i += 10) {
+    world_defer_destroy_entity(&world, entities[i]);
+  }
+  world_flush_commands(&world);
+  u64 destroy_ns = get_time_ns() - t_start;
+  printf("Deferred destroy + flush:  %.3f ms, %u live\n", ns_to_ms(destroy_ns), world.num_live_entities);
+
+  bool ok = max_error < 1e-3f && !world_entity_valid(&world, entities[0]) && world_entity_valid(&world, entities[1]);
+  ok = ok && max_archetype_error < 1e-3f && num_changed_chunks == num_sprite_chunks;
+
+  free(entities);
+  free(archetype_entities);
+  free(baseline_positions);
+  free(baseline_velocities);
+  destroy_world(&world);
+  destroy_archetype_world(&archetype_world);
+  return ok ? 0 : 1;
+}
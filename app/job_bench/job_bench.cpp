@@ -0,0 +1,237 @@
+// Job system stress test and scaling benchmark.
+//
+// For every thread count from 1 up to the maximum, the stress test checks:
+//  - many independent tiny jobs, more than a deque holds, all run exactly once
+//  - a recursive fibonacci where every job spawns two children and waits on them from inside a job
+//  - parallel_for covers every index exactly once, for awkward counts and grain sizes
+// Then the benchmark times a compute bound parallel_for and tiny job throughput at 1, 2, 4, ..., N
+// threads and prints the speedup over 1 thread.
+//
+// Usage: job_bench [--threads N] [--rounds N]
+
+#include "jobs.h"
+#include "statistics.h"
+#include "timing.h"
+#include "tuke_engine.h"
+
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_TINY_JOBS (100000)
+#define FIB_N (20)
+#define FIB_SERIAL_CUTOFF (4)
+#define BENCH_COUNT (1 << 22)
+#define BENCH_GRAIN (4096)
+#define BENCH_REPEATS (10)
+
+static void add_index_job(void *data, u32 begin, u32 end) {
+  ((std::atomic<u64> *)data)->fetch_add(begin, std::memory_order_relaxed);
+  (void)end;
+}
+
+struct FibTask {
+  JobSystem *jobs;
+  u32 n;
+  u64 result;
+};
+
+static u64 fib_serial(u32 n) { return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2); }
+
+static void fib_job(void *data, u32 begin, u32 end) {
+  (void)begin;
+  (void)end;
+  FibTask *task = (FibTask *)data;
+  if (task->n < FIB_SERIAL_CUTOFF) {
+    task->result = fib_serial(task->n);
+    return;
+  }
+
+  FibTask a = {.jobs = task->jobs, .n = task->n - 1, .result = 0};
+  FibTask b = {.jobs = task->jobs, .n = task->n - 2, .result = 0};
+  JobCounter counter = {};
+  job_system_run(task->jobs, fib_job, &a, 0, 0, &counter);
+  job_system_run(task->jobs, fib_job, &b, 0, 0, &counter);
+  job_system_wait(task->jobs, &counter);
+  task->result = a.result + b.result;
+}
+
+struct CoverageData {
+  std::atomic<u32> *hits;
+  u32 grain;
+  std::atomic<bool> oversized;
+};
+
+static void coverage_job(void *data, u32 begin, u32 end) {
+  CoverageData *coverage = (CoverageData *)data;
+  if (end - begin > coverage->grain || begin >= end) {
+    coverage->oversized.store(true);
+  }
+  for (u32 i = begin; i < end; i++) {
+    coverage->hits[i].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static bool stress(u32 num_threads, u32 rounds, RNG *rng) {
+  JobSystem *jobs = create_job_system(num_threads);
+  bool ok = true;
+
+  for (u32 round = 0; round < rounds && ok; round++) {
+    // Tiny jobs, overflowing the calling thread's deque so some run inline
+    std::atomic<u64> sum = 0;
+    JobCounter counter = {};
+    for (u32 i = 0; i < NUM_TINY_JOBS; i++) {
+      job_system_run(jobs, add_index_job, &sum, i, i + 1, &counter);
+    }
+    job_system_wait(jobs, &counter);
+    u64 expected = (u64)NUM_TINY_JOBS * (NUM_TINY_JOBS - 1) / 2;
+    if (sum.load() != expected || counter.pending.load() != 0) {
+      fprintf(
+          stderr, "stress: %u threads, tiny jobs summed %llu, expected %llu\n", num_threads,
+          (unsigned long long)sum.load(), (unsigned long long)expected
+      );
+      ok = false;
+    }
+
+    // Nested spawn and wait
+    FibTask fib = {.jobs = jobs, .n = FIB_N, .result = 0};
+    fib_job(&fib, 0, 0);
+    if (fib.result != fib_serial(FIB_N)) {
+      fprintf(stderr, "stress: %u threads, fib(%u) = %llu\n", num_threads, FIB_N, (unsigned long long)fib.result);
+      ok = false;
+    }
+
+    // parallel_for coverage
+    u32 count = 1 + (u32)(random_u64_xoroshiro128plus(rng) % 100000);
+    CoverageData coverage;
+    coverage.hits = (std::atomic<u32> *)calloc(count, sizeof(std::atomic<u32>));
+    coverage.grain = 1 + (u32)(random_u64_xoroshiro128plus(rng) % 2000);
+    coverage.oversized = false;
+    parallel_for(jobs, count, coverage.grain, coverage_job, &coverage);
+    for (u32 i = 0; i < count; i++) {
+      if (coverage.hits[i].load() != 1) {
+        fprintf(
+            stderr, "stress: %u threads, parallel_for(%u, grain %u) hit %u %u times\n", num_threads, count,
+            coverage.grain, i, coverage.hits[i].load()
+        );
+        ok = false;
+        break;
+      }
+    }
+    if (coverage.oversized.load()) {
+      fprintf(stderr, "stress: %u threads, parallel_for range over grain %u\n", num_threads, coverage.grain);
+      ok = false;
+    }
+    free(coverage.hits);
+  }
+
+  u64 steals = 0;
+  u64 sleeps = 0;
+  for (u32 i = 0; i < jobs->num_threads; i++) {
+    steals += jobs->stats[i].steals.load();
+    sleeps += jobs->stats[i].sleeps.load();
+  }
+  printf(
+      "Stress %2u threads:  %s, %llu steals, %llu sleeps\n", num_threads, ok ? "ok" : "FAILED",
+      (unsigned long long)steals, (unsigned long long)sleeps
+  );
+  destroy_job_system(jobs);
+  return ok;
+}
+
+struct BenchData {
+  f32 *values;
+};
+
+// Enough math per element that the loop is compute bound rather than memory bound
+static void bench_job(void *data, u32 begin, u32 end) {
+  f32 *values = ((BenchData *)data)->values;
+  for (u32 i = begin; i < end; i++) {
+    f32 x = values[i];
+    for (u32 k = 0; k < 16; k++) {
+      x = sqrtf(x * x + 1.0f) * 0.5f;
+    }
+    values[i] = x;
+  }
+}
+
+static void bench(u32 num_threads, f64 *base_ms, f64 *base_tiny_ms) {
+  JobSystem *jobs = create_job_system(num_threads);
+  BenchData data;
+  data.values = (f32 *)malloc(BENCH_COUNT * sizeof(f32));
+  for (u32 i = 0; i < BENCH_COUNT; i++) {
+    data.values[i] = (f32)i;
+  }
+
+  TimingAccumulator parallel_timing = {};
+  TimingAccumulator tiny_timing = {};
+  for (u32 repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+    u64 t_start = get_time_ns();
+    parallel_for(jobs, BENCH_COUNT, BENCH_GRAIN, bench_job, &data);
+    timing_accumulate(&parallel_timing, get_time_ns() - t_start);
+
+    std::atomic<u64> sum = 0;
+    JobCounter counter = {};
+    t_start = get_time_ns();
+    for (u32 i = 0; i < JOB_DEQUE_CAPACITY; i++) {
+      job_system_run(jobs, add_index_job, &sum, i, i + 1, &counter);
+    }
+    job_system_wait(jobs, &counter);
+    timing_accumulate(&tiny_timing, get_time_ns() - t_start);
+  }
+
+  f64 ms = ns_to_ms(parallel_timing.min_ns);
+  f64 tiny_ms = ns_to_ms(tiny_timing.min_ns);
+  if (num_threads == 1) {
+    *base_ms = ms;
+    *base_tiny_ms = tiny_ms;
+  }
+  printf(
+      "Bench %2u threads:   parallel_for %8.3f ms (%5.2fx)   %u tiny jobs %7.3f ms (%5.2fx, %.0f ns/job)\n",
+      num_threads, ms, *base_ms / ms, JOB_DEQUE_CAPACITY, tiny_ms, *base_tiny_ms / tiny_ms,
+      tiny_ms * 1e6 / JOB_DEQUE_CAPACITY
+  );
+
+  free(data.values);
+  destroy_job_system(jobs);
+}
+
+int main(int argc, char **argv) {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  u32 max_threads = online > 0 ? (u32)online : 1;
+  u32 rounds = 20;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      max_threads = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+      rounds = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--threads N] [--rounds N]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (max_threads == 0 || max_threads > MAX_NUM_JOB_THREADS) {
+    fprintf(stderr, "main: --threads must be in [1, %u]\n", MAX_NUM_JOB_THREADS);
+    return 1;
+  }
+  printf("%ld online CPUs\n", online);
+
+  RNG rng = create_rng(0x6a6f6273);
+  bool ok = true;
+  for (u32 num_threads = 1; num_threads <= max_threads; num_threads++) {
+    ok = stress(num_threads, rounds, &rng) && ok;
+  }
+
+  f64 base_ms = 0.0;
+  f64 base_tiny_ms = 0.0;
+  for (u32 num_threads = 1; num_threads < max_threads; num_threads *= 2) {
+    bench(num_threads, &base_ms, &base_tiny_ms);
+  }
+  bench(max_threads, &base_ms, &base_tiny_ms);
+
+  return ok ? 0 : 1;
+}
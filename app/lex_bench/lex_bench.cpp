@@ -0,0 +1,229 @@
+// Reflector lexer micro-benchmark: lexes every shader under shaders/ many times.
+//
+// First checks that string_slice_to_keyword_or_identifier agrees with a plain chain of compares, the way keywords
+// used to be classified, for every word in the tree and every keyword. Then times:
+//  - lexing every file into one reused arena, the steady state with no allocation at all
+//  - lexing every file into a fresh arena, which is what the reflector does per shader
+//  - classifying every word in the tree with the switch and with the compare chain
+//
+// Usage: lex_bench [--input DIR] [--rounds N]
+
+#include "arena.h"
+#include "filesystem_utils.h"
+#include "lexer.h"
+#include "reflector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static u64 get_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static f64 ns_to_ms(u64 ns) { return (f64)ns * 1e-6; }
+
+// The classifier as it was before the switch, kept as the reference
+static TokenType classify_with_compare_chain(const char *string, u32 length) {
+  // clang-format off
+#define KW(kw, token) if (length == (sizeof(kw) - 1) && (strncmp(string, kw, length) == 0)) { return token; }
+  KW("in",                  TOKEN_TYPE_IN)
+  KW("out",                 TOKEN_TYPE_OUT)
+  KW("version",             TOKEN_TYPE_VERSION)
+  KW("void",                TOKEN_TYPE_VOID)
+  KW("uniform",             TOKEN_TYPE_UNIFORM)
+  KW("sampler",             TOKEN_TYPE_SAMPLER)
+  KW("sampler2D",           TOKEN_TYPE_SAMPLER2D)
+  KW("sampler2DArray",      TOKEN_TYPE_SAMPLER2D_ARRAY)
+  KW("texture2D",           TOKEN_TYPE_TEXTURE2D)
+  KW("image2D",             TOKEN_TYPE_IMAGE2D)
+  KW("uint",                TOKEN_TYPE_UINT)
+  KW("float",               TOKEN_TYPE_FLOAT)
+  KW("vec2",                TOKEN_TYPE_VEC2)
+  KW("vec3",                TOKEN_TYPE_VEC3)
+  KW("vec4",                TOKEN_TYPE_VEC4)
+  KW("mat2",                TOKEN_TYPE_MAT2)
+  KW("mat3",                TOKEN_TYPE_MAT3)
+  KW("mat4",                TOKEN_TYPE_MAT4)
+  KW("VERSION",             TOKEN_TYPE_DIRECTIVE_VERSION)
+  KW("LOCATION",            TOKEN_TYPE_DIRECTIVE_LOCATION)
+  KW("SET_BINDING",         TOKEN_TYPE_DIRECTIVE_SET_BINDING)
+  KW("PUSH_CONSTANT",       TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT)
+  KW("VERTEX_SHADER",       TOKEN_TYPE_DIRECTIVE_VERTEX_SHADER)
+  KW("BINDLESS",            TOKEN_TYPE_BINDLESS)
+  KW("RATE_VERTEX",         TOKEN_TYPE_RATE_VERTEX)
+  KW("RATE_INSTANCE",       TOKEN_TYPE_RATE_INSTANCE)
+  KW("BINDING",             TOKEN_TYPE_BINDING)
+  KW("OFFSET",              TOKEN_TYPE_OFFSET)
+  KW("TIGHTLY_PACKED",      TOKEN_TYPE_TIGHTLY_PACKED)
+  KW("FORMAT",              TOKEN_TYPE_FORMAT)
+  KW("SET_LABEL",           TOKEN_TYPE_SET_LABEL)
+  KW("VERTEX_INDEX",        TOKEN_TYPE_DIRECTIVE_VERTEX_INDEX)
+  KW("INSTANCE_INDEX",      TOKEN_TYPE_DIRECTIVE_INSTANCE_INDEX)
+  // clang-format on
+#undef KW
+  return TOKEN_TYPE_TEXT;
+}
+
+static const char *KEYWORDS[] = {
+    "in", "out", "version", "void", "uniform", "sampler", "sampler2D", "sampler2DArray", "texture2D", "image2D", "uint",
+    "float", "vec2", "vec3", "vec4", "mat2", "mat3", "mat4", "VERSION", "LOCATION", "SET_BINDING", "PUSH_CONSTANT",
+    "VERTEX_SHADER", "BINDLESS", "RATE_VERTEX", "RATE_INSTANCE", "BINDING", "OFFSET", "TIGHTLY_PACKED", "FORMAT",
+    "SET_LABEL", "VERTEX_INDEX", "INSTANCE_INDEX",
+};
+
+struct Word {
+  const char *start;
+  u32 length;
+};
+
+static bool is_word_char(char c) {
+  return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+int main(int argc, char **argv) {
+  const char *input_dir = "shaders";
+  u32 num_rounds = 1000;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+      input_dir = argv[++i];
+    } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+      num_rounds = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--input DIR] [--rounds N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  SubdirectoryList subdirectory_list;
+  memset(&subdirectory_list, 0, sizeof(subdirectory_list));
+  walk_dirs(input_dir, &subdirectory_list);
+  ShaderToCompileList shaders = collect_shaders_to_compile(&subdirectory_list, input_dir);
+  if (shaders.num_shaders == 0) {
+    fprintf(stderr, "main: no shaders found in %s\n", input_dir);
+    return 1;
+  }
+
+  // Every word in the tree, keywords included, split the same way the lexer splits them
+  u64 num_bytes = 0;
+  u32 num_words = 0;
+  u32 word_capacity = 1024;
+  Word *words = (Word *)malloc(word_capacity * sizeof(Word));
+  for (u32 i = 0; i < shaders.num_shaders; i++) {
+    const char *source = shaders.shaders[i].source;
+    u64 length = shaders.shaders[i].source_length;
+    num_bytes += length;
+    u64 j = 0;
+    while (j < length) {
+      bool starts_word = is_word_char(source[j]) && !(source[j] >= '0' && source[j] <= '9');
+      if (!starts_word) {
+        j++;
+        continue;
+      }
+      u64 start = j;
+      while (j < length && is_word_char(source[j])) {
+        j++;
+      }
+      if (num_words == word_capacity) {
+        word_capacity *= 2;
+        words = (Word *)realloc(words, word_capacity * sizeof(Word));
+      }
+      words[num_words++] = {.start = source + start, .length = (u32)(j - start)};
+    }
+  }
+
+  // Correctness
+  u32 num_mismatches = 0;
+  for (u32 i = 0; i < num_words; i++) {
+    TokenType fast = string_slice_to_keyword_or_identifier(words[i].start, words[i].length);
+    TokenType reference = classify_with_compare_chain(words[i].start, words[i].length);
+    if (fast != reference) {
+      fprintf(stderr, "Mismatch on %.*s: %d vs %d\n", words[i].length, words[i].start, fast, reference);
+      num_mismatches++;
+    }
+  }
+  for (u32 i = 0; i < sizeof(KEYWORDS) / sizeof(KEYWORDS[0]); i++) {
+    u32 length = (u32)strlen(KEYWORDS[i]);
+    TokenType fast = string_slice_to_keyword_or_identifier(KEYWORDS[i], length);
+    if (fast == TOKEN_TYPE_TEXT || fast != classify_with_compare_chain(KEYWORDS[i], length)) {
+      fprintf(stderr, "Keyword %s misclassified\n", KEYWORDS[i]);
+      num_mismatches++;
+    }
+  }
+  if (num_mismatches > 0) {
+    fprintf(stderr, "%u classifier mismatches\n", num_mismatches);
+    return 1;
+  }
+
+  printf("Shaders:                   %u, %.1f KB, %u words\n", shaders.num_shaders, num_bytes / 1024.0, num_words);
+  printf("Rounds:                    %u\n", num_rounds);
+
+  // Lex into one reused arena
+  ReflectorArena arena = {};
+  u64 num_tokens = 0;
+  u64 t_start = get_time_ns();
+  for (u32 round = 0; round < num_rounds; round++) {
+    for (u32 i = 0; i < shaders.num_shaders; i++) {
+      reflector_arena_reset(&arena);
+      TokenVector tokens = lex_string(shaders.shaders[i].source, shaders.shaders[i].source_length, &arena);
+      num_tokens += tokens.size;
+    }
+  }
+  u64 reused_ns = get_time_ns() - t_start;
+  destroy_reflector_arena(&arena);
+
+  // Lex into a fresh arena per file
+  t_start = get_time_ns();
+  for (u32 round = 0; round < num_rounds; round++) {
+    for (u32 i = 0; i < shaders.num_shaders; i++) {
+      ReflectorArena file_arena = {};
+      TokenVector tokens = lex_string(shaders.shaders[i].source, shaders.shaders[i].source_length, &file_arena);
+      num_tokens += tokens.size;
+      destroy_reflector_arena(&file_arena);
+    }
+  }
+  u64 fresh_ns = get_time_ns() - t_start;
+
+  // Classify
+  u64 checksum = 0;
+  t_start = get_time_ns();
+  for (u32 round = 0; round < num_rounds; round++) {
+    for (u32 i = 0; i < num_words; i++) {
+      checksum += string_slice_to_keyword_or_identifier(words[i].start, words[i].length);
+    }
+  }
+  u64 switch_ns = get_time_ns() - t_start;
+
+  t_start = get_time_ns();
+  for (u32 round = 0; round < num_rounds; round++) {
+    for (u32 i = 0; i < num_words; i++) {
+      checksum -= classify_with_compare_chain(words[i].start, words[i].length);
+    }
+  }
+  u64 chain_ns = get_time_ns() - t_start;
+
+  f64 total_mb = (f64)num_bytes * num_rounds / (1024.0 * 1024.0);
+  u64 tokens_per_pass = num_tokens / (2ull * num_rounds);
+  printf("Tokens per pass:           %llu\n", (unsigned long long)tokens_per_pass);
+  printf(
+      "Lex, reused arena:         %.3f ms per pass, %.0f MB/s\n", ns_to_ms(reused_ns) / num_rounds,
+      total_mb / (reused_ns * 1e-9)
+  );
+  printf(
+      "Lex, arena per file:       %.3f ms per pass, %.0f MB/s\n", ns_to_ms(fresh_ns) / num_rounds,
+      total_mb / (fresh_ns * 1e-9)
+  );
+  printf("Classify, switch:          %.1f ns per word\n", (f64)switch_ns / ((f64)num_words * num_rounds));
+  printf(
+      "Classify, compare chain:   %.1f ns per word (checksum %llu)\n", (f64)chain_ns / ((f64)num_words * num_rounds),
+      (unsigned long long)checksum
+  );
+
+  free(words);
+  free_shader_to_compile_list(&shaders);
+  return 0;
+}
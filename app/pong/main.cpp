@@ -1,11 +1,76 @@
+#include "input_recording.h"
 #include "pong.h"
+#include "timing.h"
 
-int main() {
+#include <string.h>
 
-  State state = setup_state("Tuke Pong");
+// After a long hitch, drop the backlog rather than spiralling
+#define PONG_MAX_SIM_STEPS_PER_FRAME (8)
+
+// Steps the sim through a recording as fast as possible, without rendering or polling the window.
+// The window is still created, the Vulkan renderer lives in State. Cursor hit tests use the current
+// window size, so menu hovering only replays exactly at the recorded size.
+static bool replay_pong(State *state, const InputRecording *recording) {
+  u64 t_start = get_time_ns();
+  u32 num_ticks = 0;
+  bool ok = true;
+  for (u32 tick = 0; tick < recording->num_frames && ok; tick++) {
+    apply_input_frame(&state->inputs, &recording->frames[tick]);
+    process_inputs(state, recording->dt);
+    update_game_state(state, recording->dt);
+    ok = check_replay_state_hash(recording, tick, hash_pong_state(state));
+    num_ticks++;
+  }
+  f64 total_ms = ns_to_ms(get_time_ns() - t_start);
+
+  printf(
+      "Replayed %u of %u ticks in %.1f ms, %.0f ticks/s\n", num_ticks, recording->num_frames, total_ms,
+      num_ticks / (total_ms * 1e-3)
+  );
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--record PATH | --replay PATH]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  InputRecording recording;
+  if (replay_path) {
+    if (!load_input_recording(&recording, replay_path)) {
+      return 1;
+    }
+  } else {
+    recording = create_input_recording(PONG_SEED, PONG_SIM_DT);
+  }
+
+  State state = setup_state("Tuke Pong", recording.seed);
+
+  if (replay_path) {
+    glfwGetFramebufferSize(state.window, &state.window_width, &state.window_height);
+    bool ok = replay_pong(&state, &recording);
+    destroy_input_recording(&recording);
+    destroy_state(&state);
+    return ok ? 0 : 1;
+  }
+
+#ifdef TUKE_SHADER_HOT_RELOAD
+  start_pong_shader_hot_reload(&state.renderer);
+#endif
 
   f64 t_prev = glfwGetTime();
   f64 total_time = 0.0f;
+  f64 sim_time_accumulator = 0.0;
+  u32 num_steps = 1;
   while (!glfwWindowShouldClose(state.window)) {
     glfwPollEvents();
     f64 t = glfwGetTime();
@@ -14,8 +79,33 @@ int main() {
     total_time += dt;
     t_prev = t;
 
-    process_inputs(&state, dt);
-    update_game_state(&state, dt);
+    glfwGetFramebufferSize(state.window, &state.window_width, &state.window_height);
+    if (num_steps == 0) {
+      update_inputs_glfw_unconsumed(&state.inputs, state.window);
+    } else {
+      update_inputs_glfw(&state.inputs, state.window);
+    }
+
+    sim_time_accumulator += dt;
+    num_steps = 0;
+    while (sim_time_accumulator >= PONG_SIM_DT && num_steps < PONG_MAX_SIM_STEPS_PER_FRAME) {
+      if (num_steps > 0) {
+        clear_input_edges(&state.inputs);
+      }
+
+      process_inputs(&state, PONG_SIM_DT);
+      update_game_state(&state, PONG_SIM_DT);
+      if (record_path) {
+        record_input_frame(&recording, inputs_to_input_frame(&state.inputs), hash_pong_state(&state));
+      }
+
+      sim_time_accumulator -= PONG_SIM_DT;
+      num_steps++;
+    }
+    if (num_steps == PONG_MAX_SIM_STEPS_PER_FRAME) {
+      sim_time_accumulator = 0.0;
+    }
+
     render(&state);
 
     if (state.time > 0.0f) {
@@ -26,6 +116,10 @@ int main() {
     }
   }
 
+  if (record_path) {
+    save_input_recording(&recording, record_path);
+  }
+  destroy_input_recording(&recording);
   destroy_state(&state);
   return 0;
 }
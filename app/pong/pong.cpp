@@ -6,6 +6,7 @@
 #include "linalg.h"
 #include "physics.h"
 #include "pong.h"
+#include "shader_hot_reload.h"
 #include "shaders.h"
 #include "statistics.h"
 #include "tuke_engine.h"
@@ -35,6 +36,12 @@ static const StringArray texture_paths[NUM_TEXTURES] = {
     TEX("textures/generic_girl.jpg", "textures/girl_face.jpg"),
 };
 
+static PipelineConfig ui_pipeline_config() {
+  PipelineConfig config = vulkan_pipeline_config();
+  config.depth_test = false;
+  return config;
+}
+
 void init_buffers(Renderer *r) {
   VulkanContext *ctx = &r->ctx;
   r->buffer_manager = create_buffer_manager();
@@ -44,7 +51,7 @@ void init_buffers(Renderer *r) {
   r->mesh = *mesh;
 }
 
-State setup_state(const char *title) {
+State setup_state(const char *title, u64 seed) {
   GLFWwindow *window = create_window(true /* is_vulkan */);
   VulkanWindowInfo window_info = create_glfw_vulkan_window_info(window);
 
@@ -101,14 +108,15 @@ State setup_state(const char *title) {
 
       .time_since_last_powerup_draw = 0.0f,
 
-      .rngs.ball_direction = create_rng(0x69),
-      .rngs.powerup_spawn = create_rng(0x420),
+      // Offsets keep PONG_SEED producing the original streams
+      .rngs.ball_direction = create_rng(seed),
+      .rngs.powerup_spawn = create_rng(seed + 0x3b7),
 
       .camera = create_camera(CAMERA_TYPE_3D, vec3(0.0f, 2.0f, 30.0f)),
   };
   state.playing_state.camera.y_needs_inverted = true,
 
-  init_alias_table(&state.playing_state.powerup_alias_table, NUM_POWERUP_TYPES, powerup_likelihoods, 0x69420);
+  init_alias_table(&state.playing_state.powerup_alias_table, NUM_POWERUP_TYPES, powerup_likelihoods, seed + 0x693b7);
   log_alias_table(&state.playing_state.powerup_alias_table);
   init_inputs(&state.inputs);
 
@@ -148,8 +156,7 @@ State setup_state(const char *title) {
   }
 
   // UI material
-  PipelineConfig ui_conf = vulkan_pipeline_config();
-  ui_conf.depth_test = false;
+  PipelineConfig ui_conf = ui_pipeline_config();
   init_program_spec(ctx, ctx->render_pass, &ui_conf, &pong_main_menu_program_spec, &r->main_menu_mat);
   init_program_spec(ctx, ctx->render_pass, &ui_conf, &common_ui_quad_program_spec, &r->ui_mat);
   init_program_spec(ctx, ctx->render_pass, &ui_conf, &common_ui_quad_program_spec, &r->characters_mat);
@@ -161,10 +168,30 @@ State setup_state(const char *title) {
   return state;
 }
 
+void start_pong_shader_hot_reload(Renderer *r) {
+  VkRenderPass pass = r->ctx.render_pass;
+  PipelineConfig ui_conf = ui_pipeline_config();
+  ShaderHotReload *hot_reload = create_shader_hot_reload(NULL);
+  register_hot_reload_material(hot_reload, &pong_paddle_program_spec, pass, NULL, &r->paddle_mat);
+  register_hot_reload_material(hot_reload, &pong_background_program_spec, pass, NULL, &r->background_mat);
+  register_hot_reload_material(hot_reload, &pong_main_menu_program_spec, pass, &ui_conf, &r->main_menu_mat);
+  register_hot_reload_material(hot_reload, &common_ui_quad_program_spec, pass, &ui_conf, &r->ui_mat);
+  register_hot_reload_material(hot_reload, &common_ui_quad_program_spec, pass, &ui_conf, &r->characters_mat);
+  if (!start_shader_hot_reload(hot_reload)) {
+    destroy_shader_hot_reload(hot_reload);
+    return;
+  }
+  r->hot_reload = hot_reload;
+}
+
 void destroy_state(State *state) {
   VulkanContext *ctx = &state->renderer.ctx;
   vkDeviceWaitIdle(ctx->device);
 
+  if (state->renderer.hot_reload) {
+    destroy_shader_hot_reload(state->renderer.hot_reload);
+  }
+
   // texture and sampler
   for (u32 i = 0; i < NUM_TEXTURES; i++) {
     destroy_vulkan_texture(ctx->device, &state->renderer.textures[i]);
@@ -246,6 +273,9 @@ void render(State *s) {
   Renderer *r = &s->renderer;
   VulkanContext *ctx = &r->ctx;
   begin_frame(ctx);
+  if (r->hot_reload) {
+    apply_shader_hot_reloads(ctx, r->hot_reload);
+  }
   VkCommandBuffer cmd = begin_command_buffer(ctx);
 
   VkExtent2D extent = ctx->swapchain_extent;
@@ -525,9 +555,6 @@ void process_inputs_main_menu(State *st) {
 }
 
 void process_inputs(State *st, const f32 dt) {
-  glfwGetFramebufferSize(st->window, &st->window_width, &st->window_height);
-  update_inputs_glfw(&st->inputs, st->window);
-
   switch (st->game_mode) {
   case GAMEMODE_PAUSED: {
     process_inputs_paused(st);
@@ -735,3 +762,44 @@ void update_game_state(State *s, const f32 dt) {
   }
   }
 }
+
+u64 hash_pong_state(const State *s) {
+  u64 hash = STATE_HASH_SEED;
+  hash = HASH_STATE_FIELD(hash, s->game_mode);
+
+  const MenuState *ms = &s->menu_state;
+  hash = HASH_STATE_FIELD(hash, ms->menu_type);
+  hash = HASH_STATE_FIELD(hash, ms->anim_t);
+  hash = HASH_STATE_FIELD(hash, ms->selected_option);
+  hash = HASH_STATE_FIELD(hash, ms->intro_active);
+  hash = HASH_STATE_FIELD(hash, ms->selected_character);
+
+  const PlayingState *ps = &s->playing_state;
+  hash = HASH_STATE_FIELD(hash, ps->left_score);
+  hash = HASH_STATE_FIELD(hash, ps->right_score);
+  hash = HASH_STATE_FIELD(hash, ps->lpaddle_pos);
+  hash = HASH_STATE_FIELD(hash, ps->lpaddle_vel);
+  hash = HASH_STATE_FIELD(hash, ps->lpaddle_size);
+  hash = HASH_STATE_FIELD(hash, ps->rpaddle_pos);
+  hash = HASH_STATE_FIELD(hash, ps->rpaddle_vel);
+  hash = HASH_STATE_FIELD(hash, ps->rpaddle_size);
+  hash = HASH_STATE_FIELD(hash, ps->ball_pos);
+  hash = HASH_STATE_FIELD(hash, ps->ball_vel);
+  hash = HASH_STATE_FIELD(hash, ps->left_paddle_cooldown);
+  hash = HASH_STATE_FIELD(hash, ps->right_paddle_cooldown);
+  hash = HASH_STATE_FIELD(hash, ps->pong_mode);
+  hash = HASH_STATE_FIELD(hash, ps->time_since_last_powerup_draw);
+  hash = HASH_STATE_FIELD(hash, ps->last_paddle);
+  hash = HASH_STATE_FIELD(hash, ps->paddle_powerups);
+  hash = HASH_STATE_FIELD(hash, ps->left_paddle_powerup_flags);
+  hash = HASH_STATE_FIELD(hash, ps->right_paddle_powerup_flags);
+  for (u32 i = 0; i < MAX_POWERUPS; i++) {
+    hash = HASH_STATE_FIELD(hash, ps->powerups[i].type);
+    hash = HASH_STATE_FIELD(hash, ps->powerups[i].time_remaining);
+    hash = HASH_STATE_FIELD(hash, ps->powerups[i].pos);
+  }
+  hash = HASH_STATE_FIELD(hash, ps->rngs);
+  hash = HASH_STATE_FIELD(hash, ps->powerup_alias_table.rng);
+
+  return hash;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "camera.h"
+#include "input_recording.h"
 #include "physics.h"
 #include "shaders.h"
 #include "statistics.h"
@@ -28,6 +29,10 @@ const u16 unit_square_indices[] = {
 
 const f32 INTRO_DURATION = 2.0f;
 
+// The sim steps at a fixed dt so recordings replay exactly
+const f32 PONG_SIM_DT = 1.0f / 120.0f;
+const u64 PONG_SEED = 0x69;
+
 // Using dimensions in meters
 // 30m is about 96ft, a basketball court
 const f32 aspect_ratio = 16.0f / 9.0f;
@@ -37,6 +42,8 @@ const f32 x_inset_from_wall0 = 0.05f * arena_dimensions_x0;
 const f32 x_offset0 = arena_dimensions_x0 / 2.0f - x_inset_from_wall0;
 const Vec3 arena_dimensions0{arena_dimensions_x0, arena_dimensions_y0, 1.0f};
 
+struct ShaderHotReload;
+
 typedef enum {
   ENTITY_LEFT_PADDLE = 0,
   ENTITY_RIGHT_PADDLE,
@@ -242,6 +249,8 @@ typedef struct {
   VulkanMaterial main_menu_mat;
   VulkanMaterial ui_mat;
   VulkanMaterial characters_mat;
+
+  ShaderHotReload *hot_reload; // NULL unless started
 } Renderer;
 
 typedef struct {
@@ -262,10 +271,16 @@ typedef struct {
   Inputs inputs;
 } State;
 
-State setup_state(const char *title);
+State setup_state(const char *title, u64 seed);
 void destroy_state(State *state);
 
+// Materials are registered by address, so call this on the State that will render, not on one about to be copied
+void start_pong_shader_hot_reload(Renderer *r);
+
 void initialize_textures(u32 num_textures, VulkanTexture *out_textures);
 void render(State *state);
 void process_inputs(State *state, const f32 dt);
 void update_game_state(State *state, const f32 dt);
+
+// Hash of the sim state, for checking replays. Leaves out rendering and window state.
+u64 hash_pong_state(const State *state);
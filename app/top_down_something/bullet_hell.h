@@ -10,17 +10,18 @@
 // Weapon wheel
 // EVENTUALLY need some serialization scheme for things like weapon unlocks
 
+#include "bullet_hell_sim.h"
 #include "generated_shader_utils.h"
+#include "memory_arena.h"
 #include "opengl_base.h"
 #include "physics.h"
+#include "pool.h"
+#include "statistics.h"
 #include "topdown.h"
 #include "tuke_engine.h"
 #include "window.h"
 #include <OpenGL/OpenGL.h>
 
-#define MAX_NUM_BULLETS (512)
-#define MAX_NUM_ENEMIES (8)
-
 // https://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/billboards/
 //
 // Billboards in the graphics sense. A quad, always facing the screen.
@@ -71,27 +72,25 @@ struct Billboard {
   f32 rotation;
 };
 
+// Billboards live in a Pool, so a billboard's index stays valid until it is removed and the
+// capacity grows by chunk up to max_capacity instead of being fixed.
 struct BillboardManager {
-
-  Billboard *billboards;
+  Pool billboards;
   BillboardShader shader;
-
-  u32 size;     // Number of active billboards in the buffer
-  u32 capacity; // Number of billboards we have room for
+  u32 vbo_capacity; // In billboards. Regrown at draw time when the pool outgrows it.
 };
 
 // Create a new BillboardManager with heap allocated memory.
-// capacity is the number of bullboards to store. NOT the size in bytes.
+// Capacities are numbers of billboards, NOT sizes in bytes.
 // Pass 0 in case this is a screen space billboard manager with no camera.
 // It is expected this vp_ubo is already bound to UNIFORM_BUFFER_LABEL_CAMERA_VP in all other shaders
 // that use vp_ubo.
 // Also, only works with OpenGL, without a more expanded UBO abstraction.
-inline BillboardManager create_billboard_manager(u32 capacity, u32 vp_ubo) {
+inline BillboardManager create_billboard_manager(u32 initial_capacity, u32 max_capacity, u32 vp_ubo) {
 
   BillboardManager billboard_manager;
-  billboard_manager.billboards = (Billboard *)malloc(capacity * sizeof(Billboard));
-  billboard_manager.capacity = capacity;
-  billboard_manager.size = 0;
+  billboard_manager.billboards = CREATE_POOL(Billboard, initial_capacity, max_capacity);
+  billboard_manager.vbo_capacity = pool_capacity(&billboard_manager.billboards);
 
   // if OpenGL
   u32 program = shader_handles_to_gl_program(SHADER_HANDLE_COMMON_BILLBOARD_VERT, SHADER_HANDLE_COMMON_BILLBOARD_FRAG);
@@ -104,7 +103,7 @@ inline BillboardManager create_billboard_manager(u32 capacity, u32 vp_ubo) {
   billboard_manager.shader.camera_up_right_ubo = camera_up_right_ubo;
   billboard_manager.shader.vp_ubo = vp_ubo;
   billboard_manager.shader.vao = create_vao();
-  billboard_manager.shader.vbo = allocate_vbo(capacity * sizeof(Billboard), GL_DYNAMIC_DRAW);
+  billboard_manager.shader.vbo = allocate_vbo(billboard_manager.vbo_capacity * sizeof(Billboard), GL_DYNAMIC_DRAW);
 
   init_gl_vertex_layout(
       VERTEX_LAYOUT_BINDING0INSTANCE_VEC3_VEC2_FLOAT, billboard_manager.shader.vao, &billboard_manager.shader.vbo, 1, 0
@@ -114,12 +113,11 @@ inline BillboardManager create_billboard_manager(u32 capacity, u32 vp_ubo) {
 }
 
 inline void destroy_billboard_manager(BillboardManager *billboard_manager) {
-  free(billboard_manager->billboards);
-  billboard_manager->billboards = NULL;
+  destroy_pool(&billboard_manager->billboards);
 }
 
 // This assumes that the caller has already configured the VP matrix.
-inline void render_billboards_opengl(const BillboardManager *billboard_manager, const Mat4 *view) {
+inline void render_billboards_opengl(BillboardManager *billboard_manager, const Mat4 *view) {
   glUseProgram(billboard_manager->shader.program);
   glBindVertexArray(billboard_manager->shader.vao);
 
@@ -131,158 +129,160 @@ inline void render_billboards_opengl(const BillboardManager *billboard_manager,
   glBindBuffer(GL_UNIFORM_BUFFER, billboard_manager->shader.camera_up_right_ubo);
   glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUpRight), &camera_up_right);
 
+  // Pack the live billboards, the pool has holes
+  const Pool *billboards = &billboard_manager->billboards;
+  MemoryArena *scratch = get_scratch_arena();
+  ArenaMark scratch_mark = arena_mark(scratch);
+  Billboard *instances = ARENA_PUSH_ARRAY(scratch, Billboard, billboards->num_live);
+  u32 num_instances = 0;
+  for (u32 i = pool_first_live(billboards); i != POOL_INVALID_INDEX; i = pool_next_live(billboards, i)) {
+    instances[num_instances++] = *POOL_GET(billboards, Billboard, i);
+  }
+
   // Buffer instance data.
   glBindBuffer(GL_ARRAY_BUFFER, billboard_manager->shader.vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, billboard_manager->size * sizeof(Billboard), billboard_manager->billboards);
-  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, billboard_manager->size);
+  if (num_instances > billboard_manager->vbo_capacity) {
+    billboard_manager->vbo_capacity = pool_capacity(billboards);
+    glBufferData(GL_ARRAY_BUFFER, billboard_manager->vbo_capacity * sizeof(Billboard), NULL, GL_DYNAMIC_DRAW);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, num_instances * sizeof(Billboard), instances);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, num_instances);
+  arena_reset_to_mark(scratch, scratch_mark);
 }
 
-inline void clear_billboard_manager(BillboardManager *billboard_manager) { billboard_manager->size = 0; }
+inline void clear_billboard_manager(BillboardManager *billboard_manager) { pool_clear(&billboard_manager->billboards); }
 
-inline void push_billboard(BillboardManager *billboard_manager, Billboard billboard) {
-  assert(billboard_manager->size < billboard_manager->capacity);
-  billboard_manager->billboards[billboard_manager->size++] = billboard;
+// Returns the billboard's index, or POOL_INVALID_INDEX when the manager is at its max capacity
+inline u32 push_billboard(BillboardManager *billboard_manager, Billboard billboard) {
+  u32 index = pool_alloc(&billboard_manager->billboards);
+  if (index != POOL_INVALID_INDEX) {
+    *POOL_GET(&billboard_manager->billboards, Billboard, index) = billboard;
+  }
+  return index;
 }
 
-enum Uniforms {
-  UNIFORM_PLAYER_MODEL,
-  UNIFORM_PLAYER_FRAG,
-  UNIFORM_OVERLAY,
-
-  NUM_UNIFORMS,
-};
-
-const f32 BULLET_HELL_ARENA_WIDTH = 10.0f;
-const f32 BULLET_HELL_ARENA_HEIGHT = 8.0f;
-const f32 BULLET_HELL_ARENA_HALF_WIDTH = BULLET_HELL_ARENA_WIDTH / 2.0;
-const f32 BULLET_HELL_ARENA_HALF_HEIGHT = BULLET_HELL_ARENA_HEIGHT / 2.0;
-
-// clang-format off
-const f32 arena_vertices[] = {
-  // x,y,z                                                               u, v
-  -BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 0.0f, // BL
-  -BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 1.0f, // TL
-   BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 1.0f, // TR
-
-   BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 1.0f, // TR
-   BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 0.0f, // BR
-  -BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 0.0f, // BL
-};
-// clang-format on
+inline void remove_billboard(BillboardManager *billboard_manager, u32 index) {
+  pool_free(&billboard_manager->billboards, index);
+}
 
-enum BulletPattern {
-  BULLET_PATTERN_LINEAR,
-  BULLET_PATTERN_SPIRAL,
-};
+// Particles. Purely visual, so they live in the scene rather than the sim and use their own RNG,
+// leaving replays untouched. Drawn as billboards.
 
-// What shapes of bullets will I support?
-// For now, start with quads
-// Will I end up having specializations for each bullet based on update rules?
-// And then have arrays per bullet with update rule in the bullet manager?
-struct Bullet {
-  Vec2 position;
-  Vec2 velocity;
-  Vec2 size;
-  f64 t0; // Spawn time
-  BulletPattern pattern;
-};
+#define MAX_NUM_PARTICLES (16384)
+#define PARTICLE_SPARKS_PER_HIT (24)
+#define PARTICLE_SPARK_LIFETIME (0.4f)
+#define PARTICLE_SPARK_SPEED (4.0f)
+#define PARTICLE_SPARK_SIZE (0.08f)
+#define PARTICLE_DAMPING (4.0f) // Per second
 
-struct BulletRenderData {
-  Vec2 pos;
+struct Particle {
+  Vec3 pos;
+  Vec3 vel;
   f32 size;
+  f32 life; // Seconds left
 };
 
-struct BulletManager {
-  Bullet bullets[MAX_NUM_BULLETS];
-  BulletRenderData render_data[MAX_NUM_BULLETS];
-  u32 num_live_bullets;
+struct ParticleManager {
+  Pool particles;
+  RNG rng;
+  u32 num_dropped_spawns;
 };
 
-// How will I choose the right pool and right index in that pool to allocate the new bullet?
-// How will I efficiently copy the data into the array from the caller?
-//      Can return a pointer to the next bullet and populate in the caller.
-// How can I ensure that I never overrun this buffer? Can I avoid adding a branch every call?
-// How do I have an API for every type of bullet? Do I always need to copy from the caller?
-inline void spawn_bullet(BulletManager *bullet_manager, Bullet bullet) {
-  bullet_manager->bullets[bullet_manager->num_live_bullets++] = bullet;
+inline ParticleManager create_particle_manager(u64 seed) {
+  ParticleManager particle_manager;
+  particle_manager.particles = CREATE_POOL(Particle, 256, MAX_NUM_PARTICLES);
+  particle_manager.rng = create_rng(seed);
+  particle_manager.num_dropped_spawns = 0;
+  return particle_manager;
 }
 
-// An okay set of guides on FSMs for game AI, lots of OOP dogma, bad code, but introduces transition tables
-// http://www.ai-junkie.com/architecture/state_driven/tut_state1.html
-//
-// Game programming patterns on state. Also OOP, but on_entry, on_exit notions useful.
-// Heirarchical state machines, pushdown automata, state stacks, behavior trees, and planning systems also exist.
-// https://gameprogrammingpatterns.com/state.html
+inline void destroy_particle_manager(ParticleManager *particle_manager) { destroy_pool(&particle_manager->particles); }
 
-struct Enemy {
-  Vec2 position;
-};
+inline void spawn_sparks(ParticleManager *particle_manager, Vec3 pos, u32 count) {
+  for (u32 i = 0; i < count; i++) {
+    u32 index = pool_alloc(&particle_manager->particles);
+    if (index == POOL_INVALID_INDEX) {
+      particle_manager->num_dropped_spawns += count - i;
+      return;
+    }
 
-struct EnemyRenderData {
-  Vec2 pos;
-  f32 size;
-};
+    RNG *rng = &particle_manager->rng;
+    f32 angle = random_f32_in_range_xoroshiro128_plus(rng, 0.0f, 2.0f * PI);
+    f32 speed = random_f32_in_range_xoroshiro128_plus(rng, 0.5f, 1.0f) * PARTICLE_SPARK_SPEED;
+    Particle *particle = POOL_GET(&particle_manager->particles, Particle, index);
+    particle->pos = pos;
+    particle->vel = vec3(speed * cosf(angle), speed * sinf(angle), 0.0f);
+    particle->size = PARTICLE_SPARK_SIZE;
+    particle->life = PARTICLE_SPARK_LIFETIME * random_f32_in_range_xoroshiro128_plus(rng, 0.5f, 1.0f);
+  }
+}
 
-struct EnemyManager {
-  Enemy enemies[MAX_NUM_ENEMIES];
-  EnemyRenderData render_data[MAX_NUM_ENEMIES];
-  u32 num_live_enemies;
-};
+inline void update_particles(ParticleManager *particle_manager, f32 dt) {
+  Pool *particles = &particle_manager->particles;
+  f32 damping = fmaxf(0.0f, 1.0f - PARTICLE_DAMPING * dt);
+  for (u32 i = pool_first_live(particles); i != POOL_INVALID_INDEX; i = pool_next_live(particles, i)) {
+    Particle *particle = POOL_GET(particles, Particle, i);
+    particle->life -= dt;
+    if (particle->life <= 0.0f) {
+      pool_free(particles, i);
+      continue;
+    }
+    inc_v3(&particle->pos, scale_v3(particle->vel, dt));
+    particle->vel = scale_v3(particle->vel, damping);
+  }
+}
 
-enum PlayerState {
-  PLAYER_STATE_NORMAL,
-  PLAYER_STATE_SPEED_BOOST,
-  PLAYER_STATE_SLOW_MOTION,
-  PLAYER_STATE_AIMING_DASH,
-  PLAYER_STATE_DASHING,
-};
+inline void push_particle_billboards(const ParticleManager *particle_manager, BillboardManager *billboard_manager) {
+  const Pool *particles = &particle_manager->particles;
+  for (u32 i = pool_first_live(particles); i != POOL_INVALID_INDEX; i = pool_next_live(particles, i)) {
+    const Particle *particle = POOL_GET(particles, Particle, i);
+    Billboard billboard{
+        .center_pos = particle->pos,
+        .size = Vec2(particle->size),
+        .rotation = 0.0f,
+    };
+    if (push_billboard(billboard_manager, billboard) == POOL_INVALID_INDEX) {
+      return;
+    }
+  }
+}
 
-enum PlayerAbility {
-  PLAYER_ABILITY_NONE,
-  PLAYER_ABILITY_SPEED_BOOST,
-  PLAYER_ABILITY_DASH,
-  PLAYER_ABILITY_SLOW_MOTION,
-};
+enum Uniforms {
+  UNIFORM_PLAYER_MODEL,
+  UNIFORM_PLAYER_FRAG,
+  UNIFORM_OVERLAY,
 
-struct PlayerDash {
-  f32 cooldown_left;
-  f32 time_dilation_factor; // for aiming in slow motion
+  NUM_UNIFORMS,
 };
 
-struct PlayerSpeedBoost {
-  f32 boost_factor;
-};
+// clang-format off
+const f32 arena_vertices[] = {
+  // x,y,z                                                               u, v
+  -BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 0.0f, // BL
+  -BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 1.0f, // TL
+   BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 1.0f, // TR
 
-struct PlayerSlowMotion {
-  f32 time_dilation_factor;
+   BULLET_HELL_ARENA_HALF_WIDTH,  BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 1.0f, // TR
+   BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  1.0f, 0.0f, // BR
+  -BULLET_HELL_ARENA_HALF_WIDTH, -BULLET_HELL_ARENA_HALF_HEIGHT,  0.0f,  0.0f, 0.0f, // BL
 };
+// clang-format on
 
-// player_pos is the position within the bullet hell arena
-// The arena's center is (0.0, 0.0)
-struct Player {
-  Vec3 pos;
-  Vec3 size;
-  u32 current_health;
-  u32 max_health;
-  f32 invincibility_time;
-
-  PlayerState state;
-  PlayerAbility ability;
-  u32 unlocked_abilities_mask;
-
-  PlayerDash dash;
-  PlayerSpeedBoost speed_boost;
-  PlayerSlowMotion slow_motion;
-};
+// After a long hitch, drop the backlog rather than spiralling
+#define BULLET_HELL_MAX_SIM_STEPS_PER_FRAME (8)
 
 struct BulletHellSceneData {
-  Player player;
+  BulletHellSim sim; // Created by bullet_hell_preload, sim.bullet_manager is NULL until then
+  JobSystem *jobs;   // Handed to the sim
+  f32 sim_time_accumulator;
+  u32 pending_intent_flags; // From frames that ran no sim steps, so edges aren't lost
 
-  BulletManager *bullet_manager;
-  EnemyManager enemy_manager;
-  f64 bullet_spawn_time;
+  // Non NULL while recording. Every sim step appends its intent and the resulting state hash.
+  InputRecording *recording;
 
   BillboardManager billboard_manager;
+  ParticleManager particle_manager;
+  u32 last_health; // Sparks are spawned for health lost since the last frame
 
   Camera camera;
   u32 vp_ubo;
@@ -299,96 +299,11 @@ struct BulletHellSceneData {
   GLMesh enemy_mesh;
   GLMaterial enemy_material;
 
-  u32 overlay_program;
+  u32 overlay_program; // 0 until the first bullet_hell_enter creates the GL resources
 
   u32 uniforms[NUM_UNIFORMS];
 };
 
-inline void player_cancel_ability(Player *player) { player->state = PLAYER_STATE_NORMAL; }
-
-inline void player_activate_ability(Player *player) {
-
-  switch (player->state) {
-    // If normal, no reason not to activate the current ability.
-  case PLAYER_STATE_NORMAL:
-    switch (player->ability) {
-    case PLAYER_ABILITY_NONE:
-      return;
-    case PLAYER_ABILITY_SPEED_BOOST:
-      player->state = PLAYER_STATE_SPEED_BOOST;
-      return;
-    case PLAYER_ABILITY_DASH:
-      player->state = PLAYER_STATE_AIMING_DASH;
-      return;
-    case PLAYER_ABILITY_SLOW_MOTION:
-      player->state = PLAYER_STATE_SLOW_MOTION;
-      return;
-    }
-    break;
-
-    // No action required.
-  case PLAYER_STATE_AIMING_DASH:
-  case PLAYER_STATE_DASHING:
-  case PLAYER_STATE_SPEED_BOOST:
-  case PLAYER_STATE_SLOW_MOTION:
-    return;
-
-  default:
-    assert(false);
-  }
-}
-
-inline void player_release_ability(Player *player) {
-  switch (player->state) {
-
-  case PLAYER_STATE_AIMING_DASH:
-    // TODO real dashing logic
-    player->state = PLAYER_STATE_DASHING;
-    return;
-
-    // No action required.
-  case PLAYER_STATE_NORMAL:
-  case PLAYER_STATE_DASHING:
-  case PLAYER_STATE_SPEED_BOOST:
-  case PLAYER_STATE_SLOW_MOTION:
-    player->state = PLAYER_STATE_NORMAL;
-    return;
-
-  default:
-    assert(false);
-  }
-}
-
-inline void bullet_hell_move_player_normal(Player *player, Vec3 input_movement_vector, f32 dt) {
-
-  const f32 X_BOUNDARY = 0.5 * (BULLET_HELL_ARENA_WIDTH - PLAYER_SIDE_LENGTH_METERS);
-  const f32 Y_BOUNDARY = 0.5 * (BULLET_HELL_ARENA_HEIGHT - PLAYER_SIDE_LENGTH_METERS);
-
-  const f32 speed = 5.0f;
-  Vec3 movement_vector = scale_v3(input_movement_vector, speed * dt);
-
-  f32 next_x = player->pos.x + movement_vector.x;
-  f32 clamped_next_x = clamp_f32(next_x, -X_BOUNDARY, X_BOUNDARY);
-
-  f32 next_y = player->pos.y + movement_vector.y;
-  f32 clamped_next_y = clamp_f32(next_y, -Y_BOUNDARY, Y_BOUNDARY);
-
-  player->pos.x = clamped_next_x;
-  player->pos.y = clamped_next_y;
-}
-
-enum PlayerIntentFlags {
-  PLAYER_INTENT_NONE = 0,
-  PLAYER_INTENT_ACTIVATE_ABILITY = 1 << 0,
-  PLAYER_INTENT_CANCEL_ABILITY = 1 << 1,
-  PLAYER_INTENT_RELEASE_ABILITY = 1 << 1,
-};
-
-struct PlayerIntent {
-  Vec3 movement_vector;
-  u32 flags;
-};
-
 inline PlayerIntent handle_inputs_player(const Inputs *inputs) {
   // Inputs define intent
   // Shift held to activate ability
@@ -413,85 +328,37 @@ inline PlayerIntent handle_inputs_player(const Inputs *inputs) {
   return player_intents;
 }
 
-inline void bullet_hell_update_player(Player *player, PlayerIntent player_intent, f32 dt) {
-
-  // Intent for cancel assumed to be stronger than intent for activation
-  u32 flags = player_intent.flags;
-  if (flags & PLAYER_INTENT_CANCEL_ABILITY) {
-    player_cancel_ability(player);
-  } else if (flags & PLAYER_INTENT_RELEASE_ABILITY) {
-    player_release_ability(player);
-  } else if (flags & PLAYER_INTENT_ACTIVATE_ABILITY) {
-    player_activate_ability(player);
-  }
-
-  // Move the player according to the current state
-  switch (player->state) {
-  case PLAYER_STATE_NORMAL:
-  case PLAYER_STATE_SLOW_MOTION:
-    bullet_hell_move_player_normal(player, player_intent.movement_vector, dt);
-    return;
-  case PLAYER_STATE_SPEED_BOOST: {
-    Vec3 scaled_movement_vector = scale_v3(player_intent.movement_vector, player->speed_boost.boost_factor);
-    bullet_hell_move_player_normal(player, scaled_movement_vector, dt);
-    return;
-  }
-
-  case PLAYER_STATE_AIMING_DASH:
-    return;
-  case PLAYER_STATE_DASHING:
-    return;
-  default:
-    assert(false);
-  }
-}
+// Buffer this frame's sim state to the GPU.
+inline void bullet_hell_upload_gl(BulletHellSceneData *data, const GlobalState *gs) {
+  const BulletHellSim *sim = &data->sim;
+  const Player *player = &sim->player;
 
-// Supposing a rectangle of half side lengths is positioned at the origin
-inline f32 rectangle_sdf(f32 half_width, f32 half_height, Vec2 pos) {
-  Vec2 abs_pos = abs_v2(pos);
-  Vec2 rect_vec = Vec2(half_width, half_height);
-  Vec2 diff = sub_v2(abs_pos, rect_vec);
+  // TODO: Need window resize callback. Want to only update and rebuffer when there's new data.
+  CameraMatrices camera_matrices =
+      create_camera_matrices(&data->camera, f32(gs->window_width) / f32(gs->window_height));
+  buffer_vp_matrix_to_gl_ubo(&camera_matrices, data->vp_ubo);
 
-  Vec2 clamped_diff = vec2(fmax(0.0f, abs_pos.x - rect_vec.x), fmax(0.0f, abs_pos.y - rect_vec.y));
-  f32 dist_outside = len_v2(clamped_diff);
-  f32 dist_inside = fmin(fmax(diff.x, diff.y), 0.0f);
+  BulletHellPlayerFrag player_frag_data{.invincibility_time = player->invincibility_time};
+  glBindBuffer(GL_UNIFORM_BUFFER, data->uniforms[UNIFORM_PLAYER_FRAG]);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(BulletHellPlayerFrag), &player_frag_data);
 
-  return dist_outside + dist_inside;
-}
+  Mat4 player_model = mat4();
+  scale_m4(player->size, &player_model);
+  translate_m4(player->pos, &player_model);
+  glBindBuffer(GL_UNIFORM_BUFFER, data->uniforms[UNIFORM_PLAYER_MODEL]);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PlayerModel), &player_model);
 
-// This function will never spawn new bullets. It only moves and kills bullets that were alive
-// at the beginning of this frame.
-// Can consider double buffering the bullets.
-inline void update_bullets(BulletManager *bullet_manager, f32 dt) {
-
-  u32 live_bullet_index = 0;
-  u32 end = bullet_manager->num_live_bullets;
-
-  for (u32 i = 0; i < end;) {
-
-    // Current bullet. Update, and check if it survives this frame.
-    Bullet bullet = bullet_manager->bullets[i];
-    inc_v2(&bullet.position, scale_v2(bullet.velocity, dt));
-
-    // Signed distance to the arena. If negative, the bullet is still alive
-    // TODO this would break down if I decide to add bullets that go outside the arena and come back in
-    f32 signed_distance = rectangle_sdf(BULLET_HELL_ARENA_HALF_WIDTH, BULLET_HELL_ARENA_HALF_HEIGHT, bullet.position);
-
-    // Add to render data if in box, i.e. signed_distance < 0
-    if (signed_distance < 0.0f) {
-      bullet_manager->render_data[live_bullet_index].pos = bullet.position;
-      bullet_manager->render_data[live_bullet_index].size = 0.3; // FIXME
-      bullet_manager->bullets[i] = bullet;
-      live_bullet_index++;
-      i++;
-    } else {
-      // Kill. Don't copy back into bullet data. Move the bullet at the end of the live range into this spot.
-      // Skip updating i so we update the bullet copied into i in the next iteration.
-      bullet_manager->bullets[i] = bullet_manager->bullets[--end];
-    }
-  }
+  const EnemyManager *enemy_manager = &sim->enemy_manager;
+  glBindBuffer(GL_ARRAY_BUFFER, data->enemy_mesh.vbos[0]);
+  glBufferSubData(
+      GL_ARRAY_BUFFER, 0, sizeof(EnemyRenderData) * enemy_manager->num_live_enemies, &enemy_manager->render_data
+  );
 
-  bullet_manager->num_live_bullets = live_bullet_index;
+  const BulletManager *bullet_manager = sim->bullet_manager;
+  glBindBuffer(GL_ARRAY_BUFFER, data->bullet_mesh.vbos[0]);
+  glBufferSubData(
+      GL_ARRAY_BUFFER, 0, sizeof(BulletRenderData) * bullet_manager->num_live_bullets, &bullet_manager->render_data
+  );
 }
 
 // TODO do I want all OpenGL to be in the draw function, do I want explicit updates on the GPU right after CPU updates?
@@ -511,28 +378,35 @@ inline void bullet_hell_update(void *scene_data, void *global_state, f32 dt) {
   }
 
   BulletHellSceneData *data = (BulletHellSceneData *)scene_data;
-  BulletManager *bullet_manager = data->bullet_manager;
-  EnemyManager *enemy_manager = &data->enemy_manager;
-  Player *player = &data->player;
 
   PlayerIntent player_intent = handle_inputs_player(&gs->inputs);
-
-  // Update dt
-  // Potential FIXME: this is not really scalable, maybe
-  if (player->state == PLAYER_STATE_AIMING_DASH) {
-    dt = dt * player->dash.time_dilation_factor;
-  } else if (player->state == PLAYER_STATE_SLOW_MOTION) {
-    dt = dt * player->slow_motion.time_dilation_factor;
-  } else if (player->state == PLAYER_STATE_AIMING_DASH) {
-    dt = dt * player->dash.time_dilation_factor;
+  player_intent.flags |= data->pending_intent_flags;
+
+  data->sim_time_accumulator += dt;
+  u32 num_steps = 0;
+  while (data->sim_time_accumulator >= BULLET_HELL_SIM_DT && num_steps < BULLET_HELL_MAX_SIM_STEPS_PER_FRAME) {
+    f32 dilated_dt = bullet_hell_sim_step(&data->sim, player_intent, BULLET_HELL_SIM_DT);
+    gs->t += dilated_dt;
+    data->sim_time_accumulator -= BULLET_HELL_SIM_DT;
+    num_steps++;
+
+    if (data->recording) {
+      InputFrame frame = player_intent_to_input_frame(player_intent);
+      record_input_frame(data->recording, frame, hash_bullet_hell_sim(&data->sim));
+    }
   }
+  if (num_steps == BULLET_HELL_MAX_SIM_STEPS_PER_FRAME) {
+    data->sim_time_accumulator = 0.0f;
+  }
+  data->pending_intent_flags = (num_steps == 0) ? player_intent.flags : 0;
 
-  bullet_hell_update_player(&data->player, player_intent, dt);
-
-  // TODO: Need window resize callback. Want to only update and rebuffer when there's new data.
-  CameraMatrices camera_matrices =
-      create_camera_matrices(&data->camera, f32(gs->window_width) / f32(gs->window_height));
-  buffer_vp_matrix_to_gl_ubo(&camera_matrices, data->vp_ubo);
+  const Player *player = &data->sim.player;
+  if (player->current_health < data->last_health) {
+    u32 health_lost = data->last_health - player->current_health;
+    spawn_sparks(&data->particle_manager, player->pos, PARTICLE_SPARKS_PER_HIT * health_lost);
+  }
+  data->last_health = player->current_health;
+  update_particles(&data->particle_manager, dt);
 
   // Update billboards with this frame's view matrix
   clear_billboard_manager(&data->billboard_manager);
@@ -543,71 +417,9 @@ inline void bullet_hell_update(void *scene_data, void *global_state, f32 dt) {
       .rotation = 0.0f,
   };
   push_billboard(&data->billboard_manager, billboard);
+  push_particle_billboards(&data->particle_manager, &data->billboard_manager);
 
-  // Decrement and clamp invincibility_time
-  player->invincibility_time -= dt;
-  player->invincibility_time = (player->invincibility_time < 0.0) ? 0.0 : player->invincibility_time;
-  BulletHellPlayerFrag player_frag_data{.invincibility_time = player->invincibility_time};
-  glBindBuffer(GL_UNIFORM_BUFFER, data->uniforms[UNIFORM_PLAYER_FRAG]);
-  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(BulletHellPlayerFrag), &player_frag_data);
-
-  // If I add slow motion or anything like that, will need to consider how to track time updates
-  // Influences on the rate of time passing are player inputs - could add something like enemy effects
-  gs->t += dt;
-
-  Mat4 player_model = mat4();
-  scale_m4(data->player.size, &player_model);
-  translate_m4(data->player.pos, &player_model);
-  glBindBuffer(GL_UNIFORM_BUFFER, data->uniforms[UNIFORM_PLAYER_MODEL]);
-  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PlayerModel), &player_model);
-
-  // enemy update bringup
-  f32 x_amplitude = BULLET_HELL_ARENA_HALF_WIDTH * 0.8f;
-  f32 theta = 2.0 * gs->t;
-  enemy_manager->enemies[0].position.x = x_amplitude * sinf(theta);
-  enemy_manager->render_data[0].pos.x = x_amplitude * sinf(theta);
-  glBindBuffer(GL_ARRAY_BUFFER, data->enemy_mesh.vbos[0]);
-  glBufferSubData(
-      GL_ARRAY_BUFFER, 0, sizeof(EnemyRenderData) * enemy_manager->num_live_enemies, &enemy_manager->render_data
-  );
-
-  // Spawn bullets from enemy[0] - need some general bullet spawning data wrapper
-  f32 spawn_interval = 0.1;
-  data->bullet_spawn_time += dt;
-  if (data->bullet_spawn_time > spawn_interval) {
-    Enemy *enemy0 = &enemy_manager->enemies[0];
-    Bullet new_bullet{
-        .position = enemy0->position,
-        .velocity = vec2(0.0f, -8.0f),
-        .size = vec2(0.3f, 0.3f),
-        .t0 = gs->t,
-        .pattern = BULLET_PATTERN_LINEAR,
-    };
-    spawn_bullet(bullet_manager, new_bullet);
-    data->bullet_spawn_time -= spawn_interval;
-  }
-
-  // Move bullets
-  update_bullets(bullet_manager, dt);
-  glBindBuffer(GL_ARRAY_BUFFER, data->bullet_mesh.vbos[0]);
-  glBufferSubData(
-      GL_ARRAY_BUFFER, 0, sizeof(BulletRenderData) * bullet_manager->num_live_bullets, &bullet_manager->render_data
-  );
-
-  // Collision detection
-  if (player->invincibility_time <= 0.0) {
-    Vec2 player_xy(player->pos.x, player->pos.y);
-    Vec2 player_size_xy(player->size.x, player->size.y);
-
-    for (u32 i = 0; i < data->bullet_manager->num_live_bullets; i++) {
-      Bullet *bullet = &bullet_manager->bullets[i];
-
-      if (aabb_collision_v2(player_xy, player_size_xy, bullet->position, bullet->size)) {
-        player->current_health -= (player->current_health > 0);
-        player->invincibility_time = 1.0;
-      }
-    }
-  }
+  bullet_hell_upload_gl(data, gs);
 }
 
 inline void bullet_hell_draw(const GLRenderer *renderer, const void *scene_data) {
@@ -620,14 +432,14 @@ inline void bullet_hell_draw(const GLRenderer *renderer, const void *scene_data)
 
   // The arena, player, enemies, bullets
   draw_gl_mesh(&data->arena_mesh, data->arena_material);
-  draw_gl_mesh_instanced(&data->bullet_mesh, data->bullet_material, data->bullet_manager->num_live_bullets);
-  draw_gl_mesh_instanced(&data->enemy_mesh, data->enemy_material, data->enemy_manager.num_live_enemies);
+  draw_gl_mesh_instanced(&data->bullet_mesh, data->bullet_material, data->sim.bullet_manager->num_live_bullets);
+  draw_gl_mesh_instanced(&data->enemy_mesh, data->enemy_material, data->sim.enemy_manager.num_live_enemies);
   draw_gl_mesh(&data->player_mesh, data->player_material);
 
   // Overlay: health (Weapon wheel?)
   BulletHellData bullet_hell_render_data{
-      .max_health = data->player.max_health,
-      .health = data->player.current_health,
+      .max_health = data->sim.player.max_health,
+      .health = data->sim.player.current_health,
   };
 
   glUseProgram(data->overlay_program);
@@ -645,13 +457,9 @@ inline void bullet_hell_draw(const GLRenderer *renderer, const void *scene_data)
 }
 
 ////////////////////////////////// BIG INIT FUNCTION //////////////////////////////////
-inline BulletHellSceneData create_bullet_hell_scene(u32 vp_ubo) {
-
-  BulletManager *bullet_manager = (BulletManager *)malloc(sizeof(BulletManager));
-  memset(bullet_manager, 0, sizeof(BulletManager));
-
-  Camera bullet_hell_camera = create_camera(CAMERA_TYPE_2D);
-  bullet_hell_camera.position.z = 15.0f;
+// Called from bullet_hell_enter on the main thread, the first time the scene is entered.
+inline void init_bullet_hell_gl(BulletHellSceneData *bullet_hell) {
+  u32 vp_ubo = bullet_hell->vp_ubo;
 
   // Player
   u32 player_program = shader_handles_to_gl_program(
@@ -691,7 +499,7 @@ inline BulletHellSceneData create_bullet_hell_scene(u32 vp_ubo) {
       shader_handles_to_gl_program(SHADER_HANDLE_TOPDOWN_BULLET_VERT, SHADER_HANDLE_TOPDOWN_BULLET_FRAG);
 
   GLMesh bullet_mesh;
-  bullet_mesh.vbos[0] = allocate_vbo(sizeof(bullet_manager->render_data), GL_DYNAMIC_DRAW);
+  bullet_mesh.vbos[0] = allocate_vbo(MEMBER_SIZE(BulletManager, render_data), GL_DYNAMIC_DRAW);
   bullet_mesh.num_vbos = 1;
   bullet_mesh.num_vertices = 4;
   init_gl_mesh_vao(&bullet_mesh, SHADER_HANDLE_TOPDOWN_BULLET_VERT);
@@ -720,60 +528,61 @@ inline BulletHellSceneData create_bullet_hell_scene(u32 vp_ubo) {
   u32 overlay_ubo = create_gl_ubo(sizeof(BulletHellData), GL_DYNAMIC_DRAW);
   gl_bind_ubo_to_block(overlay_program, overlay_ubo, UNIFORM_BUFFER_LABEL_BULLET_HELL_DATA, "BulletHellData");
 
-  // Make Player
-  Player player{
-      .pos = Vec3(0.0f, 0.0f, 0.0f),
-      .size = Vec3(PLAYER_SIDE_LENGTH_METERS),
-      .current_health = 100,
-      .max_health = 100,
-      .invincibility_time = 0.0f,
-      .state = PLAYER_STATE_NORMAL,
-      .ability = PLAYER_ABILITY_DASH,
-      .unlocked_abilities_mask = 0,
-      .dash =
-          {
-              .cooldown_left = 0.0f,
-              .time_dilation_factor = 0.6f,
-          },
-      .speed_boost =
-          {
-              .boost_factor = 2.0f,
-          },
-      .slow_motion = {
-          .time_dilation_factor = 0.5f,
-      },
-  };
+  bullet_hell->billboard_manager = create_billboard_manager(64, 1 + MAX_NUM_PARTICLES, vp_ubo);
+  bullet_hell->player_mesh = bullet_player_mesh;
+  bullet_hell->player_material = bullet_player_material;
+  bullet_hell->arena_mesh = arena_mesh;
+  bullet_hell->arena_material = arena_material;
+  bullet_hell->bullet_mesh = bullet_mesh;
+  bullet_hell->bullet_material = bullet_material;
+  bullet_hell->enemy_mesh = enemy_mesh;
+  bullet_hell->enemy_material = enemy_material;
+  bullet_hell->overlay_program = overlay_program;
+
+  bullet_hell->uniforms[UNIFORM_PLAYER_MODEL] = player_model_ubo;
+  bullet_hell->uniforms[UNIFORM_PLAYER_FRAG] = player_frag_ubo;
+  bullet_hell->uniforms[UNIFORM_OVERLAY] = overlay_ubo;
+}
 
-  // Make Scene
-  BulletHellSceneData bullet_hell{
-      .player = player,
-      .bullet_manager = bullet_manager,
-      .bullet_spawn_time = 0.0,
-      // FIXME need a real scale for number of billboards
-      .billboard_manager = create_billboard_manager(5, vp_ubo),
-      .camera = bullet_hell_camera,
-      .vp_ubo = vp_ubo,
-      .player_mesh = bullet_player_mesh,
-      .player_material = bullet_player_material,
-      .arena_mesh = arena_mesh,
-      .arena_material = arena_material,
-      .bullet_mesh = bullet_mesh,
-      .bullet_material = bullet_material,
-      .enemy_mesh = enemy_mesh,
-      .enemy_material = enemy_material,
-      .overlay_program = overlay_program,
-  };
+// Only records settings. The sim is built by bullet_hell_preload and the GL resources by
+// bullet_hell_enter, so nothing is paid for until the scene is about to be used.
+// Pass a recording to capture every sim step, or NULL. jobs may be NULL to run the sim serially.
+inline BulletHellSceneData create_bullet_hell_scene(u32 vp_ubo, InputRecording *recording, JobSystem *jobs) {
+  BulletHellSceneData bullet_hell;
+  memset(&bullet_hell, 0, sizeof(BulletHellSceneData));
+  bullet_hell.jobs = jobs;
+  bullet_hell.recording = recording;
+  bullet_hell.camera = create_camera(CAMERA_TYPE_2D);
+  bullet_hell.camera.position.z = 15.0f;
+  bullet_hell.vp_ubo = vp_ubo;
+  return bullet_hell;
+}
 
-  bullet_hell.uniforms[UNIFORM_PLAYER_MODEL] = player_model_ubo;
-  bullet_hell.uniforms[UNIFORM_PLAYER_FRAG] = player_frag_ubo;
-  bullet_hell.uniforms[UNIFORM_OVERLAY] = overlay_ubo;
+// Scene hooks. Leaving the scene keeps the sim and GL resources, so coming back resumes the fight.
 
-  // Put an enemy that moves sinusoidally in x 80% up the arena
-  memset(&bullet_hell.enemy_manager, 0, sizeof(EnemyManager));
-  bullet_hell.enemy_manager.num_live_enemies = 1;
-  f32 enemy_height = BULLET_HELL_ARENA_HALF_HEIGHT * 0.8f;
-  bullet_hell.enemy_manager.enemies[0].position.y = enemy_height;
-  bullet_hell.enemy_manager.render_data[0].pos.y = enemy_height;
+inline void bullet_hell_preload(void *scene_data) {
+  BulletHellSceneData *data = (BulletHellSceneData *)scene_data;
+  if (data->sim.bullet_manager == NULL) {
+    data->sim = create_bullet_hell_sim(PLAYER_SIDE_LENGTH_METERS, BULLET_HELL_SEED, data->jobs);
+    data->particle_manager = create_particle_manager(BULLET_HELL_SEED);
+    data->last_health = data->sim.player.current_health;
+  }
+}
 
-  return bullet_hell;
+inline void bullet_hell_enter(void *scene_data, void *global_state) {
+  (void)global_state;
+  BulletHellSceneData *data = (BulletHellSceneData *)scene_data;
+  if (data->overlay_program == 0) {
+    init_bullet_hell_gl(data);
+  }
+}
+
+inline void destroy_bullet_hell_scene(BulletHellSceneData *data) {
+  if (data->sim.bullet_manager) {
+    destroy_bullet_hell_sim(&data->sim);
+    destroy_particle_manager(&data->particle_manager);
+  }
+  if (data->overlay_program) {
+    destroy_billboard_manager(&data->billboard_manager);
+  }
 }
@@ -0,0 +1,510 @@
+#pragma once
+
+// The bullet hell simulation, with no window, input or graphics API dependencies. bullet_hell.h
+// wraps this in a scene that turns Inputs into PlayerIntents and uploads the results to OpenGL.
+// The headless target drives it directly with scripted intents.
+
+#include "bullet_patterns.h"
+#include "input_recording.h"
+#include "jobs.h"
+#include "linalg.h"
+#include "memory_arena.h"
+#include "physics.h"
+#include "statistics.h"
+#include "timing.h"
+#include "tuke_engine.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NUM_ENEMIES (8)
+
+// The sim always steps at a fixed dt so a recording replays exactly, headless or not.
+#define BULLET_HELL_SIM_DT (1.0f / 120.0f)
+#define BULLET_HELL_SEED (0x6275)
+
+// Address space per step, committed as used. A full hit list is MAX_NUM_BULLETS * 4 bytes.
+#define BULLET_HELL_FRAME_ARENA_RESERVE (4 * 1024 * 1024)
+
+const f32 BULLET_HELL_ARENA_WIDTH = 10.0f;
+const f32 BULLET_HELL_ARENA_HEIGHT = 8.0f;
+const f32 BULLET_HELL_ARENA_HALF_WIDTH = BULLET_HELL_ARENA_WIDTH / 2.0;
+const f32 BULLET_HELL_ARENA_HALF_HEIGHT = BULLET_HELL_ARENA_HEIGHT / 2.0;
+// An okay set of guides on FSMs for game AI, lots of OOP dogma, bad code, but introduces transition tables
+// http://www.ai-junkie.com/architecture/state_driven/tut_state1.html
+//
+// Game programming patterns on state. Also OOP, but on_entry, on_exit notions useful.
+// Heirarchical state machines, pushdown automata, state stacks, behavior trees, and planning systems also exist.
+// https://gameprogrammingpatterns.com/state.html
+
+struct Enemy {
+  Vec2 position;
+};
+
+struct EnemyRenderData {
+  Vec2 pos;
+  f32 size;
+};
+
+struct EnemyManager {
+  Enemy enemies[MAX_NUM_ENEMIES];
+  EnemyRenderData render_data[MAX_NUM_ENEMIES];
+  u32 num_live_enemies;
+};
+
+enum PlayerState {
+  PLAYER_STATE_NORMAL,
+  PLAYER_STATE_SPEED_BOOST,
+  PLAYER_STATE_SLOW_MOTION,
+  PLAYER_STATE_AIMING_DASH,
+  PLAYER_STATE_DASHING,
+};
+
+enum PlayerAbility {
+  PLAYER_ABILITY_NONE,
+  PLAYER_ABILITY_SPEED_BOOST,
+  PLAYER_ABILITY_DASH,
+  PLAYER_ABILITY_SLOW_MOTION,
+};
+
+struct PlayerDash {
+  f32 cooldown_left;
+  f32 time_dilation_factor; // for aiming in slow motion
+};
+
+struct PlayerSpeedBoost {
+  f32 boost_factor;
+};
+
+struct PlayerSlowMotion {
+  f32 time_dilation_factor;
+};
+
+// player_pos is the position within the bullet hell arena
+// The arena's center is (0.0, 0.0)
+struct Player {
+  Vec3 pos;
+  Vec3 size;
+  u32 current_health;
+  u32 max_health;
+  f32 invincibility_time;
+
+  PlayerState state;
+  PlayerAbility ability;
+  u32 unlocked_abilities_mask;
+
+  PlayerDash dash;
+  PlayerSpeedBoost speed_boost;
+  PlayerSlowMotion slow_motion;
+};
+
+// The stream enemy 0 has always fired, one bullet straight down every 0.1 s
+const BulletPatternDesc bullet_hell_stream_pattern{
+    .pattern = BULLET_PATTERN_LINEAR,
+    .ring_count = 1,
+    .spread = 0.0f,
+    .base_angle = -PI_OVER_2,
+    .angular_velocity = 0.0f,
+    .speed0 = 8.0f,
+    .acceleration = 0.0f,
+    .speed_min = 0.0f,
+    .speed_max = 0.0f,
+    .turn_rate = 0.0f,
+    .homing_strength = 0.0f,
+    .size = 0.3f,
+    .fire_interval = 0.1f,
+    .burst_count = 1,
+    .burst_cooldown = 0.0f,
+};
+
+const BulletPatternDesc bullet_hell_spiral_pattern{
+    .pattern = BULLET_PATTERN_SPIRAL,
+    .ring_count = 6,
+    .spread = 2.0f * PI,
+    .base_angle = 0.0f,
+    .angular_velocity = 1.5f,
+    .speed0 = 1.0f,
+    .acceleration = 3.0f,
+    .speed_min = 0.0f,
+    .speed_max = 5.0f,
+    .turn_rate = 0.0f,
+    .homing_strength = 0.0f,
+    .size = 0.15f,
+    .fire_interval = 0.15f,
+    .burst_count = 8,
+    .burst_cooldown = 1.0f,
+};
+
+inline void player_cancel_ability(Player *player) { player->state = PLAYER_STATE_NORMAL; }
+
+inline void player_activate_ability(Player *player) {
+
+  switch (player->state) {
+    // If normal, no reason not to activate the current ability.
+  case PLAYER_STATE_NORMAL:
+    switch (player->ability) {
+    case PLAYER_ABILITY_NONE:
+      return;
+    case PLAYER_ABILITY_SPEED_BOOST:
+      player->state = PLAYER_STATE_SPEED_BOOST;
+      return;
+    case PLAYER_ABILITY_DASH:
+      player->state = PLAYER_STATE_AIMING_DASH;
+      return;
+    case PLAYER_ABILITY_SLOW_MOTION:
+      player->state = PLAYER_STATE_SLOW_MOTION;
+      return;
+    }
+    break;
+
+    // No action required.
+  case PLAYER_STATE_AIMING_DASH:
+  case PLAYER_STATE_DASHING:
+  case PLAYER_STATE_SPEED_BOOST:
+  case PLAYER_STATE_SLOW_MOTION:
+    return;
+
+  default:
+    assert(false);
+  }
+}
+
+inline void player_release_ability(Player *player) {
+  switch (player->state) {
+
+  case PLAYER_STATE_AIMING_DASH:
+    // TODO real dashing logic
+    player->state = PLAYER_STATE_DASHING;
+    return;
+
+    // No action required.
+  case PLAYER_STATE_NORMAL:
+  case PLAYER_STATE_DASHING:
+  case PLAYER_STATE_SPEED_BOOST:
+  case PLAYER_STATE_SLOW_MOTION:
+    player->state = PLAYER_STATE_NORMAL;
+    return;
+
+  default:
+    assert(false);
+  }
+}
+
+inline void bullet_hell_move_player_normal(Player *player, Vec3 input_movement_vector, f32 dt) {
+
+  const f32 X_BOUNDARY = 0.5 * (BULLET_HELL_ARENA_WIDTH - player->size.x);
+  const f32 Y_BOUNDARY = 0.5 * (BULLET_HELL_ARENA_HEIGHT - player->size.y);
+
+  const f32 speed = 5.0f;
+  Vec3 movement_vector = scale_v3(input_movement_vector, speed * dt);
+
+  f32 next_x = player->pos.x + movement_vector.x;
+  f32 clamped_next_x = clamp_f32(next_x, -X_BOUNDARY, X_BOUNDARY);
+
+  f32 next_y = player->pos.y + movement_vector.y;
+  f32 clamped_next_y = clamp_f32(next_y, -Y_BOUNDARY, Y_BOUNDARY);
+
+  player->pos.x = clamped_next_x;
+  player->pos.y = clamped_next_y;
+}
+
+enum PlayerIntentFlags {
+  PLAYER_INTENT_NONE = 0,
+  PLAYER_INTENT_ACTIVATE_ABILITY = 1 << 0,
+  PLAYER_INTENT_CANCEL_ABILITY = 1 << 1,
+  PLAYER_INTENT_RELEASE_ABILITY = 1 << 1,
+};
+
+struct PlayerIntent {
+  Vec3 movement_vector;
+  u32 flags;
+};
+
+// PlayerIntent <-> InputFrame, for recording and replay. Flags are the buttons, movement is axes 0 and 1.
+inline InputFrame player_intent_to_input_frame(PlayerIntent player_intent) {
+  InputFrame frame{
+      .buttons = player_intent.flags,
+      .axes = {player_intent.movement_vector.x, player_intent.movement_vector.y, 0.0f, 0.0f},
+  };
+  return frame;
+}
+
+inline PlayerIntent input_frame_to_player_intent(const InputFrame *frame) {
+  PlayerIntent player_intent{
+      .movement_vector = vec3(frame->axes[0], frame->axes[1], 0.0f),
+      .flags = frame->buttons,
+  };
+  return player_intent;
+}
+
+inline void bullet_hell_update_player(Player *player, PlayerIntent player_intent, f32 dt) {
+
+  // Intent for cancel assumed to be stronger than intent for activation
+  u32 flags = player_intent.flags;
+  if (flags & PLAYER_INTENT_CANCEL_ABILITY) {
+    player_cancel_ability(player);
+  } else if (flags & PLAYER_INTENT_RELEASE_ABILITY) {
+    player_release_ability(player);
+  } else if (flags & PLAYER_INTENT_ACTIVATE_ABILITY) {
+    player_activate_ability(player);
+  }
+
+  // Move the player according to the current state
+  switch (player->state) {
+  case PLAYER_STATE_NORMAL:
+  case PLAYER_STATE_SLOW_MOTION:
+    bullet_hell_move_player_normal(player, player_intent.movement_vector, dt);
+    return;
+  case PLAYER_STATE_SPEED_BOOST: {
+    Vec3 scaled_movement_vector = scale_v3(player_intent.movement_vector, player->speed_boost.boost_factor);
+    bullet_hell_move_player_normal(player, scaled_movement_vector, dt);
+    return;
+  }
+
+  case PLAYER_STATE_AIMING_DASH:
+    return;
+  case PLAYER_STATE_DASHING:
+    return;
+  default:
+    assert(false);
+  }
+}
+
+// Per system wall time, accumulated over every tick stepped.
+struct BulletHellSimTimings {
+  TimingAccumulator player;
+  TimingAccumulator emitters;
+  TimingAccumulator bullets;
+  TimingAccumulator collision;
+  TimingAccumulator total;
+};
+
+struct BulletHellSim {
+  Player player;
+
+  BulletManager *bullet_manager;
+  BulletPatternTable *bullet_patterns;
+  u32 stream_pattern; // Indices into bullet_patterns for emitters added after create_bullet_hell_sim
+  u32 spiral_pattern;
+  BulletEmitterManager emitter_manager;
+  EnemyManager enemy_manager;
+
+  // Sim time. Dilated by slow motion and dash aiming.
+  f64 t;
+
+  // Any randomness in the sim must come from here, so replays from the same seed are exact.
+  u64 seed;
+  RNG rng;
+
+  u32 peak_live_bullets;
+  BulletHellSimTimings timings;
+
+  // NULL runs every system serially. Otherwise bullets and collision use the parallel versions,
+  // which give the same results, so replays don't depend on it.
+  JobSystem *jobs;
+
+  // Reset every step, for data that doesn't outlive the step after it, like the hit list
+  FrameArena frame_arena;
+};
+
+inline Player create_bullet_hell_player(f32 side_length) {
+  Player player{
+      .pos = vec3(0.0f, 0.0f, 0.0f),
+      .size = vec3(side_length, side_length, side_length),
+      .current_health = 100,
+      .max_health = 100,
+      .invincibility_time = 0.0f,
+      .state = PLAYER_STATE_NORMAL,
+      .ability = PLAYER_ABILITY_DASH,
+      .unlocked_abilities_mask = 0,
+      .dash =
+          {
+              .cooldown_left = 0.0f,
+              .time_dilation_factor = 0.6f,
+          },
+      .speed_boost =
+          {
+              .boost_factor = 2.0f,
+          },
+      .slow_motion = {
+          .time_dilation_factor = 0.5f,
+      },
+  };
+  return player;
+}
+
+// Heap allocates the bullet storage and pattern table. Free with destroy_bullet_hell_sim.
+// jobs may be NULL to run serially.
+inline BulletHellSim create_bullet_hell_sim(f32 player_side_length, u64 seed, JobSystem *jobs) {
+  BulletHellSim sim;
+  memset(&sim, 0, sizeof(BulletHellSim));
+  sim.seed = seed;
+  sim.rng = create_rng(seed);
+  sim.jobs = jobs;
+
+  sim.player = create_bullet_hell_player(player_side_length);
+
+  sim.bullet_manager = (BulletManager *)malloc(sizeof(BulletManager));
+  memset(sim.bullet_manager, 0, sizeof(BulletManager));
+  sim.frame_arena = create_frame_arena(BULLET_HELL_FRAME_ARENA_RESERVE);
+
+  sim.bullet_patterns = (BulletPatternTable *)malloc(sizeof(BulletPatternTable));
+  memset(sim.bullet_patterns, 0, sizeof(BulletPatternTable));
+  i32 stream_pattern = compile_bullet_pattern(sim.bullet_patterns, &bullet_hell_stream_pattern);
+  i32 spiral_pattern = compile_bullet_pattern(sim.bullet_patterns, &bullet_hell_spiral_pattern);
+  assert(stream_pattern >= 0 && spiral_pattern >= 0);
+  sim.stream_pattern = (u32)stream_pattern;
+  sim.spiral_pattern = (u32)spiral_pattern;
+
+  // Put an enemy that moves sinusoidally in x 80% up the arena
+  sim.enemy_manager.num_live_enemies = 1;
+  f32 enemy_height = BULLET_HELL_ARENA_HALF_HEIGHT * 0.8f;
+  sim.enemy_manager.enemies[0].position.y = enemy_height;
+  sim.enemy_manager.render_data[0].pos.y = enemy_height;
+
+  // Enemy 0 fires a stream straight down and a slow spiral
+  add_bullet_emitter(&sim.emitter_manager, sim.stream_pattern, 0, vec2(0.0f, 0.0f), 0.0);
+  add_bullet_emitter(&sim.emitter_manager, sim.spiral_pattern, 0, vec2(0.0f, 0.0f), 0.0);
+
+  return sim;
+}
+
+inline void destroy_bullet_hell_sim(BulletHellSim *sim) {
+  free(sim->bullet_manager);
+  free(sim->bullet_patterns);
+  destroy_frame_arena(&sim->frame_arena);
+  sim->bullet_manager = NULL;
+  sim->bullet_patterns = NULL;
+}
+
+// Advance the sim by dt of real time. Returns the dilated dt the world actually moved by.
+inline f32 bullet_hell_sim_step(BulletHellSim *sim, PlayerIntent player_intent, f32 dt) {
+  u64 t_start = get_time_ns();
+
+  BulletManager *bullet_manager = sim->bullet_manager;
+  EnemyManager *enemy_manager = &sim->enemy_manager;
+  Player *player = &sim->player;
+  MemoryArena *step_arena = frame_arena_begin(&sim->frame_arena);
+
+  // Update dt
+  // Potential FIXME: this is not really scalable, maybe
+  if (player->state == PLAYER_STATE_AIMING_DASH) {
+    dt = dt * player->dash.time_dilation_factor;
+  } else if (player->state == PLAYER_STATE_SLOW_MOTION) {
+    dt = dt * player->slow_motion.time_dilation_factor;
+  }
+
+  bullet_hell_update_player(player, player_intent, dt);
+
+  // Decrement and clamp invincibility_time
+  player->invincibility_time -= dt;
+  player->invincibility_time = (player->invincibility_time < 0.0) ? 0.0 : player->invincibility_time;
+
+  // If I add slow motion or anything like that, will need to consider how to track time updates
+  // Influences on the rate of time passing are player inputs - could add something like enemy effects
+  sim->t += dt;
+
+  // enemy update bringup
+  f32 x_amplitude = BULLET_HELL_ARENA_HALF_WIDTH * 0.8f;
+  f32 theta = 2.0 * sim->t;
+  enemy_manager->enemies[0].position.x = x_amplitude * sinf(theta);
+  enemy_manager->render_data[0].pos.x = x_amplitude * sinf(theta);
+  u64 t_player = get_time_ns();
+
+  // Fire emitters, then evaluate every bullet at the new time
+  Vec2 player_xy = vec2(player->pos.x, player->pos.y);
+  Vec2 enemy_positions[MAX_NUM_ENEMIES];
+  for (u32 i = 0; i < enemy_manager->num_live_enemies; i++) {
+    enemy_positions[i] = enemy_manager->enemies[i].position;
+  }
+  update_bullet_emitters(
+      &sim->emitter_manager, bullet_manager, sim->bullet_patterns, enemy_positions, player_xy, sim->t
+  );
+  u64 t_emitters = get_time_ns();
+
+  if (sim->jobs) {
+    update_bullets_parallel(
+        sim->jobs, bullet_manager, sim->bullet_patterns, sim->t, dt, player_xy, BULLET_HELL_ARENA_HALF_WIDTH,
+        BULLET_HELL_ARENA_HALF_HEIGHT
+    );
+  } else {
+    update_bullets(
+        bullet_manager, sim->bullet_patterns, sim->t, dt, player_xy, BULLET_HELL_ARENA_HALF_WIDTH,
+        BULLET_HELL_ARENA_HALF_HEIGHT
+    );
+  }
+  u64 t_bullets = get_time_ns();
+
+  // Collision detection. Every overlapping bullet costs one health.
+  if (player->invincibility_time <= 0.0) {
+    Vec2 player_size_xy = vec2(player->size.x, player->size.y);
+    u32 *bullet_hits = ARENA_PUSH_ARRAY(step_arena, u32, bullet_manager->num_live_bullets);
+    u32 num_hits;
+    if (sim->jobs) {
+      num_hits = collect_bullet_hits_parallel(sim->jobs, bullet_manager, player_xy, player_size_xy, bullet_hits);
+    } else {
+      num_hits = collect_bullet_hits(bullet_manager, player_xy, player_size_xy, bullet_hits);
+    }
+
+    for (u32 i = 0; i < num_hits; i++) {
+      player->current_health -= (player->current_health > 0);
+      player->invincibility_time = 1.0;
+    }
+  }
+  u64 t_collision = get_time_ns();
+
+  if (bullet_manager->num_live_bullets > sim->peak_live_bullets) {
+    sim->peak_live_bullets = bullet_manager->num_live_bullets;
+  }
+
+  timing_accumulate(&sim->timings.player, t_player - t_start);
+  timing_accumulate(&sim->timings.emitters, t_emitters - t_player);
+  timing_accumulate(&sim->timings.bullets, t_bullets - t_emitters);
+  timing_accumulate(&sim->timings.collision, t_collision - t_bullets);
+  timing_accumulate(&sim->timings.total, t_collision - t_start);
+
+  return dt;
+}
+
+// Hash of everything that feeds the next tick. Timings and high water marks are left out.
+inline u64 hash_bullet_hell_sim(const BulletHellSim *sim) {
+  u64 hash = STATE_HASH_SEED;
+
+  const Player *player = &sim->player;
+  hash = HASH_STATE_FIELD(hash, player->pos);
+  hash = HASH_STATE_FIELD(hash, player->current_health);
+  hash = HASH_STATE_FIELD(hash, player->invincibility_time);
+  hash = HASH_STATE_FIELD(hash, player->state);
+  hash = HASH_STATE_FIELD(hash, player->ability);
+  hash = HASH_STATE_FIELD(hash, player->dash.cooldown_left);
+
+  hash = HASH_STATE_FIELD(hash, sim->t);
+  hash = HASH_STATE_FIELD(hash, sim->rng);
+
+  const EnemyManager *enemy_manager = &sim->enemy_manager;
+  hash = HASH_STATE_FIELD(hash, enemy_manager->num_live_enemies);
+  hash = hash_state_bytes(hash, enemy_manager->enemies, enemy_manager->num_live_enemies * sizeof(Enemy));
+
+  const BulletEmitterManager *emitter_manager = &sim->emitter_manager;
+  for (u32 i = 0; i < emitter_manager->num_emitters; i++) {
+    const BulletEmitter *emitter = &emitter_manager->emitters[i];
+    hash = HASH_STATE_FIELD(hash, emitter->next_fire_time);
+    hash = HASH_STATE_FIELD(hash, emitter->shots_fired_in_burst);
+    hash = HASH_STATE_FIELD(hash, emitter->active);
+  }
+
+  const BulletManager *bullet_manager = sim->bullet_manager;
+  u32 n = bullet_manager->num_live_bullets;
+  hash = HASH_STATE_FIELD(hash, n);
+  hash = hash_state_bytes(hash, bullet_manager->origin_x, n * sizeof(f32));
+  hash = hash_state_bytes(hash, bullet_manager->origin_y, n * sizeof(f32));
+  hash = hash_state_bytes(hash, bullet_manager->dir_x, n * sizeof(f32));
+  hash = hash_state_bytes(hash, bullet_manager->dir_y, n * sizeof(f32));
+  hash = hash_state_bytes(hash, bullet_manager->t0, n * sizeof(f64));
+  hash = hash_state_bytes(hash, bullet_manager->pattern_index, n * sizeof(u16));
+
+  return hash;
+}
@@ -0,0 +1,633 @@
+#pragma once
+
+// Data driven bullet patterns.
+//
+// Patterns are authored as BulletPatternDesc's, then compiled into a BulletPatternTable, a flat SoA
+// table of parameters indexed by pattern. Emitters reference a pattern by index and fire shots
+// (rings/fans of bullets) on a burst schedule. Bullets only store what they were spawned with:
+// origin, initial heading, spawn time and pattern index. Position is evaluated in closed form from
+// the bullet's age every tick, so the per tick update is a batch of independent evaluations with
+// no integrated state. Homing bullets depend on where the player is, so they can't be closed form.
+// Those re-base their origin and heading each tick instead.
+//
+// Nothing in here allocates. Spawns past MAX_NUM_BULLETS are dropped and counted.
+//
+// Speed curve:
+//  speed(age) = clamp(speed0 + acceleration * age, speed_min, speed_max)
+//  distance(age) is the integral, which is piecewise quadratic then linear once the clamp is hit.
+//
+// Curving bullets turn at a constant rate w with constant speed v. With heading angle a0 at spawn,
+//  x(age) = x0 + v/w * (sin(a0 + w * age) - sin(a0))
+//  y(age) = y0 - v/w * (cos(a0 + w * age) - cos(a0))
+
+#include "jobs.h"
+#include "linalg.h"
+#include "physics.h"
+#include "tuke_engine.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_NUM_BULLETS (16384)
+#define MAX_NUM_BULLET_PATTERNS (32)
+#define MAX_NUM_BULLET_EMITTERS (32)
+#define MAX_NUM_RING_DIRECTIONS (1024)
+
+enum BulletPattern {
+  BULLET_PATTERN_LINEAR, // One stream of bullets along the emitter's angle
+  BULLET_PATTERN_SPIRAL, // Rings whose emission angle turns with angular_velocity
+  BULLET_PATTERN_RING,   // Rings with a fixed emission angle
+  BULLET_PATTERN_AIMED,  // Fans centered on the player at the moment of firing
+  BULLET_PATTERN_HOMING, // Bullets steer toward the player. Not closed form.
+
+  NUM_BULLET_PATTERNS
+};
+
+// Authoring format. Angles in radians, times in seconds, distances in meters.
+struct BulletPatternDesc {
+  BulletPattern pattern;
+
+  // Shape of a single shot
+  u32 ring_count;       // Bullets per shot
+  f32 spread;           // Angle covered by a shot. 2 * PI for a full ring.
+  f32 base_angle;       // CCW from +x. Ignored by aimed patterns.
+  f32 angular_velocity; // How fast the emission angle turns, for spirals
+
+  // Motion of each bullet
+  f32 speed0;
+  f32 acceleration;
+  f32 speed_min;
+  f32 speed_max;
+  f32 turn_rate;       // Constant curve of each bullet after spawn. Requires acceleration == 0.
+  f32 homing_strength; // Max turn rate toward the player for homing bullets.
+  f32 size;
+
+  // Burst timing
+  f32 fire_interval;  // Between shots within a burst
+  u32 burst_count;    // Shots per burst
+  f32 burst_cooldown; // Between the last shot of a burst and the first of the next
+};
+
+// Compiled patterns, one column per parameter. The ring directions for every pattern are
+// precomputed into one shared table, so firing a shot is a rotation of unit vectors instead of
+// ring_count sin/cos pairs.
+struct BulletPatternTable {
+  BulletPattern pattern[MAX_NUM_BULLET_PATTERNS];
+
+  u32 ring_count[MAX_NUM_BULLET_PATTERNS];
+  u32 ring_offset[MAX_NUM_BULLET_PATTERNS];
+  f32 base_angle[MAX_NUM_BULLET_PATTERNS];
+  f32 angular_velocity[MAX_NUM_BULLET_PATTERNS];
+
+  f32 speed0[MAX_NUM_BULLET_PATTERNS];
+  f32 acceleration[MAX_NUM_BULLET_PATTERNS];
+  f32 speed_clamp[MAX_NUM_BULLET_PATTERNS]; // speed_min or speed_max, whichever the curve runs into
+  f32 clamp_age[MAX_NUM_BULLET_PATTERNS];   // Age at which the speed clamp is hit, INFINITY_F32 if never
+  f32 clamp_distance[MAX_NUM_BULLET_PATTERNS];
+  f32 turn_radius[MAX_NUM_BULLET_PATTERNS]; // speed0 / turn_rate, 0 for straight bullets
+  f32 turn_rate[MAX_NUM_BULLET_PATTERNS];
+  f32 homing_strength[MAX_NUM_BULLET_PATTERNS];
+  f32 size[MAX_NUM_BULLET_PATTERNS];
+
+  f32 fire_interval[MAX_NUM_BULLET_PATTERNS];
+  u32 burst_count[MAX_NUM_BULLET_PATTERNS];
+  f32 burst_cooldown[MAX_NUM_BULLET_PATTERNS];
+
+  // Unit vectors relative to the emission angle, ring_count of them per pattern starting at ring_offset
+  f32 ring_dir_x[MAX_NUM_RING_DIRECTIONS];
+  f32 ring_dir_y[MAX_NUM_RING_DIRECTIONS];
+
+  u32 num_patterns;
+  u32 num_ring_directions;
+};
+
+struct BulletRenderData {
+  Vec2 pos;
+  f32 size;
+};
+
+// Bullets are SoA. Analytic bullets never write their spawn state after spawning. Homing bullets
+// overwrite origin and dir every tick with their current position and heading. Their t0 stays the
+// spawn time so the speed curve still applies.
+struct BulletManager {
+  f32 origin_x[MAX_NUM_BULLETS];
+  f32 origin_y[MAX_NUM_BULLETS];
+  f32 dir_x[MAX_NUM_BULLETS];
+  f32 dir_y[MAX_NUM_BULLETS];
+  f64 t0[MAX_NUM_BULLETS]; // Spawn time
+  u16 pattern_index[MAX_NUM_BULLETS];
+
+  // Evaluated every tick. Used for both drawing and collision.
+  BulletRenderData render_data[MAX_NUM_BULLETS];
+
+  u32 num_live_bullets;
+  u32 num_dropped_spawns;
+};
+
+// Emitters are attached to an enemy by index, or fixed in place with enemy_index == EMITTER_NO_ENEMY.
+#define EMITTER_NO_ENEMY (0xFFFFFFFF)
+
+struct BulletEmitter {
+  u32 pattern_index;
+  u32 enemy_index;
+  Vec2 offset;      // From the enemy, or the absolute position when unattached
+  f64 start_time;   // For evaluating the spiral angle
+  f64 next_fire_time;
+  u32 shots_fired_in_burst;
+  bool active;
+};
+
+struct BulletEmitterManager {
+  BulletEmitter emitters[MAX_NUM_BULLET_EMITTERS];
+  u32 num_emitters;
+};
+
+// Returns the index of the compiled pattern, or -1 if the table is full or the descriptor is invalid.
+inline i32 compile_bullet_pattern(BulletPatternTable *table, const BulletPatternDesc *desc) {
+  if (table->num_patterns >= MAX_NUM_BULLET_PATTERNS) {
+    fprintf(stderr, "compile_bullet_pattern: exceeded MAX_NUM_BULLET_PATTERNS\n");
+    return -1;
+  }
+
+  u32 ring_count = (desc->pattern == BULLET_PATTERN_LINEAR || desc->ring_count == 0) ? 1 : desc->ring_count;
+  if (table->num_ring_directions + ring_count > MAX_NUM_RING_DIRECTIONS) {
+    fprintf(stderr, "compile_bullet_pattern: exceeded MAX_NUM_RING_DIRECTIONS\n");
+    return -1;
+  }
+
+  if (desc->fire_interval <= 0.0f) {
+    fprintf(stderr, "compile_bullet_pattern: fire_interval must be positive\n");
+    return -1;
+  }
+
+  f32 turn_rate = desc->turn_rate;
+  f32 acceleration = desc->acceleration;
+  if (turn_rate != 0.0f && acceleration != 0.0f) {
+    fprintf(stderr, "compile_bullet_pattern: curving bullets can't accelerate, ignoring acceleration\n");
+    acceleration = 0.0f;
+  }
+
+  u32 i = table->num_patterns++;
+  table->pattern[i] = desc->pattern;
+  table->ring_count[i] = ring_count;
+  table->ring_offset[i] = table->num_ring_directions;
+  table->base_angle[i] = desc->base_angle;
+  table->angular_velocity[i] = (desc->pattern == BULLET_PATTERN_SPIRAL) ? desc->angular_velocity : 0.0f;
+
+  // Speed curve. Find when, if ever, speed0 + acceleration * age runs into the clamp.
+  f32 speed_min = desc->speed_min < 0.0f ? 0.0f : desc->speed_min;
+  f32 speed_max = desc->speed_max > 0.0f ? desc->speed_max : INFINITY_F32;
+  f32 speed0 = clamp_f32(desc->speed0, speed_min, speed_max);
+  f32 speed_clamp = speed0;
+  f32 clamp_age = INFINITY_F32;
+  if (acceleration > 0.0f && speed_max < INFINITY_F32) {
+    speed_clamp = speed_max;
+    clamp_age = (speed_max - speed0) / acceleration;
+  } else if (acceleration < 0.0f) {
+    speed_clamp = speed_min;
+    clamp_age = (speed_min - speed0) / acceleration;
+  }
+
+  table->speed0[i] = speed0;
+  table->acceleration[i] = acceleration;
+  table->speed_clamp[i] = speed_clamp;
+  table->clamp_age[i] = clamp_age;
+  table->clamp_distance[i] =
+      (clamp_age < INFINITY_F32) ? speed0 * clamp_age + 0.5f * acceleration * clamp_age * clamp_age : 0.0f;
+  table->turn_rate[i] = turn_rate;
+  table->turn_radius[i] = (turn_rate != 0.0f) ? speed0 / turn_rate : 0.0f;
+  table->homing_strength[i] = desc->homing_strength;
+  table->size[i] = desc->size;
+
+  table->fire_interval[i] = desc->fire_interval;
+  table->burst_count[i] = desc->burst_count == 0 ? 1 : desc->burst_count;
+  table->burst_cooldown[i] = desc->burst_cooldown;
+
+  // Ring directions. Full rings space bullets evenly without doubling up at 2 * PI, partial
+  // spreads are fans that include both edges. Directions are centered on the emission angle.
+  bool full_ring = desc->spread >= 2.0f * PI - 1e-4f;
+  f32 step = 0.0f;
+  if (ring_count > 1) {
+    step = full_ring ? desc->spread / ring_count : desc->spread / (ring_count - 1);
+  }
+  f32 first = full_ring ? 0.0f : -0.5f * desc->spread;
+  for (u32 j = 0; j < ring_count; j++) {
+    f32 theta = (ring_count > 1) ? first + j * step : 0.0f;
+    table->ring_dir_x[table->num_ring_directions] = cosf(theta);
+    table->ring_dir_y[table->num_ring_directions] = sinf(theta);
+    table->num_ring_directions++;
+  }
+
+  return (i32)i;
+}
+
+// Distance travelled along the speed curve after age seconds
+static inline f32 bullet_pattern_distance(const BulletPatternTable *table, u32 pattern, f32 age) {
+  f32 clamp_age = table->clamp_age[pattern];
+  if (age < clamp_age) {
+    return table->speed0[pattern] * age + 0.5f * table->acceleration[pattern] * age * age;
+  }
+  return table->clamp_distance[pattern] + table->speed_clamp[pattern] * (age - clamp_age);
+}
+
+inline void clear_bullet_manager(BulletManager *bullet_manager) {
+  bullet_manager->num_live_bullets = 0;
+  bullet_manager->num_dropped_spawns = 0;
+}
+
+inline u32 add_bullet_emitter(
+    BulletEmitterManager *emitter_manager, u32 pattern_index, u32 enemy_index, Vec2 offset, f64 start_time
+) {
+  assert(emitter_manager->num_emitters < MAX_NUM_BULLET_EMITTERS);
+  u32 i = emitter_manager->num_emitters++;
+  emitter_manager->emitters[i] = {
+      .pattern_index = pattern_index,
+      .enemy_index = enemy_index,
+      .offset = offset,
+      .start_time = start_time,
+      .next_fire_time = start_time,
+      .shots_fired_in_burst = 0,
+      .active = true,
+  };
+  return i;
+}
+
+// Spawn one shot's worth of bullets at fire_time. t is the current sim time. Bullets spawned
+// between ticks get their real spawn time, so high fire rates don't bunch up on tick boundaries.
+static inline void fire_bullet_shot(
+    BulletManager *bullet_manager,
+    const BulletPatternTable *table,
+    u32 pattern,
+    Vec2 origin,
+    f32 emission_angle,
+    f64 fire_time
+) {
+  u32 count = table->ring_count[pattern];
+  u32 free_slots = MAX_NUM_BULLETS - bullet_manager->num_live_bullets;
+  if (count > free_slots) {
+    bullet_manager->num_dropped_spawns += count - free_slots;
+    count = free_slots;
+  }
+
+  f32 c = cosf(emission_angle);
+  f32 s = sinf(emission_angle);
+  const f32 *ring_x = &table->ring_dir_x[table->ring_offset[pattern]];
+  const f32 *ring_y = &table->ring_dir_y[table->ring_offset[pattern]];
+
+  u32 base = bullet_manager->num_live_bullets;
+  for (u32 j = 0; j < count; j++) {
+    u32 k = base + j;
+    bullet_manager->origin_x[k] = origin.x;
+    bullet_manager->origin_y[k] = origin.y;
+    bullet_manager->dir_x[k] = c * ring_x[j] - s * ring_y[j];
+    bullet_manager->dir_y[k] = s * ring_x[j] + c * ring_y[j];
+    bullet_manager->t0[k] = fire_time;
+    bullet_manager->pattern_index[k] = (u16)pattern;
+  }
+  bullet_manager->num_live_bullets += count;
+}
+
+// Fire every shot that comes due in (t - dt, t] for every emitter.
+// enemy_positions is indexed by each emitter's enemy_index.
+inline void update_bullet_emitters(
+    BulletEmitterManager *emitter_manager,
+    BulletManager *bullet_manager,
+    const BulletPatternTable *table,
+    const Vec2 *enemy_positions,
+    Vec2 player_pos,
+    f64 t
+) {
+  for (u32 i = 0; i < emitter_manager->num_emitters; i++) {
+    BulletEmitter *emitter = &emitter_manager->emitters[i];
+    if (!emitter->active) {
+      continue;
+    }
+
+    u32 pattern = emitter->pattern_index;
+    Vec2 origin = emitter->offset;
+    if (emitter->enemy_index != EMITTER_NO_ENEMY) {
+      origin = add_v2(origin, enemy_positions[emitter->enemy_index]);
+    }
+
+    while (emitter->next_fire_time <= t) {
+      f64 fire_time = emitter->next_fire_time;
+
+      f32 emission_angle;
+      if (table->pattern[pattern] == BULLET_PATTERN_AIMED || table->pattern[pattern] == BULLET_PATTERN_HOMING) {
+        emission_angle = atan2f(player_pos.y - origin.y, player_pos.x - origin.x);
+      } else {
+        f32 elapsed = (f32)(fire_time - emitter->start_time);
+        emission_angle = table->base_angle[pattern] + table->angular_velocity[pattern] * elapsed;
+      }
+
+      fire_bullet_shot(bullet_manager, table, pattern, origin, emission_angle, fire_time);
+
+      emitter->shots_fired_in_burst++;
+      if (emitter->shots_fired_in_burst >= table->burst_count[pattern]) {
+        emitter->shots_fired_in_burst = 0;
+        emitter->next_fire_time += table->fire_interval[pattern] + table->burst_cooldown[pattern];
+      } else {
+        emitter->next_fire_time += table->fire_interval[pattern];
+      }
+    }
+  }
+}
+
+// Supposing a rectangle of half side lengths is positioned at the origin
+inline f32 rectangle_sdf(f32 half_width, f32 half_height, Vec2 pos) {
+  Vec2 abs_pos = abs_v2(pos);
+  Vec2 rect_vec = vec2(half_width, half_height);
+  Vec2 diff = sub_v2(abs_pos, rect_vec);
+
+  Vec2 clamped_diff = vec2(fmax(0.0f, abs_pos.x - rect_vec.x), fmax(0.0f, abs_pos.y - rect_vec.y));
+  f32 dist_outside = len_v2(clamped_diff);
+  f32 dist_inside = fmin(fmax(diff.x, diff.y), 0.0f);
+
+  return dist_outside + dist_inside;
+}
+
+// Evaluate the position of bullets [begin, end) at time t into render_data. Each bullet only touches
+// its own columns, so disjoint ranges can be evaluated concurrently.
+inline void evaluate_bullets(
+    BulletManager *bullet_manager,
+    const BulletPatternTable *table,
+    f64 t,
+    f32 dt,
+    Vec2 player_pos,
+    u32 begin,
+    u32 end
+) {
+  for (u32 i = begin; i < end; i++) {
+    u32 pattern = bullet_manager->pattern_index[i];
+    f32 age = (f32)(t - bullet_manager->t0[i]);
+    f32 ox = bullet_manager->origin_x[i];
+    f32 oy = bullet_manager->origin_y[i];
+    f32 dx = bullet_manager->dir_x[i];
+    f32 dy = bullet_manager->dir_y[i];
+
+    Vec2 pos;
+    if (table->pattern[pattern] == BULLET_PATTERN_HOMING) {
+      // Turn toward the player by at most homing_strength * dt, then step along the new heading.
+      // The step is the speed curve's distance over the last dt, so homing bullets still follow
+      // the pattern's acceleration.
+      f32 to_player_x = player_pos.x - ox;
+      f32 to_player_y = player_pos.y - oy;
+      f32 cross = dx * to_player_y - dy * to_player_x;
+      f32 dot = dx * to_player_x + dy * to_player_y;
+      f32 angle_to_player = atan2f(cross, dot);
+      f32 max_turn = table->homing_strength[pattern] * dt;
+      f32 turn = clamp_f32(angle_to_player, -max_turn, max_turn);
+      f32 c = cosf(turn);
+      f32 s = sinf(turn);
+      f32 new_dx = c * dx - s * dy;
+      f32 new_dy = s * dx + c * dy;
+
+      f32 step = bullet_pattern_distance(table, pattern, age) -
+                 bullet_pattern_distance(table, pattern, age - dt > 0.0f ? age - dt : 0.0f);
+      pos = vec2(ox + new_dx * step, oy + new_dy * step);
+
+      bullet_manager->origin_x[i] = pos.x;
+      bullet_manager->origin_y[i] = pos.y;
+      bullet_manager->dir_x[i] = new_dx;
+      bullet_manager->dir_y[i] = new_dy;
+    } else if (table->turn_rate[pattern] != 0.0f) {
+      f32 phi = table->turn_rate[pattern] * age;
+      f32 sin_phi = sinf(phi);
+      f32 one_minus_cos_phi = 1.0f - cosf(phi);
+      f32 r = table->turn_radius[pattern];
+      pos = vec2(ox + r * (dx * sin_phi - dy * one_minus_cos_phi), oy + r * (dy * sin_phi + dx * one_minus_cos_phi));
+    } else {
+      f32 distance = bullet_pattern_distance(table, pattern, age);
+      pos = vec2(ox + dx * distance, oy + dy * distance);
+    }
+
+    bullet_manager->render_data[i].pos = pos;
+    bullet_manager->render_data[i].size = table->size[pattern];
+  }
+}
+
+// TODO this would break down if I decide to add bullets that go outside the arena and come back in
+inline bool bullet_in_arena(const BulletRenderData *bullet, f32 arena_half_width, f32 arena_half_height) {
+  return rectangle_sdf(arena_half_width, arena_half_height, bullet->pos) < 0.0f;
+}
+
+inline void copy_bullet(BulletManager *dst, u32 dst_index, const BulletManager *src, u32 src_index) {
+  dst->origin_x[dst_index] = src->origin_x[src_index];
+  dst->origin_y[dst_index] = src->origin_y[src_index];
+  dst->dir_x[dst_index] = src->dir_x[src_index];
+  dst->dir_y[dst_index] = src->dir_y[src_index];
+  dst->t0[dst_index] = src->t0[src_index];
+  dst->pattern_index[dst_index] = src->pattern_index[src_index];
+  dst->render_data[dst_index] = src->render_data[src_index];
+}
+
+// Evaluate the position of every live bullet at time t, then kill the ones that left the
+// arena. Two passes: the first is a straight batch over the SoA columns with no data dependent
+// writes besides render_data, the second compacts.
+//
+// Compaction is stable, survivors keep their spawn order. update_bullets_parallel compacts the
+// same way, so the two give bit identical results and replays don't depend on the thread count.
+//
+// This function will never spawn new bullets.
+inline void update_bullets(
+    BulletManager *bullet_manager,
+    const BulletPatternTable *table,
+    f64 t,
+    f32 dt,
+    Vec2 player_pos,
+    f32 arena_half_width,
+    f32 arena_half_height
+) {
+  u32 n = bullet_manager->num_live_bullets;
+  evaluate_bullets(bullet_manager, table, t, dt, player_pos, 0, n);
+
+  u32 num_kept = 0;
+  for (u32 i = 0; i < n; i++) {
+    if (bullet_in_arena(&bullet_manager->render_data[i], arena_half_width, arena_half_height)) {
+      if (i != num_kept) {
+        copy_bullet(bullet_manager, num_kept, bullet_manager, i);
+      }
+      num_kept++;
+    }
+  }
+
+  bullet_manager->num_live_bullets = num_kept;
+}
+
+// Parallel versions split the bullets into fixed size blocks. Block boundaries don't depend on the
+// thread count, and each block's output lands at the exclusive prefix sum of the output counts of
+// the blocks before it, so the output order is the serial order no matter who ran what.
+#define BULLET_BLOCK_SIZE (1024)
+#define MAX_NUM_BULLET_BLOCKS (MAX_NUM_BULLETS / BULLET_BLOCK_SIZE)
+
+struct BulletBlocks {
+  u32 num_bullets;
+  u32 num_blocks;
+  u32 counts[MAX_NUM_BULLET_BLOCKS];
+  u32 offsets[MAX_NUM_BULLET_BLOCKS];
+};
+
+inline void init_bullet_blocks(BulletBlocks *blocks, u32 num_bullets) {
+  blocks->num_bullets = num_bullets;
+  blocks->num_blocks = (num_bullets + BULLET_BLOCK_SIZE - 1) / BULLET_BLOCK_SIZE;
+}
+
+inline void bullet_block_range(const BulletBlocks *blocks, u32 block, u32 *begin, u32 *end) {
+  *begin = block * BULLET_BLOCK_SIZE;
+  *end = *begin + BULLET_BLOCK_SIZE < blocks->num_bullets ? *begin + BULLET_BLOCK_SIZE : blocks->num_bullets;
+}
+
+// Exclusive prefix sum of counts into offsets, returns the total
+inline u32 bullet_block_offsets(BulletBlocks *blocks) {
+  u32 total = 0;
+  for (u32 i = 0; i < blocks->num_blocks; i++) {
+    blocks->offsets[i] = total;
+    total += blocks->counts[i];
+  }
+  return total;
+}
+
+// count bullets from src to dst, every column. The ranges may overlap.
+inline void move_bullets(BulletManager *bullet_manager, u32 dst, u32 src, u32 count) {
+  memmove(&bullet_manager->origin_x[dst], &bullet_manager->origin_x[src], count * sizeof(f32));
+  memmove(&bullet_manager->origin_y[dst], &bullet_manager->origin_y[src], count * sizeof(f32));
+  memmove(&bullet_manager->dir_x[dst], &bullet_manager->dir_x[src], count * sizeof(f32));
+  memmove(&bullet_manager->dir_y[dst], &bullet_manager->dir_y[src], count * sizeof(f32));
+  memmove(&bullet_manager->t0[dst], &bullet_manager->t0[src], count * sizeof(f64));
+  memmove(&bullet_manager->pattern_index[dst], &bullet_manager->pattern_index[src], count * sizeof(u16));
+  memmove(&bullet_manager->render_data[dst], &bullet_manager->render_data[src], count * sizeof(BulletRenderData));
+}
+
+struct UpdateBulletsJob {
+  BulletManager *bullet_manager;
+  const BulletPatternTable *table;
+  f64 t;
+  f32 dt;
+  Vec2 player_pos;
+  f32 arena_half_width;
+  f32 arena_half_height;
+  BulletBlocks blocks;
+};
+
+// Evaluate, then compact each block's survivors to the front of the block
+inline void update_bullet_blocks(void *data, u32 begin_block, u32 end_block) {
+  UpdateBulletsJob *job = (UpdateBulletsJob *)data;
+  BulletManager *bullet_manager = job->bullet_manager;
+  for (u32 block = begin_block; block < end_block; block++) {
+    u32 begin, end;
+    bullet_block_range(&job->blocks, block, &begin, &end);
+    evaluate_bullets(bullet_manager, job->table, job->t, job->dt, job->player_pos, begin, end);
+
+    u32 num_kept = begin;
+    for (u32 i = begin; i < end; i++) {
+      if (bullet_in_arena(&bullet_manager->render_data[i], job->arena_half_width, job->arena_half_height)) {
+        if (i != num_kept) {
+          copy_bullet(bullet_manager, num_kept, bullet_manager, i);
+        }
+        num_kept++;
+      }
+    }
+    job->blocks.counts[block] = num_kept - begin;
+  }
+}
+
+// update_bullets on the job system, same output. Blocks are evaluated and compacted in parallel,
+// then moved down to their prefix sum offsets serially. A block's offset is at most its start, so
+// moving in block order never overwrites a block that hasn't moved yet. The serial part only
+// touches survivors.
+inline void update_bullets_parallel(
+    JobSystem *jobs,
+    BulletManager *bullet_manager,
+    const BulletPatternTable *table,
+    f64 t,
+    f32 dt,
+    Vec2 player_pos,
+    f32 arena_half_width,
+    f32 arena_half_height
+) {
+  UpdateBulletsJob job;
+  job.bullet_manager = bullet_manager;
+  job.table = table;
+  job.t = t;
+  job.dt = dt;
+  job.player_pos = player_pos;
+  job.arena_half_width = arena_half_width;
+  job.arena_half_height = arena_half_height;
+  init_bullet_blocks(&job.blocks, bullet_manager->num_live_bullets);
+
+  parallel_for(jobs, job.blocks.num_blocks, 1, update_bullet_blocks, &job);
+  u32 num_kept = bullet_block_offsets(&job.blocks);
+  for (u32 block = 0; block < job.blocks.num_blocks; block++) {
+    u32 src = block * BULLET_BLOCK_SIZE;
+    if (job.blocks.offsets[block] != src) {
+      move_bullets(bullet_manager, job.blocks.offsets[block], src, job.blocks.counts[block]);
+    }
+  }
+
+  bullet_manager->num_live_bullets = num_kept;
+}
+
+// Indices of the live bullets overlapping the AABB, ascending. out_indices needs room for every
+// live bullet. Returns the count.
+inline u32 collect_bullet_hits(const BulletManager *bullet_manager, Vec2 pos, Vec2 size, u32 *out_indices) {
+  u32 num_hits = 0;
+  for (u32 i = 0; i < bullet_manager->num_live_bullets; i++) {
+    const BulletRenderData *bullet = &bullet_manager->render_data[i];
+    if (aabb_collision_v2(pos, size, bullet->pos, vec2(bullet->size, bullet->size))) {
+      out_indices[num_hits++] = i;
+    }
+  }
+  return num_hits;
+}
+
+struct CollectBulletHitsJob {
+  const BulletManager *bullet_manager;
+  Vec2 pos;
+  Vec2 size;
+  u32 *out_indices;
+  BulletBlocks blocks;
+};
+
+// Hits of each block go to the start of the block's own range of out_indices, then are moved down
+// like update_bullets_parallel's survivors. Usually there are very few.
+inline void collect_bullet_hit_blocks(void *data, u32 begin_block, u32 end_block) {
+  CollectBulletHitsJob *job = (CollectBulletHitsJob *)data;
+  for (u32 block = begin_block; block < end_block; block++) {
+    u32 begin, end;
+    bullet_block_range(&job->blocks, block, &begin, &end);
+
+    u32 count = 0;
+    for (u32 i = begin; i < end; i++) {
+      const BulletRenderData *bullet = &job->bullet_manager->render_data[i];
+      if (aabb_collision_v2(job->pos, job->size, bullet->pos, vec2(bullet->size, bullet->size))) {
+        job->out_indices[begin + count++] = i;
+      }
+    }
+    job->blocks.counts[block] = count;
+  }
+}
+
+// collect_bullet_hits on the job system, same output
+inline u32 collect_bullet_hits_parallel(
+    JobSystem *jobs, const BulletManager *bullet_manager, Vec2 pos, Vec2 size, u32 *out_indices
+) {
+  CollectBulletHitsJob job;
+  job.bullet_manager = bullet_manager;
+  job.pos = pos;
+  job.size = size;
+  job.out_indices = out_indices;
+  init_bullet_blocks(&job.blocks, bullet_manager->num_live_bullets);
+
+  parallel_for(jobs, job.blocks.num_blocks, 1, collect_bullet_hit_blocks, &job);
+  u32 num_hits = bullet_block_offsets(&job.blocks);
+  for (u32 block = 0; block < job.blocks.num_blocks; block++) {
+    memmove(
+        &out_indices[job.blocks.offsets[block]], &out_indices[block * BULLET_BLOCK_SIZE],
+        job.blocks.counts[block] * sizeof(u32)
+    );
+  }
+  return num_hits;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+// Growable entity pool with generational handles, see entity_index.h.
+//
+// Freed slots go on an intrusive free list, making add, remove and validate O(1).
+//
+// Component data is dense. [0, num_live) are exactly the live entities, so systems iterate those
+// arrays directly. Removal swaps the last live entity into the hole, so dense indices are not
+// stable across a remove. Hold EntityIndex, not dense indices, across frames.
+
+#include "entity_index.h"
+#include "linalg.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum EntityType {
+  ENTITY_NIL = 0,
+  ENTITY_PLAYER,
+  ENTITY_NPC,
+};
+
+struct Entities {
+  // Dense, by dense index. [0, num_live) are live.
+  EntityType *types;
+  Vec3 *positions;
+  f32 *rotations;
+  EntityIndex *handles; // Back to the owning slot, for swap removal
+
+  // ShaderID *shader_id;
+  // MaterialID *material_id;
+  // MeshID *mesh_id;
+
+  u32 num_live;
+
+  // Sparse, by slot. Slot 0 is reserved for nil.
+  u32 *generations;
+  u32 *slot_to_dense; // For a free slot, the next free slot instead. 0 ends the list.
+  bool *slot_live;
+
+  u32 free_head;
+  u32 num_slots; // Slots handed out at least once, including slot 0
+  u32 capacity;  // For both the dense and sparse arrays
+};
+
+inline void entities_reserve(Entities *entities, u32 capacity) {
+  if (capacity <= entities->capacity) {
+    return;
+  }
+  assert(capacity <= MAX_NUM_ENTITY_SLOTS);
+
+  entities->types = (EntityType *)realloc(entities->types, capacity * sizeof(EntityType));
+  entities->positions = (Vec3 *)realloc(entities->positions, capacity * sizeof(Vec3));
+  entities->rotations = (f32 *)realloc(entities->rotations, capacity * sizeof(f32));
+  entities->handles = (EntityIndex *)realloc(entities->handles, capacity * sizeof(EntityIndex));
+  entities->generations = (u32 *)realloc(entities->generations, capacity * sizeof(u32));
+  entities->slot_to_dense = (u32 *)realloc(entities->slot_to_dense, capacity * sizeof(u32));
+  entities->slot_live = (bool *)realloc(entities->slot_live, capacity * sizeof(bool));
+  assert(entities->types && entities->positions && entities->rotations && entities->handles);
+  assert(entities->generations && entities->slot_to_dense && entities->slot_live);
+
+  entities->capacity = capacity;
+}
+
+// Heap allocated, free with destroy_entities. Grows past initial_capacity as needed.
+inline Entities create_entities(u32 initial_capacity) {
+  Entities entities;
+  memset(&entities, 0, sizeof(entities));
+
+  // Room for the nil slot plus at least one entity
+  entities_reserve(&entities, initial_capacity < 2 ? 2 : initial_capacity);
+  entities.generations[0] = 0;
+  entities.slot_to_dense[0] = 0;
+  entities.slot_live[0] = false;
+  entities.num_slots = 1;
+  return entities;
+}
+
+inline void destroy_entities(Entities *entities) {
+  free(entities->types);
+  free(entities->positions);
+  free(entities->rotations);
+  free(entities->handles);
+  free(entities->generations);
+  free(entities->slot_to_dense);
+  free(entities->slot_live);
+  memset(entities, 0, sizeof(Entities));
+}
+
+inline bool entities_valid(const Entities *entities, EntityIndex e) {
+  u32 slot = entity_index_slot(e);
+  return slot != 0 && slot < entities->num_slots && entities->slot_live[slot] &&
+         entities->generations[slot] == entity_index_generation(e);
+}
+
+// Return the handle of the added entity. Its components are zeroed.
+inline EntityIndex entities_add(Entities *entities) {
+  u32 slot = entities->free_head;
+  if (slot != 0) {
+    entities->free_head = entities->slot_to_dense[slot];
+  } else {
+    if (entities->num_slots == entities->capacity) {
+      assert(entities->capacity < MAX_NUM_ENTITY_SLOTS && "Out of space for non nil entities");
+      u32 capacity = 2 * entities->capacity;
+      entities_reserve(entities, capacity < MAX_NUM_ENTITY_SLOTS ? capacity : MAX_NUM_ENTITY_SLOTS);
+    }
+    slot = entities->num_slots++;
+    entities->generations[slot] = 0;
+  }
+
+  // num_live < num_slots <= capacity, so the dense arrays have room
+  u32 dense = entities->num_live++;
+  EntityIndex e = make_entity_index(slot, entities->generations[slot]);
+  entities->slot_to_dense[slot] = dense;
+  entities->slot_live[slot] = true;
+
+  entities->types[dense] = ENTITY_NIL;
+  entities->positions[dense] = vec3(0.0f, 0.0f, 0.0f);
+  entities->rotations[dense] = 0.0f;
+  entities->handles[dense] = e;
+  return e;
+}
+
+// Removing a stale or nil handle is a no-op.
+inline void entities_remove(Entities *entities, EntityIndex e) {
+  if (!entities_valid(entities, e)) {
+    return;
+  }
+
+  u32 slot = entity_index_slot(e);
+  u32 dense = entities->slot_to_dense[slot];
+  u32 last = --entities->num_live;
+
+  // Swap the last live entity into the hole
+  if (dense != last) {
+    entities->types[dense] = entities->types[last];
+    entities->positions[dense] = entities->positions[last];
+    entities->rotations[dense] = entities->rotations[last];
+    entities->handles[dense] = entities->handles[last];
+    entities->slot_to_dense[entity_index_slot(entities->handles[last])] = dense;
+  }
+
+  entities->generations[slot] = next_entity_generation(entities->generations[slot]);
+  entities->slot_live[slot] = false;
+  entities->slot_to_dense[slot] = entities->free_head;
+  entities->free_head = slot;
+}
+
+// Dense index of a live entity. Only stable until the next remove.
+inline u32 entities_dense_index(const Entities *entities, EntityIndex e) {
+  assert(entities_valid(entities, e));
+  return entities->slot_to_dense[entity_index_slot(e)];
+}
+
+inline Vec3 *entities_position(Entities *entities, EntityIndex e) {
+  return &entities->positions[entities_dense_index(entities, e)];
+}
+
+inline f32 *entities_rotation(Entities *entities, EntityIndex e) {
+  return &entities->rotations[entities_dense_index(entities, e)];
+}
+
+inline EntityType *entities_type(Entities *entities, EntityIndex e) {
+  return &entities->types[entities_dense_index(entities, e)];
+}
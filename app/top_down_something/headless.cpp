@@ -0,0 +1,250 @@
+// Runs the bullet hell sim with no window and no GPU, driven by scripted inputs.
+// Reports per system timings and peak memory. Use it to catch sim performance regressions
+// and for long soak runs.
+//
+// Usage: bullet_hell_headless [--ticks N] [--dt SECONDS] [--seed N] [--extra-emitters N] [--threads N]
+//                             [--record PATH | --replay PATH]
+//
+// --record saves the scripted run's intents and per tick state hashes. --replay feeds a recording
+// back through the sim, from the game or from --record, and stops at the first tick whose state
+// hash differs. A replay takes its tick count, dt and seed from the recording. --extra-emitters
+// must match the recorded run.
+//
+// --threads N runs bullets and collision on a job system with N threads. 0, the default, runs
+// serially. The results are identical either way, so a recording replays at any thread count.
+//
+// Built with HEADLESS_COUNT_ALLOCATIONS (glibc only, not under ASan or TSan), heap allocations after
+// the first tick are counted and should be 0 outside of --record, whose recording grows as it goes.
+// Per step temporaries come from the sim's frame arena, whose pushes are always reported.
+
+#include "bullet_hell_sim.h"
+#include "input_recording.h"
+#include "jobs.h"
+#include "timing.h"
+#include "tuke_engine.h"
+
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// Sanitizers replace malloc and friends themselves, and forwarding to glibc's behind their back breaks them
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define HEADLESS_SANITIZED (1)
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define HEADLESS_SANITIZED (1)
+#endif
+#endif
+
+// Replaces malloc, calloc and realloc with counting wrappers around glibc's own
+#if defined(HEADLESS_COUNT_ALLOCATIONS) && defined(__GLIBC__) && !defined(HEADLESS_SANITIZED)
+#define COUNT_HEAP_ALLOCATIONS (1)
+static std::atomic<u64> num_heap_allocations = 0;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) noexcept {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+#else
+#define COUNT_HEAP_ALLOCATIONS (0)
+#endif
+
+static u64 heap_allocation_count() {
+#if COUNT_HEAP_ALLOCATIONS
+  return num_heap_allocations.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
+// Deterministic stand-in for a player: weaves around the arena and taps the ability every few seconds.
+static PlayerIntent scripted_player_intent(u64 tick) {
+  f32 s = (f32)tick * 0.01f;
+  Vec3 movement_vector = vec3(sinf(s), cosf(1.3f * s), 0.0f);
+  f32 len = sqrtf(movement_vector.x * movement_vector.x + movement_vector.y * movement_vector.y);
+  if (len > EPSILON) {
+    movement_vector = scale_v3(movement_vector, 1.0f / len);
+  }
+
+  u64 phase = tick % 240;
+  u32 flags = PLAYER_INTENT_NONE;
+  flags |= (phase >= 200 && phase < 230) * PLAYER_INTENT_ACTIVATE_ABILITY;
+  flags |= (phase == 230) * PLAYER_INTENT_RELEASE_ABILITY;
+
+  PlayerIntent player_intent{
+      .movement_vector = movement_vector,
+      .flags = flags,
+  };
+  return player_intent;
+}
+
+static void print_timing(const char *name, const TimingAccumulator *timing) {
+  printf(
+      "%-10s mean %8.4f ms   min %8.4f ms   max %8.4f ms\n", name, timing_mean_ms(timing), ns_to_ms(timing->min_ns),
+      ns_to_ms(timing->max_ns)
+  );
+}
+
+// Peak resident set size in KiB
+static u64 peak_rss_kib() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return (u64)usage.ru_maxrss / 1024; // bytes on macOS
+#else
+  return (u64)usage.ru_maxrss; // KiB on Linux
+#endif
+}
+
+int main(int argc, char **argv) {
+  u64 num_ticks = 60 * 120;
+  f32 dt = BULLET_HELL_SIM_DT;
+  u64 seed = BULLET_HELL_SEED;
+  u32 num_extra_emitters = 0;
+  u32 num_threads = 0;
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+      num_ticks = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+      dt = strtof(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--extra-emitters") == 0 && i + 1 < argc) {
+      num_extra_emitters = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--ticks N] [--dt SECONDS] [--seed N] [--extra-emitters N] [--threads N] "
+          "[--record PATH | --replay PATH]\n",
+          argv[0]
+      );
+      return 1;
+    }
+  }
+
+  if (record_path && replay_path) {
+    fprintf(stderr, "main: --record and --replay are exclusive\n");
+    return 1;
+  }
+
+  InputRecording recording;
+  if (replay_path) {
+    if (!load_input_recording(&recording, replay_path)) {
+      return 1;
+    }
+    num_ticks = recording.num_frames;
+    dt = recording.dt;
+    seed = recording.seed;
+  } else {
+    recording = create_input_recording(seed, dt);
+  }
+
+  // Same size as PLAYER_SIDE_LENGTH_METERS, which lives with the windowed game.
+  JobSystem *jobs = num_threads ? create_job_system(num_threads) : NULL;
+  BulletHellSim sim = create_bullet_hell_sim(0.6f, seed, jobs);
+
+  // Extra spirals, staggered so they don't all fire on the same tick, to push the bullet count up.
+  u32 max_extra_emitters = MAX_NUM_BULLET_EMITTERS - sim.emitter_manager.num_emitters;
+  if (num_extra_emitters > max_extra_emitters) {
+    fprintf(stderr, "main: clamping --extra-emitters %u to %u\n", num_extra_emitters, max_extra_emitters);
+    num_extra_emitters = max_extra_emitters;
+  }
+  for (u32 i = 0; i < num_extra_emitters; i++) {
+    Vec2 offset = vec2(0.1f * (f32)(i % 8) - 0.35f, 0.0f);
+    add_bullet_emitter(&sim.emitter_manager, sim.spiral_pattern, 0, offset, 0.05 * i);
+  }
+
+  // Hashing only happens when recording or replaying. It shows up in Wall, not in the per system timings.
+  bool diverged = false;
+  u64 heap_allocations_at_tick1 = 0;
+  u64 t_start = get_time_ns();
+  for (u64 tick = 0; tick < num_ticks; tick++) {
+    if (tick == 1) {
+      heap_allocations_at_tick1 = heap_allocation_count();
+    }
+    if (replay_path) {
+      PlayerIntent player_intent = input_frame_to_player_intent(&recording.frames[tick]);
+      bullet_hell_sim_step(&sim, player_intent, dt);
+      if (!check_replay_state_hash(&recording, (u32)tick, hash_bullet_hell_sim(&sim))) {
+        diverged = true;
+        num_ticks = tick + 1;
+        break;
+      }
+    } else {
+      PlayerIntent player_intent = scripted_player_intent(tick);
+      bullet_hell_sim_step(&sim, player_intent, dt);
+      if (record_path) {
+        record_input_frame(&recording, player_intent_to_input_frame(player_intent), hash_bullet_hell_sim(&sim));
+      }
+    }
+  }
+  u64 t_end = get_time_ns();
+  u64 steady_heap_allocations = num_ticks > 1 ? heap_allocation_count() - heap_allocations_at_tick1 : 0;
+
+  f64 total_ms = ns_to_ms(t_end - t_start);
+  printf("Threads:    %u\n", jobs ? jobs->num_threads : 1);
+  printf("Ticks:      %llu (dt %.4f s, sim time %.2f s)\n", (unsigned long long)num_ticks, dt, sim.t);
+  printf("Wall:       %.1f ms, %.0f ticks/s\n", total_ms, (f64)num_ticks / (total_ms * 1e-3));
+  print_timing("player", &sim.timings.player);
+  print_timing("emitters", &sim.timings.emitters);
+  print_timing("bullets", &sim.timings.bullets);
+  print_timing("collision", &sim.timings.collision);
+  print_timing("total", &sim.timings.total);
+  printf(
+      "Bullets:    peak %u live, %u spawns dropped\n", sim.peak_live_bullets, sim.bullet_manager->num_dropped_spawns
+  );
+  printf("Health:     %u / %u\n", sim.player.current_health, sim.player.max_health);
+  printf("Peak RSS:   %llu KiB\n", (unsigned long long)peak_rss_kib());
+  MemoryArenaStats arena0 = sim.frame_arena.arenas[0].stats;
+  MemoryArenaStats arena1 = sim.frame_arena.arenas[1].stats;
+  printf(
+      "Step arena: peak %llu bytes, %llu commits, %llu pushes\n",
+      (unsigned long long)(arena0.peak_used > arena1.peak_used ? arena0.peak_used : arena1.peak_used),
+      (unsigned long long)(arena0.num_commits + arena1.num_commits),
+      (unsigned long long)(arena0.num_pushes + arena1.num_pushes)
+  );
+  if (COUNT_HEAP_ALLOCATIONS) {
+    printf("Heap allocs: %llu after the first tick\n", (unsigned long long)steady_heap_allocations);
+  }
+  printf("State hash: %016llx\n", (unsigned long long)hash_bullet_hell_sim(&sim));
+
+  bool ok = !diverged;
+  if (record_path) {
+    ok = save_input_recording(&recording, record_path);
+  }
+
+  destroy_input_recording(&recording);
+  destroy_bullet_hell_sim(&sim);
+  if (jobs) {
+    destroy_job_system(jobs);
+  }
+  return ok ? 0 : 1;
+}
@@ -1,5 +1,7 @@
 #include "camera.h"
 #include "generated_shader_utils.h"
+#include "input_recording.h"
+#include "jobs.h"
 #include "opengl_base.h"
 #include "scene_manager.h"
 #include "tilemap.h"
@@ -7,28 +9,31 @@
 
 #include <OpenGL/OpenGL.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bullet_hell.h"
 #include "topdown.h"
 
-int main() {
+int main(int argc, char **argv) {
+  // --record-bullet-hell <path> captures the bullet hell sim's inputs, to replay with bullet_hell_headless
+  const char *bullet_hell_recording_path = NULL;
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record-bullet-hell") == 0 && i + 1 < argc) {
+      bullet_hell_recording_path = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--record-bullet-hell PATH]\n", argv[0]);
+      return 1;
+    }
+  }
+
   // Global State
   const u32 WINDOW_WIDTH = 1600;
   const u32 WINDOW_HEIGHT = 1200;
   GlobalState global_state = create_global_state(WINDOW_WIDTH, WINDOW_HEIGHT);
 
-  // Tilemaps
-  u32 num_tiles = tilemap0.level_height * tilemap0.level_width;
-  u32 num_vertices = num_tiles * 6;
-  u32 tilemap_vertices_sizes_bytes = num_vertices * sizeof(TileVertex);
-  TileVertex *tilemap_vertices = (TileVertex *)malloc(tilemap_vertices_sizes_bytes);
-  tilemap_generate_vertices(&tilemap0, tilemap_vertices);
-
-  u32 num_tiles1 = tilemap1.level_height * tilemap1.level_width;
-  u32 num_vertices1 = num_tiles1 * 6;
-  u32 tilemap_vertices_sizes_bytes1 = num_vertices1 * sizeof(TileVertex);
-  TileVertex *tilemap1_vertices = (TileVertex *)malloc(tilemap_vertices_sizes_bytes1);
-  tilemap_generate_vertices(&tilemap1, tilemap1_vertices);
+  // One thread per core, this thread included. Also preloads scenes in the background.
+  JobSystem *jobs = create_job_system(0);
+  global_state.scene_manager.jobs = jobs;
 
   Camera camera = create_camera(CAMERA_TYPE_2D);
   camera.position.z = OVERWORLD_CAMERA_Z0;
@@ -57,25 +62,13 @@ int main() {
   gl_renderer_push_program(&global_state.renderer, SHADER_ID_OVERWORLD_OVERLAY, overworld_overlay_program);
   gl_renderer_push_program(&global_state.renderer, SHADER_ID_VISION_CONE, vision_cone_program);
 
-  // Meshes
-  GLMesh tilemap_mesh = create_gl_mesh_with_vertex_layout(
-      (f32 *)tilemap_vertices, tilemap_vertices_sizes_bytes, num_vertices, VERTEX_LAYOUT_BINDING0VERTEX_VEC2_VEC3_UINT,
-      GL_STATIC_DRAW
-  );
-
-  GLMesh tilemap1_mesh = create_gl_mesh_with_vertex_layout(
-      (f32 *)tilemap1_vertices, tilemap_vertices_sizes_bytes1, num_vertices1,
-      VERTEX_LAYOUT_BINDING0VERTEX_VEC2_VEC3_UINT, GL_STATIC_DRAW
-  );
-
+  // Meshes. Tilemap meshes are built by the overworld scenes' hooks.
   GLMesh player_mesh = create_gl_mesh_with_vertex_layout(
       player_vertices, sizeof(player_vertices), 6, VERTEX_LAYOUT_BINDING0VERTEX_VEC3_VEC2, GL_STATIC_DRAW
   );
 
   GLMesh fullscreen_quad_mesh = create_gl_mesh_with_vertex_layout(NULL, 0, 3, VERTEX_LAYOUT_NULL, GL_STATIC_DRAW);
 
-  gl_renderer_push_mesh(&global_state.renderer, MESH_TILEMAP, tilemap_mesh);
-  gl_renderer_push_mesh(&global_state.renderer, MESH_TILEMAP1, tilemap1_mesh);
   gl_renderer_push_mesh(&global_state.renderer, MESH_PLAYER, player_mesh);
   gl_renderer_push_mesh(&global_state.renderer, MESH_FULLSCREEN_QUAD, fullscreen_quad_mesh);
 
@@ -114,23 +107,26 @@ int main() {
   gl_renderer_push_material(&global_state.renderer, MATERIAL_FULLSCREEN_QUAD, fullscreen_quad_material);
 
   const Vec3 PLAYER_POSITION0(camera.position.x, camera.position.y, 0.0f);
-  Entities entities = create_entities();
+  Entities entities = create_entities(INITIAL_ENTITIES_CAPACITY);
   EntityIndex player_index = entities_add(&entities);
-  entities.positions[player_index.idx] = PLAYER_POSITION0;
+  *entities_type(&entities, player_index) = ENTITY_PLAYER;
+  *entities_position(&entities, player_index) = PLAYER_POSITION0;
 
   // Scenes
   OverworldSceneData scene0_data{
       .camera_mode = CAMERA_MODE_OVERWORLD,
+      .entities = &entities,
       .player_index = player_index,
       .player_rotation_simulation = 0.0f,
       .player_rotation_render = 0.0f,
       .camera = camera,
       .tilemap = &tilemap0,
+      .tilemap_vertices = NULL,
+      .load_arena = create_memory_arena(OVERWORLD_LOAD_ARENA_RESERVE),
       .other_scene = SCENE1,
       .just_transitioned = false,
       .vp_ubo = vp_ubo,
       .player_model_ubo = player_model_ubo,
-      .tilemap_mesh = tilemap_mesh,
       .tilemap_material = tilemap_material,
       .render_target = overworld_render_target,
       .fullscreen_quad_mesh = fullscreen_quad_mesh,
@@ -140,16 +136,18 @@ int main() {
 
   OverworldSceneData scene1_data{
       .camera_mode = CAMERA_MODE_OVERWORLD,
+      .entities = &entities,
       .player_index = player_index,
       .player_rotation_simulation = 0.0f,
       .player_rotation_render = 0.0f,
       .camera = camera,
       .tilemap = &tilemap1,
+      .tilemap_vertices = NULL,
+      .load_arena = create_memory_arena(OVERWORLD_LOAD_ARENA_RESERVE),
       .other_scene = SCENE0,
       .just_transitioned = false,
       .vp_ubo = vp_ubo,
       .player_model_ubo = player_model_ubo,
-      .tilemap_mesh = tilemap1_mesh,
       .tilemap_material = tilemap_material,
       .render_target = overworld_render_target,
       .fullscreen_quad_mesh = fullscreen_quad_mesh,
@@ -159,16 +157,22 @@ int main() {
 
   Scene scene0 = create_scene(overworld_update, overworld_draw, &scene0_data);
   Scene scene1 = create_scene(overworld_update, overworld_draw, &scene1_data);
+  scene_set_hooks(&scene0, overworld_enter, overworld_exit, overworld_preload);
+  scene_set_hooks(&scene1, overworld_enter, overworld_exit, overworld_preload);
 
-  BulletHellSceneData bullet_hell_scene_data = create_bullet_hell_scene(vp_ubo);
+  InputRecording bullet_hell_recording = create_input_recording(BULLET_HELL_SEED, BULLET_HELL_SIM_DT);
+  BulletHellSceneData bullet_hell_scene_data =
+      create_bullet_hell_scene(vp_ubo, bullet_hell_recording_path ? &bullet_hell_recording : NULL, jobs);
   Scene scene_bullet_hell = create_scene(bullet_hell_update, bullet_hell_draw, &bullet_hell_scene_data);
+  scene_set_hooks(&scene_bullet_hell, bullet_hell_enter, NULL, bullet_hell_preload);
 
   // Register scenes
   global_state.scene_manager.scene_registry[SCENE0] = &scene0;
   global_state.scene_manager.scene_registry[SCENE1] = &scene1;
   global_state.scene_manager.scene_registry[SCENE_BULLET_HELL] = &scene_bullet_hell;
 
-  set_base_scene(&global_state.scene_manager, &scene0);
+  // Enters scene0, which starts preloading scene1
+  set_base_scene(&global_state.scene_manager, &scene0, &global_state);
 
   // Main loop
   f64 t0 = glfwGetTime();
@@ -187,15 +191,24 @@ int main() {
     assert(current_scene != NULL);
     current_scene->update(current_scene->data, &global_state, dt);
     current_scene->render(&global_state.renderer, current_scene->data);
-    handle_scene_action(&global_state.scene_manager);
+    handle_scene_action(&global_state.scene_manager, &global_state);
 
     glfwSwapBuffers(global_state.window);
   }
 
   // Cleanup
-  free(bullet_hell_scene_data.bullet_manager);
+  wait_for_scene_preloads(&global_state.scene_manager);
+  destroy_memory_arena(&scene0_data.load_arena);
+  destroy_memory_arena(&scene1_data.load_arena);
+  if (bullet_hell_recording_path) {
+    save_input_recording(&bullet_hell_recording, bullet_hell_recording_path);
+  }
+  destroy_input_recording(&bullet_hell_recording);
+  destroy_bullet_hell_scene(&bullet_hell_scene_data);
+  destroy_entities(&entities);
   glDeleteFramebuffers(1, &overworld_render_target.fbo);
   destroy_global_state(&global_state);
+  destroy_job_system(jobs);
   glfwTerminate();
   return 0;
 }
@@ -0,0 +1,197 @@
+// Serial vs job system versions of the heavy per frame loops:
+//  - update_bullets, evaluate and compact a full BulletManager
+//  - collect_bullet_hits, the player vs bullets overlap list
+//  - tilemap_generate_vertices on a large map
+// Every parallel run is checked bit for bit against the serial output, then timed at 1, 2, 4, ..., N
+// threads. Speedups are against the serial function, not the 1 thread job system.
+//
+// Usage: parallel_bench [--threads N] [--repeats N] [--tilemap-side N]
+
+#include "bullet_hell_sim.h"
+#include "bullet_patterns.h"
+#include "jobs.h"
+#include "statistics.h"
+#include "tilemap.h"
+#include "timing.h"
+#include "tuke_engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct BenchBullets {
+  const BulletManager *snapshot;
+  const BulletPatternTable *table;
+  f64 t;
+  f32 dt;
+  Vec2 player_pos;
+};
+
+// Every live column of the first n bullets
+static bool bullets_equal(const BulletManager *a, const BulletManager *b) {
+  u32 n = a->num_live_bullets;
+  return n == b->num_live_bullets && memcmp(a->origin_x, b->origin_x, n * sizeof(f32)) == 0 &&
+         memcmp(a->origin_y, b->origin_y, n * sizeof(f32)) == 0 && memcmp(a->dir_x, b->dir_x, n * sizeof(f32)) == 0 &&
+         memcmp(a->dir_y, b->dir_y, n * sizeof(f32)) == 0 && memcmp(a->t0, b->t0, n * sizeof(f64)) == 0 &&
+         memcmp(a->pattern_index, b->pattern_index, n * sizeof(u16)) == 0 &&
+         memcmp(a->render_data, b->render_data, n * sizeof(BulletRenderData)) == 0;
+}
+
+// A full manager of bullets of every compiled pattern, at random ages, some already outside the arena
+static void fill_bullets(BulletManager *bullet_manager, u32 num_patterns, f64 t, RNG *rng) {
+  memset(bullet_manager, 0, sizeof(BulletManager));
+  for (u32 i = 0; i < MAX_NUM_BULLETS; i++) {
+    f32 angle = random_f32_in_range_xoroshiro128_plus(rng, 0.0f, 2.0f * PI);
+    bullet_manager->origin_x[i] = random_f32_in_range_xoroshiro128_plus(rng, -0.5f, 0.5f) * BULLET_HELL_ARENA_WIDTH;
+    bullet_manager->origin_y[i] = random_f32_in_range_xoroshiro128_plus(rng, -0.5f, 0.5f) * BULLET_HELL_ARENA_HEIGHT;
+    bullet_manager->dir_x[i] = cosf(angle);
+    bullet_manager->dir_y[i] = sinf(angle);
+    bullet_manager->t0[i] = t - random_f32_in_range_xoroshiro128_plus(rng, 0.0f, 4.0f);
+    bullet_manager->pattern_index[i] = (u16)(random_u64_xoroshiro128plus(rng) % num_patterns);
+  }
+  bullet_manager->num_live_bullets = MAX_NUM_BULLETS;
+}
+
+static void print_row(const char *name, u32 num_threads, f64 serial_ms, f64 parallel_ms) {
+  printf(
+      "%-10s %2u threads   serial %8.3f ms   parallel %8.3f ms   %5.2fx\n", name, num_threads, serial_ms, parallel_ms,
+      serial_ms / parallel_ms
+  );
+}
+
+int main(int argc, char **argv) {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  u32 max_threads = online > 0 ? (u32)online : 1;
+  u32 num_repeats = 50;
+  u32 tilemap_side = 1024;
+
+  for (i32 i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      max_threads = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+      num_repeats = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--tilemap-side") == 0 && i + 1 < argc) {
+      tilemap_side = (u32)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--threads N] [--repeats N] [--tilemap-side N]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (max_threads == 0 || max_threads > MAX_NUM_JOB_THREADS || num_repeats == 0 || tilemap_side == 0) {
+    fprintf(stderr, "main: --threads must be in [1, %u], --repeats and --tilemap-side positive\n", MAX_NUM_JOB_THREADS);
+    return 1;
+  }
+  printf("%ld online CPUs, %u bullets, %ux%u tilemap\n", online, MAX_NUM_BULLETS, tilemap_side, tilemap_side);
+
+  // The sim owns the compiled pattern table
+  BulletHellSim sim = create_bullet_hell_sim(0.6f, BULLET_HELL_SEED, NULL);
+  RNG rng = create_rng(0x70617261);
+  const f64 t = 10.0;
+  const f32 dt = BULLET_HELL_SIM_DT;
+  const Vec2 player_pos = vec2(0.0f, -BULLET_HELL_ARENA_HALF_HEIGHT * 0.5f);
+  const Vec2 hit_box = vec2(BULLET_HELL_ARENA_HALF_WIDTH, BULLET_HELL_ARENA_HALF_HEIGHT);
+
+  BulletManager *snapshot = (BulletManager *)malloc(sizeof(BulletManager));
+  BulletManager *serial = (BulletManager *)malloc(sizeof(BulletManager));
+  BulletManager *parallel = (BulletManager *)malloc(sizeof(BulletManager));
+  u32 *serial_hits = (u32 *)malloc(MAX_NUM_BULLETS * sizeof(u32));
+  u32 *parallel_hits = (u32 *)malloc(MAX_NUM_BULLETS * sizeof(u32));
+  fill_bullets(snapshot, sim.bullet_patterns->num_patterns, t, &rng);
+
+  u32 num_tiles = tilemap_side * tilemap_side;
+  u8 *level_map = (u8 *)malloc(num_tiles);
+  for (u32 i = 0; i < num_tiles; i++) {
+    level_map[i] = (u8)(random_u64_xoroshiro128plus(&rng) % 4);
+  }
+  Tilemap tilemap = create_tilemap(tilemap_side, tilemap_side, level_map);
+  TileVertex *serial_vertices = (TileVertex *)malloc((u64)num_tiles * 6 * sizeof(TileVertex));
+  TileVertex *parallel_vertices = (TileVertex *)malloc((u64)num_tiles * 6 * sizeof(TileVertex));
+
+  // Serial baselines
+  TimingAccumulator serial_bullets_timing = {};
+  TimingAccumulator serial_hits_timing = {};
+  TimingAccumulator serial_tilemap_timing = {};
+  u32 num_serial_hits = 0;
+  for (u32 repeat = 0; repeat < num_repeats; repeat++) {
+    memcpy(serial, snapshot, sizeof(BulletManager));
+    u64 t_start = get_time_ns();
+    update_bullets(
+        serial, sim.bullet_patterns, t, dt, player_pos, BULLET_HELL_ARENA_HALF_WIDTH, BULLET_HELL_ARENA_HALF_HEIGHT
+    );
+    timing_accumulate(&serial_bullets_timing, get_time_ns() - t_start);
+
+    t_start = get_time_ns();
+    num_serial_hits = collect_bullet_hits(serial, player_pos, hit_box, serial_hits);
+    timing_accumulate(&serial_hits_timing, get_time_ns() - t_start);
+
+    t_start = get_time_ns();
+    tilemap_generate_vertices(&tilemap, serial_vertices);
+    timing_accumulate(&serial_tilemap_timing, get_time_ns() - t_start);
+  }
+  printf("Serial:    %u of %u bullets survive, %u hits\n", serial->num_live_bullets, MAX_NUM_BULLETS, num_serial_hits);
+
+  bool ok = true;
+  u32 num_threads = 1;
+  while (true) {
+    JobSystem *jobs = create_job_system(num_threads);
+
+    TimingAccumulator bullets_timing = {};
+    TimingAccumulator hits_timing = {};
+    TimingAccumulator tilemap_timing = {};
+    for (u32 repeat = 0; repeat < num_repeats; repeat++) {
+      memcpy(parallel, snapshot, sizeof(BulletManager));
+      u64 t_start = get_time_ns();
+      update_bullets_parallel(
+          jobs, parallel, sim.bullet_patterns, t, dt, player_pos, BULLET_HELL_ARENA_HALF_WIDTH,
+          BULLET_HELL_ARENA_HALF_HEIGHT
+      );
+      timing_accumulate(&bullets_timing, get_time_ns() - t_start);
+
+      t_start = get_time_ns();
+      u32 num_hits = collect_bullet_hits_parallel(jobs, parallel, player_pos, hit_box, parallel_hits);
+      timing_accumulate(&hits_timing, get_time_ns() - t_start);
+
+      memset(parallel_vertices, 0, (u64)num_tiles * 6 * sizeof(TileVertex));
+      t_start = get_time_ns();
+      tilemap_generate_vertices_parallel(jobs, &tilemap, parallel_vertices);
+      timing_accumulate(&tilemap_timing, get_time_ns() - t_start);
+
+      if (repeat == 0) {
+        bool bullets_ok = bullets_equal(serial, parallel);
+        bool hits_ok =
+            num_hits == num_serial_hits && memcmp(serial_hits, parallel_hits, num_hits * sizeof(u32)) == 0;
+        bool tilemap_ok = memcmp(serial_vertices, parallel_vertices, (u64)num_tiles * 6 * sizeof(TileVertex)) == 0;
+        if (!bullets_ok || !hits_ok || !tilemap_ok) {
+          fprintf(
+              stderr, "main: %u threads differ from serial: bullets %s, hits %s, tilemap %s\n", num_threads,
+              bullets_ok ? "ok" : "DIFFER", hits_ok ? "ok" : "DIFFER", tilemap_ok ? "ok" : "DIFFER"
+          );
+          ok = false;
+        }
+      }
+    }
+
+    print_row("bullets", num_threads, ns_to_ms(serial_bullets_timing.min_ns), ns_to_ms(bullets_timing.min_ns));
+    print_row("hits", num_threads, ns_to_ms(serial_hits_timing.min_ns), ns_to_ms(hits_timing.min_ns));
+    print_row("tilemap", num_threads, ns_to_ms(serial_tilemap_timing.min_ns), ns_to_ms(tilemap_timing.min_ns));
+    destroy_job_system(jobs);
+
+    if (num_threads == max_threads) {
+      break;
+    }
+    num_threads = 2 * num_threads < max_threads ? 2 * num_threads : max_threads;
+  }
+  printf("Outputs match serial: %s\n", ok ? "yes" : "NO");
+
+  free(snapshot);
+  free(serial);
+  free(parallel);
+  free(serial_hits);
+  free(parallel_hits);
+  free(level_map);
+  free(serial_vertices);
+  free(parallel_vertices);
+  destroy_bullet_hell_sim(&sim);
+  return ok ? 0 : 1;
+}
@@ -3,7 +3,10 @@
 #include "window.h"
 
 #include "camera.h"
+#include "entities.h"
+#include "generated_shader_utils.h"
 #include "linalg.h"
+#include "memory_arena.h"
 #include "opengl_base.h"
 #include "scene_manager.h"
 #include "tilemap.h"
@@ -20,7 +23,8 @@
 #define PLAYER_SIDE_LENGTH_METERS (0.6f)
 #define PLAYER_INTERACTION_DISTANCE (1.0f)
 #define PLAYER_INTERACTION_FOV (1.04f) // Radians, around 60 degrees
-#define NUM_ENTITIES (64)
+#define INITIAL_ENTITIES_CAPACITY (64)
+#define OVERWORLD_LOAD_ARENA_RESERVE (256 * 1024 * 1024) // Address space only
 
 const f32 OVERWORLD_CAMERA_Z0 = 15.0f;
 const f32 PLAYER_INTERACTION_HALF_FOV = PLAYER_INTERACTION_FOV / 2.0f;
@@ -125,61 +129,6 @@ enum MaterialID {
   MATERIAL_FULLSCREEN_QUAD,
 };
 
-enum EntityType {
-  ENTITY_NIL = 0,
-  ENTITY_PLAYER,
-  ENTITY_NPC,
-};
-
-// Trying out a technique where 0 is a sentinel failure value. Index 0 into these arrays is always invalid.
-// ZII.
-struct EntityIndex {
-  u32 idx;
-};
-
-struct Entities {
-  EntityType types[NUM_ENTITIES];
-  bool active[NUM_ENTITIES];
-  Vec3 positions[NUM_ENTITIES];
-  f32 rotations[NUM_ENTITIES];
-
-  // ShaderID shader_id[NUM_ENTITIES];
-  // MaterialID material_id[NUM_ENTITIES];
-  // MeshID mesh_id[NUM_ENTITIES];
-
-  EntityIndex next_inactive;
-};
-
-inline Entities create_entities() {
-  Entities entities;
-  memset(&entities, 0, sizeof(entities));
-  entities.next_inactive.idx = 1;
-  return entities;
-}
-
-// Return the index of the added entity.
-inline EntityIndex entities_add(Entities *entities) {
-
-  u32 next_inactive = entities->next_inactive.idx;
-  if (next_inactive < NUM_ENTITIES && !entities->active[next_inactive]) {
-    entities->next_inactive.idx++;
-    return {
-        .idx = next_inactive,
-    };
-  }
-
-  for (u32 i = 1; i < NUM_ENTITIES; i++) {
-    if (entities->active[i] == false) {
-      entities->next_inactive.idx = i + 1;
-      return {
-          .idx = i,
-      };
-    }
-  }
-
-  assert(false && "Out of space for non nil entities");
-}
-
 enum SceneID { SCENE0, SCENE1, SCENE_BULLET_HELL, NUM_SCENES, SCENE_NONE };
 
 enum CameraMode {
@@ -190,7 +139,7 @@ enum CameraMode {
 struct OverworldSceneData {
   // Is this impure? This is half debug?
   CameraMode camera_mode;
-  Entities entities;
+  Entities *entities; // Shared between overworld scenes
 
   EntityIndex player_index;
 
@@ -200,6 +149,8 @@ struct OverworldSceneData {
 
   Camera camera;
   Tilemap *tilemap;
+  TileVertex *tilemap_vertices; // Built by overworld_preload, uploaded by overworld_enter
+  MemoryArena load_arena;       // Holds tilemap_vertices. Reset after the upload, stays committed.
 
   SceneID other_scene;
   bool just_transitioned;
@@ -340,7 +291,7 @@ inline void overworld_update(void *scene_data_void_ptr, void *global_state_void_
   case CAMERA_MODE_OVERWORLD: {
     // Move player.
     const f32 SPEED = 5.0f;
-    Vec3 *player_pos = &scene_data->entities.positions[scene_data->player_index.idx];
+    Vec3 *player_pos = entities_position(scene_data->entities, scene_data->player_index);
     Vec2 movement_vector = scale_v2(player_intent.key_movement_vector, SPEED * dt);
     u8 x_tile, y_tile;
     move_player_in_tilemap(movement_vector, scene_data->tilemap, player_pos, &x_tile, &y_tile);
@@ -449,7 +400,7 @@ inline void overworld_draw(const GLRenderer *renderer, const void *scene_data_vo
   Vec3 player_scale = vec3(PLAYER_SIDE_LENGTH_METERS, PLAYER_SIDE_LENGTH_METERS, PLAYER_SIDE_LENGTH_METERS);
   Mat4 player_model = mat4();
   scale_m4(player_scale, &player_model);
-  translate_m4(scene_data->entities.positions[scene_data->player_index.idx], &player_model);
+  translate_m4(*entities_position(scene_data->entities, scene_data->player_index), &player_model);
   // FIXME no rotations yet.
   // player_model = glm::rotate(player_model, scene_data->player_rotation_render, Vec3(0.0f, 0.0f, 1.0f));
 
@@ -480,3 +431,36 @@ inline void overworld_draw(const GLRenderer *renderer, const void *scene_data_vo
   glBindTexture(GL_TEXTURE_2D, scene_data->render_target.texture.texture);
   draw_gl_mesh(&scene_data->fullscreen_quad_mesh, scene_data->fullscreen_quad_material);
 }
+
+// Scene hooks. The tilemap mesh only exists on the GPU while the scene is current. Entering a scene
+// starts preloading the scene it transitions to, so its vertices are ready by the time it's needed.
+
+inline void overworld_preload(void *scene_data_void_ptr) {
+  OverworldSceneData *scene_data = (OverworldSceneData *)scene_data_void_ptr;
+  const Tilemap *tilemap = scene_data->tilemap;
+  u32 num_vertices = tilemap->level_width * tilemap->level_height * 6;
+  arena_reset(&scene_data->load_arena);
+  scene_data->tilemap_vertices = ARENA_PUSH_ARRAY(&scene_data->load_arena, TileVertex, num_vertices);
+  tilemap_generate_vertices(tilemap, scene_data->tilemap_vertices);
+}
+
+inline void overworld_enter(void *scene_data_void_ptr, void *global_state_void_ptr) {
+  GlobalState *global_state = (GlobalState *)global_state_void_ptr;
+  OverworldSceneData *scene_data = (OverworldSceneData *)scene_data_void_ptr;
+
+  u32 num_vertices = scene_data->tilemap->level_width * scene_data->tilemap->level_height * 6;
+  scene_data->tilemap_mesh = create_gl_mesh_with_vertex_layout(
+      (f32 *)scene_data->tilemap_vertices, num_vertices * sizeof(TileVertex), num_vertices,
+      VERTEX_LAYOUT_BINDING0VERTEX_VEC2_VEC3_UINT, GL_STATIC_DRAW
+  );
+  arena_reset(&scene_data->load_arena);
+  scene_data->tilemap_vertices = NULL;
+
+  request_scene_preload(&global_state->scene_manager, scene_data->other_scene);
+}
+
+inline void overworld_exit(void *scene_data_void_ptr, void *global_state_void_ptr) {
+  (void)global_state_void_ptr;
+  OverworldSceneData *scene_data = (OverworldSceneData *)scene_data_void_ptr;
+  destroy_gl_mesh(&scene_data->tilemap_mesh);
+}
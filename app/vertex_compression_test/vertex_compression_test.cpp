@@ -0,0 +1,189 @@
+#include "vertex_compression.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Odd so the array encoders' scalar tails run too
+#define NUM_RANDOM_INPUTS (100003)
+#define F32_SWEEP_STEP (7919)
+
+static u32 next_random(u32 *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state;
+}
+
+// Mostly [-2, 2] so every format clamps some, with the edge cases mixed in
+static f32 random_input(u32 *state) {
+  u32 r = next_random(state);
+  switch (r % 16) {
+  case 0: {
+    u32 bits = next_random(state);
+    f32 f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  case 1:
+    return 0.0f;
+  case 2:
+    return -0.0f;
+  case 3:
+    return NAN;
+  case 4:
+    return 1e-6f * (f32)((r >> 8) % 100);
+  default:
+    return (f32)(r >> 8) / (f32)(1 << 24) * 4.0f - 2.0f;
+  }
+}
+
+static f32 random_signed_unit(u32 *state) { return (f32)next_random(state) / 4294967296.0f * 2.0f - 1.0f; }
+
+static u32 report(const char *name, u32 num_failed) {
+  if (num_failed == 0) {
+    printf("%-40s ok\n", name);
+  } else {
+    printf("%-40s FAILED %u\n", name, num_failed);
+  }
+  return num_failed;
+}
+
+// The SSE2 paths of the _array encoders must give the same bits as the scalar encoders
+static u32 test_arrays_match_scalar() {
+  u32 state = 1;
+  Vec4 *v4s = (Vec4 *)malloc(NUM_RANDOM_INPUTS * sizeof(Vec4));
+  Vec3 *v3s = (Vec3 *)malloc(NUM_RANDOM_INPUTS * sizeof(Vec3));
+  Vec2 *v2s = (Vec2 *)malloc(NUM_RANDOM_INPUTS * sizeof(Vec2));
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    v4s[i] = vec4(random_input(&state), random_input(&state), random_input(&state), random_input(&state));
+    v3s[i] = vec3(random_input(&state), random_input(&state), random_input(&state));
+    v2s[i] = vec2(random_input(&state), random_input(&state));
+  }
+
+  // Strided like an interleaved vertex buffer, every other u32
+  u32 *out = (u32 *)malloc(NUM_RANDOM_INPUTS * 2 * sizeof(u32));
+  u32 stride = 2 * sizeof(u32);
+  u32 num_failed = 0;
+
+  u32 n = 0;
+  encode_unorm8x4_array(v4s, NUM_RANDOM_INPUTS, out, stride);
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    n += out[2 * i] != encode_unorm8x4(v4s[i]);
+  }
+  num_failed += report("encode_unorm8x4_array", n);
+
+  n = 0;
+  encode_unorm10_10_10_2_array(v4s, NUM_RANDOM_INPUTS, out, stride);
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    n += out[2 * i] != encode_unorm10_10_10_2(v4s[i]);
+  }
+  num_failed += report("encode_unorm10_10_10_2_array", n);
+
+  n = 0;
+  encode_snorm16x2_array(v2s, NUM_RANDOM_INPUTS, out, stride);
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    n += out[2 * i] != encode_snorm16x2(v2s[i]);
+  }
+  num_failed += report("encode_snorm16x2_array", n);
+
+  n = 0;
+  encode_half2_array(v2s, NUM_RANDOM_INPUTS, out, stride);
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    n += out[2 * i] != encode_half2(v2s[i]);
+  }
+  num_failed += report("encode_half2_array", n);
+
+  n = 0;
+  encode_octahedral_array(v3s, NUM_RANDOM_INPUTS, out, stride);
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    n += out[2 * i] != encode_octahedral(v3s[i]);
+  }
+  num_failed += report("encode_octahedral_array", n);
+
+  free(out);
+  free(v2s);
+  free(v3s);
+  free(v4s);
+  return num_failed;
+}
+
+// The compiler's _Float16 conversion is the reference. NaNs only have to stay NaNs.
+static u32 test_f32_to_f16() {
+  u32 num_failed = 0;
+  for (u64 bits = 0; bits <= 0xffffffffull; bits += F32_SWEEP_STEP) {
+    u32 b = (u32)bits;
+    f32 f;
+    memcpy(&f, &b, sizeof(f));
+    u16 got = f32_to_f16(f);
+    if (isnan(f)) {
+      num_failed += (got & 0x7c00) != 0x7c00 || (got & 0x03ff) == 0;
+      continue;
+    }
+    _Float16 h = (_Float16)f;
+    u16 want;
+    memcpy(&want, &h, sizeof(want));
+    num_failed += got != want;
+  }
+  return report("f32_to_f16 against _Float16", num_failed);
+}
+
+static u32 test_f16_round_trip() {
+  u32 num_failed = 0;
+  for (u32 bits = 0; bits <= 0xffff; bits++) {
+    u16 b = (u16)bits;
+    _Float16 h;
+    memcpy(&h, &b, sizeof(h));
+    f32 want = (f32)h;
+    f32 got = f16_to_f32(b);
+    if (isnan(want)) {
+      num_failed += !isnan(got);
+      continue;
+    }
+    num_failed += memcmp(&got, &want, sizeof(got)) != 0;
+    num_failed += f32_to_f16(got) != b;
+  }
+  return report("f16_to_f32 round trip", num_failed);
+}
+
+// 16 bits per component keeps unit vectors within a few hundredths of a degree
+static u32 test_octahedral_error() {
+  u32 state = 2;
+  f32 max_error_degrees = 0.0f;
+  for (u32 i = 0; i < NUM_RANDOM_INPUTS; i++) {
+    Vec3 v = vec3(random_signed_unit(&state), random_signed_unit(&state), random_signed_unit(&state));
+    f32 length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (length < 1e-3f) {
+      continue;
+    }
+    v = vec3(v.x / length, v.y / length, v.z / length);
+    Vec3 d = decode_octahedral(encode_octahedral(v));
+    f32 cos_angle = fminf(1.0f, d.x * v.x + d.y * v.y + d.z * v.z);
+    max_error_degrees = fmaxf(max_error_degrees, acosf(cos_angle) * 180.0f / 3.14159265f);
+  }
+  printf("octahedral max error %f degrees\n", max_error_degrees);
+
+  u32 num_failed = max_error_degrees > 0.05f;
+  Vec3 zero = decode_octahedral(encode_octahedral(vec3(0.0f, 0.0f, 0.0f)));
+  num_failed += zero.x != 0.0f || zero.y != 0.0f || zero.z != 1.0f;
+  Vec3 down = decode_octahedral(encode_octahedral(vec3(0.0f, 0.0f, -1.0f)));
+  num_failed += fabsf(down.z + 1.0f) > 1e-6f;
+  return report("octahedral", num_failed);
+}
+
+static u32 test_known_values() {
+  u32 num_failed = 0;
+  num_failed += encode_unorm8x4(vec4(1.0f, 0.0f, 0.5f, 1.0f)) != 0xff8000ff;
+  num_failed += encode_unorm10_10_10_2(vec4(1.0f, 0.0f, 0.0f, 1.0f)) != 0xc00003ff;
+  num_failed += encode_snorm16x2(vec2(-1.0f, 1.0f)) != 0x7fff8001;
+  num_failed += encode_half2(vec2(1.0f, -2.0f)) != 0xc0003c00;
+  return report("known values", num_failed);
+}
+
+int main() {
+  u32 num_failed = 0;
+  num_failed += test_known_values();
+  num_failed += test_arrays_match_scalar();
+  num_failed += test_f32_to_f16();
+  num_failed += test_f16_round_trip();
+  num_failed += test_octahedral_error();
+  return num_failed == 0 ? 0 : 1;
+}
@@ -11,8 +11,11 @@ int main() {
   GLFWwindow *window = create_window(true /* is_vulkan */);
   VulkanTest t = init_vulkan_test(window);
 
+  PhongVertex phong_cube_vertices[num_cube_vertices];
+  pack_phong_cube_vertices(phong_cube_vertices);
+
   BufferManager buffer_manager = create_buffer_manager();
-  VulkanMesh *mesh = UPLOAD_VERTEX_ARRAY(buffer_manager, cube_vertices, num_cube_vertices);
+  VulkanMesh *mesh = UPLOAD_VERTEX_ARRAY(buffer_manager, phong_cube_vertices, num_cube_vertices);
   VulkanMesh *light_mesh = UPLOAD_VERTEX_ARRAY(buffer_manager, cube_position_vertices, num_cube_vertices);
   flush_buffers(&t.ctx, &buffer_manager);
 
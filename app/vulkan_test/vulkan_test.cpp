@@ -41,7 +41,10 @@ int main() {
   const u64 iq_vsizes[] = {sizeof(unit_square_positions), sizeof(quad_positions)};
   VulkanMesh *p_iq =
       upload_arrays(&buffer_manager, iq_varrays, iq_vsizes, 0, 2, unit_square_indices, sizeof(unit_square_indices), 6);
-  VulkanMesh *p_cube = upload_arrays_single(&buffer_manager, cube_vertices, sizeof(cube_vertices), 36, NULL, 0, 0);
+  PhongVertex phong_cube_vertices[num_cube_vertices];
+  pack_phong_cube_vertices(phong_cube_vertices);
+  VulkanMesh *p_cube =
+      upload_arrays_single(&buffer_manager, phong_cube_vertices, sizeof(phong_cube_vertices), 36, NULL, 0, 0);
   flush_buffers(&t.ctx, &buffer_manager);
 
   UniformBufferManager ub_manager = create_uniform_buffer_manager();
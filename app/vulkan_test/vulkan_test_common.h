@@ -2,6 +2,7 @@
 #include "tuke_engine.h"
 
 #include "glfw_vulkan.h"
+#include "vertex_compression.h"
 #include "vulkan/vulkan_base.h"
 
 typedef struct {
@@ -175,3 +176,26 @@ static const u16 f_indices[] = {
 
 static const u32 num_f_indices = ARRAY_SIZE(f_indices);
 // clang-format on
+
+// Vertices as common/phong.vert reads them, 20 bytes instead of cube_vertices' 32
+typedef struct {
+  f32 pos[3];
+  u32 normal; // OCTAHEDRAL
+  u32 uv;     // HALF2
+} PhongVertex;
+static_assert(sizeof(PhongVertex) == 20, "PhongVertex must match the phong vertex layout's stride");
+
+static inline void pack_phong_cube_vertices(PhongVertex *out) {
+  Vec3 normals[num_cube_vertices];
+  Vec2 uvs[num_cube_vertices];
+  for (u32 i = 0; i < num_cube_vertices; i++) {
+    const f32 *v = &cube_vertices[i * 8];
+    out[i].pos[0] = v[0];
+    out[i].pos[1] = v[1];
+    out[i].pos[2] = v[2];
+    normals[i] = vec3(v[3], v[4], v[5]);
+    uvs[i] = vec2(v[6], v[7]);
+  }
+  encode_octahedral_array(normals, num_cube_vertices, &out[0].normal, sizeof(PhongVertex));
+  encode_half2_array(uvs, num_cube_vertices, &out[0].uv, sizeof(PhongVertex));
+}
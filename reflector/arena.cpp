@@ -0,0 +1,104 @@
+#include "arena.h"
+#include "reflector.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Header padded so the first byte of every block is aligned to REFLECTOR_ARENA_DEFAULT_ALIGNMENT
+#define BLOCK_HEADER_SIZE                                                                                              \
+  ((sizeof(ReflectorArenaBlock) + REFLECTOR_ARENA_DEFAULT_ALIGNMENT - 1) &                                             \
+   ~(u64)(REFLECTOR_ARENA_DEFAULT_ALIGNMENT - 1))
+
+static u8 *block_data(ReflectorArenaBlock *block) { return (u8 *)block + BLOCK_HEADER_SIZE; }
+
+static u64 align_up(u64 offset, u64 alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
+
+// Offset of the first address at or after block->used that is aligned. Aligns the address, not the offset, since
+// block data is only REFLECTOR_ARENA_DEFAULT_ALIGNMENT aligned.
+static u64 aligned_offset(ReflectorArenaBlock *block, u64 alignment) {
+  u64 base = (u64)(uintptr_t)block_data(block);
+  return align_up(base + block->used, alignment) - base;
+}
+
+void destroy_reflector_arena(ReflectorArena *arena) {
+  ReflectorArenaBlock *block = arena->current;
+  while (block != NULL) {
+    ReflectorArenaBlock *prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  arena->current = NULL;
+  arena->total_size = 0;
+}
+
+void reflector_arena_reset(ReflectorArena *arena) {
+  ReflectorArenaBlock *largest = arena->current;
+  for (ReflectorArenaBlock *block = arena->current; block != NULL; block = block->prev) {
+    if (block->size > largest->size) {
+      largest = block;
+    }
+  }
+  if (largest == NULL) {
+    return;
+  }
+
+  ReflectorArenaBlock *block = arena->current;
+  while (block != NULL) {
+    ReflectorArenaBlock *prev = block->prev;
+    if (block != largest) {
+      free(block);
+    }
+    block = prev;
+  }
+  largest->prev = NULL;
+  largest->used = 0;
+  arena->current = largest;
+  arena->total_size = largest->size;
+}
+
+void *reflector_arena_push(ReflectorArena *arena, u64 size, u64 alignment) {
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+  ReflectorArenaBlock *block = arena->current;
+  if (block != NULL) {
+    u64 offset = aligned_offset(block, alignment);
+    if (offset + size <= block->size) {
+      block->used = offset + size;
+      return block_data(block) + offset;
+    }
+  }
+
+  // Oversized pushes get a block to themselves. Alignments beyond the block's own need the slack.
+  u64 slack = alignment > REFLECTOR_ARENA_DEFAULT_ALIGNMENT ? alignment : 0;
+  u64 block_size = size + slack > REFLECTOR_ARENA_BLOCK_SIZE ? size + slack : REFLECTOR_ARENA_BLOCK_SIZE;
+  ReflectorArenaBlock *new_block = (ReflectorArenaBlock *)malloc(BLOCK_HEADER_SIZE + block_size);
+  if (new_block == NULL) {
+    fprintf(stderr, "reflector_arena_push: failed to allocate a %llu byte block\n", (unsigned long long)block_size);
+    exit(1);
+  }
+  new_block->prev = block;
+  new_block->size = block_size;
+  new_block->used = 0;
+  arena->current = new_block;
+  arena->total_size += block_size;
+
+  u64 offset = aligned_offset(new_block, alignment);
+  new_block->used = offset + size;
+  return block_data(new_block) + offset;
+}
+
+void *reflector_arena_push_zero(ReflectorArena *arena, u64 size, u64 alignment) {
+  void *memory = reflector_arena_push(arena, size, alignment);
+  memset(memory, 0, size);
+  return memory;
+}
+
+void *reflector_arena_push_copy(ReflectorArena *arena, const void *src, u64 size, u64 alignment) {
+  void *memory = reflector_arena_push(arena, size, alignment);
+  if (size > 0) {
+    memcpy(memory, src, size);
+  }
+  return memory;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "reflector.h"
+
+// ReflectorArena: a bump allocator over a chain of malloc'd blocks. A zeroed ReflectorArena is empty and valid, the
+// first push allocates. Blocks are never moved or reallocated, so pointers stay valid until destroy_reflector_arena
+// frees everything at once. Not thread safe, give each thread its own arena. Separate from the engine's MemoryArena in
+// src/memory_arena.h, which reserves a fixed range up front.
+//
+// Pushes that don't fit in the current block start a new one of at least REFLECTOR_ARENA_BLOCK_SIZE bytes. Running out
+// of memory is fatal, like every other allocation failure in the reflector.
+
+#define REFLECTOR_ARENA_BLOCK_SIZE (64 * 1024)
+#define REFLECTOR_ARENA_DEFAULT_ALIGNMENT (16)
+
+struct ReflectorArenaBlock {
+  ReflectorArenaBlock *prev;
+  u64 size; // Bytes usable after the header
+  u64 used;
+};
+
+struct ReflectorArena {
+  ReflectorArenaBlock *current;
+  u64 total_size; // Sum of block sizes, for reporting
+};
+
+void destroy_reflector_arena(ReflectorArena *arena);
+
+// Frees every block but the largest and empties it, for reusing an arena in a loop without going back to malloc
+void reflector_arena_reset(ReflectorArena *arena);
+
+// alignment must be a power of two. reflector_arena_push leaves the memory uninitialized.
+void *reflector_arena_push(ReflectorArena *arena, u64 size, u64 alignment);
+void *reflector_arena_push_zero(ReflectorArena *arena, u64 size, u64 alignment);
+void *reflector_arena_push_copy(ReflectorArena *arena, const void *src, u64 size, u64 alignment);
+
+#define REFLECTOR_ARENA_PUSH_ARRAY(arena, type, count)                                                                 \
+  ((type *)reflector_arena_push((arena), sizeof(type) * (count), alignof(type)))
+#define REFLECTOR_ARENA_PUSH_ARRAY_ZERO(arena, type, count)                                                            \
+  ((type *)reflector_arena_push_zero((arena), sizeof(type) * (count), alignof(type)))
+#define REFLECTOR_ARENA_PUSH_ARRAY_COPY(arena, type, src, count)                                                       \
+  ((type *)reflector_arena_push_copy((arena), (src), sizeof(type) * (count), alignof(type)))
@@ -0,0 +1,241 @@
+#include "build_cache.h"
+#include "filesystem_utils.h"
+#include "reflector.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FNV_PRIME 0x100000001b3ull
+
+u64 hash_bytes(u64 hash, const void *bytes, u64 length) {
+  const u8 *cursor = (const u8 *)bytes;
+  for (u64 i = 0; i < length; i++) {
+    hash ^= cursor[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static u64 hash_u64(u64 hash, u64 value) { return hash_bytes(hash, &value, sizeof(value)); }
+
+BuildCache open_build_cache(const char *output_path, bool read_enabled) {
+  BuildCache cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.read_enabled = read_enabled;
+
+  const char *last_slash = strrchr(output_path, '/');
+  int dir_len = last_slash ? (int)(last_slash - output_path) : 0;
+  int n = last_slash ? snprintf(cache.dir, sizeof(cache.dir), "%.*s/%s", dir_len, output_path, BUILD_CACHE_DIR_NAME)
+                     : snprintf(cache.dir, sizeof(cache.dir), "%s", BUILD_CACHE_DIR_NAME);
+  if (n < 0 || n >= FULL_PATH_BUFFER_LENGTH) {
+    fprintf(stderr, "open_build_cache: cache path too long, building without a cache\n");
+    return cache;
+  }
+
+  if (mkdir(cache.dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "open_build_cache: %s: %s, building without a cache\n", cache.dir, strerror(errno));
+    return cache;
+  }
+
+  cache.enabled = true;
+  return cache;
+}
+
+void build_cache_keep_in_memory(BuildCache *cache) {
+  if (cache->memory_entries != NULL) {
+    return;
+  }
+  cache->memory_capacity = BUILD_CACHE_MEMORY_INITIAL_CAPACITY;
+  cache->memory_entries = (SpirvMemoryEntry *)calloc(cache->memory_capacity, sizeof(SpirvMemoryEntry));
+  if (cache->memory_entries == NULL) {
+    fprintf(stderr, "build_cache_keep_in_memory: failed to allocate %u entries\n", cache->memory_capacity);
+    exit(1);
+  }
+}
+
+void close_build_cache(BuildCache *cache) {
+  for (u32 i = 0; i < cache->memory_capacity; i++) {
+    free(cache->memory_entries[i].bytes);
+  }
+  free(cache->memory_entries);
+  cache->memory_entries = NULL;
+  cache->memory_capacity = 0;
+  cache->num_memory_entries = 0;
+}
+
+// The slot holding key, or the empty slot it would go in
+static SpirvMemoryEntry *find_memory_entry(SpirvMemoryEntry *entries, u32 capacity, u64 key) {
+  u32 mask = capacity - 1;
+  for (u32 slot = (u32)key & mask;; slot = (slot + 1) & mask) {
+    if (entries[slot].bytes == NULL || entries[slot].key == key) {
+      return &entries[slot];
+    }
+  }
+}
+
+static void remember_spirv(BuildCache *cache, u64 key, const u8 *bytes, u32 length) {
+  if (cache->memory_entries == NULL) {
+    return;
+  }
+
+  // Grow at half full so probes stay short
+  if (2 * (cache->num_memory_entries + 1) > cache->memory_capacity) {
+    u32 new_capacity = cache->memory_capacity * 2;
+    SpirvMemoryEntry *new_entries = (SpirvMemoryEntry *)calloc(new_capacity, sizeof(SpirvMemoryEntry));
+    if (new_entries == NULL) {
+      fprintf(stderr, "remember_spirv: failed to allocate %u entries\n", new_capacity);
+      exit(1);
+    }
+    for (u32 i = 0; i < cache->memory_capacity; i++) {
+      if (cache->memory_entries[i].bytes != NULL) {
+        *find_memory_entry(new_entries, new_capacity, cache->memory_entries[i].key) = cache->memory_entries[i];
+      }
+    }
+    free(cache->memory_entries);
+    cache->memory_entries = new_entries;
+    cache->memory_capacity = new_capacity;
+  }
+
+  SpirvMemoryEntry *entry = find_memory_entry(cache->memory_entries, cache->memory_capacity, key);
+  if (entry->bytes != NULL) {
+    return;
+  }
+  u8 *copy = (u8 *)malloc(length);
+  if (copy == NULL) {
+    fprintf(stderr, "remember_spirv: failed to allocate %u bytes\n", length);
+    exit(1);
+  }
+  memcpy(copy, bytes, length);
+  *entry = {.key = key, .bytes = copy, .length = length};
+  cache->num_memory_entries++;
+}
+
+u64 shader_tree_hash(const ShaderToCompileList *shader_list) {
+  u64 hash = hash_u64(FNV_OFFSET_BASIS, REFLECTOR_VERSION);
+  hash = hash_u64(hash, shader_list->num_shaders);
+  for (u32 i = 0; i < shader_list->num_shaders; i++) {
+    const ShaderToCompile *shader = &shader_list->shaders[i];
+    u64 path_length = strlen(shader->source_path);
+    hash = hash_u64(hash, path_length);
+    hash = hash_bytes(hash, shader->source_path, path_length);
+    hash = hash_u64(hash, shader->source_length);
+    hash = hash_bytes(hash, shader->source, shader->source_length);
+  }
+  return hash;
+}
+
+static bool make_entry_path(const BuildCache *cache, char *buf, const char *name) {
+  int n = snprintf(buf, FULL_PATH_BUFFER_LENGTH, "%s/%s", cache->dir, name);
+  return n >= 0 && n < FULL_PATH_BUFFER_LENGTH;
+}
+
+bool build_cache_tree_matches(const BuildCache *cache, u64 tree_hash) {
+  char path[FULL_PATH_BUFFER_LENGTH];
+  if (!cache->enabled || !cache->read_enabled || !make_entry_path(cache, path, "tree")) {
+    return false;
+  }
+
+  u8 *bytes = NULL;
+  size_t length = 0;
+  if (read_file_to_heap(path, &bytes, &length) != 0) {
+    return false;
+  }
+
+  char expected[32];
+  int expected_length = snprintf(expected, sizeof(expected), "%016llx\n", (unsigned long long)tree_hash);
+  bool matches = length == (size_t)expected_length && memcmp(bytes, expected, length) == 0;
+  free(bytes);
+  return matches;
+}
+
+void build_cache_store_tree(const BuildCache *cache, u64 tree_hash) {
+  char path[FULL_PATH_BUFFER_LENGTH];
+  if (!cache->enabled || !make_entry_path(cache, path, "tree")) {
+    return;
+  }
+
+  char contents[32];
+  int length = snprintf(contents, sizeof(contents), "%016llx\n", (unsigned long long)tree_hash);
+  if (!write_file_atomic(path, contents, (u64)length)) {
+    fprintf(stderr, "build_cache_store_tree: failed to write %s\n", path);
+  }
+}
+
+void build_cache_clear_tree(const BuildCache *cache) {
+  char path[FULL_PATH_BUFFER_LENGTH];
+  if (!cache->enabled || !make_entry_path(cache, path, "tree")) {
+    return;
+  }
+  if (unlink(path) != 0 && errno != ENOENT) {
+    fprintf(stderr, "build_cache_clear_tree: failed to remove %s: %s\n", path, strerror(errno));
+  }
+}
+
+u64 spirv_cache_key(const GLSLSource *vulkan_source, Backend backend, u32 spirv_opt) {
+  u64 hash = hash_u64(FNV_OFFSET_BASIS, REFLECTOR_VERSION);
+  hash = hash_u64(hash, backend);
+  hash = hash_u64(hash, spirv_opt);
+  hash = hash_u64(hash, vulkan_source->stage);
+  hash = hash_u64(hash, vulkan_source->length);
+  return hash_bytes(hash, vulkan_source->string, vulkan_source->length);
+}
+
+static bool make_spirv_entry_path(const BuildCache *cache, char *buf, u64 key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)key);
+  return make_entry_path(cache, buf, name);
+}
+
+bool build_cache_load_spirv(BuildCache *cache, u64 key, u8 **out_bytes, u32 *out_length) {
+  if (cache->memory_entries != NULL && cache->read_enabled) {
+    const SpirvMemoryEntry *entry = find_memory_entry(cache->memory_entries, cache->memory_capacity, key);
+    if (entry->bytes != NULL) {
+      u8 *bytes = (u8 *)malloc(entry->length);
+      if (bytes == NULL) {
+        fprintf(stderr, "build_cache_load_spirv: failed to allocate %u bytes\n", entry->length);
+        exit(1);
+      }
+      memcpy(bytes, entry->bytes, entry->length);
+      *out_bytes = bytes;
+      *out_length = entry->length;
+      cache->hits++;
+      return true;
+    }
+  }
+
+  char path[FULL_PATH_BUFFER_LENGTH];
+  if (!cache->enabled || !cache->read_enabled || !make_spirv_entry_path(cache, path, key)) {
+    cache->misses++;
+    return false;
+  }
+
+  u8 *bytes = NULL;
+  size_t length = 0;
+  if (read_file_to_heap(path, &bytes, &length) != 0 || (length & 3u) != 0u) {
+    free(bytes);
+    cache->misses++;
+    return false;
+  }
+
+  remember_spirv(cache, key, bytes, (u32)length);
+  *out_bytes = bytes;
+  *out_length = (u32)length;
+  cache->hits++;
+  return true;
+}
+
+void build_cache_store_spirv(BuildCache *cache, u64 key, const u8 *bytes, u32 length) {
+  remember_spirv(cache, key, bytes, length);
+  char path[FULL_PATH_BUFFER_LENGTH];
+  if (!cache->enabled || !make_spirv_entry_path(cache, path, key)) {
+    return;
+  }
+
+  if (!write_file_atomic(path, bytes, length)) {
+    fprintf(stderr, "build_cache_store_spirv: failed to write %s\n", path);
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "filesystem_utils.h"
+#include "reflector.h"
+
+// On disk cache for the reflector, in .reflector_cache/ next to the generated header.
+//
+// Two kinds of entries:
+// - <key>.spv holds the SPIR-V for one shader. The key hashes exactly what the compiler is given (the Vulkan GLSL
+//   after directive replacement) plus the stage, backend, spirv-opt passes and REFLECTOR_VERSION, so a shader is only
+//   recompiled when its compiler input changes.
+// - tree holds the hash of every source file that went into the last header written successfully. If it matches,
+//   the header is current and the reflector skips parsing and compiling altogether.
+//
+// Bump REFLECTOR_VERSION whenever directive replacement or codegen output changes, that invalidates every entry.
+//
+// A long running reflector (--watch) also keeps every SPIR-V entry it has loaded or stored in memory, so a rebuild
+// doesn't go back to disk for the shaders that didn't change. That works even when the directory couldn't be created.
+
+#define REFLECTOR_VERSION 5
+#define BUILD_CACHE_DIR_NAME ".reflector_cache"
+#define BUILD_CACHE_MEMORY_INITIAL_CAPACITY 256 // Power of two
+
+struct SpirvMemoryEntry {
+  u64 key;
+  u8 *bytes; // NULL for an empty slot
+  u32 length;
+};
+
+struct BuildCache {
+  char dir[FULL_PATH_BUFFER_LENGTH];
+  bool enabled;
+  bool read_enabled; // Off when forcing a rebuild, entries are still written
+  u32 hits;
+  u32 misses;
+
+  // Open addressing on the key, empty unless build_cache_keep_in_memory was called
+  SpirvMemoryEntry *memory_entries;
+  u32 memory_capacity;
+  u32 num_memory_entries;
+};
+
+// 64 bit FNV-1a, chained through hash. Start from FNV_OFFSET_BASIS.
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+u64 hash_bytes(u64 hash, const void *bytes, u64 length);
+
+// Creates the cache directory next to output_path if needed. Returns a disabled cache if it can't.
+BuildCache open_build_cache(const char *output_path, bool read_enabled);
+void build_cache_keep_in_memory(BuildCache *cache);
+// Frees the in memory entries, the directory is left alone
+void close_build_cache(BuildCache *cache);
+
+u64 shader_tree_hash(const ShaderToCompileList *shader_list);
+bool build_cache_tree_matches(const BuildCache *cache, u64 tree_hash);
+void build_cache_store_tree(const BuildCache *cache, u64 tree_hash);
+// Forgets the stored tree, so the next build runs even if nothing changed
+void build_cache_clear_tree(const BuildCache *cache);
+
+// spirv_opt is the SpirvOptFlags run after compiling, 0 for none
+u64 spirv_cache_key(const GLSLSource *vulkan_source, Backend backend, u32 spirv_opt);
+
+// On a hit, out_bytes is malloc'd and owned by the caller, whether it came from memory or disk. Counts the hit or miss.
+bool build_cache_load_spirv(BuildCache *cache, u64 key, u8 **out_bytes, u32 *out_length);
+void build_cache_store_spirv(BuildCache *cache, u64 key, const u8 *bytes, u32 length);
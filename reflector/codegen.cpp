@@ -1,15 +1,23 @@
 #include "codegen.h"
+#include "build_cache.h"
+#include "layout.h"
+#include "parallel.h"
 #include "parser.h"
 #include "reflector.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -30,62 +38,6 @@ static int create_tempfile(char *filepath_template) {
   return fd;
 }
 
-static int read_file_to_heap(const char *path, u8 **out_buf, size_t *out_len) {
-  *out_buf = NULL;
-  *out_len = 0;
-
-  int fd = open(path, O_RDONLY);
-  if (fd < 0) {
-    return -1;
-  }
-
-  struct stat st;
-  if (fstat(fd, &st) < 0) {
-    close(fd);
-    return -1;
-  }
-  if (st.st_size <= 0) {
-    close(fd);
-    errno = EINVAL;
-    return -1;
-  }
-
-  size_t len = (size_t)st.st_size;
-  u8 *buf = (u8 *)malloc(len);
-  if (!buf) {
-    close(fd);
-    return -1;
-  }
-
-  size_t off = 0;
-  while (off < len) {
-    ssize_t n = read(fd, buf + off, len - off);
-    if (n < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      free(buf);
-      close(fd);
-      return -1;
-    }
-    if (n == 0) {
-      break; // EOF (unexpected but handled)
-    }
-    off += (size_t)n;
-  }
-  close(fd);
-
-  if (off != len) {
-    free(buf);
-    errno = EIO;
-    return -1;
-  }
-
-  *out_buf = buf;
-  *out_len = len;
-  return 0;
-}
-
 // Could potentially optimize this with cleverer buffering.
 // Could avoid text copy by searching for boundaries and doing fwrite.
 static void dump_source_with_line_numbers(const char *source_string) {
@@ -109,135 +61,312 @@ static void dump_source_with_line_numbers(const char *source_string) {
   }
 }
 
-// Scatter.
-// Make tempfiles, write GLSL source to them, spawn glslValidator on them in one loop.
-static void start_spirv_compilation(CompileJob *jobs, const GLSLSource *sources, u32 num_sources) {
-  for (u32 i = 0; i < num_sources; i++) {
-    char *glsl_path = jobs[i].glsl_path;
-    char *spirv_path = jobs[i].spirv_path;
-    jobs[i].glsl_source_str = sources[i].string;
+static f64 elapsed_ms(const struct timespec *t0, const struct timespec *t1) {
+  return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) * 1e-6;
+}
 
-    // Make temp for GLSL source that we will invoke the compiler on.
-    int glsl_fd = create_tempfile(glsl_path);
-    if (glsl_fd < 0) {
-      perror("mkstemp input");
-      return;
-    }
+static const char *compile_tool_name(CompileTool tool) {
+  return tool == COMPILE_TOOL_SPIRV_OPT ? "spirv-opt" : "glslangValidator";
+}
 
-    // Write GLSL to input file
-    const u8 *cur_pos = (const u8 *)sources[i].string;
-    u32 bytes_left = sources[i].length;
-    while (bytes_left) {
-      ssize_t bytes_written = write(glsl_fd, cur_pos, bytes_left);
-      if (bytes_written < 0) {
-        if (errno == EINTR) {
-          continue;
-        }
+#ifdef __linux__
+// The input and SPIR-V live in anonymous memory files, so nothing touches the disk. The tool reads its input from
+// stdin and writes SPIR-V to /dev/fd/SPIRV_OUTPUT_FD, which reopens the memfd the parent reads back.
+static bool stage_compile_job_in_memory(CompileJob *job) {
+  job->input_fd = memfd_create("input", MFD_CLOEXEC);
+  job->output_fd = memfd_create("spirv", MFD_CLOEXEC);
+  bool staged = job->input_fd >= 0 && job->output_fd >= 0 && write_all(job->input_fd, job->input, job->input_length) &&
+                lseek(job->input_fd, 0, SEEK_SET) == 0;
+  if (!staged) {
+    perror("memfd");
+    close(job->input_fd);
+    close(job->output_fd);
+    job->input_fd = -1;
+    job->output_fd = -1;
+  }
+  return staged;
+}
+#endif
+
+// Fallback where memfd isn't available: a tempfile for each side.
+static bool stage_compile_job_in_tempfiles(CompileJob *job) {
+  int input_fd = create_tempfile(job->input_path);
+  if (input_fd < 0) {
+    perror("mkstemp input");
+    job->input_path[0] = '\0';
+    return false;
+  }
 
-        perror("write GLSL");
-        close(glsl_fd);
-        unlink(glsl_path);
-        return;
-      }
+  bool written = write_all(input_fd, job->input, job->input_length);
+  close(input_fd);
+  if (!written) {
+    perror("write input");
+    return false;
+  }
 
-      cur_pos += bytes_written;
-      bytes_left -= bytes_written;
-    }
+  // Make a tempfile for the compiled bytecode.
+  int spirv_fd = create_tempfile(job->output_path);
+  if (spirv_fd < 0) {
+    perror("mkstemp output");
+    job->output_path[0] = '\0';
+    return false;
+  }
+  close(spirv_fd);
+  return true;
+}
 
-    // Ensure data reaches disk before compiler reads it (paranoid but safe).
-    fsync(glsl_fd);
-    close(glsl_fd);
+static void release_compile_job(CompileJob *job) {
+  if (job->input_fd >= 0) {
+    close(job->input_fd);
+    job->input_fd = -1;
+  }
+  if (job->output_fd >= 0) {
+    close(job->output_fd);
+    job->output_fd = -1;
+  }
+  if (job->input_path[0] != '\0') {
+    unlink(job->input_path);
+    job->input_path[0] = '\0';
+  }
+  if (job->output_path[0] != '\0') {
+    unlink(job->output_path);
+    job->output_path[0] = '\0';
+  }
+}
 
-    // Make a tempfile for the compiled bytecode.
-    int spirv_fd = create_tempfile(spirv_path);
-    close(spirv_fd);
-    if (spirv_fd < 0) {
-      perror("mkstemp output");
-      return;
-    }
+// Stage the job's input and spawn its tool on it. Returns false if the job never started.
+static bool start_compile_job(CompileJob *job) {
+  job->input_fd = -1;
+  job->output_fd = -1;
+  job->in_memory = false;
+#ifdef __linux__
+  job->in_memory = stage_compile_job_in_memory(job);
+#endif
+  if (!job->in_memory && !stage_compile_job_in_tempfiles(job)) {
+    release_compile_job(job);
+    return false;
+  }
 
-    // Invoke compiler
-    pid_t pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      return;
+  clock_gettime(CLOCK_MONOTONIC, &job->start_time);
+
+  // Invoke compiler
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    release_compile_job(job);
+    return false;
+  }
+
+  if (pid == 0) {
+    // Child: point stdin and SPIRV_OUTPUT_FD at the memfds, or name the tempfiles
+    char input_path[32];
+    char output_path[32];
+    if (job->in_memory) {
+      // dup2 clears close on exec on the new descriptor, but is a no-op if the memfd already is SPIRV_OUTPUT_FD
+      bool redirected = dup2(job->input_fd, STDIN_FILENO) == STDIN_FILENO &&
+                        (job->output_fd == SPIRV_OUTPUT_FD ? fcntl(SPIRV_OUTPUT_FD, F_SETFD, 0) == 0
+                                                           : dup2(job->output_fd, SPIRV_OUTPUT_FD) == SPIRV_OUTPUT_FD);
+      if (!redirected) {
+        perror("dup2");
+        _exit(127);
+      }
+      snprintf(input_path, sizeof(input_path), "/dev/fd/%d", STDIN_FILENO);
+      snprintf(output_path, sizeof(output_path), "/dev/fd/%d", SPIRV_OUTPUT_FD);
     }
+    char *in = job->in_memory ? input_path : job->input_path;
+    char *out = job->in_memory ? output_path : job->output_path;
 
-    if (pid == 0) {
-      // Child: exec glslangValidator
-      // glslangValidator -S <stage> -V -o <out> <in>
-      char *stage_str = (char *)shader_stage_to_string[sources[i].stage];
+    const char *tool = compile_tool_name(job->tool);
+    if (job->tool == COMPILE_TOOL_GLSLANG) {
+      // glslangValidator -S <stage> -V -o <out> <in>, or --stdin in memory
+      char *stage_str = (char *)shader_stage_to_string[job->source->stage];
       char *const argv[] = {
-          (char *)"glslangValidator", (char *)"-S", stage_str, (char *)"-V", (char *)"-o", spirv_path, glsl_path, NULL
+          (char *)tool, (char *)"-S", stage_str, (char *)"-V", (char *)"-o", out,
+          job->in_memory ? (char *)"--stdin" : in, NULL
       };
-      execvp("glslangValidator", argv);
+      execvp(tool, argv);
+    } else {
+      // spirv-opt [-O] [--strip-debug] <in> -o <out>
+      char *argv[8];
+      u32 argc = 0;
+      argv[argc++] = (char *)tool;
+      if (job->spirv_opt & SPIRV_OPT_PERFORMANCE) {
+        argv[argc++] = (char *)"-O";
+      }
+      if (job->spirv_opt & SPIRV_OPT_STRIP_DEBUG) {
+        argv[argc++] = (char *)"--strip-debug";
+      }
+      argv[argc++] = in;
+      argv[argc++] = (char *)"-o";
+      argv[argc++] = out;
+      argv[argc] = NULL;
+      execvp(tool, argv);
+    }
+
+    // If we get here, exec failed
+    fprintf(stderr, "execvp %s: %s\n", tool, strerror(errno));
+    _exit(127);
+  }
 
-      // If we get here, exec failed
-      perror("execvp glslangValidator");
-      _exit(127);
+  job->pid = pid;
+  return true;
+}
+
+// Collect the output of a reaped job and release its files. Returns whether it produced SPIR-V.
+static bool finish_compile_job(CompileJob *job, int status, SpirVBytesArray *bytes_array) {
+  bool success = false;
+
+  const char *tool = compile_tool_name(job->tool);
+  if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s exited %d on %s\n", tool, WEXITSTATUS(status), job->name);
+    if (job->tool == COMPILE_TOOL_GLSLANG) {
+      dump_source_with_line_numbers(job->source->string);
+    }
+  } else if (!WIFEXITED(status)) {
+    fprintf(stderr, "%s killed by signal %d on %s\n", tool, WTERMSIG(status), job->name);
+  } else {
+    // Read SPIR-V. The child wrote through its own open of the memfd, so our offset is still at the start.
+    u8 *bytes = NULL;
+    size_t len = 0;
+    int read_result = job->in_memory ? read_fd_to_heap(job->output_fd, &bytes, &len)
+                                     : read_file_to_heap(job->output_path, &bytes, &len);
+    if (read_result != 0) {
+      perror("read SPIR-V");
+    } else if ((len & 3u) != 0u) {
+      // Validate 4-byte word alignment
+      fprintf(stderr, "SPIR-V length not multiple of 4: %zu\n", len);
+      free(bytes);
     } else {
-      jobs[i].pid = pid;
+      // Success — hand ownership to caller
+      bytes_array->bytes = bytes;
+      bytes_array->length = (u32)len;
+      success = true;
     }
   }
+
+  release_compile_job(job);
+  return success;
 }
 
-// Gather
-static bool finish_spirv_compilation(const CompileJob *jobs, SpirVBytesArray *bytes_arrays, u32 num_jobs) {
+// For when waitpid(-1) fails and can't report the rest: kills every job still running, reaps it and releases its files
+static void abort_running_compile_jobs(CompileJob *jobs, u32 num_jobs) {
   for (u32 i = 0; i < num_jobs; i++) {
-    int status = 0;
-    // TODO reap zombies properly
-    if (waitpid(jobs[i].pid, &status, 0) < 0) {
-      perror("waitpid");
-      return false;
+    CompileJob *job = &jobs[i];
+    if (job->pid <= 0) {
+      continue;
     }
-    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-      fprintf(stderr, "glslangValidator exited %d\n", WEXITSTATUS(status));
-      dump_source_with_line_numbers(jobs[i].glsl_source_str);
-      return false;
+    kill(job->pid, SIGKILL);
+    while (waitpid(job->pid, NULL, 0) < 0 && errno == EINTR) {
     }
-    if (!WIFEXITED(status)) {
-      fprintf(stderr, "glslangValidator killed by signal %d\n", WTERMSIG(status));
-      return false;
+    job->pid = 0;
+    release_compile_job(job);
+  }
+}
+
+static int compare_jobs_by_time_desc(const void *a, const void *b) {
+  f64 left = (*(const CompileJob *const *)a)->ms;
+  f64 right = (*(const CompileJob *const *)b)->ms;
+  return (left < right) - (left > right);
+}
+
+static void report_compile_job_times(ReflectorArena *arena, CompileJob *jobs, u32 num_jobs) {
+  CompileJob **sorted = REFLECTOR_ARENA_PUSH_ARRAY(arena, CompileJob *, num_jobs);
+  u32 num_finished = 0;
+  for (u32 i = 0; i < num_jobs; i++) {
+    if (jobs[i].finished) {
+      sorted[num_finished++] = &jobs[i];
     }
+  }
+  qsort(sorted, num_finished, sizeof(sorted[0]), compare_jobs_by_time_desc);
+
+  u32 num_reported = num_finished < COMPILE_REPORT_SLOWEST ? num_finished : COMPILE_REPORT_SLOWEST;
+  for (u32 i = 0; i < num_reported; i++) {
+    printf("  %7.1f ms  %s.%s\n", sorted[i]->ms, sorted[i]->name, shader_stage_to_string[sorted[i]->source->stage]);
+  }
+  if (num_finished > num_reported) {
+    printf("  ... and %u faster\n", num_finished - num_reported);
+  }
+}
 
-    const char *glsl_path = jobs[i].glsl_path;
-    const char *spirv_path = jobs[i].spirv_path;
+// Runs at most max_running tool processes at once. Whenever any job exits it is reaped and the next one starts, so a
+// slow shader only holds up its own slot. After a failed compile no new jobs start, but running ones are still reaped
+// and collected. spirv-opt failures aren't fatal, so every optimization runs regardless.
+// glslangValidator compiles sources. spirv-opt optimizes inputs, which must then have an entry per source.
+// bytes_arrays[i].bytes is left NULL for every job that didn't produce SPIR-V.
+static bool run_compile_jobs(
+    ReflectorArena *arena,
+    CompileTool tool,
+    u32 spirv_opt,
+    const GLSLSource *sources,
+    const SpirVBytesArray *inputs,
+    const char *const *names,
+    SpirVBytesArray *bytes_arrays,
+    u32 num_sources,
+    u32 max_running
+) {
+  CompileJob *jobs = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(arena, CompileJob, num_sources);
+  memset(bytes_arrays, 0, num_sources * sizeof(SpirVBytesArray));
+
+  u32 next_job = 0;
+  u32 num_running = 0;
+  bool success = true;
+  bool stop_on_failure = tool == COMPILE_TOOL_GLSLANG;
+
+  while (num_running > 0 || ((success || !stop_on_failure) && next_job < num_sources)) {
+    while ((success || !stop_on_failure) && num_running < max_running && next_job < num_sources) {
+      CompileJob *job = &jobs[next_job];
+      job->tool = tool;
+      job->spirv_opt = spirv_opt;
+      job->source = &sources[next_job];
+      job->input = tool == COMPILE_TOOL_GLSLANG ? (const u8 *)sources[next_job].string : inputs[next_job].bytes;
+      job->input_length = tool == COMPILE_TOOL_GLSLANG ? sources[next_job].length : inputs[next_job].length;
+      job->name = names[next_job];
+      next_job++;
+      if (start_compile_job(job)) {
+        num_running++;
+      } else {
+        success = false;
+      }
+    }
+    if (num_running == 0) {
+      break;
+    }
 
-    // Read SPIR-V
-    u8 *bytes = NULL;
-    size_t len = 0;
-    if (read_file_to_heap(spirv_path, &bytes, &len) != 0) {
-      perror("read SPIR-V");
-      unlink(glsl_path);
-      unlink(spirv_path);
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("waitpid");
+      abort_running_compile_jobs(jobs, next_job);
       return false;
     }
 
-    // Validate 4-byte word alignment
-    if ((len & 3u) != 0u) {
-      fprintf(stderr, "SPIR-V length not multiple of 4: %zu\n", len);
-      free(bytes);
-      unlink(glsl_path);
-      unlink(spirv_path);
-      return false;
+    u32 job_index = 0;
+    while (job_index < next_job && jobs[job_index].pid != pid) {
+      job_index++;
+    }
+    if (job_index == next_job) {
+      continue; // Not one of ours
     }
 
-    // Cleanup temp files
-    unlink(glsl_path);
-    unlink(spirv_path);
+    CompileJob *job = &jobs[job_index];
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    job->ms = elapsed_ms(&job->start_time, &end_time);
+    job->finished = true;
+    job->pid = 0;
+    num_running--;
 
-    // Success — hand ownership to caller
-    bytes_arrays[i].bytes = bytes;
-    bytes_arrays[i].length = (u32)len;
+    if (!finish_compile_job(job, status, &bytes_arrays[job_index])) {
+      success = false;
+    }
   }
 
-  return true;
-}
-
-static bool compile_to_spirv(const GLSLSource *sources, SpirVBytesArray *bytes_arrays, u32 num_sources) {
-  CompileJob jobs[MAX_NUM_SHADERS];
-  start_spirv_compilation(jobs, sources, num_sources);
-  bool success = finish_spirv_compilation(jobs, bytes_arrays, num_sources);
+  const char *verb = tool == COMPILE_TOOL_GLSLANG ? "Compiled" : "Optimized";
+  printf("%s %u shaders, at most %u at a time. Slowest:\n", verb, next_job, max_running);
+  report_compile_job_times(arena, jobs, next_job);
   return success;
 }
 
@@ -399,7 +528,12 @@ static TemplateStringReplacement perform_replacement(const TemplateStringSlice *
 GLSLSource replace_string_slices(const ParsedShader *parsed, Backend backend) {
   // First pass, get replacements and accumulate lengths.
   u32 compiled_source_length = 0;
-  TemplateStringReplacement replacements[MAX_NUM_STRING_SLICES] = {};
+  TemplateStringReplacement *replacements =
+      (TemplateStringReplacement *)malloc(parsed->num_slices * sizeof(TemplateStringReplacement));
+  if (replacements == NULL && parsed->num_slices > 0) {
+    fprintf(stderr, "replace_string_slices: failed to allocate %u replacements\n", parsed->num_slices);
+    exit(1);
+  }
   for (u32 i = 0; i < parsed->num_slices; i++) {
     replacements[i] = perform_replacement(&parsed->slices[i], backend);
     compiled_source_length += replacements[i].length;
@@ -440,6 +574,7 @@ GLSLSource replace_string_slices(const ParsedShader *parsed, Backend backend) {
   }
 
   compiled_source[compiled_source_length] = '\0';
+  free(replacements);
 
   GLSLSource glsl_source = {
       .length = compiled_source_length,
@@ -450,7 +585,7 @@ GLSLSource replace_string_slices(const ParsedShader *parsed, Backend backend) {
 }
 
 static void codegen_compiled_shader_header(FILE *dst) {
-  fprintf(dst, "// Generated shader header, do not edit\n");
+  fprintf(dst, "// Generated shader types, do not edit. Only changes when a type, name or layout does.\n");
   fprintf(dst, "#pragma once\n");
   fprintf(dst, "#include \"glad/gl.h\"\n");
   fprintf(dst, "#include \"linalg.h\"\n");
@@ -475,6 +610,8 @@ static void codegen_compiled_shader_header(FILE *dst) {
 
 static void codegen_shader_spec_struct_definition(FILE *dst) {
   fprintf(dst, "typedef struct {\n");
+  fprintf(dst, "  const char* name;\n");
+  fprintf(dst, "  const char* source_path;\n");
   fprintf(dst, "  const char* opengl_glsl;\n");
   fprintf(dst, "  const uint32_t* spv;\n");
   fprintf(dst, "  const uint32_t spv_size;\n");
@@ -493,6 +630,9 @@ static void codegen_program_spec_struct_definition(FILE *dst) {
   fprintf(dst, "  const uint32_t* frag_spv;\n");
   fprintf(dst, "  const uint32_t frag_spv_size;\n");
 
+  fprintf(dst, "  const ShaderSpec* vert_shader_spec;\n");
+  fprintf(dst, "  const ShaderSpec* frag_shader_spec;\n");
+
   fprintf(dst, "  VertexLayoutID vertex_layout_id;\n");
 
   fprintf(dst, "  const VkDescriptorSetLayoutBinding *binding_lists[MAX_NUM_DESCRIPTOR_SET_LAYOUTS];\n");
@@ -552,6 +692,13 @@ const char *glsl_type_to_vulkan_format(GLSLType type) {
   }
 }
 
+static const char *vertex_attribute_to_vulkan_format(const VertexAttribute *attribute) {
+  if (attribute->format != VERTEX_FORMAT_DEFAULT) {
+    return vertex_format_info[attribute->format].vulkan_format;
+  }
+  return glsl_type_to_vulkan_format(attribute->glsl_type);
+}
+
 void generate_vulkan_vertex_layout_array(FILE *dst, const ParsedShadersIR *ir) {
   fprintf(dst, "//////////////////// VULKAN VERTEX LAYOUTS ///////////////\n");
 
@@ -601,7 +748,7 @@ void generate_vulkan_vertex_layout_array(FILE *dst, const ParsedShadersIR *ir) {
     for (u32 i = 0; i < vertex_layout->attribute_count; i++) {
       fprintf(dst, "  {  .location = %u, ", vertex_layout->attributes[i].location);
       fprintf(dst, ".binding = %u, ", vertex_layout->attributes[i].binding);
-      fprintf(dst, ".format = %s,", glsl_type_to_vulkan_format(vertex_layout->attributes[i].glsl_type));
+      fprintf(dst, ".format = %s,", vertex_attribute_to_vulkan_format(&vertex_layout->attributes[i]));
       fprintf(dst, ".offset = %u, }\n,", vertex_layout->attributes[i].offset);
     }
     fprintf(dst, "};\n\n"); // close attributes
@@ -721,9 +868,16 @@ void generate_opengl_vertex_layout_array(FILE *dst, const ParsedShadersIR *ir) {
       }
       fprintf(dst, "  glEnableVertexAttribArray(%u);\n", attribute->location);
 
-      // supporting GL_FLOAT and GL_UNSIGNED_INT for now
+      // supporting GL_FLOAT and GL_UNSIGNED_INT for now, plus the packed formats, which are read as floats
       // only konw that in uint takes glVertexAttribIPointer(n, m, GL_UNSIGNED_INT,.. ) for now
-      if (attribute->glsl_type == GLSL_TYPE_UINT) {
+      const VertexFormatInfo *format = &vertex_format_info[attribute->format];
+      if (attribute->format != VERTEX_FORMAT_DEFAULT) {
+        fprintf(
+            dst, "  glVertexAttribPointer(%u, %u, %s, %s, %u, (void*)%u);\n", attribute->location,
+            format->gl_components, format->gl_type, format->gl_normalized ? "GL_TRUE" : "GL_FALSE", binding_stride,
+            attribute->offset
+        );
+      } else if (attribute->glsl_type == GLSL_TYPE_UINT) {
         fprintf(
             dst, "  glVertexAttribIPointer(%u, %u, GL_UNSIGNED_INT, %u, (void*)%u);\n", attribute->location,
             glsl_type_to_number_of_floats(attribute->glsl_type), binding_stride, attribute->offset
@@ -934,7 +1088,7 @@ static void codegen_struct_defintions(FILE *dst, const GLSLStruct *glsl_structs,
     for (u32 j = 0; j < glsl_struct->num_members; j++) {
       const GLSLStructMember *member = &glsl_struct->members[j];
       fprintf(
-          dst, "  alignas(%u) %s %.*s", glsl_type_to_alignment[member->type], glsl_type_to_c_type[member->type],
+          dst, "  alignas(%u) %s %.*s", glsl_struct->member_layouts[j].alignment, glsl_type_to_c_type[member->type],
           member->identifier_length, member->identifier
       );
       if (member->array_length > 1) {
@@ -948,7 +1102,21 @@ static void codegen_struct_defintions(FILE *dst, const GLSLStruct *glsl_structs,
       fprintf(dst, "  unsigned char _padding[%u];\n", glsl_struct->padding);
     }
 
-    fprintf(dst, "} %.*s;\n\n", glsl_struct->type_name_len, glsl_struct->type_name);
+    fprintf(dst, "} %.*s;\n", glsl_struct->type_name_len, glsl_struct->type_name);
+
+    // The parser only lets through structs the C side can match, these catch linalg types changing under it
+    for (u32 j = 0; j < glsl_struct->num_members; j++) {
+      const GLSLStructMember *member = &glsl_struct->members[j];
+      fprintf(
+          dst, "static_assert(offsetof(%.*s, %.*s) == %u, \"std140 offset\");\n", glsl_struct->type_name_len,
+          glsl_struct->type_name, member->identifier_length, member->identifier, glsl_struct->member_layouts[j].offset
+      );
+    }
+    u32 c_size = (glsl_struct->size_in_bytes + 15) & ~15u;
+    fprintf(
+        dst, "static_assert(sizeof(%.*s) == %u, \"std140 size\");\n\n", glsl_struct->type_name_len,
+        glsl_struct->type_name, c_size
+    );
   }
 }
 
@@ -988,7 +1156,22 @@ static bool make_full_shader_name(char *buf, size_t buf_size, const char *name,
   return true;
 }
 
-inline void codegen_program_spec(FILE *dst, const ShaderProgram *program) {
+// For paths, which are only ever plain but could hold a quote or a backslash
+static void codegen_string_literal(FILE *dst, const char *string) {
+  fputc('"', dst);
+  for (const char *c = string; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', dst);
+    }
+    fputc(*c, dst);
+  }
+  fputc('"', dst);
+}
+
+// The pack's arrays are defined in assembly, so their size comes from the offset table instead of sizeof
+static const char *spv_size_format(bool spirv_pack) { return spirv_pack ? "%s_spv_size" : "sizeof(%s_spv)"; }
+
+inline void codegen_program_spec(FILE *dst, const ShaderProgram *program, bool spirv_pack) {
   // TODO compute
 
   char vert_name[256];
@@ -1010,9 +1193,16 @@ inline void codegen_program_spec(FILE *dst, const ShaderProgram *program) {
   fprintf(dst, "  .frag_opengl_glsl = %s_opengl_glsl,\n", frag_name);
 
   fprintf(dst, "  .vert_spv         = %s_spv,\n",         vert_name);
-  fprintf(dst, "  .vert_spv_size    = sizeof(%s_spv),\n", vert_name);
+  fprintf(dst, "  .vert_spv_size    = ");
+  fprintf(dst, spv_size_format(spirv_pack), vert_name);
+  fprintf(dst, ",\n");
   fprintf(dst, "  .frag_spv         = %s_spv,\n",         frag_name);
-  fprintf(dst, "  .frag_spv_size    = sizeof(%s_spv),\n", frag_name);
+  fprintf(dst, "  .frag_spv_size    = ");
+  fprintf(dst, spv_size_format(spirv_pack), frag_name);
+  fprintf(dst, ",\n");
+
+  fprintf(dst, "  .vert_shader_spec = &%s_shader_spec,\n", vert_name);
+  fprintf(dst, "  .frag_shader_spec = &%s_shader_spec,\n", frag_name);
 
   fprintf(dst, "  .vertex_layout_id = %s,\n",             vertex_layout_name);
 
@@ -1066,7 +1256,7 @@ inline void codegen_program_spec(FILE *dst, const ShaderProgram *program) {
   // clang-format on
 }
 
-inline void codegen_shader_spec(FILE *dst, const CompiledShaders *shaders, u32 num_shaders) {
+inline void codegen_shader_spec(FILE *dst, const CompiledShaders *shaders, u32 num_shaders, bool spirv_pack) {
   for (u32 i = 0; i < num_shaders; i++) {
     const ParsedShader *parsed = shaders->parsed[i];
     const char *stage_suffix = shader_stage_to_string[parsed->stage];
@@ -1082,19 +1272,48 @@ inline void codegen_shader_spec(FILE *dst, const CompiledShaders *shaders, u32 n
 
     // clang-format off
     fprintf(dst, "const ShaderSpec %s_shader_spec = {\n",   full_name);
+    fprintf(dst, "  .name             = \"%s\",\n",         full_name);
+    fprintf(dst, "  .source_path      = ");
+    codegen_string_literal(dst, parsed->source_path);
+    fprintf(dst, ",\n");
     fprintf(dst, "  .opengl_glsl      = %s_opengl_glsl,\n", full_name);
     fprintf(dst, "  .spv              = %s_spv,\n",         full_name);
-    fprintf(dst, "  .spv_size         = sizeof(%s_spv),\n", full_name);
+    fprintf(dst, "  .spv_size         = ");
+    fprintf(dst, spv_size_format(spirv_pack), full_name);
+    fprintf(dst, ",\n");
     fprintf(dst, "  .vertex_layout_id = %s,\n",             vertex_layout_name);
     fprintf(dst, "};\n\n");
     // clang-format on
   }
 }
 
-static void codegen_footer(FILE *dst, const ParsedShadersIR *ir) {
+// Declarations for everything in the code file, so shaders.h only changes when shaders are added or removed
+static void codegen_compiled_code_declarations(FILE *dst, const ParsedShadersIR *ir) {
+  fprintf(dst, "//////////////////// SHADER CODE, DEFINED IN %s ///////////////\n", SHADER_CODE_FILE_NAME);
+  for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
+    const ParsedShader *shader = &ir->parsed_shaders[i];
+    char full_name[256];
+    if (!make_full_shader_name(full_name, sizeof(full_name), shader->name, shader_stage_to_string[shader->stage])) {
+      continue;
+    }
+    fprintf(dst, "extern const uint32_t %s_spv[];\n", full_name);
+    fprintf(dst, "extern const char* %s_opengl_glsl;\n", full_name);
+    fprintf(dst, "extern const char* %s_vulkan_glsl;\n", full_name);
+    fprintf(dst, "extern const ShaderSpec %s_shader_spec;\n", full_name);
+  }
+  fprintf(dst, "\n");
+
+  for (u32 i = 0; i < ir->num_programs; i++) {
+    fprintf(dst, "extern const ProgramSpec %s_program_spec;\n", ir->programs[i].name);
+  }
+  fprintf(dst, "\n");
+
   fprintf(dst, "const uint32_t num_generated_specs = %u;\n", ir->num_parsed_shaders);
+  fprintf(dst, "extern const ShaderSpec* generated_shader_specs[];\n\n");
+}
 
-  fprintf(dst, "static const ShaderSpec* generated_shader_specs[] = {\n");
+static void codegen_footer(FILE *dst, const ParsedShadersIR *ir) {
+  fprintf(dst, "const ShaderSpec* generated_shader_specs[] = {\n");
   for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
     const ParsedShader *shader = &ir->parsed_shaders[i];
     const char *shader_name = shader->name;
@@ -1180,77 +1399,596 @@ static int check_tool_on_path(const char *tool) {
   return -1;
 }
 
-static bool compile_shaders(const ParsedShadersIR *ir, CompiledShaders *compileds) {
-  if (check_tool_on_path("glslangValidator") != 0) {
-    fprintf(stderr, "glslangValidator not in PATH. Stopping.\n");
-    return false;
+void resolve_codegen_options(CodegenOptions *options) {
+  if (options->spirv_opt != 0 && check_tool_on_path("spirv-opt") != 0) {
+    fprintf(stderr, "spirv-opt not in PATH, SPIR-V won't be optimized or stripped.\n");
+    options->spirv_opt = 0;
   }
+}
 
-  for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
-    const ParsedShader *parsed = &ir->parsed_shaders[i];
-    compileds->parsed[i] = parsed;
-    compileds->gl_sources[i] = replace_string_slices(parsed, BACKEND_OPENGL);
-    compileds->vk_sources[i] = replace_string_slices(parsed, BACKEND_VULKAN);
+typedef struct {
+  const ParsedShadersIR *ir;
+  CompiledShaders *compileds;
+} ReplaceSlicesTask;
+
+static void replace_slices_task(void *data, u32 index) {
+  ReplaceSlicesTask *task = (ReplaceSlicesTask *)data;
+  const ParsedShader *parsed = &task->ir->parsed_shaders[index];
+  task->compileds->parsed[index] = parsed;
+  task->compileds->gl_sources[index] = replace_string_slices(parsed, BACKEND_OPENGL);
+  task->compileds->vk_sources[index] = replace_string_slices(parsed, BACKEND_VULKAN);
+}
+
+typedef struct {
+  const char *name;
+  ShaderStage stage;
+  u32 size_before;
+  u32 size_after;
+} SpirvSizeChange;
+
+static int compare_size_changes_by_saving_desc(const void *a, const void *b) {
+  const SpirvSizeChange *left = (const SpirvSizeChange *)a;
+  const SpirvSizeChange *right = (const SpirvSizeChange *)b;
+  i64 left_saving = (i64)left->size_before - (i64)left->size_after;
+  i64 right_saving = (i64)right->size_before - (i64)right->size_after;
+  return (left_saving < right_saving) - (left_saving > right_saving);
+}
+
+// Runs spirv-opt over every shader that compiled, swapping in the optimized SPIR-V, and reports what it saved. A shader
+// spirv-opt fails on keeps its unoptimized SPIR-V for this run but is marked not cacheable. Returns how many failed.
+static u32 optimize_spirv(
+    ReflectorArena *arena,
+    u32 spirv_opt,
+    const GLSLSource *sources,
+    const char *const *names,
+    SpirVBytesArray *bytes_arrays,
+    bool *cacheable,
+    u32 num_shaders,
+    u32 max_running
+) {
+  u32 *indices = REFLECTOR_ARENA_PUSH_ARRAY(arena, u32, num_shaders);
+  GLSLSource *opt_sources = REFLECTOR_ARENA_PUSH_ARRAY(arena, GLSLSource, num_shaders);
+  const char **opt_names = REFLECTOR_ARENA_PUSH_ARRAY(arena, const char *, num_shaders);
+  SpirVBytesArray *inputs = REFLECTOR_ARENA_PUSH_ARRAY(arena, SpirVBytesArray, num_shaders);
+  SpirVBytesArray *outputs = REFLECTOR_ARENA_PUSH_ARRAY(arena, SpirVBytesArray, num_shaders);
+  u32 num_inputs = 0;
+  for (u32 i = 0; i < num_shaders; i++) {
+    if (bytes_arrays[i].bytes == NULL) {
+      continue;
+    }
+    indices[num_inputs] = i;
+    opt_sources[num_inputs] = sources[i];
+    opt_names[num_inputs] = names[i];
+    inputs[num_inputs] = bytes_arrays[i];
+    num_inputs++;
+  }
+
+  run_compile_jobs(
+      arena, COMPILE_TOOL_SPIRV_OPT, spirv_opt, opt_sources, inputs, opt_names, outputs, num_inputs, max_running
+  );
+
+  SpirvSizeChange *changes = REFLECTOR_ARENA_PUSH_ARRAY(arena, SpirvSizeChange, num_inputs);
+  u32 num_changes = 0;
+  u32 num_failed = 0;
+  u64 total_before = 0;
+  u64 total_after = 0;
+  for (u32 i = 0; i < num_inputs; i++) {
+    u32 shader_index = indices[i];
+    if (outputs[i].bytes == NULL) {
+      cacheable[shader_index] = false;
+      num_failed++;
+      continue;
+    }
+    changes[num_changes++] = {
+        .name = opt_names[i],
+        .stage = opt_sources[i].stage,
+        .size_before = inputs[i].length,
+        .size_after = outputs[i].length,
+    };
+    total_before += inputs[i].length;
+    total_after += outputs[i].length;
+    free((void *)bytes_arrays[shader_index].bytes);
+    bytes_arrays[shader_index] = outputs[i];
   }
 
+  qsort(changes, num_changes, sizeof(changes[0]), compare_size_changes_by_saving_desc);
+  f64 saved_percent = total_before > 0 ? 100.0 * (f64)(total_before - total_after) / (f64)total_before : 0.0;
+  printf(
+      "SPIR-V optimized %u shaders, %llu -> %llu bytes, %.1f%% smaller.%s\n", num_changes,
+      (unsigned long long)total_before, (unsigned long long)total_after, saved_percent,
+      num_changes > 0 ? " Biggest savings:" : ""
+  );
+  u32 num_reported = num_changes < COMPILE_REPORT_SLOWEST ? num_changes : COMPILE_REPORT_SLOWEST;
+  for (u32 i = 0; i < num_reported; i++) {
+    const SpirvSizeChange *change = &changes[i];
+    printf(
+        "  %7u -> %7u bytes  %s.%s\n", change->size_before, change->size_after, change->name,
+        shader_stage_to_string[change->stage]
+    );
+  }
+  if (num_failed > 0) {
+    fprintf(stderr, "spirv-opt failed on %u shaders, they're left unoptimized and uncached.\n", num_failed);
+  }
+  return num_failed;
+}
+
+// Only shaders missing from the cache go to the compiler, so an unchanged shader never costs a compile. out_complete is
+// cleared when spirv-opt failed on a shader that is written unoptimized.
+static bool compile_shaders(
+    ReflectorArena *arena,
+    const ParsedShadersIR *ir,
+    CompiledShaders *compileds,
+    BuildCache *cache,
+    const CodegenOptions *options,
+    bool *out_complete
+) {
+  u32 num_threads = options->num_threads;
+  ReplaceSlicesTask replace_task = {.ir = ir, .compileds = compileds};
+  parallel_for_each(ir->num_parsed_shaders, num_threads, replace_slices_task, &replace_task);
+
   // Start timers
   struct timespec t0, t1;
   clock_gettime(CLOCK_MONOTONIC, &t0);
 
-  bool should_codegen = compile_to_spirv(compileds->vk_sources, compileds->spirv_bytes_arrays, ir->num_parsed_shaders);
+  u32 num_shaders = ir->num_parsed_shaders;
+  u64 *keys = REFLECTOR_ARENA_PUSH_ARRAY(arena, u64, num_shaders);
+  u32 *miss_indices = REFLECTOR_ARENA_PUSH_ARRAY(arena, u32, num_shaders);
+  GLSLSource *miss_sources = REFLECTOR_ARENA_PUSH_ARRAY(arena, GLSLSource, num_shaders);
+  const char **miss_names = REFLECTOR_ARENA_PUSH_ARRAY(arena, const char *, num_shaders);
+  SpirVBytesArray *miss_bytes_arrays = REFLECTOR_ARENA_PUSH_ARRAY(arena, SpirVBytesArray, num_shaders);
+  u32 num_misses = 0;
+  for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
+    keys[i] = spirv_cache_key(&compileds->vk_sources[i], BACKEND_VULKAN, options->spirv_opt);
+    u8 *bytes = NULL;
+    u32 length = 0;
+    if (build_cache_load_spirv(cache, keys[i], &bytes, &length)) {
+      compileds->spirv_bytes_arrays[i] = {.bytes = bytes, .length = length};
+    } else {
+      miss_indices[num_misses] = i;
+      miss_sources[num_misses] = compileds->vk_sources[i];
+      miss_names[num_misses] = compileds->parsed[i]->name;
+      num_misses++;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("Cache:  %u hits, %u misses, %.1f ms\n", cache->hits, cache->misses, elapsed_ms(&t0, &t1));
+
+  if (num_misses == 0) {
+    return true;
+  }
+
+  if (check_tool_on_path("glslangValidator") != 0) {
+    fprintf(stderr, "glslangValidator not in PATH. Stopping.\n");
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  u32 max_running = num_threads ? num_threads : default_thread_count();
+  bool should_codegen = run_compile_jobs(
+      arena, COMPILE_TOOL_GLSLANG, 0, miss_sources, NULL, miss_names, miss_bytes_arrays, num_misses, max_running
+  );
 
   clock_gettime(CLOCK_MONOTONIC, &t1);
-  printf("SPIRV:  %.1f ms\n", (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+  printf("SPIRV:  %.1f ms\n", elapsed_ms(&t0, &t1));
+
+  bool *cacheable = REFLECTOR_ARENA_PUSH_ARRAY(arena, bool, num_misses);
+  for (u32 i = 0; i < num_misses; i++) {
+    cacheable[i] = true;
+  }
+  if (options->spirv_opt != 0) {
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    u32 num_failed = optimize_spirv(
+        arena, options->spirv_opt, miss_sources, miss_names, miss_bytes_arrays, cacheable, num_misses, max_running
+    );
+    *out_complete = num_failed == 0;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Opt:    %.1f ms\n", elapsed_ms(&t0, &t1));
+  }
+
+  // Cache whatever compiled even if something else failed, so the next run only retries the broken shaders.
+  for (u32 i = 0; i < num_misses; i++) {
+    if (miss_bytes_arrays[i].bytes == NULL) {
+      continue;
+    }
+    u32 shader_index = miss_indices[i];
+    compileds->spirv_bytes_arrays[shader_index] = miss_bytes_arrays[i];
+    if (cacheable[i]) {
+      build_cache_store_spirv(cache, keys[shader_index], miss_bytes_arrays[i].bytes, miss_bytes_arrays[i].length);
+    }
+  }
 
   return should_codegen;
 }
 
-static void codegen_compiled_code(FILE *dst, const CompiledShaders *shaders, u32 num_shaders) {
+static void codegen_compiled_shader(FILE *dst, const CompiledShaders *shaders, u32 index, bool spirv_pack) {
+  const ParsedShader *parsed = shaders->parsed[index];
+  const char *stage_suffix = shader_stage_to_string[parsed->stage];
+  char full_name[256];
+  if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, stage_suffix)) {
+    return;
+  }
+
+  // Bytes, unless they're in the pack
+  if (!spirv_pack) {
+    fprintf(dst, "const uint32_t %s_spv[] = {\n", full_name);
+    print_bytes_array(dst, &shaders->spirv_bytes_arrays[index]);
+    fprintf(dst, "};\n\n");
+  }
+
+  // OpenGL GLSL
+  fprintf(dst, "const char* %s_opengl_glsl = \"", full_name);
+  print_c_string_with_newlines(dst, shaders->gl_sources[index].string);
+  fprintf(dst, "\";\n\n");
+
+  // Vulkan GLSL
+  fprintf(dst, "const char* %s_vulkan_glsl = \"", full_name);
+  print_c_string_with_newlines(dst, shaders->vk_sources[index].string);
+  fprintf(dst, "\";\n\n");
+}
+
+typedef struct {
+  const CompiledShaders *shaders;
+  char **texts;
+  size_t *text_lengths;
+  bool spirv_pack;
+} CompiledCodeTask;
+
+static void format_compiled_shader_task(void *data, u32 index) {
+  CompiledCodeTask *task = (CompiledCodeTask *)data;
+  FILE *text = open_memstream(&task->texts[index], &task->text_lengths[index]);
+  if (text == NULL) {
+    fprintf(stderr, "format_compiled_shader_task: failed to open a buffer\n");
+    exit(1);
+  }
+  codegen_compiled_shader(text, task->shaders, index, task->spirv_pack);
+  fclose(text);
+}
+
+// The SPIR-V arrays are most of the header, so each shader is formatted on its own thread and written in order.
+static void codegen_compiled_code(
+    ReflectorArena *arena, FILE *dst, const CompiledShaders *shaders, u32 num_shaders, u32 num_threads, bool spirv_pack
+) {
+  char **texts = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(arena, char *, num_shaders);
+  size_t *text_lengths = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(arena, size_t, num_shaders);
+  CompiledCodeTask task = {
+      .shaders = shaders,
+      .texts = texts,
+      .text_lengths = text_lengths,
+      .spirv_pack = spirv_pack,
+  };
+  parallel_for_each(num_shaders, num_threads, format_compiled_shader_task, &task);
+
+  for (u32 i = 0; i < num_shaders; i++) {
+    fwrite(texts[i], 1, text_lengths[i], dst);
+    free(texts[i]);
+  }
+}
+
+// Every shader's SPIR-V back to back. SPIR-V is whole words, so each shader stays 4 byte aligned.
+static u8 *build_spirv_pack(
+    ReflectorArena *arena, const CompiledShaders *shaders, u32 num_shaders, u32 *offsets, u64 *out_length
+) {
+  u64 length = 0;
+  for (u32 i = 0; i < num_shaders; i++) {
+    length += shaders->spirv_bytes_arrays[i].length;
+  }
+  if (length > UINT32_MAX) {
+    fprintf(stderr, "build_spirv_pack: %llu bytes of SPIR-V don't fit a pack\n", (unsigned long long)length);
+    exit(1);
+  }
+
+  u8 *pack = REFLECTOR_ARENA_PUSH_ARRAY(arena, u8, length);
+  u32 offset = 0;
+  for (u32 i = 0; i < num_shaders; i++) {
+    const SpirVBytesArray *bytes_array = &shaders->spirv_bytes_arrays[i];
+    offsets[i] = offset;
+    if (bytes_array->length > 0) {
+      memcpy(pack + offset, bytes_array->bytes, bytes_array->length);
+    }
+    offset += bytes_array->length;
+  }
+  *out_length = length;
+  return pack;
+}
+
+// Offset table, and the .incbin that defines each <name>_spv inside the pack. The pack's hash is in the comment so the
+// code file, and its object, change whenever the pack does, even when no offset or size moved.
+static void codegen_spirv_pack(
+    FILE *dst, const CompiledShaders *shaders, u32 num_shaders, const u32 *offsets, const char *pack_path, u64 pack_hash
+) {
+  fprintf(dst, "//////////////////// SPIR-V PACK ///////////////\n");
+  fprintf(dst, "// Linked from %s, content hash %016llx\n", pack_path, (unsigned long long)pack_hash);
+  fprintf(dst, "#if defined(__APPLE__)\n");
+  fprintf(dst, "#define SPIRV_PACK_SECTION \".const_data\\n\"\n");
+  fprintf(dst, "#define SPIRV_PACK_PREVIOUS \".text\\n\"\n");
+  fprintf(dst, "#define SPIRV_PACK_SYMBOL(name) \"_\" #name\n");
+  fprintf(dst, "#else\n");
+  fprintf(dst, "#define SPIRV_PACK_SECTION \".section .rodata\\n\"\n");
+  fprintf(dst, "#define SPIRV_PACK_PREVIOUS \".previous\\n\"\n");
+  fprintf(dst, "#define SPIRV_PACK_SYMBOL(name) #name\n");
+  fprintf(dst, "#endif\n\n");
+
   for (u32 i = 0; i < num_shaders; i++) {
     const ParsedShader *parsed = shaders->parsed[i];
-    const char *stage_suffix = shader_stage_to_string[parsed->stage];
     char full_name[256];
-    if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, stage_suffix)) {
+    if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, shader_stage_to_string[parsed->stage])) {
       continue;
     }
+    fprintf(
+        dst, "static const uint32_t %s_spv_size = %u; // offset %u\n", full_name, shaders->spirv_bytes_arrays[i].length,
+        offsets[i]
+    );
+  }
+  fprintf(dst, "\n");
 
-    // Bytes
-    fprintf(dst, "const uint32_t %s_spv[] = {\n", full_name);
-    print_bytes_array(dst, &shaders->spirv_bytes_arrays[i]);
-    fprintf(dst, "};\n\n");
+  fprintf(dst, "__asm__(\n");
+  fprintf(dst, "    SPIRV_PACK_SECTION\n");
+  for (u32 i = 0; i < num_shaders; i++) {
+    const ParsedShader *parsed = shaders->parsed[i];
+    char full_name[256];
+    if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, shader_stage_to_string[parsed->stage])) {
+      continue;
+    }
+    fprintf(dst, "    \".balign 4\\n\"\n");
+    fprintf(dst, "    \".globl \" SPIRV_PACK_SYMBOL(%s_spv) \"\\n\"\n", full_name);
+    fprintf(dst, "    SPIRV_PACK_SYMBOL(%s_spv) \":\\n\"\n", full_name);
+    fprintf(
+        dst, "    \".incbin \\\"%s\\\", %u, %u\\n\"\n", pack_path, offsets[i], shaders->spirv_bytes_arrays[i].length
+    );
+  }
+  fprintf(dst, "    SPIRV_PACK_PREVIOUS\n");
+  fprintf(dst, ");\n\n");
+}
+
+// The assembler resolves .incbin from wherever the compiler runs, so the pack is referenced by absolute path
+static bool resolve_spirv_pack_path(const char *pack_path, char *absolute_path) {
+  if (realpath(pack_path, absolute_path) == NULL) {
+    fprintf(stderr, "Failed to resolve %s: %s\n", pack_path, strerror(errno));
+    return false;
+  }
+  if (strpbrk(absolute_path, "\"\\\n") != NULL) {
+    fprintf(stderr, "%s can't be quoted for .incbin, move the output somewhere plainer.\n", absolute_path);
+    return false;
+  }
+  return true;
+}
+
+bool make_generated_file_path(char *buf, const char *header_path, const char *file_name) {
+  const char *last_slash = strrchr(header_path, '/');
+  int dir_len = last_slash ? (int)(last_slash - header_path) : 0;
+  int n = last_slash ? snprintf(buf, FULL_PATH_BUFFER_LENGTH, "%.*s/%s", dir_len, header_path, file_name)
+                     : snprintf(buf, FULL_PATH_BUFFER_LENGTH, "%s", file_name);
+  return n >= 0 && n < FULL_PATH_BUFFER_LENGTH;
+}
+
+typedef struct {
+  const char *path;
+  FILE *stream;
+  char *text;
+  size_t text_length;
+} GeneratedFile;
+
+static bool is_hot_reload_spirv_of(const CompiledShaders *shaders, u32 num_shaders, const char *file_name) {
+  for (u32 i = 0; i < num_shaders; i++) {
+    const ParsedShader *parsed = shaders->parsed[i];
+    char full_name[256];
+    if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, shader_stage_to_string[parsed->stage])) {
+      continue;
+    }
+    size_t name_len = strlen(full_name);
+    if (strncmp(file_name, full_name, name_len) == 0 && strcmp(file_name + name_len, ".spv") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Shaders that were removed or renamed would otherwise leave their old .spv behind for the engine to keep loading
+static bool remove_stale_hot_reload_spirv(const CompiledShaders *shaders, u32 num_shaders, const char *dir_path) {
+  DIR *dir = opendir(dir_path);
+  if (!dir) {
+    fprintf(stderr, "Failed to open %s: %s\n", dir_path, strerror(errno));
+    return false;
+  }
 
-    // OpenGL GLSL
-    fprintf(dst, "static const char* %s_opengl_glsl = \"", full_name);
-    print_c_string_with_newlines(dst, shaders->gl_sources[i].string);
-    fprintf(dst, "\";\n\n");
+  bool success = true;
+  struct dirent *directory_entry;
+  while ((directory_entry = readdir(dir))) {
+    const char *file_name = directory_entry->d_name;
+    size_t name_len = strlen(file_name);
+    if (name_len < 4 || strcmp(file_name + name_len - 4, ".spv") != 0 ||
+        is_hot_reload_spirv_of(shaders, num_shaders, file_name)) {
+      continue;
+    }
 
-    // Vulkan GLSL
-    fprintf(dst, "static const char* %s_vulkan_glsl = \"", full_name);
-    print_c_string_with_newlines(dst, shaders->vk_sources[i].string);
-    fprintf(dst, "\";\n\n");
+    char spv_path[FULL_PATH_BUFFER_LENGTH];
+    int n = snprintf(spv_path, sizeof(spv_path), "%s/%s", dir_path, file_name);
+    if (n < 0 || n >= FULL_PATH_BUFFER_LENGTH) {
+      fprintf(stderr, "Stale hot reload path for %s is too long.\n", file_name);
+      success = false;
+      continue;
+    }
+    if (unlink(spv_path) != 0 && errno != ENOENT) {
+      fprintf(stderr, "Failed to remove stale %s: %s\n", spv_path, strerror(errno));
+      success = false;
+      continue;
+    }
+    printf("Removed stale %s\n", spv_path);
   }
+
+  closedir(dir);
+  return success;
 }
 
-// The real deal!
-bool codegen(const char *out_path, const ParsedShadersIR *ir) {
+// One <name>.spv per shader in HOT_RELOAD_DIR_NAME. Unchanged shaders keep their file and mtime, so a running engine
+// only reloads the ones that were edited. .spv files no shader produced are removed.
+static bool write_hot_reload_spirv(
+    const CompiledShaders *shaders,
+    u32 num_shaders,
+    const char *out_path,
+    u32 *num_files_written,
+    u32 *num_files
+) {
+  char dir_path[FULL_PATH_BUFFER_LENGTH];
+  if (!make_generated_file_path(dir_path, out_path, HOT_RELOAD_DIR_NAME)) {
+    fprintf(stderr, "Hot reload directory path next to %s is too long.\n", out_path);
+    return false;
+  }
+  if (mkdir(dir_path, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create %s: %s\n", dir_path, strerror(errno));
+    return false;
+  }
+
+  for (u32 i = 0; i < num_shaders; i++) {
+    const ParsedShader *parsed = shaders->parsed[i];
+    char full_name[256];
+    if (!make_full_shader_name(full_name, sizeof(full_name), parsed->name, shader_stage_to_string[parsed->stage])) {
+      return false;
+    }
+    char spv_path[FULL_PATH_BUFFER_LENGTH];
+    int n = snprintf(spv_path, sizeof(spv_path), "%s/%s.spv", dir_path, full_name);
+    if (n < 0 || n >= FULL_PATH_BUFFER_LENGTH) {
+      fprintf(stderr, "Hot reload path for %s is too long.\n", full_name);
+      return false;
+    }
+
+    const SpirVBytesArray *bytes_array = &shaders->spirv_bytes_arrays[i];
+    bool changed = false;
+    if (!write_file_if_changed(spv_path, bytes_array->bytes, bytes_array->length, &changed)) {
+      fprintf(stderr, "Failed to write %s: %s\n", spv_path, strerror(errno));
+      return false;
+    }
+    *num_files_written += changed ? 1 : 0;
+    (*num_files)++;
+  }
+  return remove_stale_hot_reload_spirv(shaders, num_shaders, dir_path);
+}
+
+// Generated files are rendered into memory first, so nothing on disk is touched until a file is complete
+static bool open_generated_file(GeneratedFile *file, const char *path) {
+  file->path = path;
+  file->text = NULL;
+  file->text_length = 0;
+  file->stream = open_memstream(&file->text, &file->text_length);
+  if (file->stream == NULL) {
+    fprintf(stderr, "Failed to open a buffer for %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// Files whose bytes didn't change keep their mtime, so make doesn't rebuild everything that includes them
+static bool close_generated_file(GeneratedFile *file, u32 *num_files_written) {
+  if (fclose(file->stream) != 0) {
+    fprintf(stderr, "Failed to render %s: %s\n", file->path, strerror(errno));
+    free(file->text);
+    return false;
+  }
+
+  bool changed = false;
+  bool success = write_file_if_changed(file->path, file->text, file->text_length, &changed);
+  if (!success) {
+    fprintf(stderr, "Failed to write %s: %s\n", file->path, strerror(errno));
+  } else if (changed) {
+    (*num_files_written)++;
+  }
+  free(file->text);
+  return success;
+}
+
+static bool codegen_with_arena(
+    ReflectorArena *arena,
+    CompiledShaders *compileds,
+    const char *out_path,
+    const ParsedShadersIR *ir,
+    BuildCache *cache,
+    const CodegenOptions *options,
+    bool *out_complete
+) {
+  u32 num_threads = options->num_threads;
 
   // Compile and replace GLSL slices.
-  CompiledShaders compiled_shaders;
-  bool compile_success = compile_shaders(ir, &compiled_shaders);
+  u32 num_shaders = ir->num_parsed_shaders;
+  bool compile_success = compile_shaders(arena, ir, compileds, cache, options, out_complete);
   if (!compile_success) {
     fprintf(stderr, "Shader compilation failed. Not writing %s.\n", out_path);
     return false;
   }
 
-  // Codegen.
-  FILE *dst = fopen(out_path, "w");
+  // Codegen. Types, Vulkan data and shader code go to separate files so that editing a shader body only rebuilds the
+  // code file.
+  char types_path[FULL_PATH_BUFFER_LENGTH];
+  char code_path[FULL_PATH_BUFFER_LENGTH];
+  char pack_path[FULL_PATH_BUFFER_LENGTH];
+  if (!make_generated_file_path(types_path, out_path, SHADER_TYPES_FILE_NAME) ||
+      !make_generated_file_path(code_path, out_path, SHADER_CODE_FILE_NAME) ||
+      !make_generated_file_path(pack_path, out_path, SPIRV_PACK_FILE_NAME)) {
+    fprintf(stderr, "Generated file paths next to %s are too long.\n", out_path);
+    return false;
+  }
 
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  u32 num_files_written = 0;
+  u32 num_files = 3;
+
+  // SPIR-V pack first, the code file refers to it
+  char absolute_pack_path[PATH_MAX];
+  u32 *pack_offsets = NULL;
+  u64 pack_hash = 0;
+  if (options->spirv_pack) {
+    pack_offsets = REFLECTOR_ARENA_PUSH_ARRAY(arena, u32, num_shaders);
+    u64 pack_length = 0;
+    u8 *pack = build_spirv_pack(arena, compileds, num_shaders, pack_offsets, &pack_length);
+    pack_hash = hash_bytes(FNV_OFFSET_BASIS, pack, pack_length);
+
+    bool changed = false;
+    if (!write_file_if_changed(pack_path, pack, pack_length, &changed)) {
+      fprintf(stderr, "Failed to write %s: %s\n", pack_path, strerror(errno));
+      return false;
+    }
+    num_files_written += changed ? 1 : 0;
+    num_files++;
+    if (!resolve_spirv_pack_path(pack_path, absolute_pack_path)) {
+      return false;
+    }
+  }
+
+  if (options->hot_reload) {
+    if (!write_hot_reload_spirv(compileds, num_shaders, out_path, &num_files_written, &num_files)) {
+      return false;
+    }
+  }
+
+  // Types
+  GeneratedFile file;
+  if (!open_generated_file(&file, types_path)) {
+    return false;
+  }
+  FILE *dst = file.stream;
   codegen_compiled_shader_header(dst);
   codegen_descriptor_set_enum(dst, ir);
   codegen_shader_handle_enum(dst, ir); // TODO deprecate
   codegen_shader_program_enum(dst, ir->programs, ir->num_programs);
   codegen_vertex_layout_enum(dst, ir);
   codegen_buffer_label_enum(dst, ir);
+  codegen_shader_spec_struct_definition(dst);
+  codegen_program_spec_struct_definition(dst);
+  codegen_struct_defintions(dst, ir->structs, ir->num_structs);
+  if (!close_generated_file(&file, &num_files_written)) {
+    return false;
+  }
+
+  // Vulkan data and declarations
+  if (!open_generated_file(&file, out_path)) {
+    return false;
+  }
+  dst = file.stream;
+  fprintf(dst, "// Generated shader header, do not edit\n");
+  fprintf(dst, "#pragma once\n");
+  fprintf(dst, "#include \"%s\"\n\n", SHADER_TYPES_FILE_NAME);
 
   generate_vulkan_vertex_layout_array(dst, ir);
   generate_opengl_vertex_layout_array(dst, ir);
@@ -1259,16 +1997,62 @@ bool codegen(const char *out_path, const ParsedShadersIR *ir) {
   generate_vulkan_descriptor_write_templates(dst, ir);
   generate_vulkan_descriptor_pool_size_array(dst, ir);
 
-  codegen_shader_spec_struct_definition(dst);
-  codegen_struct_defintions(dst, ir->structs, ir->num_structs);
-  codegen_compiled_code(dst, &compiled_shaders, ir->num_parsed_shaders);
-  codegen_shader_spec(dst, &compiled_shaders, ir->num_parsed_shaders);
+  codegen_compiled_code_declarations(dst, ir);
+  if (!close_generated_file(&file, &num_files_written)) {
+    return false;
+  }
 
-  codegen_program_spec_struct_definition(dst);
-  for (u32 i = 0; i < ir->num_programs; i++) {
-    codegen_program_spec(dst, &ir->programs[i]);
+  // SPIR-V, GLSL and specs
+  if (!open_generated_file(&file, code_path)) {
+    return false;
   }
+  dst = file.stream;
+  fprintf(dst, "// Generated shader code, do not edit\n");
+  fprintf(dst, "#include \"shaders.h\"\n\n");
 
+  if (options->spirv_pack) {
+    codegen_spirv_pack(dst, compileds, num_shaders, pack_offsets, absolute_pack_path, pack_hash);
+  }
+  codegen_compiled_code(arena, dst, compileds, num_shaders, num_threads, options->spirv_pack);
+  codegen_shader_spec(dst, compileds, num_shaders, options->spirv_pack);
+  for (u32 i = 0; i < ir->num_programs; i++) {
+    codegen_program_spec(dst, &ir->programs[i], options->spirv_pack);
+  }
   codegen_footer(dst, ir);
+  if (!close_generated_file(&file, &num_files_written)) {
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("Write:  %.1f ms, %u of %u files changed\n", elapsed_ms(&t0, &t1), num_files_written, num_files);
   return true;
 }
+
+// The real deal! Scratch for the whole run goes in one arena, freed at the end.
+bool codegen(
+    const char *out_path,
+    const ParsedShadersIR *ir,
+    BuildCache *cache,
+    const CodegenOptions *options,
+    bool *out_complete
+) {
+  *out_complete = true;
+  ReflectorArena arena = {};
+  u32 num_shaders = ir->num_parsed_shaders;
+  CompiledShaders compileds = {
+      .parsed = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&arena, const ParsedShader *, num_shaders),
+      .spirv_bytes_arrays = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&arena, SpirVBytesArray, num_shaders),
+      .gl_sources = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&arena, GLSLSource, num_shaders),
+      .vk_sources = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&arena, GLSLSource, num_shaders),
+  };
+  bool success = codegen_with_arena(&arena, &compileds, out_path, ir, cache, options, out_complete);
+
+  // The GLSL and SPIR-V are malloc'd per shader. Freed here, not left to exit, since --watch calls this every rebuild.
+  for (u32 i = 0; i < num_shaders; i++) {
+    free((void *)compileds.gl_sources[i].string);
+    free((void *)compileds.vk_sources[i].string);
+    free((void *)compileds.spirv_bytes_arrays[i].bytes);
+  }
+  destroy_reflector_arena(&arena);
+  return success;
+}
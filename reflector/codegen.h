@@ -1,20 +1,59 @@
 #pragma once
 
+#include "arena.h"
+#include "build_cache.h"
 #include "parser.h"
 #include "reflector.h"
 
+#include <sys/types.h>
+#include <time.h>
+
 #define TEMPLATE_FILE_LENGTH 128
+#define COMPILE_REPORT_SLOWEST 8
+#define SPIRV_OUTPUT_FD 3 // Where the compiler child finds the output memfd
+
+// Written next to the shaders.h output path. shader_types.h only holds types and names, shaders.h adds the Vulkan
+// tables and declarations, and the code file defines the SPIR-V, GLSL and specs and is linked into the engine.
+#define SHADER_TYPES_FILE_NAME "shader_types.h"
+#define SHADER_CODE_FILE_NAME "shader_code.cpp"
+#define SPIRV_PACK_FILE_NAME "shaders.spvpack"
+// With CodegenOptions::hot_reload, every shader's SPIR-V is also written to <name>.spv in this directory, next to the
+// generated files, for a running engine to pick up
+#define HOT_RELOAD_DIR_NAME "hot_reload"
 
 typedef struct {
   const u8 *bytes;
   u32 length;
 } SpirVBytesArray;
 
+// The external tools a CompileJob can run. Both write SPIR-V.
+typedef enum {
+  COMPILE_TOOL_GLSLANG,   // GLSL in, glslangValidator -V
+  COMPILE_TOOL_SPIRV_OPT, // SPIR-V in, spirv-opt with the passes in CompileJob::spirv_opt
+} CompileTool;
+
+// SPIR-V post-processing, combined as flags. Part of the SPIR-V cache key.
+typedef enum {
+  SPIRV_OPT_PERFORMANCE = 1 << 0, // spirv-opt -O
+  SPIRV_OPT_STRIP_DEBUG = 1 << 1, // spirv-opt --strip-debug
+} SpirvOptFlags;
+
 typedef struct {
-  const char *glsl_source_str;
-  char glsl_path[TEMPLATE_FILE_LENGTH];
-  char spirv_path[TEMPLATE_FILE_LENGTH];
+  CompileTool tool;
+  u32 spirv_opt;
+  const GLSLSource *source; // Stage and GLSL for reporting, whichever tool runs
+  const u8 *input;          // What the tool reads, the GLSL or the SPIR-V to optimize
+  u64 input_length;
+  const char *name;
+  bool in_memory;
+  int input_fd; // memfds when in_memory
+  int output_fd;
+  char input_path[TEMPLATE_FILE_LENGTH]; // tempfiles otherwise
+  char output_path[TEMPLATE_FILE_LENGTH];
   pid_t pid;
+  struct timespec start_time;
+  f64 ms;
+  bool finished;
 } CompileJob;
 
 typedef struct {
@@ -22,12 +61,44 @@ typedef struct {
   u32 length;
 } TemplateStringReplacement;
 
+// One entry per parsed shader, in codegen's arena
 typedef struct {
-  const ParsedShader *parsed[MAX_NUM_SHADERS];
-  SpirVBytesArray spirv_bytes_arrays[MAX_NUM_SHADERS];
-  GLSLSource gl_sources[MAX_NUM_SHADERS];
-  GLSLSource vk_sources[MAX_NUM_SHADERS];
+  const ParsedShader **parsed;
+  SpirVBytesArray *spirv_bytes_arrays;
+  GLSLSource *gl_sources;
+  GLSLSource *vk_sources;
 } CompiledShaders;
 
+typedef struct {
+  // Bounds both worker threads and concurrent compiler processes, 0 for one per core. The output doesn't depend on it.
+  u32 num_threads;
+  // Writes all SPIR-V to SPIRV_PACK_FILE_NAME, linked into the code file with .incbin, instead of as integer arrays
+  // the compiler has to parse
+  bool spirv_pack;
+  // SpirvOptFlags run on every freshly compiled shader
+  u32 spirv_opt;
+  // Writes HOT_RELOAD_DIR_NAME. Only changed shaders are rewritten, so a file's mtime tells the engine when to reload.
+  bool hot_reload;
+  // Prints every struct's std140, std430 and scalar size after parsing, and the member orders that would pack tighter.
+  // Builds even when nothing changed, so there's always a report.
+  bool layout_report;
+} CodegenOptions;
+
+// Drops, with a warning, whatever the tools on PATH can't do, so the build carries on without them. Call before
+// hashing the options, so hashes and cache keys only reflect what actually runs.
+void resolve_codegen_options(CodegenOptions *options);
+
 // Return value is whether codegen was successful or not.
-bool codegen(const char *output_filepath, const ParsedShadersIR *parsed_shaders_ir);
+// SPIR-V is taken from the cache where possible, and fresh compiles are stored in it.
+// out_complete is false when the output was written but a shader fell back to unoptimized SPIR-V because spirv-opt
+// failed on it. The build should be redone next time then, even if nothing changed.
+bool codegen(
+    const char *output_filepath,
+    const ParsedShadersIR *parsed_shaders_ir,
+    BuildCache *cache,
+    const CodegenOptions *options,
+    bool *out_complete
+);
+
+// Path of file_name in the directory of header_path, buf holds FULL_PATH_BUFFER_LENGTH. False if it doesn't fit.
+bool make_generated_file_path(char *buf, const char *header_path, const char *file_name);
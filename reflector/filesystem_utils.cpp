@@ -4,10 +4,12 @@
 #include <cstring>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 // Sanitize input dir.
 // If the path ends in shaders/, then use the path as is.
@@ -66,6 +68,25 @@ void free_shader_to_compile_list(ShaderToCompileList *shader_to_compile_list) {
       fprintf(stderr, "Attemped to free memory from ShaderToCompile when null\n");
     }
   }
+  free(shader_to_compile_list->shaders);
+  shader_to_compile_list->shaders = NULL;
+  shader_to_compile_list->num_shaders = 0;
+  shader_to_compile_list->capacity = 0;
+}
+
+static ShaderToCompile *push_shader_to_compile(ShaderToCompileList *shader_list) {
+  if (shader_list->num_shaders == shader_list->capacity) {
+    u32 new_capacity = shader_list->capacity ? shader_list->capacity * 2 : SHADER_LIST_INITIAL_CAPACITY;
+    ShaderToCompile *new_shaders =
+        (ShaderToCompile *)realloc(shader_list->shaders, new_capacity * sizeof(ShaderToCompile));
+    if (new_shaders == NULL) {
+      fprintf(stderr, "push_shader_to_compile: failed to grow the shader list to %u\n", new_capacity);
+      exit(1);
+    }
+    shader_list->shaders = new_shaders;
+    shader_list->capacity = new_capacity;
+  }
+  return &shader_list->shaders[shader_list->num_shaders++];
 }
 
 void push_subdirectory(SubdirectoryList *subdir_list, const char *s) {
@@ -152,6 +173,127 @@ const char *read_file(const char *path, u64 *out_size) {
   return buffer;
 }
 
+int read_fd_to_heap(int fd, u8 **out_buf, size_t *out_len) {
+  *out_buf = NULL;
+  *out_len = 0;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    return -1;
+  }
+  if (st.st_size <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size_t len = (size_t)st.st_size;
+  u8 *buf = (u8 *)malloc(len);
+  if (!buf) {
+    return -1;
+  }
+
+  size_t off = 0;
+  while (off < len) {
+    ssize_t n = read(fd, buf + off, len - off);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      free(buf);
+      return -1;
+    }
+    if (n == 0) {
+      break; // EOF (unexpected but handled)
+    }
+    off += (size_t)n;
+  }
+
+  if (off != len) {
+    free(buf);
+    errno = EIO;
+    return -1;
+  }
+
+  *out_buf = buf;
+  *out_len = len;
+  return 0;
+}
+
+int read_file_to_heap(const char *path, u8 **out_buf, size_t *out_len) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *out_buf = NULL;
+    *out_len = 0;
+    return -1;
+  }
+
+  int result = read_fd_to_heap(fd, out_buf, out_len);
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return result;
+}
+
+bool write_all(int fd, const void *bytes, u64 length) {
+  const u8 *cursor = (const u8 *)bytes;
+  u64 bytes_left = length;
+  while (bytes_left) {
+    ssize_t bytes_written = write(fd, cursor, bytes_left);
+    if (bytes_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    cursor += bytes_written;
+    bytes_left -= bytes_written;
+  }
+  return true;
+}
+
+// Writes to a temporary next to path and renames it over path, so readers never see a partial file.
+bool write_file_atomic(const char *path, const void *bytes, u64 length) {
+  char tmp_path[FULL_PATH_BUFFER_LENGTH];
+  int n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+  if (n < 0 || n >= FULL_PATH_BUFFER_LENGTH) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (!write_all(fd, bytes, length)) {
+    close(fd);
+    unlink(tmp_path);
+    return false;
+  }
+
+  if (close(fd) != 0 || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+bool write_file_if_changed(const char *path, const void *bytes, u64 length, bool *out_changed) {
+  u8 *existing = NULL;
+  size_t existing_length = 0;
+  if (read_file_to_heap(path, &existing, &existing_length) == 0) {
+    bool same = existing_length == length && (length == 0 || memcmp(existing, bytes, length) == 0);
+    free(existing);
+    if (same) {
+      *out_changed = false;
+      return true;
+    }
+  }
+
+  *out_changed = true;
+  return write_file_atomic(path, bytes, length);
+}
+
 static const char *scan_token(const char *src, char *out, u32 out_size, char delim) {
   u32 i = 0;
   while (*src != '\0' && *src != delim && i < out_size - 1)
@@ -160,21 +302,9 @@ static const char *scan_token(const char *src, char *out, u32 out_size, char del
   return src;
 }
 
-ShaderToCompileList collect_shaders_to_compile(
-    const SubdirectoryList *subdirectory_list, const char *shaders_root, const char *output_path
-) {
+ShaderToCompileList collect_shaders_to_compile(const SubdirectoryList *subdirectory_list, const char *shaders_root) {
   ShaderToCompileList shader_list;
   memset(&shader_list, 0, sizeof(shader_list));
-  bool found_newer_shader = false;
-
-  struct stat out_header_stat;
-  memset(&out_header_stat, 0, sizeof(out_header_stat));
-  if (stat(output_path, &out_header_stat) != 0) {
-    if (errno == ENOENT) {
-      printf("%s does not exist: Compiling shaders.\n", output_path);
-      shader_list.needs_recompiled = true;
-    }
-  }
 
   for (u32 subdir_index = 0; subdir_index < subdirectory_list->num_subdirectories; subdir_index++) {
     const char *subdir_path = subdirectory_list->subdirectories[subdir_index];
@@ -200,11 +330,6 @@ ShaderToCompileList collect_shaders_to_compile(
         continue;
       }
 
-      if (shader_list.num_shaders >= MAX_NUM_SHADERS) {
-        printf("%s(): Exceeded MAX_NUM_SHADERS\n", __func__);
-        break;
-      }
-
       // Full path is e.g. shaders/common/quad.vert.in
       // Sticks together subdirectory path (shaders/common/) and name (name.stage.in)
       char full_path[FULL_PATH_BUFFER_LENGTH];
@@ -228,11 +353,6 @@ ShaderToCompileList collect_shaders_to_compile(
         continue;
       }
 
-      if (shader_stat.st_mtime > out_header_stat.st_mtime) {
-        found_newer_shader = true;
-        shader_list.needs_recompiled = true;
-      }
-
       const char *shaders_prefix_trimmed_path = full_path + strlen(shaders_root) + 1;
       const char *cursor = shaders_prefix_trimmed_path;
       const char *last_slash_location = shaders_prefix_trimmed_path;
@@ -308,7 +428,7 @@ ShaderToCompileList collect_shaders_to_compile(
       }
       shader_name[shader_name_length] = '\0';
 
-      shader_list.shaders[shader_list.num_shaders++] = {
+      *push_shader_to_compile(&shader_list) = {
           .stage = shader_stage,
           .source = shader_source,
           .source_length = source_length,
@@ -320,9 +440,26 @@ ShaderToCompileList collect_shaders_to_compile(
     closedir(subdirectory);
   } // main loop over subdirectories
 
-  if (!found_newer_shader) {
-    printf("Found no shaders newer than %s.\n", output_path);
+  return shader_list;
+}
+
+bool reload_shader_source(ShaderToCompile *shader) {
+  // Not read_file, a file caught mid-save shouldn't take the whole watch down
+  u8 *bytes = NULL;
+  size_t length = 0;
+  if (read_file_to_heap(shader->source_path, &bytes, &length) != 0) {
+    fprintf(stderr, "%s(): Failed to reload %s: %s\n", __func__, shader->source_path, strerror(errno));
+    return false;
   }
+  char *source = (char *)realloc(bytes, length + 1);
+  if (source == NULL) {
+    fprintf(stderr, "Failed to allocate buffer for %s\n", shader->source_path);
+    exit(1);
+  }
+  source[length] = '\0';
 
-  return shader_list;
+  free((void *)shader->source);
+  shader->source = source;
+  shader->source_length = length;
+  return true;
 }
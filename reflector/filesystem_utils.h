@@ -5,6 +5,7 @@
 #define FULL_PATH_BUFFER_LENGTH 4096
 #define MAX_NUM_SUBDIRECTORIES 32
 #define SUBDIRECTORY_PATH_BUFFER_LENGTH 512
+#define SHADER_LIST_INITIAL_CAPACITY 64
 
 struct SubdirectoryList {
   u32 num_subdirectories;
@@ -21,15 +22,28 @@ struct ShaderToCompile {
   const char *source_path;
 };
 
+// shaders is malloc'd and grows as files are found
 struct ShaderToCompileList {
-  ShaderToCompile shaders[MAX_NUM_SHADERS];
+  ShaderToCompile *shaders;
   u32 num_shaders;
-  bool needs_recompiled;
+  u32 capacity;
 };
 
 void validate_in_path(const char *raw_path, char *out_path);
 void free_shader_to_compile_list(ShaderToCompileList *shader_to_compile_list);
 void push_subdirectory(SubdirectoryList *subdirectory_list, const char *s);
 void walk_dirs(const char *path, SubdirectoryList *subdirectory_list);
-ShaderToCompileList
-collect_shaders_to_compile(const SubdirectoryList *subdir_list, const char *shaders_root, const char *output_path);
+ShaderToCompileList collect_shaders_to_compile(const SubdirectoryList *subdir_list, const char *shaders_root);
+// Rereads the source from source_path. On failure prints why and keeps the old source.
+bool reload_shader_source(ShaderToCompile *shader);
+
+// Returns 0 on success with out_buf malloc'd, -1 with errno set otherwise. read_fd_to_heap reads from the current
+// offset up to the file size.
+int read_fd_to_heap(int fd, u8 **out_buf, size_t *out_len);
+int read_file_to_heap(const char *path, u8 **out_buf, size_t *out_len);
+
+// Retries short writes and EINTR
+bool write_all(int fd, const void *bytes, u64 length);
+bool write_file_atomic(const char *path, const void *bytes, u64 length);
+// Leaves path alone, mtime included, when it already holds exactly these bytes. Otherwise writes it atomically.
+bool write_file_if_changed(const char *path, const void *bytes, u64 length, bool *out_changed);
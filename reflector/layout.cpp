@@ -0,0 +1,247 @@
+#include "layout.h"
+#include "arena.h"
+#include "reflector.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static u32 align_up(u32 offset, u32 alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
+
+static bool is_matrix(GLSLType type) {
+  return type == GLSL_TYPE_MAT2 || type == GLSL_TYPE_MAT3 || type == GLSL_TYPE_MAT4;
+}
+
+// Scalars and vectors. Matrices are laid out as arrays of their columns.
+static u32 glsl_type_num_components(GLSLType type) {
+  switch (type) {
+  case GLSL_TYPE_FLOAT:
+  case GLSL_TYPE_UINT:
+    return 1;
+  case GLSL_TYPE_VEC2:
+  case GLSL_TYPE_MAT2:
+    return 2;
+  case GLSL_TYPE_VEC3:
+  case GLSL_TYPE_MAT3:
+    return 3;
+  case GLSL_TYPE_VEC4:
+  case GLSL_TYPE_MAT4:
+    return 4;
+  case GLSL_TYPE_NULL:
+  default:
+    return 0;
+  }
+}
+
+// One member on its own, at offset 0. array_length 0 is not an array, like the parser leaves it.
+static GLSLMemberLayout layout_glsl_member(GLSLType type, u32 array_length, GLSLLayoutRule rule) {
+  // Base alignment and size of a scalar or vector, or of one matrix column
+  u32 num_components = glsl_type_num_components(type);
+  u32 size = 4 * num_components;
+  u32 alignment = 4;
+  if (rule != GLSL_LAYOUT_SCALAR) {
+    alignment = num_components == 1 ? 4 : (num_components == 2 ? 8 : 16);
+  }
+
+  u32 num_columns = is_matrix(type) ? num_components : 1;
+  u32 num_elements = array_length > 0 ? array_length : 1;
+  if (num_columns == 1 && array_length == 0) {
+    return {.offset = 0, .size = size, .alignment = alignment, .array_stride = 0};
+  }
+
+  // Arrays and matrices. std140 rounds their alignment, and so the stride, up to a vec4.
+  if (rule == GLSL_LAYOUT_STD140) {
+    alignment = align_up(alignment, 16);
+  }
+  u32 column_stride = rule == GLSL_LAYOUT_SCALAR ? size : align_up(size, alignment);
+  u32 element_size = column_stride * num_columns;
+  return {
+      .offset = 0,
+      .size = element_size * num_elements,
+      .alignment = alignment,
+      .array_stride = array_length > 0 ? element_size : 0,
+  };
+}
+
+u32 layout_glsl_struct(
+    const GLSLStructMember *members,
+    u32 num_members,
+    GLSLLayoutRule rule,
+    GLSLMemberLayout *out_layouts
+) {
+  u32 offset = 0;
+  u32 max_alignment = 1;
+  for (u32 i = 0; i < num_members; i++) {
+    GLSLMemberLayout layout = layout_glsl_member(members[i].type, members[i].array_length, rule);
+    layout.offset = align_up(offset, layout.alignment);
+    offset = layout.offset + layout.size;
+    if (layout.alignment > max_alignment) {
+      max_alignment = layout.alignment;
+    }
+    out_layouts[i] = layout;
+  }
+  return align_up(offset, max_alignment);
+}
+
+static void log_member_type(FILE *dst, const GLSLStructMember *member) {
+  fprintf(dst, "%s", glsl_type_to_string[member->type]);
+  if (member->array_length > 0) {
+    fprintf(dst, "[%u]", member->array_length);
+  }
+}
+
+bool validate_glsl_struct_c_layout(
+    const GLSLStruct *glsl_struct,
+    const GLSLMemberLayout *layouts,
+    GLSLLayoutRule rule
+) {
+  // Codegen emits alignas(layout alignment) and the linalg type, an array only past one element
+  u32 c_end = 0;
+  for (u32 i = 0; i < glsl_struct->num_members; i++) {
+    const GLSLStructMember *member = &glsl_struct->members[i];
+    const GLSLMemberLayout *layout = &layouts[i];
+    u32 c_count = member->array_length > 1 ? member->array_length : 1;
+    u32 c_offset = align_up(c_end, layout->alignment);
+    u32 c_size = glsl_type_to_size[member->type] * c_count;
+    c_end = c_offset + c_size;
+    if (member->type != GLSL_TYPE_MAT2 && c_offset == layout->offset && c_size == layout->size) {
+      continue;
+    }
+
+    fprintf(
+        stderr, "Struct %.*s: member %.*s (", glsl_struct->type_name_len, glsl_struct->type_name,
+        member->identifier_length, member->identifier
+    );
+    log_member_type(stderr, member);
+    fprintf(
+        stderr, ") is %u bytes at offset %u under %s, the generated C struct can't match it.\n", layout->size,
+        layout->offset, glsl_layout_rule_to_string[rule]
+    );
+    if (member->type == GLSL_TYPE_MAT2) {
+      fprintf(stderr, "    There is no C Mat2, use a vec4.\n");
+    } else if (member->type == GLSL_TYPE_MAT3) {
+      fprintf(stderr, "    Its columns are padded to 16 bytes, the C Mat3 is packed. Use a mat4.\n");
+    } else if (member->array_length > 0) {
+      fprintf(
+          stderr, "    The array stride is %u bytes, the C array's %u. Use vec4 or mat4 elements.\n",
+          layout->array_stride, glsl_type_to_size[member->type]
+      );
+    }
+    return false;
+  }
+  return true;
+}
+
+bool validate_push_constant_layout(
+    ReflectorArena *arena,
+    const GLSLStruct *glsl_struct,
+    const GLSLMemberLayout *layouts
+) {
+  GLSLMemberLayout *std430_layouts = REFLECTOR_ARENA_PUSH_ARRAY(arena, GLSLMemberLayout, glsl_struct->num_members);
+  layout_glsl_struct(glsl_struct->members, glsl_struct->num_members, GLSL_LAYOUT_STD430, std430_layouts);
+  for (u32 i = 0; i < glsl_struct->num_members; i++) {
+    if (std430_layouts[i].offset == layouts[i].offset && std430_layouts[i].size == layouts[i].size) {
+      continue;
+    }
+    const GLSLStructMember *member = &glsl_struct->members[i];
+    fprintf(
+        stderr,
+        "Push constant %.*s: member %.*s is at offset %u under std430 (Vulkan) but %u under std140 (OpenGL). Reorder "
+        "or pad it so both agree.\n",
+        glsl_struct->type_name_len, glsl_struct->type_name, member->identifier_length, member->identifier,
+        std430_layouts[i].offset, layouts[i].offset
+    );
+    return false;
+  }
+  return true;
+}
+
+u32 pack_glsl_struct_members(
+    ReflectorArena *arena,
+    const GLSLStructMember *members,
+    u32 num_members,
+    GLSLLayoutRule rule,
+    u32 *out_order
+) {
+  GLSLMemberLayout *layouts = REFLECTOR_ARENA_PUSH_ARRAY(arena, GLSLMemberLayout, num_members);
+  u32 declared_size = layout_glsl_struct(members, num_members, rule, layouts);
+  bool *placed = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(arena, bool, num_members);
+
+  u32 offset = 0;
+  u32 max_alignment = 1;
+  for (u32 n = 0; n < num_members; n++) {
+    u32 best = num_members;
+    u32 best_padding = 0;
+    for (u32 i = 0; i < num_members; i++) {
+      if (placed[i]) {
+        continue;
+      }
+      u32 padding = align_up(offset, layouts[i].alignment) - offset;
+      bool better = best == num_members || padding < best_padding ||
+                    (padding == best_padding && layouts[i].alignment > layouts[best].alignment) ||
+                    (padding == best_padding && layouts[i].alignment == layouts[best].alignment &&
+                     layouts[i].size > layouts[best].size);
+      if (better) {
+        best = i;
+        best_padding = padding;
+      }
+    }
+    placed[best] = true;
+    out_order[n] = best;
+    offset += best_padding + layouts[best].size;
+    if (layouts[best].alignment > max_alignment) {
+      max_alignment = layouts[best].alignment;
+    }
+  }
+
+  u32 packed_size = align_up(offset, max_alignment);
+  if (packed_size < declared_size) {
+    return packed_size;
+  }
+  for (u32 i = 0; i < num_members; i++) {
+    out_order[i] = i;
+  }
+  return declared_size;
+}
+
+void report_glsl_struct_layouts(FILE *dst, const GLSLStruct *glsl_structs, u32 num_glsl_structs) {
+  ReflectorArena arena = {};
+  u32 total_saved = 0;
+  fprintf(dst, "Struct layouts, bytes:             std140  std430  scalar  padding\n");
+  for (u32 i = 0; i < num_glsl_structs; i++) {
+    const GLSLStruct *glsl_struct = &glsl_structs[i];
+    u32 num_members = glsl_struct->num_members;
+    GLSLMemberLayout *layouts = REFLECTOR_ARENA_PUSH_ARRAY(&arena, GLSLMemberLayout, num_members);
+
+    u32 sizes[NUM_GLSL_LAYOUT_RULES];
+    for (u32 rule = 0; rule < NUM_GLSL_LAYOUT_RULES; rule++) {
+      sizes[rule] = layout_glsl_struct(glsl_struct->members, num_members, (GLSLLayoutRule)rule, layouts);
+    }
+    u32 data_size = 0;
+    for (u32 j = 0; j < num_members; j++) {
+      const GLSLStructMember *member = &glsl_struct->members[j];
+      data_size += layout_glsl_member(member->type, member->array_length, GLSL_LAYOUT_SCALAR).size;
+    }
+    fprintf(
+        dst, "  %-32.*s %6u  %6u  %6u  %7u\n", glsl_struct->type_name_len, glsl_struct->type_name,
+        sizes[GLSL_LAYOUT_STD140], sizes[GLSL_LAYOUT_STD430], sizes[GLSL_LAYOUT_SCALAR],
+        sizes[GLSL_LAYOUT_STD140] - data_size
+    );
+
+    // Reordering is only suggested, the order is the shader's
+    u32 *order = REFLECTOR_ARENA_PUSH_ARRAY(&arena, u32, num_members);
+    u32 packed_size = pack_glsl_struct_members(&arena, glsl_struct->members, num_members, GLSL_LAYOUT_STD140, order);
+    if (packed_size < sizes[GLSL_LAYOUT_STD140]) {
+      u32 saved = sizes[GLSL_LAYOUT_STD140] - packed_size;
+      total_saved += saved;
+      fprintf(dst, "    Reordered to save %u bytes:", saved);
+      for (u32 j = 0; j < num_members; j++) {
+        const GLSLStructMember *member = &glsl_struct->members[order[j]];
+        fprintf(dst, " %.*s", member->identifier_length, member->identifier);
+      }
+      fprintf(dst, "\n");
+    }
+    reflector_arena_reset(&arena);
+  }
+  fprintf(dst, "Reordering members would save %u bytes across %u structs.\n", total_saved, num_glsl_structs);
+  destroy_reflector_arena(&arena);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "arena.h"
+#include "reflector.h"
+
+#include <stdio.h>
+
+// GLSL block layouts: where each struct member lands under std140, std430 and scalar block layout, and whether the C
+// struct codegen emits for it lands on the same bytes.
+//
+// Uniform blocks are std140 on both backends. Vulkan push constants default to std430, but OpenGL gets them as a std140
+// uniform block, and both share one C struct, so push constants must lay out the same under both. Scalar layout needs
+// VK_EXT_scalar_block_layout, which the engine doesn't enable, it is only reported.
+//
+// The C struct puts every member at alignas(member alignment) with the linalg type. That can't express array strides
+// or matrix columns padded to 16 bytes, so structs that would need them are rejected instead of silently disagreeing
+// with the shader.
+
+enum GLSLLayoutRule {
+  GLSL_LAYOUT_STD140,
+  GLSL_LAYOUT_STD430,
+  GLSL_LAYOUT_SCALAR,
+  NUM_GLSL_LAYOUT_RULES,
+};
+
+static const char *glsl_layout_rule_to_string[NUM_GLSL_LAYOUT_RULES] = {
+    [GLSL_LAYOUT_STD140] = "std140",
+    [GLSL_LAYOUT_STD430] = "std430",
+    [GLSL_LAYOUT_SCALAR] = "scalar",
+};
+
+struct GLSLMemberLayout {
+  u32 offset;
+  u32 size;
+  u32 alignment;
+  u32 array_stride; // 0 unless the member is an array
+};
+
+// Lays out members in order, writing one GLSLMemberLayout per member, and returns the block size: the end of the last
+// member rounded up to the largest member alignment.
+u32 layout_glsl_struct(
+    const GLSLStructMember *members,
+    u32 num_members,
+    GLSLLayoutRule rule,
+    GLSLMemberLayout *out_layouts
+);
+
+// Checks the emitted C struct against layouts, computed with layout_glsl_struct. On a mismatch, reports the member to
+// stderr and returns false.
+bool validate_glsl_struct_c_layout(
+    const GLSLStruct *glsl_struct,
+    const GLSLMemberLayout *layouts,
+    GLSLLayoutRule rule
+);
+
+// Push constants are std430 on Vulkan and std140 on OpenGL, see above. layouts is the struct's std140 layout.
+bool validate_push_constant_layout(
+    ReflectorArena *arena,
+    const GLSLStruct *glsl_struct,
+    const GLSLMemberLayout *layouts
+);
+
+// Greedy packing: at each offset, places the member that needs the least padding there, the most aligned first. Writes
+// the order to out_order and returns the block size it gives, or the declared order and size if that is no larger.
+u32 pack_glsl_struct_members(
+    ReflectorArena *arena,
+    const GLSLStructMember *members,
+    u32 num_members,
+    GLSLLayoutRule rule,
+    u32 *out_order
+);
+
+// For --layout-report: block size under every rule, padding, and the member order that would save bytes
+void report_glsl_struct_layouts(FILE *dst, const GLSLStruct *glsl_structs, u32 num_glsl_structs);
@@ -0,0 +1,390 @@
+#include "lexer.h"
+#include "arena.h"
+#include "reflector.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool is_octal_digit(char c) { return c >= '0' && c <= '7'; }
+
+static bool is_hex_digit(char c) {
+  bool is_upper_hex = (c >= 'A' && c <= 'F');
+  bool is_lower_hex = (c >= 'a' && c <= 'f');
+  return is_digit(c) || is_lower_hex || is_upper_hex;
+}
+
+static bool is_nondigit(char c) {
+  bool is_upper = (c >= 'A' && c <= 'Z');
+  bool is_lower = (c >= 'a' && c <= 'z');
+  return c == '_' || is_lower || is_upper;
+}
+
+// Shortest and longest keywords, "in" and "sampler2DArray"/"TIGHTLY_PACKED"/"INSTANCE_INDEX"
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 14
+
+// Most words in a shader are identifiers, so reject on length and first char before comparing anything. Only the
+// keywords sharing the first char are compared after that, at most five.
+TokenType string_slice_to_keyword_or_identifier(const char *string, u32 length) {
+  if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+    return TOKEN_TYPE_TEXT;
+  }
+
+  // clang-format off
+#define KW(kw, token) if (length == (sizeof(kw) - 1) && (memcmp(string, kw, length) == 0)) { return token; }
+  switch (string[0]) {
+  case 'f':
+    KW("float",               TOKEN_TYPE_FLOAT)
+    break;
+  case 'i':
+    KW("in",                  TOKEN_TYPE_IN)
+    KW("image2D",             TOKEN_TYPE_IMAGE2D)
+    break;
+  case 'm':
+    KW("mat2",                TOKEN_TYPE_MAT2)
+    KW("mat3",                TOKEN_TYPE_MAT3)
+    KW("mat4",                TOKEN_TYPE_MAT4)
+    break;
+  case 'o':
+    KW("out",                 TOKEN_TYPE_OUT)
+    break;
+  case 's':
+    KW("sampler",             TOKEN_TYPE_SAMPLER)
+    KW("sampler2D",           TOKEN_TYPE_SAMPLER2D)
+    KW("sampler2DArray",      TOKEN_TYPE_SAMPLER2D_ARRAY)
+    break;
+  case 't':
+    KW("texture2D",           TOKEN_TYPE_TEXTURE2D)
+    break;
+  case 'u':
+    KW("uniform",             TOKEN_TYPE_UNIFORM)
+    KW("uint",                TOKEN_TYPE_UINT)
+    break;
+  case 'v':
+    KW("version",             TOKEN_TYPE_VERSION)
+    KW("void",                TOKEN_TYPE_VOID)
+    KW("vec2",                TOKEN_TYPE_VEC2)
+    KW("vec3",                TOKEN_TYPE_VEC3)
+    KW("vec4",                TOKEN_TYPE_VEC4)
+    break;
+  case 'B':
+    KW("BINDLESS",            TOKEN_TYPE_BINDLESS)
+    KW("BINDING",             TOKEN_TYPE_BINDING)
+    break;
+  case 'F':
+    KW("FORMAT",              TOKEN_TYPE_FORMAT)
+    break;
+  case 'I':
+    KW("INSTANCE_INDEX",      TOKEN_TYPE_DIRECTIVE_INSTANCE_INDEX)
+    break;
+  case 'L':
+    KW("LOCATION",            TOKEN_TYPE_DIRECTIVE_LOCATION)
+    break;
+  case 'O':
+    KW("OFFSET",              TOKEN_TYPE_OFFSET)
+    break;
+  case 'P':
+    KW("PUSH_CONSTANT",       TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT)
+    break;
+  case 'R':
+    KW("RATE_VERTEX",         TOKEN_TYPE_RATE_VERTEX)
+    KW("RATE_INSTANCE",       TOKEN_TYPE_RATE_INSTANCE)
+    break;
+  case 'S':
+    KW("SET_BINDING",         TOKEN_TYPE_DIRECTIVE_SET_BINDING)
+    KW("SET_LABEL",           TOKEN_TYPE_SET_LABEL)
+    break;
+  case 'T':
+    KW("TIGHTLY_PACKED",      TOKEN_TYPE_TIGHTLY_PACKED)
+    break;
+  case 'V':
+    KW("VERSION",             TOKEN_TYPE_DIRECTIVE_VERSION)
+    KW("VERTEX_SHADER",       TOKEN_TYPE_DIRECTIVE_VERTEX_SHADER)
+    KW("VERTEX_INDEX",        TOKEN_TYPE_DIRECTIVE_VERTEX_INDEX)
+    break;
+  default:
+    break;
+  }
+  // clang-format on
+#undef KW
+  return TOKEN_TYPE_TEXT;
+}
+
+// return the number of chars consumed, i.e. length of lexed number looking
+// thing
+static u32 lex_number(const char *string, u32 string_length) {
+  bool seen_decimal_point = false;
+  bool seen_exponent = false;
+  bool seen_float_suffix = false;
+  bool seen_unsigned_suffix = false;
+  u32 i = 0;
+
+  // check hex
+  if (string_length >= 2 && (string[0] == '0' && (string[1] == 'x' || string[1] == 'X'))) {
+    i += 2;
+    while (i < string_length && (is_hex_digit(string[i]))) {
+      i++;
+    }
+    if (i < string_length && (string[i] == 'u' || string[i] == 'U')) {
+      i++;
+    }
+    return i;
+  }
+
+  // check octal
+  if (string_length >= 2 && (string[0] == '0' && is_octal_digit(string[1]))) {
+    i += 2;
+    while (i < string_length && (is_octal_digit(string[i]))) {
+      i++;
+    }
+    if (i < string_length && (string[i] == 'u' || string[i] == 'U')) {
+      i++;
+    }
+    return i;
+  }
+
+  while (i < string_length) {
+    char c = string[i];
+    if (is_digit(c)) {
+      i++;
+      continue;
+    }
+
+    // check decimal points
+    if (c == '.') {
+      if (seen_decimal_point) {
+        fprintf(stderr, "%s: found number with two decimal points\n", __func__);
+      }
+
+      if (seen_exponent) {
+        fprintf(stderr, "%s: found number with decimal exponent\n", __func__);
+      }
+
+      seen_decimal_point = true;
+      i++;
+      continue;
+    }
+
+    // check exponents
+    if (c == 'e' || c == 'E') {
+      if (seen_exponent) {
+        fprintf(stderr, "%s: found number with two exponents\n", __func__);
+      }
+      seen_exponent = true;
+      i++;
+
+      if (i < string_length && (string[i] == '+' || string[i] == '-')) {
+        i++;
+      }
+
+      continue;
+    }
+
+    // check suffixes
+    // not currently supporting doubles
+    if (c == 'F' || c == 'f') {
+      if (seen_float_suffix) {
+        fprintf(stderr, "%s: found number with two float suffixes\n", __func__);
+      }
+      seen_float_suffix = true;
+      i++;
+      continue;
+    }
+
+    if (c == 'u' || c == 'U') {
+      if (seen_unsigned_suffix) {
+        fprintf(stderr, "%s: found number with two unsigned suffixes\n", __func__);
+      }
+      seen_unsigned_suffix = true;
+      i++;
+      continue;
+    }
+
+    // got something not part of a number, break
+    break;
+  }
+
+  return i;
+}
+
+TokenVector lex_string(const char *string, u64 string_length, ReflectorArena *arena) {
+  if (string_length >= UINT32_MAX) {
+    fprintf(stderr, "lex_string: %llu byte source is too long to lex\n", (unsigned long long)string_length);
+    exit(1);
+  }
+
+  TokenVector tokens = {
+      .size = 0,
+      .capacity = (u32)string_length,
+      .tokens = REFLECTOR_ARENA_PUSH_ARRAY(arena, Token, string_length + 1),
+  };
+
+  u64 i = 0;
+  while (i < string_length) {
+    char c = string[i];
+
+    if (c == ' ' || c == '\t' || c == '\n') {
+      i++;
+      continue;
+    }
+
+    switch (c) {
+    case '/': {
+      // skip line comments
+      if (i + 1 < string_length && string[i + 1] == '/') {
+        while (i < string_length && string[i] != '\n' && string[i] != '\0') {
+          i++;
+        }
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_SLASH, string + i));
+        i++;
+      }
+      break;
+    }
+
+      // periods and check numbers
+    case '.': {
+      if (i + 1 < string_length && is_digit(string[i + 1])) {
+        const char *start = string + i;
+        u32 consumed_chars = lex_number(string + i, string_length - i);
+        push_token(&tokens, new_text_token(TOKEN_TYPE_NUMBER, start, consumed_chars));
+        i += consumed_chars;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_PERIOD, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '{': {
+      if (i + 1 < string_length && string[i + 1] == '{') {
+        push_token(&tokens, new_token(TOKEN_TYPE_DOUBLE_L_BRACE, string + i));
+        i += 2;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_L_BRACE, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '}': {
+      if (i + 1 < string_length && string[i + 1] == '}') {
+        push_token(&tokens, new_token(TOKEN_TYPE_DOUBLE_R_BRACE, string + i));
+        i += 2;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_R_BRACE, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '+': {
+      if (i + 1 < string_length && string[i + 1] == '+') {
+        push_token(&tokens, new_token(TOKEN_TYPE_PLUS_PLUS, string + i));
+        i += 2;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_PLUS, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '-': {
+      if (i + 1 < string_length && string[i + 1] == '-') {
+        push_token(&tokens, new_token(TOKEN_TYPE_MINUS_MINUS, string + i));
+        i += 2;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_MINUS, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '=': {
+      if (i + 1 < string_length && string[i + 1] == '=') {
+        push_token(&tokens, new_token(TOKEN_TYPE_EQUALS_EQUALS, string + i));
+        i += 2;
+      } else {
+        push_token(&tokens, new_token(TOKEN_TYPE_EQUALS, string + i));
+        i++;
+      }
+      break;
+    }
+
+    case '#': {
+      push_token(&tokens, new_token(TOKEN_TYPE_POUND, string + i));
+      i++;
+      break;
+    }
+
+    case '(': {
+      push_token(&tokens, new_token(TOKEN_TYPE_L_PAREN, string + i));
+      i++;
+      break;
+    }
+
+    case ')': {
+      push_token(&tokens, new_token(TOKEN_TYPE_R_PAREN, string + i));
+      i++;
+      break;
+    }
+
+    case '[': {
+      push_token(&tokens, new_token(TOKEN_TYPE_L_BRACKET, string + i));
+      i++;
+      break;
+    }
+
+    case ']': {
+      push_token(&tokens, new_token(TOKEN_TYPE_R_BRACKET, string + i));
+      i++;
+      break;
+    }
+
+    case ';': {
+      push_token(&tokens, new_token(TOKEN_TYPE_SEMICOLON, string + i));
+      i++;
+      break;
+    }
+
+    case ',': {
+      push_token(&tokens, new_token(TOKEN_TYPE_COMMA, string + i));
+      i++;
+      break;
+    }
+
+    default: {
+      if (is_digit(c)) {
+        const char *start = string + i;
+        u32 consumed_chars = lex_number(string + i, string_length - i);
+        push_token(&tokens, new_text_token(TOKEN_TYPE_NUMBER, start, consumed_chars));
+        i += consumed_chars;
+      } else {
+        const char *text_start = string + i;
+        u32 start_index = i;
+        i++;
+
+        while (i < string_length && (is_nondigit(string[i]) || is_digit(string[i]))) {
+          i++;
+        }
+
+        u32 consumed_chars = i - start_index;
+        TokenType token_type = string_slice_to_keyword_or_identifier(text_start, consumed_chars);
+        if (token_type == TOKEN_TYPE_TEXT) {
+          push_token(&tokens, new_text_token(TOKEN_TYPE_TEXT, text_start, consumed_chars));
+        } else {
+          push_token(&tokens, new_token(token_type, text_start));
+        }
+      }
+    }
+    }
+  }
+
+  // Parsers peek one past the last token
+  tokens.tokens[tokens.size] = new_text_token(TOKEN_TYPE_TEXT, string + string_length, 0);
+  return tokens;
+}
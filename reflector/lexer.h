@@ -0,0 +1,171 @@
+#pragma once
+
+#include "arena.h"
+#include "reflector.h"
+
+#include <assert.h>
+
+typedef enum {
+  TOKEN_TYPE_POUND,
+  TOKEN_TYPE_DOUBLE_L_BRACE,
+  TOKEN_TYPE_DOUBLE_R_BRACE,
+  TOKEN_TYPE_L_BRACE,
+  TOKEN_TYPE_R_BRACE,
+  TOKEN_TYPE_L_PAREN,
+  TOKEN_TYPE_R_PAREN,
+  TOKEN_TYPE_L_BRACKET,
+  TOKEN_TYPE_R_BRACKET,
+  TOKEN_TYPE_SEMICOLON,
+  TOKEN_TYPE_COMMA,
+  TOKEN_TYPE_PERIOD,
+
+  TOKEN_TYPE_EQUALS,
+  TOKEN_TYPE_EQUALS_EQUALS,
+  TOKEN_TYPE_PLUS,
+  TOKEN_TYPE_PLUS_PLUS,
+  TOKEN_TYPE_MINUS,
+  TOKEN_TYPE_MINUS_MINUS,
+  TOKEN_TYPE_ASTERISK,
+  TOKEN_TYPE_SLASH,
+
+  TOKEN_TYPE_IN,
+  TOKEN_TYPE_OUT,
+  TOKEN_TYPE_VERSION,
+  TOKEN_TYPE_VOID,
+  TOKEN_TYPE_UNIFORM,
+  TOKEN_TYPE_SAMPLER,
+  TOKEN_TYPE_SAMPLER2D,
+  TOKEN_TYPE_SAMPLER2D_ARRAY,
+  TOKEN_TYPE_TEXTURE2D,
+  TOKEN_TYPE_IMAGE2D,
+
+  TOKEN_TYPE_FLOAT,
+  TOKEN_TYPE_UINT,
+  TOKEN_TYPE_VEC2,
+  TOKEN_TYPE_VEC3,
+  TOKEN_TYPE_VEC4,
+  TOKEN_TYPE_MAT2,
+  TOKEN_TYPE_MAT3,
+  TOKEN_TYPE_MAT4,
+
+  TOKEN_TYPE_DIRECTIVE_VERSION,
+  TOKEN_TYPE_DIRECTIVE_LOCATION,
+  TOKEN_TYPE_DIRECTIVE_SET_BINDING,
+  TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT,
+  TOKEN_TYPE_DIRECTIVE_VERTEX_SHADER,
+
+  TOKEN_TYPE_BINDLESS,
+  TOKEN_TYPE_RATE_VERTEX,
+  TOKEN_TYPE_RATE_INSTANCE,
+  TOKEN_TYPE_BINDING,
+  TOKEN_TYPE_OFFSET,
+  TOKEN_TYPE_TIGHTLY_PACKED,
+  TOKEN_TYPE_FORMAT,
+  TOKEN_TYPE_SET_LABEL,
+  TOKEN_TYPE_DIRECTIVE_VERTEX_INDEX,
+  TOKEN_TYPE_DIRECTIVE_INSTANCE_INDEX,
+
+  TOKEN_TYPE_TEXT,
+  TOKEN_TYPE_NUMBER,
+
+  NUM_TOKEN_TYPES
+} TokenType;
+
+static const char *token_type_to_string[NUM_TOKEN_TYPES] = {
+    [TOKEN_TYPE_POUND] = "#",
+    [TOKEN_TYPE_DOUBLE_L_BRACE] = "{{",
+    [TOKEN_TYPE_DOUBLE_R_BRACE] = "}}",
+    [TOKEN_TYPE_L_BRACE] = "{",
+    [TOKEN_TYPE_R_BRACE] = "}",
+    [TOKEN_TYPE_L_PAREN] = "(",
+    [TOKEN_TYPE_R_PAREN] = ")",
+    [TOKEN_TYPE_L_BRACKET] = "[",
+    [TOKEN_TYPE_R_BRACKET] = "]",
+    [TOKEN_TYPE_SEMICOLON] = ";",
+    [TOKEN_TYPE_COMMA] = ",",
+    [TOKEN_TYPE_PERIOD] = ".",
+
+    [TOKEN_TYPE_EQUALS] = "=",
+    [TOKEN_TYPE_EQUALS_EQUALS] = "==",
+    [TOKEN_TYPE_PLUS] = "+",
+    [TOKEN_TYPE_PLUS_PLUS] = "++",
+    [TOKEN_TYPE_MINUS] = "-",
+    [TOKEN_TYPE_MINUS_MINUS] = "--",
+    [TOKEN_TYPE_ASTERISK] = "*",
+    [TOKEN_TYPE_SLASH] = "/",
+
+    [TOKEN_TYPE_IN] = "in",
+    [TOKEN_TYPE_OUT] = "out",
+    [TOKEN_TYPE_VERSION] = "version",
+    [TOKEN_TYPE_VOID] = "void",
+    [TOKEN_TYPE_UNIFORM] = "uniform",
+    [TOKEN_TYPE_SAMPLER] = "sampler",
+    [TOKEN_TYPE_SAMPLER2D] = "sampler2D",
+    [TOKEN_TYPE_TEXTURE2D] = "texture2D",
+    [TOKEN_TYPE_IMAGE2D] = "image2D",
+
+    [TOKEN_TYPE_FLOAT] = "float",
+    [TOKEN_TYPE_UINT] = "uint",
+    [TOKEN_TYPE_VEC2] = "vec2",
+    [TOKEN_TYPE_VEC3] = "vec3",
+    [TOKEN_TYPE_VEC4] = "vec4",
+    [TOKEN_TYPE_MAT2] = "mat2",
+    [TOKEN_TYPE_MAT3] = "mat3",
+    [TOKEN_TYPE_MAT4] = "mat4",
+    [TOKEN_TYPE_DIRECTIVE_VERSION] = "VERSION",
+    [TOKEN_TYPE_DIRECTIVE_LOCATION] = "LOCATION",
+    [TOKEN_TYPE_DIRECTIVE_SET_BINDING] = "SET_BINDING",
+    [TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT] = "PUSH_CONSTANT",
+    [TOKEN_TYPE_RATE_VERTEX] = "RATE_VERTEX",
+    [TOKEN_TYPE_RATE_INSTANCE] = "RATE_INSTANCE",
+    [TOKEN_TYPE_BINDING] = "BINDING",
+    [TOKEN_TYPE_OFFSET] = "OFFSET",
+    [TOKEN_TYPE_TIGHTLY_PACKED] = "TIGHTLY_PACKED",
+    [TOKEN_TYPE_FORMAT] = "FORMAT",
+    [TOKEN_TYPE_SET_LABEL] = "SET_LABEL",
+
+    [TOKEN_TYPE_TEXT] = "a text literal",
+    [TOKEN_TYPE_NUMBER] = "a number literal",
+};
+
+// Token definitions. start points into the source, so tokens are only valid while it is.
+typedef struct {
+  const char *start;
+  u32 text_length;
+  TokenType type;
+} Token;
+
+inline Token new_token(TokenType type, const char *start) {
+  Token token;
+  token.type = type;
+  token.start = start;
+  token.text_length = 0;
+  return token;
+};
+
+inline Token new_text_token(TokenType type, const char *text, u32 text_length) {
+  Token token;
+  token.type = type;
+  token.start = text;
+  token.text_length = text_length;
+  return token;
+};
+
+// Every token is at least one char, so lex_string sizes tokens for one per source char up front and pushes never
+// reallocate. tokens[size] is always readable, a zero length text token at the end of the source.
+typedef struct {
+  u32 size;
+  u32 capacity;
+  Token *tokens;
+} TokenVector;
+
+inline void push_token(TokenVector *token_vector, Token token) {
+  assert(token_vector->size < token_vector->capacity);
+  token_vector->tokens[token_vector->size++] = token;
+}
+
+// Keywords and directive names get their own token type, anything else is TOKEN_TYPE_TEXT
+TokenType string_slice_to_keyword_or_identifier(const char *string, u32 length);
+
+// tokens live in arena
+TokenVector lex_string(const char *string, u64 string_length, ReflectorArena *arena);
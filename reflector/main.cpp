@@ -1,15 +1,156 @@
+#include "build_cache.h"
 #include "codegen.h"
 #include "filesystem_utils.h"
+#include "layout.h"
 #include "parser.h"
+#include "watch.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
+static f64 elapsed_ms(const struct timespec *t0, const struct timespec *t1) {
+  return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) * 1e-6;
+}
+
+// Every generated file has to be there to skip a build, the engine build needs all of them. Returns the first missing
+// one, written to path_buffer unless it's output_path itself, or NULL if none are.
+static const char *find_missing_generated_file(
+    const char *output_path,
+    const CodegenOptions *options,
+    char *path_buffer
+) {
+  const char *generated_file_names[] = {SHADER_TYPES_FILE_NAME, SHADER_CODE_FILE_NAME, SPIRV_PACK_FILE_NAME};
+  u32 num_generated_files = options->spirv_pack ? 3 : 2;
+  struct stat output_stat;
+  if (stat(output_path, &output_stat) != 0) {
+    return output_path;
+  }
+  for (u32 i = 0; i < num_generated_files; i++) {
+    if (!make_generated_file_path(path_buffer, output_path, generated_file_names[i]) ||
+        stat(path_buffer, &output_stat) != 0) {
+      return path_buffer;
+    }
+  }
+  if (options->hot_reload && (!make_generated_file_path(path_buffer, output_path, HOT_RELOAD_DIR_NAME) ||
+                              stat(path_buffer, &output_stat) != 0)) {
+    return path_buffer;
+  }
+  return NULL;
+}
+
+// Steps 3) and 4) of the main flow, skipped when the tree matches the last build. Only the shaders retained marks as
+// stale are parsed again.
+static bool build_shaders(
+    const char *output_path,
+    const ShaderToCompileList *shader_to_compile_list,
+    RetainedShaderParses *retained,
+    BuildCache *build_cache,
+    const CodegenOptions *codegen_options
+) {
+  // Options that change the output are part of the tree, so switching them regenerates
+  u64 tree_hash = shader_tree_hash(shader_to_compile_list);
+  tree_hash = hash_bytes(tree_hash, &codegen_options->spirv_pack, sizeof(codegen_options->spirv_pack));
+  tree_hash = hash_bytes(tree_hash, &codegen_options->spirv_opt, sizeof(codegen_options->spirv_opt));
+  tree_hash = hash_bytes(tree_hash, &codegen_options->hot_reload, sizeof(codegen_options->hot_reload));
+  char generated_path[FULL_PATH_BUFFER_LENGTH];
+  const char *missing_path = find_missing_generated_file(output_path, codegen_options, generated_path);
+  if (missing_path != NULL) {
+    printf("%s does not exist: Compiling shaders.\n", missing_path);
+  } else if (!codegen_options->layout_report && build_cache_tree_matches(build_cache, tree_hash)) {
+    printf("Shaders unchanged since %s was written.\n", output_path);
+    return true;
+  }
+
+  // 3) Parse shaders
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  ParsedShadersIR parsed_shaders_ir;
+  parse_shaders_retained(&parsed_shaders_ir, shader_to_compile_list, retained, codegen_options->num_threads);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("Parse:  %.1f ms\n", elapsed_ms(&t0, &t1));
+  if (!parsed_shaders_ir.parsing_successful) {
+    printf("Parsing error in shaders.\n");
+    free_parsed_shaders_ir(&parsed_shaders_ir);
+    return false;
+  }
+  if (codegen_options->layout_report) {
+    report_glsl_struct_layouts(stdout, parsed_shaders_ir.structs, parsed_shaders_ir.num_structs);
+  }
+
+  // 4) Codegen
+  build_cache->hits = 0;
+  build_cache->misses = 0;
+  bool codegen_complete = true;
+  bool codegen_successful = codegen(output_path, &parsed_shaders_ir, build_cache, codegen_options, &codegen_complete);
+  free_parsed_shaders_ir(&parsed_shaders_ir);
+  if (!codegen_successful) {
+    printf("Codegen error in shaders.\n");
+    return false;
+  }
+  // Without a matching tree hash the next run rebuilds, and retries spirv-opt on the shaders it failed on
+  if (codegen_complete) {
+    build_cache_store_tree(build_cache, tree_hash);
+  } else {
+    build_cache_clear_tree(build_cache);
+  }
+  return true;
+}
+
+// Reloads just the shaders that were written. Anything else, or a written file that isn't in the list yet, means
+// walking the tree and collecting every shader again. Returns whether it did.
+static bool apply_shader_tree_changes(
+    const ShaderTreeChanges *changes,
+    const char *input_dir_path,
+    SubdirectoryList *subdirectory_list,
+    ShaderToCompileList *shader_to_compile_list,
+    RetainedShaderParses *retained
+) {
+  bool recollect = changes->structural;
+  for (u32 i = 0; i < changes->num_paths && !recollect; i++) {
+    u32 shader_index = 0;
+    while (shader_index < shader_to_compile_list->num_shaders &&
+           strcmp(shader_to_compile_list->shaders[shader_index].source_path, changes->paths[i]) != 0) {
+      shader_index++;
+    }
+    if (shader_index == shader_to_compile_list->num_shaders) {
+      recollect = true;
+    } else if (reload_shader_source(&shader_to_compile_list->shaders[shader_index])) {
+      printf("Changed: %s\n", changes->paths[i]);
+      retained->stale[shader_index] = true;
+    } else {
+      recollect = true;
+    }
+  }
+  if (!recollect) {
+    return false;
+  }
+
+  printf("Shader tree changed, collecting shaders again.\n");
+  free_shader_to_compile_list(shader_to_compile_list);
+  memset(subdirectory_list, 0, sizeof(*subdirectory_list));
+  walk_dirs(input_dir_path, subdirectory_list);
+  *shader_to_compile_list = collect_shaders_to_compile(subdirectory_list, input_dir_path);
+  reset_retained_shader_parses(retained, shader_to_compile_list->num_shaders);
+  return true;
+}
+
 int main(int argc, char **argv) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
   // Parse args
   bool force_shaders = false;
+  bool watch = false;
+  CodegenOptions codegen_options = {
+      .num_threads = 0, // One per core
+      .spirv_pack = false,
+      .spirv_opt = 0,
+      .hot_reload = false,
+      .layout_report = false,
+  };
   const char *parsed_input_dir_path = NULL;
   for (int i = 1; i < argc; i++) {
     bool force =
@@ -18,6 +159,20 @@ int main(int argc, char **argv) {
       force_shaders = true;
     } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
       parsed_input_dir_path = argv[++i];
+    } else if ((strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) && i + 1 < argc) {
+      codegen_options.num_threads = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--spirv-pack") == 0) {
+      codegen_options.spirv_pack = true;
+    } else if (strcmp(argv[i], "--spirv-opt") == 0) {
+      codegen_options.spirv_opt |= SPIRV_OPT_PERFORMANCE;
+    } else if (strcmp(argv[i], "--spirv-strip-debug") == 0) {
+      codegen_options.spirv_opt |= SPIRV_OPT_STRIP_DEBUG;
+    } else if (strcmp(argv[i], "--layout-report") == 0) {
+      codegen_options.layout_report = true;
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      // A watching reflector is a development session, so also feed the engine's runtime hot reload
+      watch = true;
+      codegen_options.hot_reload = true;
     }
   }
 
@@ -57,9 +212,10 @@ int main(int argc, char **argv) {
 
   // Main flow:
   // 1) Walk dirs
-  // 2) Collect shaders
+  // 2) Collect shaders, skip everything if they match the last build
   // 3) Parse shaders and populate symbol tables
-  // 4) Codegen
+  // 4) Codegen, compiling only shaders missing from the cache
+  // With --watch, then wait for changes and go again from 2), or from 1) if files or directories came or went
 
   // 1) Walk dirs
   SubdirectoryList subdirectory_list;
@@ -67,38 +223,74 @@ int main(int argc, char **argv) {
   walk_dirs(input_dir_path, &subdirectory_list);
 
   // 2) Collect shaders
-  ShaderToCompileList shader_to_compile_list =
-      collect_shaders_to_compile(&subdirectory_list, input_dir_path, output_path);
-  if (shader_to_compile_list.num_shaders == 0) {
+  ShaderToCompileList shader_to_compile_list = collect_shaders_to_compile(&subdirectory_list, input_dir_path);
+  if (shader_to_compile_list.num_shaders == 0 && !watch) {
     printf("Got no shaders to compile, not recompiling.\n");
     return 0;
   }
 
-  if (!force_shaders && shader_to_compile_list.needs_recompiled == false) {
-    printf("Determined that we should not recompile, reflector exiting.\n");
+  BuildCache build_cache = open_build_cache(output_path, !force_shaders);
+  resolve_codegen_options(&codegen_options);
+  RetainedShaderParses retained = {};
+  reset_retained_shader_parses(&retained, shader_to_compile_list.num_shaders);
+  if (watch) {
+    build_cache_keep_in_memory(&build_cache);
+  }
+
+  bool success = shader_to_compile_list.num_shaders == 0 ||
+                 build_shaders(output_path, &shader_to_compile_list, &retained, &build_cache, &codegen_options);
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (!watch) {
+    free_retained_shader_parses(&retained);
+    free_shader_to_compile_list(&shader_to_compile_list);
+    close_build_cache(&build_cache);
+    if (!success) {
+      printf("Reflector exiting.\n");
+      return 1;
+    }
+    printf("Total:  %.1f ms\n", elapsed_ms(&start, &end));
+    printf("Successfully compiled shaders.\n\n");
     return 0;
   }
 
-  // 3) Parse shaders
-  struct timespec t0, t1;
-  clock_gettime(CLOCK_MONOTONIC, &t0);
-  ParsedShadersIR parsed_shaders_ir = parse_shaders(&shader_to_compile_list);
-  clock_gettime(CLOCK_MONOTONIC, &t1);
-  printf("Parse:  %.1f ms\n", (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
-  if (!parsed_shaders_ir.parsing_successful) {
-    printf("Parsing error in shaders, reflector exiting.\n");
+  // Keeps the shader list, the parses and every SPIR-V blob between builds. A rebuild reads and parses only the shaders
+  // that changed, and only those go to the compiler.
+  printf("Total:  %.1f ms\n", elapsed_ms(&start, &end));
+  build_cache.read_enabled = true; // --force only applies to the first build
+  ShaderTreeWatcher watcher;
+  if (!open_shader_tree_watcher(&watcher, input_dir_path, &subdirectory_list)) {
     return 1;
   }
+  printf("Watching %s for changes, Ctrl-C to stop.\n\n", input_dir_path);
+  fflush(stdout); // Often piped to an editor or a log, which wouldn't see anything until the buffer filled
 
-  // 4) Codegen
-  bool codegen_successful = codegen(output_path, &parsed_shaders_ir);
-  if (!codegen_successful) {
-    printf("Codegen error in shaders, reflector exiting.\n");
-    return 1;
+  static ShaderTreeChanges changes;
+  while (wait_for_shader_tree_changes(&watcher, &changes)) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool recollected =
+        apply_shader_tree_changes(&changes, input_dir_path, &subdirectory_list, &shader_to_compile_list, &retained);
+    if (recollected) {
+      close_shader_tree_watcher(&watcher);
+      if (!open_shader_tree_watcher(&watcher, input_dir_path, &subdirectory_list)) {
+        return 1;
+      }
+    }
+
+    if (shader_to_compile_list.num_shaders == 0) {
+      printf("Got no shaders to compile, not recompiling.\n\n");
+      fflush(stdout);
+      continue;
+    }
+    success = build_shaders(output_path, &shader_to_compile_list, &retained, &build_cache, &codegen_options);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%s in %.1f ms\n\n", success ? "Rebuilt" : "Failed", elapsed_ms(&start, &end));
+    fflush(stdout);
   }
 
-  // 5) cleanup
+  close_shader_tree_watcher(&watcher);
+  free_retained_shader_parses(&retained);
   free_shader_to_compile_list(&shader_to_compile_list);
-  printf("Successfully compiled shaders.\n\n");
-  return 0;
+  close_build_cache(&build_cache);
+  return 1;
 }
@@ -0,0 +1,67 @@
+#include "parallel.h"
+#include "reflector.h"
+
+#include <atomic>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MAX_PARALLEL_THREADS 64
+
+struct ParallelForEach {
+  ParallelTask task;
+  void *data;
+  u32 count;
+  std::atomic<u32> next_index;
+};
+
+static void *run_parallel_for_each(void *arg) {
+  ParallelForEach *work = (ParallelForEach *)arg;
+  for (;;) {
+    u32 index = work->next_index.fetch_add(1, std::memory_order_relaxed);
+    if (index >= work->count) {
+      break;
+    }
+    work->task(work->data, index);
+  }
+  return NULL;
+}
+
+u32 default_thread_count() {
+  long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_cores > 0 ? (u32)num_cores : 1;
+}
+
+void parallel_for_each(u32 count, u32 num_threads, ParallelTask task, void *data) {
+  if (num_threads == 0) {
+    num_threads = default_thread_count();
+  }
+  if (num_threads > count) {
+    num_threads = count;
+  }
+  if (num_threads > MAX_PARALLEL_THREADS) {
+    num_threads = MAX_PARALLEL_THREADS;
+  }
+
+  ParallelForEach work;
+  work.task = task;
+  work.data = data;
+  work.count = count;
+  work.next_index.store(0, std::memory_order_relaxed);
+
+  // The caller is one of the threads. Helpers that fail to start just leave more work for the others.
+  pthread_t helpers[MAX_PARALLEL_THREADS];
+  u32 num_helpers = 0;
+  for (u32 i = 1; i < num_threads; i++) {
+    if (pthread_create(&helpers[num_helpers], NULL, run_parallel_for_each, &work) != 0) {
+      fprintf(stderr, "parallel_for_each: failed to start a thread, continuing with %u\n", num_helpers + 1);
+      break;
+    }
+    num_helpers++;
+  }
+
+  run_parallel_for_each(&work);
+  for (u32 i = 0; i < num_helpers; i++) {
+    pthread_join(helpers[i], NULL);
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "reflector.h"
+
+// Minimal fork-join helper for the reflector's per-shader work. Indices are handed out one at a time from a shared
+// counter, so the order work runs in is arbitrary. Tasks write results to their own index and callers merge them in
+// index order afterwards, which keeps the output independent of the thread count.
+
+typedef void (*ParallelTask)(void *data, u32 index);
+
+// Number of online cores, at least 1
+u32 default_thread_count();
+
+// Calls task(data, i) for every i in [0, count) on up to num_threads threads, the calling thread included. Returns
+// when all calls have returned. num_threads 0 means default_thread_count().
+void parallel_for_each(u32 count, u32 num_threads, ParallelTask task, void *data);
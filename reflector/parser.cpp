@@ -1,11 +1,16 @@
 #include "parser.h"
+#include "arena.h"
 #include "filesystem_utils.h"
+#include "layout.h"
+#include "parallel.h"
 #include "reflector.h"
 
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static bool labels_match(const char *a, const char *b, u32 a_len, u32 b_len) {
   return a_len == b_len && (strncmp(a, b, a_len) == 0);
@@ -22,62 +27,6 @@ static Token get_next_token(Parser *parser) {
 
 static bool still_valid(Parser *parser) { return parser->token_index < parser->tokens.size; }
 
-static bool is_digit(char c) { return c >= '0' && c <= '9'; }
-
-static bool is_octal_digit(char c) { return c >= '0' && c <= '7'; }
-
-static bool is_hex_digit(char c) {
-  bool is_upper_hex = (c >= 'A' && c <= 'F');
-  bool is_lower_hex = (c >= 'a' && c <= 'f');
-  return is_digit(c) || is_lower_hex || is_upper_hex;
-}
-
-static bool is_nondigit(char c) {
-  bool is_upper = (c >= 'A' && c <= 'Z');
-  bool is_lower = (c >= 'a' && c <= 'z');
-  return c == '_' || is_lower || is_upper;
-}
-
-static TokenType string_slice_to_keyword_or_identifier(const char *string, u32 length) {
-  // clang-format off
-#define KW(kw, token) if (length == (sizeof(kw) - 1) && (strncmp(string, kw, length) == 0)) { return token; }
-  KW("in",                  TOKEN_TYPE_IN)
-  KW("out",                 TOKEN_TYPE_OUT)
-  KW("version",             TOKEN_TYPE_VERSION)
-  KW("void",                TOKEN_TYPE_VOID)
-  KW("uniform",             TOKEN_TYPE_UNIFORM)
-  KW("sampler",             TOKEN_TYPE_SAMPLER)
-  KW("sampler2D",           TOKEN_TYPE_SAMPLER2D)
-  KW("sampler2DArray",      TOKEN_TYPE_SAMPLER2D_ARRAY)
-  KW("texture2D",           TOKEN_TYPE_TEXTURE2D)
-  KW("image2D",             TOKEN_TYPE_IMAGE2D)
-  KW("uint",                TOKEN_TYPE_UINT)
-  KW("float",               TOKEN_TYPE_FLOAT)
-  KW("vec2",                TOKEN_TYPE_VEC2)
-  KW("vec3",                TOKEN_TYPE_VEC3)
-  KW("vec4",                TOKEN_TYPE_VEC4)
-  KW("mat2",                TOKEN_TYPE_MAT2)
-  KW("mat3",                TOKEN_TYPE_MAT3)
-  KW("mat4",                TOKEN_TYPE_MAT4)
-  KW("VERSION",             TOKEN_TYPE_DIRECTIVE_VERSION)
-  KW("LOCATION",            TOKEN_TYPE_DIRECTIVE_LOCATION)
-  KW("SET_BINDING",         TOKEN_TYPE_DIRECTIVE_SET_BINDING)
-  KW("PUSH_CONSTANT",       TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT)
-  KW("VERTEX_SHADER",       TOKEN_TYPE_DIRECTIVE_VERTEX_SHADER)
-  KW("BINDLESS",            TOKEN_TYPE_BINDLESS)
-  KW("RATE_VERTEX",         TOKEN_TYPE_RATE_VERTEX)
-  KW("RATE_INSTANCE",       TOKEN_TYPE_RATE_INSTANCE)
-  KW("BINDING",             TOKEN_TYPE_BINDING)
-  KW("OFFSET",              TOKEN_TYPE_OFFSET)
-  KW("TIGHTLY_PACKED",      TOKEN_TYPE_TIGHTLY_PACKED)
-  KW("SET_LABEL",           TOKEN_TYPE_SET_LABEL)
-  KW("VERTEX_INDEX",        TOKEN_TYPE_DIRECTIVE_VERTEX_INDEX)
-  KW("INSTANCE_INDEX",      TOKEN_TYPE_DIRECTIVE_INSTANCE_INDEX)
-  // clang-format on
-#undef KW
-  return TOKEN_TYPE_TEXT;
-}
-
 static VertexAttributeRate token_type_to_vertex_attribute_rate(TokenType type) {
   switch (type) {
   case TOKEN_TYPE_RATE_VERTEX:
@@ -90,6 +39,17 @@ static VertexAttributeRate token_type_to_vertex_attribute_rate(TokenType type) {
   }
 }
 
+// VERTEX_FORMAT_DEFAULT is only implied by leaving FORMAT out, so it is never matched by name
+static VertexFormat token_to_vertex_format(Token token) {
+  for (u32 i = VERTEX_FORMAT_DEFAULT + 1; i < NUM_VERTEX_FORMATS; i++) {
+    const char *name = vertex_format_info[i].name;
+    if (strlen(name) == token.text_length && memcmp(name, token.start, token.text_length) == 0) {
+      return (VertexFormat)i;
+    }
+  }
+  return NUM_VERTEX_FORMATS;
+}
+
 static GLSLType token_type_to_glsl_type(TokenType type) {
   switch (type) {
   case TOKEN_TYPE_FLOAT:
@@ -114,270 +74,6 @@ static GLSLType token_type_to_glsl_type(TokenType type) {
   }
 }
 
-// return the number of chars consumed, i.e. length of lexed number looking
-// thing
-static u32 lex_number(const char *string, u32 string_length) {
-  bool seen_decimal_point = false;
-  bool seen_exponent = false;
-  bool seen_float_suffix = false;
-  bool seen_unsigned_suffix = false;
-  u32 i = 0;
-
-  // check hex
-  if (string_length >= 2 && (string[0] == '0' && (string[1] == 'x' || string[1] == 'X'))) {
-    i += 2;
-    while (i < string_length && (is_hex_digit(string[i]))) {
-      i++;
-    }
-    if (i < string_length && (string[i] == 'u' || string[i] == 'U')) {
-      i++;
-    }
-    return i;
-  }
-
-  // check octal
-  if (string_length >= 2 && (string[0] == '0' && is_octal_digit(string[1]))) {
-    i += 2;
-    while (i < string_length && (is_octal_digit(string[i]))) {
-      i++;
-    }
-    if (i < string_length && (string[i] == 'u' || string[i] == 'U')) {
-      i++;
-    }
-    return i;
-  }
-
-  while (i < string_length) {
-    char c = string[i];
-    if (is_digit(c)) {
-      i++;
-      continue;
-    }
-
-    // check decimal points
-    if (c == '.') {
-      if (seen_decimal_point) {
-        fprintf(stderr, "%s: found number with two decimal points\n", __func__);
-      }
-
-      if (seen_exponent) {
-        fprintf(stderr, "%s: found number with decimal exponent\n", __func__);
-      }
-
-      seen_decimal_point = true;
-      i++;
-      continue;
-    }
-
-    // check exponents
-    if (c == 'e' || c == 'E') {
-      if (seen_exponent) {
-        fprintf(stderr, "%s: found number with two exponents\n", __func__);
-      }
-      seen_exponent = true;
-      i++;
-
-      if (i < string_length && (string[i] == '+' || string[i] == '-')) {
-        i++;
-      }
-
-      continue;
-    }
-
-    // check suffixes
-    // not currently supporting doubles
-    if (c == 'F' || c == 'f') {
-      if (seen_float_suffix) {
-        fprintf(stderr, "%s: found number with two float suffixes\n", __func__);
-      }
-      seen_float_suffix = true;
-      i++;
-      continue;
-    }
-
-    if (c == 'u' || c == 'U') {
-      if (seen_unsigned_suffix) {
-        fprintf(stderr, "%s: found number with two unsigned suffixes\n", __func__);
-      }
-      seen_unsigned_suffix = true;
-      i++;
-      continue;
-    }
-
-    // got something not part of a number, break
-    break;
-  }
-
-  return i;
-}
-
-static TokenVector lex_string(const char *string, u64 string_length) {
-  TokenVector tokens = new_token_vector();
-
-  u64 i = 0;
-  while (i < string_length) {
-    char c = string[i];
-
-    if (c == ' ' || c == '\t' || c == '\n') {
-      i++;
-      continue;
-    }
-
-    switch (c) {
-    case '/': {
-      // skip line comments
-      if (i + 1 < string_length && string[i + 1] == '/') {
-        while (i < string_length && string[i] != '\n' && string[i] != '\0') {
-          i++;
-        }
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_SLASH, string + i));
-        i++;
-      }
-      break;
-    }
-
-      // periods and check numbers
-    case '.': {
-      if (i + 1 < string_length && is_digit(string[i + 1])) {
-        const char *start = string + i;
-        u32 consumed_chars = lex_number(string + i, string_length - i);
-        push_token(&tokens, new_text_token(TOKEN_TYPE_NUMBER, start, consumed_chars));
-        i += consumed_chars;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_PERIOD, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '{': {
-      if (i + 1 < string_length && string[i + 1] == '{') {
-        push_token(&tokens, new_token(TOKEN_TYPE_DOUBLE_L_BRACE, string + i));
-        i += 2;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_L_BRACE, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '}': {
-      if (i + 1 < string_length && string[i + 1] == '}') {
-        push_token(&tokens, new_token(TOKEN_TYPE_DOUBLE_R_BRACE, string + i));
-        i += 2;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_R_BRACE, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '+': {
-      if (i + 1 < string_length && string[i + 1] == '+') {
-        push_token(&tokens, new_token(TOKEN_TYPE_PLUS_PLUS, string + i));
-        i += 2;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_PLUS, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '-': {
-      if (i + 1 < string_length && string[i + 1] == '-') {
-        push_token(&tokens, new_token(TOKEN_TYPE_MINUS_MINUS, string + i));
-        i += 2;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_MINUS, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '=': {
-      if (i + 1 < string_length && string[i + 1] == '=') {
-        push_token(&tokens, new_token(TOKEN_TYPE_EQUALS_EQUALS, string + i));
-        i += 2;
-      } else {
-        push_token(&tokens, new_token(TOKEN_TYPE_EQUALS, string + i));
-        i++;
-      }
-      break;
-    }
-
-    case '#': {
-      push_token(&tokens, new_token(TOKEN_TYPE_POUND, string + i));
-      i++;
-      break;
-    }
-
-    case '(': {
-      push_token(&tokens, new_token(TOKEN_TYPE_L_PAREN, string + i));
-      i++;
-      break;
-    }
-
-    case ')': {
-      push_token(&tokens, new_token(TOKEN_TYPE_R_PAREN, string + i));
-      i++;
-      break;
-    }
-
-    case '[': {
-      push_token(&tokens, new_token(TOKEN_TYPE_L_BRACKET, string + i));
-      i++;
-      break;
-    }
-
-    case ']': {
-      push_token(&tokens, new_token(TOKEN_TYPE_R_BRACKET, string + i));
-      i++;
-      break;
-    }
-
-    case ';': {
-      push_token(&tokens, new_token(TOKEN_TYPE_SEMICOLON, string + i));
-      i++;
-      break;
-    }
-
-    case ',': {
-      push_token(&tokens, new_token(TOKEN_TYPE_COMMA, string + i));
-      i++;
-      break;
-    }
-
-    default: {
-      if (is_digit(c)) {
-        const char *start = string + i;
-        u32 consumed_chars = lex_number(string + i, string_length - i);
-        push_token(&tokens, new_text_token(TOKEN_TYPE_NUMBER, start, consumed_chars));
-        i += consumed_chars;
-      } else {
-        const char *text_start = string + i;
-        u32 start_index = i;
-        i++;
-
-        while (i < string_length && (is_nondigit(string[i]) || is_digit(string[i]))) {
-          i++;
-        }
-
-        u32 consumed_chars = i - start_index;
-        TokenType token_type = string_slice_to_keyword_or_identifier(text_start, consumed_chars);
-        if (token_type == TOKEN_TYPE_TEXT) {
-          push_token(&tokens, new_text_token(TOKEN_TYPE_TEXT, text_start, consumed_chars));
-        } else {
-          push_token(&tokens, new_token(token_type, text_start));
-        }
-      }
-    }
-    }
-  }
-
-  return tokens;
-}
-
 static void
 report_parser_error(Parser *parser, const char *token_start, TokenType recovery_token_type, const char *fmt, ...) {
   const char *start = token_start;
@@ -399,9 +95,9 @@ report_parser_error(Parser *parser, const char *token_start, TokenType recovery_
   vsnprintf(buffer, sizeof(buffer), fmt, args);
   va_end(args);
 
-  printf("%sERROR%s: %s\n", RED, RESET, parser->input->source_path);
-  printf("       %s\n", buffer);                      // print message
-  printf("       %.*s\n", (int)(end - start), start); // print offending line
+  fprintf(parser->log, "%sERROR%s: %s\n", RED, RESET, parser->input->source_path);
+  fprintf(parser->log, "       %s\n", buffer);                      // print message
+  fprintf(parser->log, "       %.*s\n", (int)(end - start), start); // print offending line
 
   while (still_valid(parser)) {
     Token cur_tok = get_current_token(parser);
@@ -484,6 +180,8 @@ static u32 parse_integer_token(Parser *parser, Token token) {
 
 // {{ LOCATION 0 BINDING 0 RATE_VERTEX OFFSET TIGHTLY_PACKED }} in type identifier;
 // or
+// {{ LOCATION 0 BINDING 0 RATE_VERTEX OFFSET TIGHTLY_PACKED FORMAT HALF2 }} in type identifier;
+// or
 // {{ LOCATION 0 }} - for fragment and compute shaders, or
 static LocationDirectiveParse
 parse_location_directive(Parser *parser, ShaderStage shader_stage, TemplateStringSlice *template_string_slice) {
@@ -498,6 +196,7 @@ parse_location_directive(Parser *parser, ShaderStage shader_stage, TemplateStrin
       .vertex_attribute.offset = 0,
       .vertex_attribute.rate = VERTEX_ATTRIBUTE_RATE_VERTEX,
       .vertex_attribute.glsl_type = GLSL_TYPE_NULL,
+      .vertex_attribute.format = VERTEX_FORMAT_DEFAULT,
       .vertex_attribute.is_tightly_packed = false,
       .vertex_attribute.is_valid = false,
   };
@@ -614,12 +313,37 @@ parse_location_directive(Parser *parser, ShaderStage shader_stage, TemplateStrin
     is_tightly_packed = true;
   }
 
-  // double r brace
+  // optional format
   cur_tok = get_next_token(parser);
+  VertexFormat format = VERTEX_FORMAT_DEFAULT;
+  if (cur_tok.type == TOKEN_TYPE_FORMAT) {
+    cur_tok = get_next_token(parser);
+    if (cur_tok.type != TOKEN_TYPE_TEXT) {
+      report_parser_error(
+          parser, cur_tok.start, TOKEN_TYPE_DOUBLE_R_BRACE,
+          "Expected vertex format after FORMAT in location directive, got %s", token_type_to_string[cur_tok.type]
+      );
+      return location_parse;
+    }
+    format = token_to_vertex_format(cur_tok);
+    if (format == NUM_VERTEX_FORMATS) {
+      report_parser_error(
+          parser, cur_tok.start, TOKEN_TYPE_DOUBLE_R_BRACE,
+          "Unknown vertex format %.*s in location directive, expected UNORM8X4, SNORM16X2, HALF2, OCTAHEDRAL or "
+          "UNORM10_10_10_2",
+          cur_tok.text_length, cur_tok.start
+      );
+      return location_parse;
+    }
+    cur_tok = get_next_token(parser);
+  }
+
+  // double r brace
   if (cur_tok.type != TOKEN_TYPE_DOUBLE_R_BRACE) {
     report_parser_error(
         parser, cur_tok.start, TOKEN_TYPE_DOUBLE_R_BRACE,
-        "Expected DOUBLE_R_BRACE after offset in location directive, got %s", token_type_to_string[cur_tok.type]
+        "Expected FORMAT or DOUBLE_R_BRACE after offset in location directive, got %s",
+        token_type_to_string[cur_tok.type]
     );
     return location_parse;
   }
@@ -650,6 +374,14 @@ parse_location_directive(Parser *parser, ShaderStage shader_stage, TemplateStrin
     );
     return location_parse;
   }
+  GLSLType format_glsl_type = vertex_format_info[format].glsl_type;
+  if (format_glsl_type != GLSL_TYPE_NULL && glsl_type != format_glsl_type) {
+    report_parser_error(
+        parser, cur_tok.start, TOKEN_TYPE_SEMICOLON, "FORMAT %s in location directive is read as a %s, got %s",
+        vertex_format_info[format].name, glsl_type_to_string[format_glsl_type], glsl_type_to_string[glsl_type]
+    );
+    return location_parse;
+  }
 
   // identifier
   cur_tok = get_next_token(parser);
@@ -678,6 +410,7 @@ parse_location_directive(Parser *parser, ShaderStage shader_stage, TemplateStrin
         .binding = (u8)binding,
         .rate = vertex_attribute_rate,
         .glsl_type = glsl_type,
+        .format = format,
         .offset = offset,
         .is_valid = true,
         .is_tightly_packed = is_tightly_packed,
@@ -727,6 +460,17 @@ static void parse_glsl_struct_member_list(Parser *parser, GLSLStruct *glsl_struc
   assert(get_current_token(parser).type == TOKEN_TYPE_L_BRACE);
   glsl_struct->num_members = 0;
 
+  // Members can't nest, so each one ends in one of the semicolons before the closing brace
+  u32 max_members = 0;
+  for (u32 i = parser->token_index + 1; i < parser->tokens.size; i++) {
+    TokenType type = parser->tokens.tokens[i].type;
+    if (type == TOKEN_TYPE_R_BRACE) {
+      break;
+    }
+    max_members += (type == TOKEN_TYPE_SEMICOLON);
+  }
+  glsl_struct->members = REFLECTOR_ARENA_PUSH_ARRAY(parser->arena, GLSLStructMember, max_members);
+
   Token cur_tok = get_next_token(parser);
   while (still_valid(parser)) {
     GLSLStructMember member;
@@ -774,7 +518,7 @@ static void parse_glsl_struct_member_list(Parser *parser, GLSLStruct *glsl_struc
     }
     cur_tok = get_next_token(parser);
 
-    assert(member_list.num_members < MAX_NUM_STRUCT_MEMBERS);
+    assert(glsl_struct->num_members < max_members);
     glsl_struct->members[glsl_struct->num_members++] = member;
 
     if (cur_tok.type == TOKEN_TYPE_R_BRACE) {
@@ -1234,22 +978,28 @@ static void populate_vertex_layout_name(VertexLayout *vertex_layout) {
       );
     }
 
-    // need to append underscore and next type's slice
-    const char *next_slice = glsl_type_to_vertex_layout_enum_slice(vertex_layout->attributes[i].glsl_type);
-    u32 slice_length = strlen(next_slice);
-    u32 next_length = slice_length + 1;
-    // need to keep a null terminator, so stop at  max length - 1
-    if (current_length + next_length >= MAX_VERTEX_LAYOUT_NAME_LENGTH - 1) {
-      fprintf(
-          stderr, "Not enough space to add next glsl type to vertex layout name, which currently is %s.\n",
-          vertex_layout->name
-      );
-      return;
-    }
+    // need to append underscore and next type's slice, then the format's if it isn't the default
+    VertexFormat format = vertex_layout->attributes[i].format;
+    const char *slices[2] = {
+        glsl_type_to_vertex_layout_enum_slice(vertex_layout->attributes[i].glsl_type),
+        format != VERTEX_FORMAT_DEFAULT ? vertex_format_info[format].name : NULL,
+    };
+    for (u32 j = 0; j < 2 && slices[j] != NULL; j++) {
+      u32 slice_length = strlen(slices[j]);
+      u32 next_length = slice_length + 1;
+      // need to keep a null terminator, so stop at  max length - 1
+      if (current_length + next_length >= MAX_VERTEX_LAYOUT_NAME_LENGTH - 1) {
+        fprintf(
+            stderr, "Not enough space to add next glsl type to vertex layout name, which currently is %s.\n",
+            vertex_layout->name
+        );
+        return;
+      }
 
-    vertex_layout->name[current_length] = '_';
-    memcpy(vertex_layout->name + current_length + 1, next_slice, slice_length);
-    current_length += next_length;
+      vertex_layout->name[current_length] = '_';
+      memcpy(vertex_layout->name + current_length + 1, slices[j], slice_length);
+      current_length += next_length;
+    }
   }
 
   // the assumption here is that the vertex layout we're populating was 0'd out at init time,
@@ -1353,7 +1103,7 @@ static bool vertex_layout_validate_and_compute_offsets(VertexLayout *vertex_layo
     }
     u32 current_binding = vertex_layout->attributes[i].binding;
     vertex_layout->attributes[i].offset = vertex_layout->binding_strides[current_binding];
-    vertex_layout->binding_strides[current_binding] += glsl_type_to_size[vertex_layout->attributes[i].glsl_type];
+    vertex_layout->binding_strides[current_binding] += vertex_attribute_size(&vertex_layout->attributes[i]);
   }
 
   vertex_layout->binding_count = 0;
@@ -1584,36 +1334,45 @@ static u32 find_label_set_number(ShaderProgram *prog, DescriptorSetLayout *layou
   return prog->num_descriptor_set_layouts - 1;
 }
 
-static u32 align_up(u32 offset, u32 alignment) { return (offset + alignment - 1) & ~(alignment - 1); }
-
-static void populate_glsl_struct_size(GLSLStruct *glsl_struct) {
-  u32 max_alignment = 0;
-  u32 size = 0;
-  for (u32 i = 0; i < glsl_struct->num_members; i++) {
-    const GLSLStructMember *member = &glsl_struct->members[i];
-    u32 alignment = glsl_type_to_alignment[member->type];
-    if (alignment > max_alignment)
-      max_alignment = alignment;
-    size = align_up(size, alignment);
-    size += glsl_type_to_size[member->type];
-  }
-
-  // Align up to get full size, and then subtract data size from aligned size to emit padding.
-  glsl_struct->size_in_bytes = align_up(size, max_alignment);
-  glsl_struct->padding = glsl_struct->size_in_bytes - size;
+// std140, for uniform blocks on both backends and push constants on OpenGL. Fails if the C struct can't match it.
+static bool populate_glsl_struct_layout(ReflectorArena *arena, GLSLStruct *glsl_struct) {
+  GLSLMemberLayout *layouts = REFLECTOR_ARENA_PUSH_ARRAY(arena, GLSLMemberLayout, glsl_struct->num_members);
+  u32 size = layout_glsl_struct(glsl_struct->members, glsl_struct->num_members, GLSL_LAYOUT_STD140, layouts);
+  u32 end = 0;
+  if (glsl_struct->num_members > 0) {
+    const GLSLMemberLayout *last = &layouts[glsl_struct->num_members - 1];
+    end = last->offset + last->size;
+  }
+
+  // Padding is emitted after the last member, up to the full size
+  glsl_struct->member_layouts = layouts;
+  glsl_struct->size_in_bytes = size;
+  glsl_struct->padding = size - end;
+  return validate_glsl_struct_c_layout(glsl_struct, layouts, GLSL_LAYOUT_STD140);
 }
 
-static const GLSLStruct *push_struct(ParsedShadersIR *ir, const ShaderToCompile *input, GLSLStruct *new_struct) {
+static const GLSLStruct *push_struct(
+    ParsedShadersIR *ir,
+    const ShaderToCompile *input,
+    const GLSLStruct *new_struct
+) {
   const GLSLStruct *persistent_struct = NULL;
   const GLSLStruct *matching_struct = search_structs(new_struct, ir);
 
   if (matching_struct == NULL) { // Discovered new struct.
-    new_struct->discovered_shader_name = input->name;
-    new_struct->discovered_shader_name_len = input->name_len;
-    populate_glsl_struct_size(new_struct);
-
-    ir->structs[ir->num_structs] = *new_struct;
-    persistent_struct = &ir->structs[ir->num_structs++];
+    assert(ir->num_structs < ir->struct_capacity);
+    GLSLStruct *ir_struct = &ir->structs[ir->num_structs++];
+    *ir_struct = *new_struct;
+    ir_struct->discovered_shader_name = input->name;
+    ir_struct->discovered_shader_name_len = input->name_len;
+    ir_struct->members =
+        REFLECTOR_ARENA_PUSH_ARRAY_COPY(&ir->arena, GLSLStructMember, new_struct->members, new_struct->num_members);
+    if (!populate_glsl_struct_layout(&ir->arena, ir_struct)) {
+      fprintf(stderr, "Found in %.*s.\n", input->name_len, input->name);
+      ir->num_structs--;
+      return NULL;
+    }
+    persistent_struct = ir_struct;
   } else { // Found existing match.
     // Name is same. If mismatch, report error. If matches, update matching struct.
     bool mismatch = !member_list_equals(new_struct, matching_struct);
@@ -1633,55 +1392,45 @@ static const GLSLStruct *push_struct(ParsedShadersIR *ir, const ShaderToCompile
   return persistent_struct;
 }
 
-static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
+// Lex and parse one shader without looking at any other, so this can run on any thread. Structs are kept local and
+// vertex layouts unvalidated until merge_shader_parse deduplicates them against the rest of the tree.
+static void parse_shader_local(const ShaderToCompile *input, ShaderParse *out) {
+  FILE *log = open_memstream(&out->log, &out->log_size);
+  if (log == NULL) {
+    fprintf(stderr, "parse_shader_local: failed to open a log for %s\n", input->name);
+    exit(1);
+  }
+
+  // Tokens are only needed until the parse is done, the parse's own arena outlives it
+  ReflectorArena token_arena = {};
   Parser parser = {
       .success = true,
-      .tokens = lex_string(input->source, input->source_length),
+      .tokens = lex_string(input->source, input->source_length, &token_arena),
       .token_index = 0,
       .input = input,
+      .log = log,
+      .arena = &out->arena,
   };
 
-  // Validate no name conflicts
-  bool new_vert = (input->stage == SHADER_STAGE_VERTEX);
-  bool new_frag = (input->stage == SHADER_STAGE_FRAGMENT);
-  bool new_comp = (input->stage == SHADER_STAGE_COMPUTE);
-  for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
-    const ParsedShader *old = &ir->parsed_shaders[i];
-    if (strcmp(input->name, old->name) != 0) {
-      continue;
-    }
-
-    bool old_vert = (old->stage == SHADER_STAGE_VERTEX);
-    bool old_frag = (old->stage == SHADER_STAGE_FRAGMENT);
-    bool old_comp = (old->stage == SHADER_STAGE_COMPUTE);
-
-    bool valid = true;
-    if ((new_vert && old_vert) || (new_frag && old_frag) || (new_comp && old_comp)) {
-      char *stage_str = (char *)shader_stage_to_string[old->stage];
-      fprintf(stderr, "Shader %s has a duplicate %s stage.\n", input->name, stage_str);
-      valid = false;
-    }
-
-    bool old_graphics_new_comp = new_comp && (old_vert || old_frag);
-    bool new_graphics_old_comp = (new_vert || new_frag) && old_comp;
-    if (old_graphics_new_comp || new_graphics_old_comp) {
-      fprintf(stderr, "Shader %s mixes compute with vertex/fragment stages.\n", input->name);
-      valid = false;
-    }
-
-    if (!valid) {
-      return false;
-    }
-  }
-
   // Setup parsing
   u32 slice_idx = 0;
-  ParsedShader *parsed_shader = &ir->parsed_shaders[ir->num_parsed_shaders++];
-  *parsed_shader = {.name = input->name, .stage = input->stage};
-  VertexLayout vertex_layout = {};
+  ParsedShader *parsed_shader = &out->parsed;
+  *parsed_shader = {.stage = input->stage, .name = input->name, .source_path = input->source_path};
+
+  // Each directive adds at most one struct, one record, its own slice and the GLSL slice before it. Then there is the
+  // GLSL after the last one.
+  u32 num_directives = 0;
+  for (u32 i = 0; i < parser.tokens.size; i++) {
+    num_directives += (parser.tokens.tokens[i].type == TOKEN_TYPE_DOUBLE_L_BRACE);
+  }
+  parsed_shader->slices = REFLECTOR_ARENA_PUSH_ARRAY(&out->arena, TemplateStringSlice, 2 * num_directives + 1);
+  parsed_shader->set_binding_records = REFLECTOR_ARENA_PUSH_ARRAY(&out->arena, SetBindingRecord, num_directives);
+  out->structs = REFLECTOR_ARENA_PUSH_ARRAY(&out->arena, LocalStruct, num_directives);
+  VertexLayout *vertex_layout = &out->vertex_layout;
   TemplateStringSlice glsl_slice = {.start = input->source, .type = DIRECTIVE_TYPE_GLSL_SOURCE};
+  bool stop_parsing = false;
 
-  while (still_valid(&parser)) {
+  while (still_valid(&parser) && !stop_parsing) {
     Token cur_tok = get_current_token(&parser);
     if (cur_tok.type != TOKEN_TYPE_DOUBLE_L_BRACE) {
       advance(&parser);
@@ -1725,11 +1474,11 @@ static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
       u32 location = location_parse.vertex_attribute.location;
 
       if (location_parse.vertex_attribute.glsl_type != GLSL_TYPE_NULL) {
-        assert(input.stage == SHADER_STAGE_VERTEX);
-        if (vertex_layout.attributes[location].is_valid) {
-          fprintf(stderr, "Found repeat location %u for vertex layout in %s.\n", location, input->name);
+        assert(input->stage == SHADER_STAGE_VERTEX);
+        if (vertex_layout->attributes[location].is_valid) {
+          fprintf(log, "Found repeat location %u for vertex layout in %s.\n", location, input->name);
         } else {
-          vertex_layout.attributes[location] = location_parse.vertex_attribute;
+          vertex_layout->attributes[location] = location_parse.vertex_attribute;
         }
       }
 
@@ -1742,22 +1491,9 @@ static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
       PushConstantDirectiveParse pc_parse = parse_push_constant_directive(&parser, &slice);
       glsl_slice.start = pc_parse.next_glsl_source_start;
 
-      const GLSLStruct *persistent_struct = push_struct(ir, input, &pc_parse.glsl_struct);
-      if (persistent_struct == NULL) {
-        fprintf(stderr, "Shader %.*s has push constant, but cannot identify struct.\n", input->name_len, input->name);
-        return false;
-      } else {
-        parsed_shader->push_constant_struct = persistent_struct;
-      }
-
-      if (persistent_struct->size_in_bytes > 128) {
-        fprintf(
-            stderr, "Shader %.*s has push constant of size %u, exceeding max of 128.\n", input->name_len, input->name,
-            persistent_struct->size_in_bytes
-        );
-        return false;
+      if (pc_parse.was_successful) {
+        out->structs[out->num_structs++] = {.glsl_struct = pc_parse.glsl_struct, .record_index = -1};
       }
-
       break;
     } // End push constant
 
@@ -1768,18 +1504,18 @@ static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
       sb_parse.stage = input->stage;
       glsl_slice.start = sb_parse.next_glsl_source_start;
 
-      // May have a new struct, or may be a redefintion of one with the same type name.
-      const GLSLStruct *persistent_struct = NULL;
-      if (sb_parse.descriptor_type == DESCRIPTOR_TYPE_UNIFORM) {
-        persistent_struct = push_struct(ir, input, &sb_parse.glsl_struct);
+      // May have a new struct, or may be a redefintion of one with the same type name. Resolved at merge.
+      u32 record_index = parsed_shader->num_set_binding_records++;
+      if (sb_parse.was_successful && sb_parse.descriptor_type == DESCRIPTOR_TYPE_UNIFORM) {
+        out->structs[out->num_structs++] = {.glsl_struct = sb_parse.glsl_struct, .record_index = (i32)record_index};
       }
 
-      parsed_shader->set_binding_records[parsed_shader->num_set_binding_records++] = {
+      parsed_shader->set_binding_records[record_index] = {
           .set_name = sb_parse.set_name,
           .set_name_len = sb_parse.set_name_len,
           .binding_name = sb_parse.instance_name,
           .binding_name_len = sb_parse.instance_name_len,
-          .glsl_struct = persistent_struct,
+          .glsl_struct = NULL,
           .binding = sb_parse.binding,
           .descriptor_type = sb_parse.descriptor_type,
           .descriptor_count = sb_parse.descriptor_count,
@@ -1795,10 +1531,12 @@ static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
       slice.type = DIRECTIVE_TYPE_VERTEX_SHADER;
       if (input->stage != SHADER_STAGE_FRAGMENT) {
         fprintf(
-            stderr, "Found VERTEX_SHADER directive in %.*s, which is not a fragment shader.\n", input->name_len,
+            log, "Found VERTEX_SHADER directive in %.*s, which is not a fragment shader.\n", input->name_len,
             input->name
         );
-        return false;
+        parser.success = false;
+        stop_parsing = true;
+        break;
       }
 
       VertexShaderDirectiveParse vs_parse = parse_vertex_shader_directive(&parser, &slice);
@@ -1819,33 +1557,127 @@ static bool parse_shader(const ShaderToCompile *input, ParsedShadersIR *ir) {
     parsed_shader->slices[slice_idx++] = glsl_slice;
   }
 
-  // Validate vertex layouts
-  if (input->stage == SHADER_STAGE_VERTEX) {
-    if (vertex_layout_validate_and_compute_offsets(&vertex_layout)) {
-      // If this vertex layout is valid, check that it doesn't match an existing one
-      const VertexLayout *matching_layout = NULL;
-      for (u32 i = 0; i < ir->num_vertex_layouts; i++) {
-        if (vertex_layout_equals(&vertex_layout, &ir->vertex_layouts[i])) {
-          matching_layout = &ir->vertex_layouts[i];
-          break;
-        }
+  parsed_shader->num_slices = slice_idx;
+  destroy_reflector_arena(&token_arena);
+  fclose(log);
+  out->success = parser.success;
+}
+
+static bool validate_shader_name(const ParsedShadersIR *ir, const ShaderToCompile *input) {
+  bool new_vert = (input->stage == SHADER_STAGE_VERTEX);
+  bool new_frag = (input->stage == SHADER_STAGE_FRAGMENT);
+  bool new_comp = (input->stage == SHADER_STAGE_COMPUTE);
+  for (u32 i = 0; i < ir->num_parsed_shaders; i++) {
+    const ParsedShader *old = &ir->parsed_shaders[i];
+    if (strcmp(input->name, old->name) != 0) {
+      continue;
+    }
+
+    bool old_vert = (old->stage == SHADER_STAGE_VERTEX);
+    bool old_frag = (old->stage == SHADER_STAGE_FRAGMENT);
+    bool old_comp = (old->stage == SHADER_STAGE_COMPUTE);
+
+    bool valid = true;
+    if ((new_vert && old_vert) || (new_frag && old_frag) || (new_comp && old_comp)) {
+      char *stage_str = (char *)shader_stage_to_string[old->stage];
+      fprintf(stderr, "Shader %s has a duplicate %s stage.\n", input->name, stage_str);
+      valid = false;
+    }
+
+    bool old_graphics_new_comp = new_comp && (old_vert || old_frag);
+    bool new_graphics_old_comp = (new_vert || new_frag) && old_comp;
+    if (old_graphics_new_comp || new_graphics_old_comp) {
+      fprintf(stderr, "Shader %s mixes compute with vertex/fragment stages.\n", input->name);
+      valid = false;
+    }
+
+    if (!valid) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Serial, in input order: this is where shaders meet, so struct and vertex layout order in the IR doesn't depend on
+// which thread parsed what.
+static bool merge_shader_parse(ParsedShadersIR *ir, const ShaderToCompile *input, const ShaderParse *shader_parse) {
+  if (!validate_shader_name(ir, input)) {
+    return false;
+  }
+  fwrite(shader_parse->log, 1, shader_parse->log_size, stdout);
+
+  // The parse's arena can go away after the merge, keep copies of its arrays
+  ParsedShader *parsed_shader = &ir->parsed_shaders[ir->num_parsed_shaders++];
+  *parsed_shader = shader_parse->parsed;
+  parsed_shader->slices = REFLECTOR_ARENA_PUSH_ARRAY_COPY(
+      &ir->arena, TemplateStringSlice, parsed_shader->slices, parsed_shader->num_slices
+  );
+  parsed_shader->set_binding_records = REFLECTOR_ARENA_PUSH_ARRAY_COPY(
+      &ir->arena, SetBindingRecord, parsed_shader->set_binding_records, parsed_shader->num_set_binding_records
+  );
+
+  // Structs in the order the shader declared them
+  for (u32 i = 0; i < shader_parse->num_structs; i++) {
+    const LocalStruct *local = &shader_parse->structs[i];
+    const GLSLStruct *persistent_struct = push_struct(ir, input, &local->glsl_struct);
+    if (local->record_index >= 0) {
+      if (persistent_struct == NULL) {
+        return false;
       }
+      parsed_shader->set_binding_records[local->record_index].glsl_struct = persistent_struct;
+      continue;
+    }
 
-      if (matching_layout != NULL) {
-        parsed_shader->vertex_layout = matching_layout;
-      } else {
-        ir->vertex_layouts[ir->num_vertex_layouts++] = vertex_layout;
-        parsed_shader->vertex_layout = &ir->vertex_layouts[ir->num_vertex_layouts - 1];
+    if (persistent_struct == NULL) {
+      fprintf(stderr, "Shader %.*s has push constant, but cannot identify struct.\n", input->name_len, input->name);
+      return false;
+    }
+    parsed_shader->push_constant_struct = persistent_struct;
+    if (!validate_push_constant_layout(&ir->arena, persistent_struct, persistent_struct->member_layouts)) {
+      fprintf(stderr, "Found in %.*s.\n", input->name_len, input->name);
+      return false;
+    }
+
+    if (persistent_struct->size_in_bytes > 128) {
+      fprintf(
+          stderr, "Shader %.*s has push constant of size %u, exceeding max of 128.\n", input->name_len, input->name,
+          persistent_struct->size_in_bytes
+      );
+      return false;
+    }
+  }
+
+  if (!shader_parse->success) {
+    return false;
+  }
+
+  // Validate vertex layouts. On a copy, a retained parse is merged again on the next build.
+  if (input->stage == SHADER_STAGE_VERTEX) {
+    VertexLayout layout_copy = shader_parse->vertex_layout;
+    VertexLayout *vertex_layout = &layout_copy;
+    if (!vertex_layout_validate_and_compute_offsets(vertex_layout)) {
+      fprintf(stderr, "Failed to validate vertex layout for %s.\n", input->name);
+      return false;
+    }
+
+    // If this vertex layout is valid, check that it doesn't match an existing one
+    const VertexLayout *matching_layout = NULL;
+    for (u32 i = 0; i < ir->num_vertex_layouts; i++) {
+      if (vertex_layout_equals(vertex_layout, &ir->vertex_layouts[i])) {
+        matching_layout = &ir->vertex_layouts[i];
+        break;
       }
+    }
+
+    if (matching_layout != NULL) {
+      parsed_shader->vertex_layout = matching_layout;
     } else {
-      fprintf(stderr, "Failed to validate vertex layout for %s.\n", input->name);
-      return true;
+      ir->vertex_layouts[ir->num_vertex_layouts++] = *vertex_layout;
+      parsed_shader->vertex_layout = &ir->vertex_layouts[ir->num_vertex_layouts - 1];
     }
   }
 
-  parsed_shader->num_slices = slice_idx;
-  token_vector_free(&parser.tokens);
-  return parser.success;
+  return true;
 }
 
 static bool resolve_set_bindings(ParsedShadersIR *ir, ShaderProgram *program, ParsedShader *shader) {
@@ -1856,7 +1688,7 @@ static bool resolve_set_bindings(ParsedShadersIR *ir, ShaderProgram *program, Pa
     DescriptorSetLayout *layout;
 
     if (matching_layout == NULL) { // New layout.
-      assert(ir->num_descriptor_set_layouts < MAX_NUM_DESCRIPTOR_SET_LISTS);
+      assert(ir->num_descriptor_set_layouts < ir->descriptor_set_layout_capacity);
       layout = &ir->descriptor_set_layouts[ir->num_descriptor_set_layouts++];
 
       u32 name_len = record->set_name_len;
@@ -1950,35 +1782,137 @@ static bool semantic_analysis(ParsedShadersIR *ir) {
   return true;
 }
 
-ParsedShadersIR parse_shaders(const ShaderToCompileList *shaders) {
-  ParsedShadersIR ir;
-  memset(&ir, 0, sizeof(ir));
+typedef struct {
+  const ShaderToCompileList *shaders;
+  ShaderParse *shader_parses;
+  const u32 *indices;
+} ParseShadersTask;
+
+static void parse_shader_task(void *data, u32 index) {
+  ParseShadersTask *task = (ParseShadersTask *)data;
+  u32 shader_index = task->indices[index];
+  parse_shader_local(&task->shaders->shaders[shader_index], &task->shader_parses[shader_index]);
+}
+
+static void release_shader_parse(ShaderParse *shader_parse) {
+  free(shader_parse->log);
+  destroy_reflector_arena(&shader_parse->arena);
+  memset(shader_parse, 0, sizeof(*shader_parse));
+}
+
+void reset_retained_shader_parses(RetainedShaderParses *retained, u32 num_shaders) {
+  free_retained_shader_parses(retained);
+  retained->parses = (ShaderParse *)calloc(num_shaders, sizeof(ShaderParse));
+  retained->stale = (bool *)malloc(num_shaders * sizeof(bool));
+  if ((retained->parses == NULL || retained->stale == NULL) && num_shaders > 0) {
+    fprintf(stderr, "reset_retained_shader_parses: failed to allocate %u shader parses\n", num_shaders);
+    exit(1);
+  }
+  for (u32 i = 0; i < num_shaders; i++) {
+    retained->stale[i] = true;
+  }
+  retained->num_shaders = num_shaders;
+}
 
-  ir.parsing_successful = true;
+void free_retained_shader_parses(RetainedShaderParses *retained) {
+  for (u32 i = 0; i < retained->num_shaders; i++) {
+    release_shader_parse(&retained->parses[i]);
+  }
+  free(retained->parses);
+  free(retained->stale);
+  memset(retained, 0, sizeof(*retained));
+}
+
+void parse_shaders(ParsedShadersIR *ir, const ShaderToCompileList *shaders, u32 num_threads) {
+  RetainedShaderParses retained = {};
+  reset_retained_shader_parses(&retained, shaders->num_shaders);
+  parse_shaders_retained(ir, shaders, &retained, num_threads);
+  free_retained_shader_parses(&retained);
+}
+
+void parse_shaders_retained(
+    ParsedShadersIR *ir,
+    const ShaderToCompileList *shaders,
+    RetainedShaderParses *retained,
+    u32 num_threads
+) {
+  assert(retained->num_shaders == shaders->num_shaders);
+  memset(ir, 0, sizeof(*ir));
+  ir->parsing_successful = true;
+  ShaderParse *shader_parses = retained->parses;
+
+  // Lex and parse every stale shader independently
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  u32 *stale_indices = REFLECTOR_ARENA_PUSH_ARRAY(&ir->arena, u32, shaders->num_shaders);
+  u32 num_stale = 0;
   for (u32 i = 0; i < shaders->num_shaders; i++) {
-    bool successful = parse_shader(&shaders->shaders[i], &ir);
+    if (retained->stale[i]) {
+      release_shader_parse(&shader_parses[i]);
+      stale_indices[num_stale++] = i;
+      retained->stale[i] = false;
+    }
+  }
+  ParseShadersTask task = {.shaders = shaders, .shader_parses = shader_parses, .indices = stale_indices};
+  if (num_threads == 0) {
+    num_threads = default_thread_count();
+  }
+  parallel_for_each(num_stale, num_threads, parse_shader_task, &task);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf(
+      "Shader: %.1f ms lexing and parsing %u of %u on %u threads\n",
+      (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6, num_stale, shaders->num_shaders, num_threads
+  );
+
+  // Size the IR. Every shader is at most one program and one vertex layout, and can't add more structs or set layouts
+  // than it declared.
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  u32 num_local_structs = 0;
+  u32 num_set_binding_records = 0;
+  for (u32 i = 0; i < shaders->num_shaders; i++) {
+    num_local_structs += shader_parses[i].num_structs;
+    num_set_binding_records += shader_parses[i].parsed.num_set_binding_records;
+  }
+  ir->parsed_shaders = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&ir->arena, ParsedShader, shaders->num_shaders);
+  ir->programs = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&ir->arena, ShaderProgram, shaders->num_shaders);
+  ir->vertex_layouts = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&ir->arena, VertexLayout, shaders->num_shaders);
+  ir->structs = REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&ir->arena, GLSLStruct, num_local_structs);
+  ir->struct_capacity = num_local_structs;
+  ir->descriptor_set_layouts =
+      REFLECTOR_ARENA_PUSH_ARRAY_ZERO(&ir->arena, DescriptorSetLayout, num_set_binding_records);
+  ir->descriptor_set_layout_capacity = num_set_binding_records;
+
+  // Merge them in input order
+  for (u32 i = 0; i < shaders->num_shaders; i++) {
+    bool successful = merge_shader_parse(ir, &shaders->shaders[i], &shader_parses[i]);
     if (!successful) {
-      ir.parsing_successful = false;
+      ir->parsing_successful = false;
     }
   }
 
-  if (!semantic_analysis(&ir)) {
-    ir.parsing_successful = false;
+  if (!semantic_analysis(ir)) {
+    ir->parsing_successful = false;
   }
 
   // Validate names are either compute OR both vertex and fragment.
-  for (u32 i = 0; i < ir.num_programs; i++) {
-    ShaderProgram *prog = &ir.programs[i];
+  for (u32 i = 0; i < ir->num_programs; i++) {
+    ShaderProgram *prog = &ir->programs[i];
     if (prog->parsed_comp) {
       continue;
     }
     if (!prog->parsed_vert || !prog->parsed_frag) {
       const char *missing_stage = !prog->parsed_vert ? "vertex" : "fragment";
       fprintf(stderr, "Shader %s is missing a %s stage.\n", prog->name, missing_stage);
-      ir.parsing_successful = false;
+      ir->parsing_successful = false;
       continue;
     }
   }
 
-  return ir;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("Merge:  %.1f ms\n", (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+}
+
+void free_parsed_shaders_ir(ParsedShadersIR *ir) {
+  destroy_reflector_arena(&ir->arena);
+  memset(ir, 0, sizeof(*ir));
 }
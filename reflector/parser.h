@@ -1,144 +1,20 @@
 #pragma once
 
+#include "arena.h"
 #include "filesystem_utils.h"
+#include "lexer.h"
 #include "reflector.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define TOKEN_VECTOR_INITIAL_CAPACITY 64
-#define MAX_NUM_STRING_SLICES 64
-#define MAX_NUM_VERTEX_LAYOUTS 32
 #define MAX_NUM_DESCRIPTOR_SET_LISTS 32
-#define MAX_NUM_GLSL_STRUCTS 64
-#define MAX_NUM_BINDING_SLOTS 128
 #define BINDLESS_DESCRIPTOR_COUNT 1024
 
 static const char *RED = "\033[31m";
 static const char *RESET = "\033[0m";
 
-typedef enum {
-  TOKEN_TYPE_POUND,
-  TOKEN_TYPE_DOUBLE_L_BRACE,
-  TOKEN_TYPE_DOUBLE_R_BRACE,
-  TOKEN_TYPE_L_BRACE,
-  TOKEN_TYPE_R_BRACE,
-  TOKEN_TYPE_L_PAREN,
-  TOKEN_TYPE_R_PAREN,
-  TOKEN_TYPE_L_BRACKET,
-  TOKEN_TYPE_R_BRACKET,
-  TOKEN_TYPE_SEMICOLON,
-  TOKEN_TYPE_COMMA,
-  TOKEN_TYPE_PERIOD,
-
-  TOKEN_TYPE_EQUALS,
-  TOKEN_TYPE_EQUALS_EQUALS,
-  TOKEN_TYPE_PLUS,
-  TOKEN_TYPE_PLUS_PLUS,
-  TOKEN_TYPE_MINUS,
-  TOKEN_TYPE_MINUS_MINUS,
-  TOKEN_TYPE_ASTERISK,
-  TOKEN_TYPE_SLASH,
-
-  TOKEN_TYPE_IN,
-  TOKEN_TYPE_OUT,
-  TOKEN_TYPE_VERSION,
-  TOKEN_TYPE_VOID,
-  TOKEN_TYPE_UNIFORM,
-  TOKEN_TYPE_SAMPLER,
-  TOKEN_TYPE_SAMPLER2D,
-  TOKEN_TYPE_SAMPLER2D_ARRAY,
-  TOKEN_TYPE_TEXTURE2D,
-  TOKEN_TYPE_IMAGE2D,
-
-  TOKEN_TYPE_FLOAT,
-  TOKEN_TYPE_UINT,
-  TOKEN_TYPE_VEC2,
-  TOKEN_TYPE_VEC3,
-  TOKEN_TYPE_VEC4,
-  TOKEN_TYPE_MAT2,
-  TOKEN_TYPE_MAT3,
-  TOKEN_TYPE_MAT4,
-
-  TOKEN_TYPE_DIRECTIVE_VERSION,
-  TOKEN_TYPE_DIRECTIVE_LOCATION,
-  TOKEN_TYPE_DIRECTIVE_SET_BINDING,
-  TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT,
-  TOKEN_TYPE_DIRECTIVE_VERTEX_SHADER,
-
-  TOKEN_TYPE_BINDLESS,
-  TOKEN_TYPE_RATE_VERTEX,
-  TOKEN_TYPE_RATE_INSTANCE,
-  TOKEN_TYPE_BINDING,
-  TOKEN_TYPE_OFFSET,
-  TOKEN_TYPE_TIGHTLY_PACKED,
-  TOKEN_TYPE_SET_LABEL,
-  TOKEN_TYPE_DIRECTIVE_VERTEX_INDEX,
-  TOKEN_TYPE_DIRECTIVE_INSTANCE_INDEX,
-
-  TOKEN_TYPE_TEXT,
-  TOKEN_TYPE_NUMBER,
-
-  NUM_TOKEN_TYPES
-} TokenType;
-
-static const char *token_type_to_string[NUM_TOKEN_TYPES] = {
-    [TOKEN_TYPE_POUND] = "#",
-    [TOKEN_TYPE_DOUBLE_L_BRACE] = "{{",
-    [TOKEN_TYPE_DOUBLE_R_BRACE] = "}}",
-    [TOKEN_TYPE_L_BRACE] = "{",
-    [TOKEN_TYPE_R_BRACE] = "}",
-    [TOKEN_TYPE_L_PAREN] = "(",
-    [TOKEN_TYPE_R_PAREN] = ")",
-    [TOKEN_TYPE_L_BRACKET] = "[",
-    [TOKEN_TYPE_R_BRACKET] = "]",
-    [TOKEN_TYPE_SEMICOLON] = ";",
-    [TOKEN_TYPE_COMMA] = ",",
-    [TOKEN_TYPE_PERIOD] = ".",
-
-    [TOKEN_TYPE_EQUALS] = "=",
-    [TOKEN_TYPE_EQUALS_EQUALS] = "==",
-    [TOKEN_TYPE_PLUS] = "+",
-    [TOKEN_TYPE_PLUS_PLUS] = "++",
-    [TOKEN_TYPE_MINUS] = "-",
-    [TOKEN_TYPE_MINUS_MINUS] = "--",
-    [TOKEN_TYPE_ASTERISK] = "*",
-    [TOKEN_TYPE_SLASH] = "/",
-
-    [TOKEN_TYPE_IN] = "in",
-    [TOKEN_TYPE_OUT] = "out",
-    [TOKEN_TYPE_VERSION] = "version",
-    [TOKEN_TYPE_VOID] = "void",
-    [TOKEN_TYPE_UNIFORM] = "uniform",
-    [TOKEN_TYPE_SAMPLER] = "sampler",
-    [TOKEN_TYPE_SAMPLER2D] = "sampler2D",
-    [TOKEN_TYPE_TEXTURE2D] = "texture2D",
-    [TOKEN_TYPE_IMAGE2D] = "image2D",
-
-    [TOKEN_TYPE_FLOAT] = "float",
-    [TOKEN_TYPE_UINT] = "uint",
-    [TOKEN_TYPE_VEC2] = "vec2",
-    [TOKEN_TYPE_VEC3] = "vec3",
-    [TOKEN_TYPE_VEC4] = "vec4",
-    [TOKEN_TYPE_MAT2] = "mat2",
-    [TOKEN_TYPE_MAT3] = "mat3",
-    [TOKEN_TYPE_MAT4] = "mat4",
-    [TOKEN_TYPE_DIRECTIVE_VERSION] = "VERSION",
-    [TOKEN_TYPE_DIRECTIVE_LOCATION] = "LOCATION",
-    [TOKEN_TYPE_DIRECTIVE_SET_BINDING] = "SET_BINDING",
-    [TOKEN_TYPE_DIRECTIVE_PUSH_CONSTANT] = "PUSH_CONSTANT",
-    [TOKEN_TYPE_RATE_VERTEX] = "RATE_VERTEX",
-    [TOKEN_TYPE_RATE_INSTANCE] = "RATE_INSTANCE",
-    [TOKEN_TYPE_BINDING] = "BINDING",
-    [TOKEN_TYPE_OFFSET] = "OFFSET",
-    [TOKEN_TYPE_TIGHTLY_PACKED] = "TIGHTLY_PACKED",
-    [TOKEN_TYPE_SET_LABEL] = "SET_LABEL",
-
-    [TOKEN_TYPE_TEXT] = "a text literal",
-    [TOKEN_TYPE_NUMBER] = "a number literal",
-};
-
 typedef enum {
   DIRECTIVE_TYPE_VERSION,
   DIRECTIVE_TYPE_SET_BINDING,
@@ -232,77 +108,13 @@ typedef struct {
   u32 repeated_attribute_location;
 } LocationDirectiveParse;
 
-// Token definitions
-typedef struct {
-  TokenType type;
-  const char *start;
-  u32 text_length;
-} Token;
-
-inline Token new_token(TokenType type, const char *start) {
-  Token token;
-  token.type = type;
-  token.start = start;
-  token.text_length = 0;
-  return token;
-};
-
-inline Token new_text_token(TokenType type, const char *text, u32 text_length) {
-  Token token;
-  token.type = type;
-  token.start = text;
-  token.text_length = text_length;
-  return token;
-};
-
-// TokenVector implementation/declarations
-typedef struct {
-  u32 size;
-  u32 capacity;
-  Token *tokens;
-} TokenVector;
-
-inline TokenVector new_token_vector() {
-  TokenVector token_vector;
-  token_vector.size = 0;
-  token_vector.capacity = TOKEN_VECTOR_INITIAL_CAPACITY;
-  token_vector.tokens = (Token *)malloc(TOKEN_VECTOR_INITIAL_CAPACITY * sizeof(Token));
-
-  if (token_vector.tokens == NULL) {
-    fprintf(stderr, "new_token_vector: failed to malloc\n");
-    exit(1);
-  }
-
-  return token_vector;
-}
-
-inline void push_token(TokenVector *token_vector, Token token) {
-  if (token_vector->size >= token_vector->capacity) {
-    token_vector->capacity *= 2;
-    Token *new_tokens = (Token *)realloc(token_vector->tokens, sizeof(Token) * token_vector->capacity);
-
-    if (new_tokens == NULL) {
-      fprintf(stderr, "push_token: failed to realloc\n");
-      exit(1);
-    }
-    token_vector->tokens = new_tokens;
-  }
-
-  token_vector->tokens[token_vector->size++] = token;
-}
-
-inline void token_vector_free(TokenVector *token_vector) {
-  token_vector->capacity = 0;
-  token_vector->size = 0;
-  free(token_vector->tokens);
-  token_vector->tokens = NULL;
-}
-
 typedef struct {
   bool success;
   TokenVector tokens;
   u32 token_index;
   const ShaderToCompile *input;
+  FILE *log;          // Parse errors go here
+  ReflectorArena *arena; // Struct members go here
 } Parser;
 
 // This is a carbon copy of SetBindingDirectiveParse
@@ -329,9 +141,10 @@ typedef struct {
 // Warn that vertex shaders are unused, but do not error and die.
 typedef struct {
   ShaderStage stage;
-  const char *name; // name is a malloc'd string owned by ShaderToCompile
+  const char *name;        // name is a malloc'd string owned by ShaderToCompile
+  const char *source_path; // Also owned by ShaderToCompile
 
-  TemplateStringSlice slices[MAX_NUM_STRING_SLICES];
+  TemplateStringSlice *slices;
   u32 num_slices;
 
   const VertexLayout *vertex_layout;
@@ -339,7 +152,7 @@ typedef struct {
   u16 binding_strides[MAX_NUM_VERTEX_BINDINGS];
   u8 binding_count;
 
-  SetBindingRecord set_binding_records[MAX_NUM_DESCRIPTOR_SET_LAYOUTS * MAX_NUM_DESCRIPTOR_BINDINGS];
+  SetBindingRecord *set_binding_records;
   u32 num_set_binding_records;
 
   DescriptorSetLayout *descriptor_set_layouts[MAX_NUM_DESCRIPTOR_SET_LAYOUTS];
@@ -375,25 +188,75 @@ typedef struct {
 // ShaderToCompileList is generated in the beginning of the main function, which owns all source strings. It is freed
 // at the end of the main function. ParsedShadersIR contains slices into it, so as long as ShaderToCompileList is
 // freed after codegen, ParsedShadersIR will remain valid
+//
+// Everything else lives in the IR's arena, freed by free_parsed_shaders_ir. The arrays are sized once every shader has
+// been parsed, when the most each can need is known, so they never move and pointers between them stay valid.
 typedef struct {
+  ReflectorArena arena;
   bool parsing_successful;
 
-  ParsedShader parsed_shaders[MAX_NUM_SHADERS];
+  ParsedShader *parsed_shaders;
   u32 num_parsed_shaders;
 
-  DescriptorSetLayout descriptor_set_layouts[MAX_NUM_DESCRIPTOR_SET_LISTS];
+  DescriptorSetLayout *descriptor_set_layouts;
   u32 num_descriptor_set_layouts;
+  u32 descriptor_set_layout_capacity;
 
   u32 descriptor_binding_types[NUM_DESCRIPTOR_TYPES];
 
-  VertexLayout vertex_layouts[MAX_NUM_VERTEX_LAYOUTS];
+  VertexLayout *vertex_layouts;
   u32 num_vertex_layouts;
 
-  GLSLStruct structs[MAX_NUM_GLSL_STRUCTS];
+  GLSLStruct *structs;
   u32 num_structs;
+  u32 struct_capacity;
 
-  ShaderProgram programs[MAX_NUM_SHADERS];
+  ShaderProgram *programs;
   u32 num_programs;
 } ParsedShadersIR;
 
-ParsedShadersIR parse_shaders(const ShaderToCompileList *shader_to_compile_list);
+// A struct as one shader declared it, before it is deduplicated against the rest of the tree.
+// record_index is the set binding record it belongs to, or -1 for the push constant.
+typedef struct {
+  GLSLStruct glsl_struct;
+  i32 record_index;
+} LocalStruct;
+
+// Everything one shader's parse finds without looking at the others, so shaders can be parsed on any thread.
+// parse_shaders merges them into the IR in input order. The arrays are sized from the number of directives and live in
+// the parse's own arena, the merge copies what it keeps into the IR's.
+typedef struct {
+  ReflectorArena arena;
+  ParsedShader parsed; // Set binding structs and the push constant are resolved at merge
+  LocalStruct *structs;
+  u32 num_structs;
+  VertexLayout vertex_layout; // Validated at merge
+  char *log;                  // Parse errors, printed at merge so they come out in input order
+  size_t log_size;
+  bool success;
+} ShaderParse;
+
+// Per-shader lexing and parsing runs on num_threads threads, 0 for one per core. The IR is the same for any count.
+// Fills in ir, which is freed with free_parsed_shaders_ir whether or not parsing succeeded.
+void parse_shaders(ParsedShadersIR *ir, const ShaderToCompileList *shader_to_compile_list, u32 num_threads);
+void free_parsed_shaders_ir(ParsedShadersIR *ir);
+
+// Shader parses kept from one build to the next by --watch, one per shader in input order. A retained parse points into
+// its shader's source, so it has to be marked stale whenever that source is reloaded.
+typedef struct {
+  ShaderParse *parses;
+  bool *stale;
+  u32 num_shaders;
+} RetainedShaderParses;
+
+// Frees any old parses and marks all num_shaders as stale, for a fresh or recollected shader list
+void reset_retained_shader_parses(RetainedShaderParses *retained, u32 num_shaders);
+void free_retained_shader_parses(RetainedShaderParses *retained);
+
+// parse_shaders, but only the stale shaders are lexed and parsed. The rest are merged from their retained parses.
+void parse_shaders_retained(
+    ParsedShadersIR *ir,
+    const ShaderToCompileList *shader_to_compile_list,
+    RetainedShaderParses *retained,
+    u32 num_threads
+);
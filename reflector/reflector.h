@@ -3,10 +3,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define MAX_NUM_SHADERS 128
 #define MAX_NUM_VERTEX_ATTRIBUTES 32
 #define MAX_NUM_VERTEX_BINDINGS 8
-#define MAX_NUM_STRUCT_MEMBERS 8
 #define MAX_NUM_DESCRIPTOR_BINDINGS 8
 #define MAX_VERTEX_LAYOUT_NAME_LENGTH 128
 #define MAX_DESCRIPTOR_SET_LAYOUT_NAME_LENGTH 256
@@ -88,19 +86,14 @@ static const char *glsl_type_to_string[NUM_GLSL_TYPES]{
     [GLSL_TYPE_MAT2] = "mat2", [GLSL_TYPE_MAT3] = "mat3",   [GLSL_TYPE_MAT4] = "mat4",
 };
 
+// Sizes of the C types codegen emits, which are also the GLSL sizes of a lone scalar, vector or mat4. Arrays and the
+// other matrices depend on the block layout, see layout.h.
 static const u32 glsl_type_to_size[NUM_GLSL_TYPES]{
     [GLSL_TYPE_NULL] = 0,     [GLSL_TYPE_FLOAT] = 4,    [GLSL_TYPE_UINT] = 4,
     [GLSL_TYPE_VEC2] = 8,     [GLSL_TYPE_VEC3] = 12,    [GLSL_TYPE_VEC4] = 16,
     [GLSL_TYPE_MAT2] = 4 * 4, [GLSL_TYPE_MAT3] = 9 * 4, [GLSL_TYPE_MAT4] = 16 * 4,
 };
 
-// https://registry.khronos.org/OpenGL/specs/gl/glspec46.core.pdf
-// page 146 has the alignment rules
-static const u32 glsl_type_to_alignment[NUM_GLSL_TYPES]{
-    [GLSL_TYPE_NULL] = 0,  [GLSL_TYPE_FLOAT] = 4, [GLSL_TYPE_UINT] = 4,  [GLSL_TYPE_VEC2] = 8,  [GLSL_TYPE_VEC3] = 16,
-    [GLSL_TYPE_VEC4] = 16, [GLSL_TYPE_MAT2] = 16, [GLSL_TYPE_MAT3] = 16, [GLSL_TYPE_MAT4] = 16,
-};
-
 static const char *glsl_type_to_c_type[] = {
     [GLSL_TYPE_FLOAT] = "float", [GLSL_TYPE_UINT] = "unsigned", [GLSL_TYPE_VEC2] = "Vec2", [GLSL_TYPE_VEC3] = "Vec3",
     [GLSL_TYPE_VEC4] = "Vec4",   [GLSL_TYPE_MAT2] = "Mat2",     [GLSL_TYPE_MAT3] = "Mat3", [GLSL_TYPE_MAT4] = "Mat4",
@@ -127,16 +120,53 @@ static inline const char *vertex_attribute_rate_to_vulkan_enum_string(VertexAttr
   }
 }
 
+// How a vertex attribute is stored in the vertex buffer, from FORMAT in the location directive:
+//   {{ LOCATION 1 BINDING 0 RATE_VERTEX OFFSET TIGHTLY_PACKED FORMAT OCTAHEDRAL }} in vec2 a_normal;
+// The shader still declares the float type it reads, the vertex fetch converts. Without FORMAT, every component is 32
+// bits, as before. src/vertex_compression.h has the matching CPU encoders.
+enum VertexFormat {
+  VERTEX_FORMAT_DEFAULT,
+  VERTEX_FORMAT_UNORM8X4,        // vec4 in [0, 1], colors
+  VERTEX_FORMAT_SNORM16X2,       // vec2 in [-1, 1]
+  VERTEX_FORMAT_HALF2,           // vec2, UVs
+  VERTEX_FORMAT_OCTAHEDRAL,      // Unit vec3 folded onto a vec2, stored as SNORM16X2. Decode in the shader.
+  VERTEX_FORMAT_UNORM10_10_10_2, // vec4 in [0, 1], xyz with 10 bits and w with 2
+  NUM_VERTEX_FORMATS,
+};
+
+struct VertexFormatInfo {
+  const char *name;    // As written after FORMAT
+  GLSLType glsl_type;  // The only type the shader may declare, NULL for any
+  u32 size;            // Bytes, 0 for the GLSL type's size
+  const char *vulkan_format;
+  u32 gl_components;
+  const char *gl_type;
+  bool gl_normalized;
+};
+
+static const VertexFormatInfo vertex_format_info[NUM_VERTEX_FORMATS] = {
+    [VERTEX_FORMAT_DEFAULT] = {"DEFAULT", GLSL_TYPE_NULL, 0, NULL, 0, NULL, false},
+    [VERTEX_FORMAT_UNORM8X4] = {"UNORM8X4", GLSL_TYPE_VEC4, 4, "VK_FORMAT_R8G8B8A8_UNORM", 4, "GL_UNSIGNED_BYTE", true},
+    [VERTEX_FORMAT_SNORM16X2] = {"SNORM16X2", GLSL_TYPE_VEC2, 4, "VK_FORMAT_R16G16_SNORM", 2, "GL_SHORT", true},
+    [VERTEX_FORMAT_HALF2] = {"HALF2", GLSL_TYPE_VEC2, 4, "VK_FORMAT_R16G16_SFLOAT", 2, "GL_HALF_FLOAT", false},
+    [VERTEX_FORMAT_OCTAHEDRAL] = {"OCTAHEDRAL", GLSL_TYPE_VEC2, 4, "VK_FORMAT_R16G16_SNORM", 2, "GL_SHORT", true},
+    [VERTEX_FORMAT_UNORM10_10_10_2] =
+        {"UNORM10_10_10_2", GLSL_TYPE_VEC4, 4, "VK_FORMAT_A2B10G10R10_UNORM_PACK32", 4,
+         "GL_UNSIGNED_INT_2_10_10_10_REV", true},
+};
+
 // a vertex attribute is a single variable, like a vec3 for position
 // the vulkan struct contains location, binding, offset and rate
 // in opengl, calls are to
 //  glVertexAttribPointer(location, num of type in next arg, GL_FLOAT, GL_FALSE, stride(bytes), (void*)offset(bytes));
+// or with the format's type and normalization, see VertexFormat
 struct VertexAttribute {
   u8 location;
   u8 binding;
   u32 offset;
   VertexAttributeRate rate;
   GLSLType glsl_type;
+  VertexFormat format;
   bool is_tightly_packed;
   // treat a vertex layout as a list of MAX_NUM_VERTEX_ATTRIBUTES attributes, and only emit code for the valid ones
   bool is_valid;
@@ -152,12 +182,18 @@ inline void log_vertex_attribute(VertexAttribute vertex_attribute) {
     rate_string = "invalid";
   }
   printf(
-      "Vertex Attribute is\n\tlocation: %u, binding: %u, offset: %u, rate: %s, glsl type %s\n",
+      "Vertex Attribute is\n\tlocation: %u, binding: %u, offset: %u, rate: %s, glsl type %s, format %s\n",
       vertex_attribute.location, vertex_attribute.binding, vertex_attribute.offset, rate_string,
-      glsl_type_to_string[vertex_attribute.glsl_type]
+      glsl_type_to_string[vertex_attribute.glsl_type], vertex_format_info[vertex_attribute.format].name
   );
 }
 
+// Bytes the attribute takes in its binding
+inline u32 vertex_attribute_size(const VertexAttribute *vertex_attribute) {
+  u32 format_size = vertex_format_info[vertex_attribute->format].size;
+  return format_size > 0 ? format_size : glsl_type_to_size[vertex_attribute->glsl_type];
+}
+
 // the vertex layout is the collection of all the attributes
 // this is how we tell the shader how to interpret incoming data
 //
@@ -220,9 +256,10 @@ inline bool vertex_layout_equals(const VertexLayout *left, const VertexLayout *r
 
     bool same_location = (l.location == r.location);
     bool same_type = (l.glsl_type == r.glsl_type);
+    bool same_format = (l.format == r.format);
     bool same_binding = (l.binding == r.binding);
     bool same_rate = (l.rate == r.rate);
-    if (!(same_type && same_location && same_binding && same_rate)) {
+    if (!(same_type && same_format && same_location && same_binding && same_rate)) {
       return false;
     }
   }
@@ -238,6 +275,8 @@ struct GLSLStructMember {
   GLSLType type; // type encodes alignment, which can vary with backend or usage
 };
 
+struct GLSLMemberLayout;
+
 struct GLSLStruct {
   const char *type_name;
   u32 type_name_len;
@@ -245,8 +284,11 @@ struct GLSLStruct {
   const char *discovered_shader_name;
   u32 discovered_shader_name_len;
 
-  GLSLStructMember members[MAX_NUM_STRUCT_MEMBERS];
+  GLSLStructMember *members; // In the arena of whoever parsed it, copied into the IR's when the struct is new
   u32 num_members;
+
+  // Set when the struct is pushed into the IR. The std140 layout, which push constants are validated to share.
+  const GLSLMemberLayout *member_layouts;
   u32 size_in_bytes; // Size including padding. Aligned to alignement of struct.
   u32 padding;
 };
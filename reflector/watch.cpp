@@ -0,0 +1,188 @@
+#include "watch.h"
+#include "filesystem_utils.h"
+#include "reflector.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define WATCH_DIRECTORY_MASK                                                                                           \
+  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static bool is_gen_directory(const char *path) {
+  const char *last_slash = strrchr(path, '/');
+  return strcmp(last_slash ? last_slash + 1 : path, "gen") == 0;
+}
+
+static bool is_shader_file_name(const char *name) {
+  size_t length = strlen(name);
+  return length > strlen(".in") && strcmp(name + length - strlen(".in"), ".in") == 0;
+}
+
+static bool add_directory_watch(ShaderTreeWatcher *watcher, const char *path) {
+  int wd = inotify_add_watch(watcher->fd, path, WATCH_DIRECTORY_MASK | IN_ONLYDIR);
+  if (wd < 0) {
+    fprintf(stderr, "inotify_add_watch %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  watcher->watch_descriptors[watcher->num_watches] = wd;
+  snprintf(watcher->watch_paths[watcher->num_watches], SUBDIRECTORY_PATH_BUFFER_LENGTH, "%s", path);
+  watcher->num_watches++;
+  return true;
+}
+
+bool open_shader_tree_watcher(
+    ShaderTreeWatcher *watcher,
+    const char *shaders_root,
+    const SubdirectoryList *subdirectory_list
+) {
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd < 0) {
+    perror("inotify_init1");
+    return false;
+  }
+
+  // The root is watched for new directories only, shaders are collected from subdirectories
+  if (!add_directory_watch(watcher, shaders_root)) {
+    close_shader_tree_watcher(watcher);
+    return false;
+  }
+  for (u32 i = 0; i < subdirectory_list->num_subdirectories; i++) {
+    const char *path = subdirectory_list->subdirectories[i];
+    if (!is_gen_directory(path) && !add_directory_watch(watcher, path)) {
+      close_shader_tree_watcher(watcher);
+      return false;
+    }
+  }
+  return true;
+}
+
+void close_shader_tree_watcher(ShaderTreeWatcher *watcher) {
+  if (watcher->fd >= 0) {
+    close(watcher->fd); // Drops every watch with it
+  }
+  watcher->fd = -1;
+  watcher->num_watches = 0;
+}
+
+static void record_event(
+    const ShaderTreeWatcher *watcher,
+    const struct inotify_event *event,
+    ShaderTreeChanges *changes
+) {
+  if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+    changes->structural = true;
+    return;
+  }
+
+  u32 watch_index = 0;
+  while (watch_index < watcher->num_watches && watcher->watch_descriptors[watch_index] != event->wd) {
+    watch_index++;
+  }
+  if (watch_index == watcher->num_watches || event->len == 0) {
+    return; // IN_IGNORED for a watch already dropped, or an event about the directory itself
+  }
+
+  if (event->mask & IN_ISDIR) {
+    if (strcmp(event->name, "gen") != 0) {
+      changes->structural = true;
+    }
+    return;
+  }
+  if (watch_index == 0 || !is_shader_file_name(event->name)) {
+    return; // Editor backups, swap files and the like
+  }
+
+  if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+    changes->structural = true;
+  } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+    char path[FULL_PATH_BUFFER_LENGTH];
+    int n = snprintf(path, sizeof(path), "%s/%s", watcher->watch_paths[watch_index], event->name);
+    if (n < 0 || n >= FULL_PATH_BUFFER_LENGTH) {
+      changes->structural = true;
+      return;
+    }
+    for (u32 i = 0; i < changes->num_paths; i++) {
+      if (strcmp(changes->paths[i], path) == 0) {
+        return;
+      }
+    }
+    if (changes->num_paths == MAX_WATCHED_CHANGES) {
+      changes->structural = true;
+      return;
+    }
+    memcpy(changes->paths[changes->num_paths++], path, (size_t)n + 1);
+  }
+}
+
+bool wait_for_shader_tree_changes(ShaderTreeWatcher *watcher, ShaderTreeChanges *changes) {
+  changes->num_paths = 0;
+  changes->structural = false;
+
+  alignas(struct inotify_event) char buffer[4096];
+  int timeout_ms = -1; // Block until the first event, then only until it settles
+  for (;;) {
+    struct pollfd poll_fd = {.fd = watcher->fd, .events = POLLIN, .revents = 0};
+    int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      return false;
+    }
+    if (ready == 0) {
+      if (changes->num_paths > 0 || changes->structural) {
+        return true;
+      }
+      timeout_ms = -1; // Only ignored events so far, keep waiting
+      continue;
+    }
+
+    ssize_t length = read(watcher->fd, buffer, sizeof(buffer));
+    if (length < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      perror("read inotify");
+      return false;
+    }
+    for (ssize_t offset = 0; offset < length;) {
+      const struct inotify_event *event = (const struct inotify_event *)(buffer + offset);
+      record_event(watcher, event, changes);
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+    timeout_ms = WATCH_SETTLE_MS;
+  }
+}
+
+#else
+
+bool open_shader_tree_watcher(
+    ShaderTreeWatcher *watcher,
+    const char *shaders_root,
+    const SubdirectoryList *subdirectory_list
+) {
+  (void)shaders_root;
+  (void)subdirectory_list;
+  memset(watcher, 0, sizeof(*watcher));
+  watcher->fd = -1;
+  fprintf(stderr, "--watch needs inotify, it is only supported on Linux.\n");
+  return false;
+}
+
+void close_shader_tree_watcher(ShaderTreeWatcher *watcher) { watcher->fd = -1; }
+
+bool wait_for_shader_tree_changes(ShaderTreeWatcher *watcher, ShaderTreeChanges *changes) {
+  (void)watcher;
+  (void)changes;
+  return false;
+}
+
+#endif
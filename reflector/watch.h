@@ -0,0 +1,40 @@
+#pragma once
+
+#include "filesystem_utils.h"
+#include "reflector.h"
+
+// Watches the shaders/ tree for --watch. Built on inotify, so Linux only: elsewhere opening the watcher fails.
+//
+// Editors save in several steps (truncate and write, or write a temp file and rename it over), so after the first
+// event the watcher keeps reading until the tree has been quiet for WATCH_SETTLE_MS and reports everything at once.
+
+#define WATCH_SETTLE_MS 30
+#define MAX_WATCHED_CHANGES 16
+
+struct ShaderTreeWatcher {
+  int fd;
+  u32 num_watches;
+  int watch_descriptors[MAX_NUM_SUBDIRECTORIES + 1];
+  char watch_paths[MAX_NUM_SUBDIRECTORIES + 1][SUBDIRECTORY_PATH_BUFFER_LENGTH];
+};
+
+struct ShaderTreeChanges {
+  // Shader files written or renamed into place. Paths are built the way collect_shaders_to_compile builds source_path.
+  char paths[MAX_WATCHED_CHANGES][FULL_PATH_BUFFER_LENGTH];
+  u32 num_paths;
+  // Shaders or directories were removed or renamed away, a directory was added, or there were too many changes to
+  // list. The shader list has to be collected again.
+  bool structural;
+};
+
+// Watches shaders_root and every subdirectory in subdirectory_list but gen/ ones, the same set the shaders are
+// collected from.
+bool open_shader_tree_watcher(
+    ShaderTreeWatcher *watcher,
+    const char *shaders_root,
+    const SubdirectoryList *subdirectory_list
+);
+void close_shader_tree_watcher(ShaderTreeWatcher *watcher);
+
+// Blocks until something changes and settles. Returns false if the watch itself failed.
+bool wait_for_shader_tree_changes(ShaderTreeWatcher *watcher, ShaderTreeChanges *changes);
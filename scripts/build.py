@@ -14,6 +14,8 @@ def main():
     parser = argparse.ArgumentParser(description="Build, compile shaders, and run executables.")
     parser.add_argument("--no-shaders", action="store_true", help="Skip shader compilation")
     parser.add_argument("--force-shaders", action="store_true", help="Force shader compilation")
+    parser.add_argument("--spirv-pack", action="store_true", help="Link SPIR-V from a binary pack instead of arrays")
+    parser.add_argument("--spirv-opt", action="store_true", help="Optimize and strip SPIR-V with spirv-opt if on PATH")
     parser.add_argument("--no-build", action="store_true", help="Skip building")
     parser.add_argument("--target", type=str, default="", help="Make target to build (default: all)")
     parser.add_argument("--run", type=str, default="", help="Executable to run (builds only that target)")
@@ -35,6 +37,10 @@ def main():
         invocations = [REFLECTOR_PATH]
         if args.force_shaders:
             invocations.append("--force-shaders")
+        if args.spirv_pack:
+            invocations.append("--spirv-pack")
+        if args.spirv_opt:
+            invocations += ["--spirv-opt", "--spirv-strip-debug"]
 
         try:
             subprocess.run(invocations, check=True)
@@ -0,0 +1,339 @@
+#include "archetype.h"
+#include "ecs.h"
+#include "entity_index.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CHUNKS_CAPACITY (4)
+
+static u32 align_up(u32 x, u32 alignment) { return (x + alignment - 1) & ~(alignment - 1); }
+
+static void reserve_archetype_entity_slots(ArchetypeWorld *world, u32 capacity) {
+  if (capacity <= world->slot_capacity) {
+    return;
+  }
+  assert(capacity <= MAX_NUM_ENTITY_SLOTS);
+
+  world->generations = (u32 *)realloc(world->generations, capacity * sizeof(u32));
+  world->next_free = (u32 *)realloc(world->next_free, capacity * sizeof(u32));
+  world->slot_live = (bool *)realloc(world->slot_live, capacity * sizeof(bool));
+  world->locations =
+      (ArchetypeEntityLocation *)realloc(world->locations, capacity * sizeof(ArchetypeEntityLocation));
+  assert(world->generations && world->next_free && world->slot_live && world->locations);
+  world->slot_capacity = capacity;
+}
+
+ArchetypeWorld create_archetype_world(u32 initial_entity_capacity) {
+  ArchetypeWorld world;
+  memset(&world, 0, sizeof(ArchetypeWorld));
+
+  world.archetypes = (Archetype *)calloc(MAX_NUM_ARCHETYPES, sizeof(Archetype));
+  assert(world.archetypes);
+
+  // Room for the nil slot plus at least one entity
+  reserve_archetype_entity_slots(&world, initial_entity_capacity < 2 ? 2 : initial_entity_capacity);
+  world.generations[0] = 0;
+  world.next_free[0] = 0;
+  world.slot_live[0] = false;
+  world.num_slots = 1;
+
+  // Chunk versions start at 0, so everything counts as changed to a consumer that has seen nothing
+  world.version = 1;
+  return world;
+}
+
+void destroy_archetype_world(ArchetypeWorld *world) {
+  for (u32 i = 0; i < world->num_archetypes; i++) {
+    Archetype *archetype = &world->archetypes[i];
+    for (u32 c = 0; c < archetype->num_chunks; c++) {
+      free(archetype->chunks[c].data);
+    }
+    free(archetype->chunks);
+  }
+  free(world->archetypes);
+  free(world->generations);
+  free(world->next_free);
+  free(world->slot_live);
+  free(world->locations);
+  memset(world, 0, sizeof(ArchetypeWorld));
+}
+
+ComponentID archetype_world_register_component(ArchetypeWorld *world, u32 component_size) {
+  assert(world->num_component_types < ECS_MAX_COMPONENT_TYPES);
+  assert(component_size > 0 && component_size <= ARCHETYPE_CHUNK_SIZE / 4);
+  // Archetypes are created lazily, but an archetype mentioning this component would have to be rebuilt
+  assert(world->num_archetypes == 0 && "Register every component before creating entities");
+
+  ComponentID id = world->num_component_types++;
+  world->component_sizes[id] = component_size;
+  return id;
+}
+
+// Column offsets for a given row count, returns the bytes used
+static u32 layout_archetype_columns(const ArchetypeWorld *world, Archetype *archetype, u32 rows) {
+  u32 offset = 0;
+  archetype->entity_column_offset = offset;
+  offset = align_up(offset + rows * (u32)sizeof(EntityIndex), ARCHETYPE_COLUMN_ALIGNMENT);
+  for (u32 i = 0; i < archetype->num_columns; i++) {
+    archetype->column_offsets[i] = offset;
+    offset = align_up(offset + rows * world->component_sizes[archetype->components[i]], ARCHETYPE_COLUMN_ALIGNMENT);
+  }
+  return offset;
+}
+
+static u32 find_or_create_archetype(ArchetypeWorld *world, ComponentMask mask) {
+  for (u32 i = 0; i < world->num_archetypes; i++) {
+    if (world->archetypes[i].mask == mask) {
+      return i;
+    }
+  }
+
+  assert(world->num_archetypes < MAX_NUM_ARCHETYPES && "Out of archetypes");
+  assert(
+      (world->num_component_types == 32 || (mask >> world->num_component_types) == 0) &&
+      "Mask has unregistered components"
+  );
+
+  u32 index = world->num_archetypes++;
+  Archetype *archetype = &world->archetypes[index];
+  memset(archetype, 0, sizeof(Archetype));
+  archetype->mask = mask;
+
+  u32 row_size = sizeof(EntityIndex);
+  for (ComponentID id = 0; id < ECS_MAX_COMPONENT_TYPES; id++) {
+    archetype->column_of_component[id] = ARCHETYPE_NO_COLUMN;
+    if (mask & COMPONENT_BIT(id)) {
+      archetype->column_of_component[id] = archetype->num_columns;
+      archetype->components[archetype->num_columns++] = id;
+      row_size += world->component_sizes[id];
+    }
+  }
+
+  // As many rows as fit once every column is padded out to its alignment
+  u32 rows = ARCHETYPE_CHUNK_SIZE / row_size;
+  while (layout_archetype_columns(world, archetype, rows) > ARCHETYPE_CHUNK_SIZE) {
+    rows--;
+  }
+  assert(rows > 0);
+  archetype->chunk_capacity = rows;
+  return index;
+}
+
+static EntityIndex *archetype_entity_row(const Archetype *archetype, u32 index) {
+  const ArchetypeChunk *chunk = &archetype->chunks[index / archetype->chunk_capacity];
+  return (EntityIndex *)(chunk->data + archetype->entity_column_offset) + index % archetype->chunk_capacity;
+}
+
+static void *archetype_component(const ArchetypeWorld *world, const Archetype *archetype, u32 column, u32 index) {
+  const ArchetypeChunk *chunk = &archetype->chunks[index / archetype->chunk_capacity];
+  u32 size = world->component_sizes[archetype->components[column]];
+  return chunk->data + archetype->column_offsets[column] + (u64)(index % archetype->chunk_capacity) * size;
+}
+
+static void mark_chunk_changed(const ArchetypeWorld *world, Archetype *archetype, u32 chunk) {
+  for (u32 i = 0; i < archetype->num_columns; i++) {
+    archetype->chunks[chunk].versions[i] = world->version;
+  }
+}
+
+// Appends a zeroed row for entity, returns its index
+static u32 archetype_push(ArchetypeWorld *world, Archetype *archetype, EntityIndex entity) {
+  u32 index = archetype->num_entities++;
+  u32 chunk_index = index / archetype->chunk_capacity;
+
+  if (chunk_index == archetype->num_chunks) {
+    if (archetype->num_chunks == archetype->chunks_capacity) {
+      u32 capacity = archetype->chunks_capacity ? 2 * archetype->chunks_capacity : INITIAL_CHUNKS_CAPACITY;
+      archetype->chunks = (ArchetypeChunk *)realloc(archetype->chunks, capacity * sizeof(ArchetypeChunk));
+      assert(archetype->chunks);
+      archetype->chunks_capacity = capacity;
+    }
+
+    ArchetypeChunk *chunk = &archetype->chunks[archetype->num_chunks++];
+    memset(chunk, 0, sizeof(ArchetypeChunk));
+    chunk->data = (u8 *)aligned_alloc(ARCHETYPE_COLUMN_ALIGNMENT, ARCHETYPE_CHUNK_SIZE);
+    assert(chunk->data);
+  }
+
+  archetype->chunks[chunk_index].count++;
+  *archetype_entity_row(archetype, index) = entity;
+  for (u32 i = 0; i < archetype->num_columns; i++) {
+    memset(archetype_component(world, archetype, i, index), 0, world->component_sizes[archetype->components[i]]);
+  }
+  mark_chunk_changed(world, archetype, chunk_index);
+  return index;
+}
+
+// Moves the archetype's last entity into the hole at index. Empty chunks are kept for reuse.
+static void archetype_remove(ArchetypeWorld *world, Archetype *archetype, u32 index) {
+  u32 last = --archetype->num_entities;
+  if (index != last) {
+    for (u32 i = 0; i < archetype->num_columns; i++) {
+      memcpy(
+          archetype_component(world, archetype, i, index), archetype_component(world, archetype, i, last),
+          world->component_sizes[archetype->components[i]]
+      );
+    }
+    EntityIndex moved = *archetype_entity_row(archetype, last);
+    *archetype_entity_row(archetype, index) = moved;
+    world->locations[entity_index_slot(moved)].index = index;
+    mark_chunk_changed(world, archetype, index / archetype->chunk_capacity);
+  }
+
+  u32 last_chunk = last / archetype->chunk_capacity;
+  archetype->chunks[last_chunk].count--;
+  mark_chunk_changed(world, archetype, last_chunk);
+}
+
+EntityIndex archetype_world_create_entity(ArchetypeWorld *world, ComponentMask mask) {
+  u32 slot = world->free_head;
+  if (slot != 0) {
+    world->free_head = world->next_free[slot];
+  } else {
+    if (world->num_slots == world->slot_capacity) {
+      assert(world->slot_capacity < MAX_NUM_ENTITY_SLOTS && "Out of entity slots");
+      u32 capacity = 2 * world->slot_capacity;
+      reserve_archetype_entity_slots(world, capacity < MAX_NUM_ENTITY_SLOTS ? capacity : MAX_NUM_ENTITY_SLOTS);
+    }
+    slot = world->num_slots++;
+    world->generations[slot] = 0;
+  }
+
+  EntityIndex entity = make_entity_index(slot, world->generations[slot]);
+  u32 archetype = find_or_create_archetype(world, mask);
+  world->locations[slot].archetype = archetype;
+  world->locations[slot].index = archetype_push(world, &world->archetypes[archetype], entity);
+  world->slot_live[slot] = true;
+  world->num_live_entities++;
+  return entity;
+}
+
+bool archetype_world_entity_valid(const ArchetypeWorld *world, EntityIndex entity) {
+  u32 slot = entity_index_slot(entity);
+  return slot != 0 && slot < world->num_slots && world->slot_live[slot] &&
+         world->generations[slot] == entity_index_generation(entity);
+}
+
+void archetype_world_destroy_entity(ArchetypeWorld *world, EntityIndex entity) {
+  if (!archetype_world_entity_valid(world, entity)) {
+    return;
+  }
+
+  u32 slot = entity_index_slot(entity);
+  ArchetypeEntityLocation location = world->locations[slot];
+  archetype_remove(world, &world->archetypes[location.archetype], location.index);
+
+  world->generations[slot] = next_entity_generation(world->generations[slot]);
+  world->slot_live[slot] = false;
+  world->next_free[slot] = world->free_head;
+  world->free_head = slot;
+  world->num_live_entities--;
+}
+
+static void move_entity_to_archetype(ArchetypeWorld *world, EntityIndex entity, ComponentMask mask) {
+  u32 slot = entity_index_slot(entity);
+  ArchetypeEntityLocation from = world->locations[slot];
+  if (world->archetypes[from.archetype].mask == mask) {
+    return;
+  }
+
+  // world->archetypes is allocated up front, so these stay valid while archetypes are created
+  u32 to_archetype = find_or_create_archetype(world, mask);
+  Archetype *source = &world->archetypes[from.archetype];
+  Archetype *target = &world->archetypes[to_archetype];
+  u32 to_index = archetype_push(world, target, entity);
+
+  // Copy the components both have, new ones stay zeroed
+  for (u32 i = 0; i < source->num_columns; i++) {
+    ComponentID component = source->components[i];
+    u32 column = target->column_of_component[component];
+    if (column != ARCHETYPE_NO_COLUMN) {
+      memcpy(
+          archetype_component(world, target, column, to_index), archetype_component(world, source, i, from.index),
+          world->component_sizes[component]
+      );
+    }
+  }
+
+  archetype_remove(world, source, from.index);
+  world->locations[slot].archetype = to_archetype;
+  world->locations[slot].index = to_index;
+}
+
+void archetype_world_add_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!archetype_world_entity_valid(world, entity)) {
+    return;
+  }
+  ComponentMask mask = world->archetypes[world->locations[entity_index_slot(entity)].archetype].mask;
+  move_entity_to_archetype(world, entity, mask | COMPONENT_BIT(component));
+}
+
+void archetype_world_remove_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!archetype_world_entity_valid(world, entity)) {
+    return;
+  }
+  ComponentMask mask = world->archetypes[world->locations[entity_index_slot(entity)].archetype].mask;
+  move_entity_to_archetype(world, entity, mask & ~COMPONENT_BIT(component));
+}
+
+const void *
+archetype_world_read_component(const ArchetypeWorld *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!archetype_world_entity_valid(world, entity)) {
+    return NULL;
+  }
+  ArchetypeEntityLocation location = world->locations[entity_index_slot(entity)];
+  const Archetype *archetype = &world->archetypes[location.archetype];
+  u32 column = archetype->column_of_component[component];
+  return column == ARCHETYPE_NO_COLUMN ? NULL : archetype_component(world, archetype, column, location.index);
+}
+
+void *archetype_world_write_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!archetype_world_entity_valid(world, entity)) {
+    return NULL;
+  }
+  ArchetypeEntityLocation location = world->locations[entity_index_slot(entity)];
+  Archetype *archetype = &world->archetypes[location.archetype];
+  u32 column = archetype->column_of_component[component];
+  if (column == ARCHETYPE_NO_COLUMN) {
+    return NULL;
+  }
+  archetype->chunks[location.index / archetype->chunk_capacity].versions[column] = world->version;
+  return archetype_component(world, archetype, column, location.index);
+}
+
+ArchetypeQuery archetype_query(ArchetypeWorld *world, ComponentMask required) {
+  ArchetypeQuery query;
+  memset(&query, 0, sizeof(ArchetypeQuery));
+  query.world = world;
+  query.required = required;
+  return query;
+}
+
+bool archetype_query_next(ArchetypeQuery *query, ArchetypeChunkView *view) {
+  ArchetypeWorld *world = query->world;
+  while (query->archetype < world->num_archetypes) {
+    Archetype *archetype = &world->archetypes[query->archetype];
+    if ((archetype->mask & query->required) == query->required) {
+      while (query->chunk < archetype->num_chunks) {
+        ArchetypeChunk *chunk = &archetype->chunks[query->chunk++];
+        if (chunk->count > 0) {
+          view->world = world;
+          view->archetype = archetype;
+          view->chunk = chunk;
+          view->count = chunk->count;
+          return true;
+        }
+      }
+    }
+    query->archetype++;
+    query->chunk = 0;
+  }
+  return false;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+// Archetype chunked ECS storage. An alternative to the sparse sets in ecs.h, for the hot, wide
+// queries where sparse lookups cost too much.
+//
+// Entities are grouped by their exact component set (their archetype). Each archetype stores its
+// entities in ARCHETYPE_CHUNK_SIZE chunks, and inside a chunk every component is its own column:
+// a contiguous, ARCHETYPE_COLUMN_ALIGNMENT aligned array with one element per row. A query for
+// Position+Velocity walks the matching archetypes chunk by chunk and gets plain arrays back,
+// which the compiler can vectorize without any sparse lookups or per entity branching.
+//
+// Archetypes are kept packed. An archetype's entity n lives at chunk n / chunk_capacity, row
+// n % chunk_capacity, and removal moves the archetype's last entity into the hole. Adding or
+// removing a component moves the entity to another archetype. Row pointers are only valid until the
+// next structural change. Hold EntityIndex across frames.
+//
+// Change versions: every chunk remembers, per column, the world version when that column was last
+// written or the chunk last changed shape. Advance the world version once per frame before running
+// systems. A consumer that remembers the version it last looked at can then skip chunks whose
+// columns have not changed since, e.g. a renderer rebuilding only the instance data of chunks that
+// moved.
+
+#include "ecs.h"
+#include "entity_index.h"
+#include "tuke_engine.h"
+
+#define ARCHETYPE_CHUNK_SIZE (16 * 1024)
+#define ARCHETYPE_COLUMN_ALIGNMENT (64)
+#define MAX_NUM_ARCHETYPES (256)
+#define ARCHETYPE_NO_COLUMN (0xFFFFFFFF)
+
+typedef u32 ComponentMask;
+#define COMPONENT_BIT(component) (1u << (component))
+
+static_assert(ECS_MAX_COMPONENT_TYPES <= 32, "ComponentMask is a u32");
+
+struct ArchetypeChunk {
+  u8 *data; // ARCHETYPE_CHUNK_SIZE bytes, aligned to ARCHETYPE_COLUMN_ALIGNMENT
+  u32 count;
+
+  // World version of the last write to each column, by column index
+  u32 versions[ECS_MAX_COMPONENT_TYPES];
+};
+
+struct Archetype {
+  ComponentMask mask;
+  u32 num_columns;
+  ComponentID components[ECS_MAX_COMPONENT_TYPES];  // By column index, in ComponentID order
+  u32 column_offsets[ECS_MAX_COMPONENT_TYPES];      // By column index, byte offset into the chunk
+  u32 column_of_component[ECS_MAX_COMPONENT_TYPES]; // By ComponentID, or ARCHETYPE_NO_COLUMN
+  u32 entity_column_offset;                         // The EntityIndex of each row
+  u32 chunk_capacity;                               // Rows per chunk
+
+  ArchetypeChunk *chunks;
+  u32 num_chunks;
+  u32 chunks_capacity;
+  u32 num_entities;
+};
+
+struct ArchetypeEntityLocation {
+  u32 archetype;
+  u32 index; // Into the archetype, see the packing note above
+};
+
+struct ArchetypeWorld {
+  u32 component_sizes[ECS_MAX_COMPONENT_TYPES];
+  u32 num_component_types;
+
+  Archetype *archetypes; // MAX_NUM_ARCHETYPES
+  u32 num_archetypes;
+
+  // Entity slots. Slot 0 is reserved for nil.
+  u32 *generations;
+  u32 *next_free; // Intrusive free list through free slots. 0 ends the list
+  bool *slot_live;
+  ArchetypeEntityLocation *locations;
+  u32 free_head;
+  u32 num_slots;
+  u32 slot_capacity;
+  u32 num_live_entities;
+
+  u32 version;
+};
+
+// One chunk of a query's results
+struct ArchetypeChunkView {
+  ArchetypeWorld *world;
+  Archetype *archetype;
+  ArchetypeChunk *chunk;
+  u32 count;
+};
+
+struct ArchetypeQuery {
+  ArchetypeWorld *world;
+  ComponentMask required;
+  u32 archetype;
+  u32 chunk;
+};
+
+ArchetypeWorld create_archetype_world(u32 initial_entity_capacity);
+void destroy_archetype_world(ArchetypeWorld *world);
+
+// Component sizes must be multiples of their alignment, and alignments at most ARCHETYPE_COLUMN_ALIGNMENT.
+ComponentID archetype_world_register_component(ArchetypeWorld *world, u32 component_size);
+#define ARCHETYPE_WORLD_REGISTER_COMPONENT(world, type) archetype_world_register_component((world), sizeof(type))
+
+// Once per frame, before running systems
+static inline void archetype_world_advance_version(ArchetypeWorld *world) { world->version++; }
+
+// Components start zeroed (ZII)
+EntityIndex archetype_world_create_entity(ArchetypeWorld *world, ComponentMask mask);
+void archetype_world_destroy_entity(ArchetypeWorld *world, EntityIndex entity);
+bool archetype_world_entity_valid(const ArchetypeWorld *world, EntityIndex entity);
+
+// Moves the entity to the archetype with or without the component. Adding keeps existing values.
+void archetype_world_add_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component);
+void archetype_world_remove_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component);
+
+// NULL if the entity is stale or does not have the component. _write marks the column changed.
+const void *archetype_world_read_component(const ArchetypeWorld *world, EntityIndex entity, ComponentID component);
+void *archetype_world_write_component(ArchetypeWorld *world, EntityIndex entity, ComponentID component);
+
+// Chunks of every archetype that has all of required, skipping empty chunks.
+// ArchetypeQuery query = archetype_query(world, COMPONENT_BIT(position) | COMPONENT_BIT(velocity));
+// ArchetypeChunkView view;
+// while (archetype_query_next(&query, &view)) {
+//   Vec3 *p = (Vec3 *)archetype_chunk_write(&view, position);
+//   const Vec3 *v = (const Vec3 *)archetype_chunk_read(&view, velocity);
+//   for (u32 i = 0; i < view.count; i++) { ... }
+// }
+ArchetypeQuery archetype_query(ArchetypeWorld *world, ComponentMask required);
+bool archetype_query_next(ArchetypeQuery *query, ArchetypeChunkView *view);
+
+static inline const void *archetype_chunk_read(const ArchetypeChunkView *view, ComponentID component) {
+  u32 column = view->archetype->column_of_component[component];
+  return column == ARCHETYPE_NO_COLUMN ? NULL : view->chunk->data + view->archetype->column_offsets[column];
+}
+
+static inline void *archetype_chunk_write(ArchetypeChunkView *view, ComponentID component) {
+  u32 column = view->archetype->column_of_component[component];
+  if (column == ARCHETYPE_NO_COLUMN) {
+    return NULL;
+  }
+  view->chunk->versions[column] = view->world->version;
+  return view->chunk->data + view->archetype->column_offsets[column];
+}
+
+static inline const EntityIndex *archetype_chunk_entities(const ArchetypeChunkView *view) {
+  return (const EntityIndex *)(view->chunk->data + view->archetype->entity_column_offset);
+}
+
+// Whether the column was written, or the chunk changed shape, after version
+static inline bool archetype_chunk_changed(const ArchetypeChunkView *view, ComponentID component, u32 version) {
+  u32 column = view->archetype->column_of_component[component];
+  return column != ARCHETYPE_NO_COLUMN && view->chunk->versions[column] > version;
+}
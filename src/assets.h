@@ -2,6 +2,7 @@
 
 #include "stb_image.h"
 #include "stb_image_resize2.h"
+#include "memory_arena.h"
 #include "tuke_engine.h"
 #include "utils.h"
 #include "vulkan_base.h"
@@ -29,7 +30,9 @@ static inline void load_vulkan_texture_array(
   if (paths == NULL || ctx == NULL) {
     return;
   }
-  STBImage stbs[MAX_NUM_TEXTURES];
+  MemoryArena *scratch = get_scratch_arena();
+  ArenaMark scratch_mark = arena_mark(scratch);
+  STBImage *stbs = ARENA_PUSH_ARRAY(scratch, STBImage, num_paths);
 
   u32 max_size = 0;
   for (u32 i = 0; i < num_paths; i++) {
@@ -67,8 +70,8 @@ static inline void load_vulkan_texture_array(
   vkUnmapMemory(ctx->device, buffer.memory);
   destroy_vulkan_buffer(ctx, buffer);
 
-  VkWriteDescriptorSet writes[MAX_NUM_TEXTURES] = {};
-  VkDescriptorImageInfo image_infos[MAX_NUM_TEXTURES] = {};
+  VkWriteDescriptorSet *writes = ARENA_PUSH_ARRAY_ZERO(scratch, VkWriteDescriptorSet, num_paths);
+  VkDescriptorImageInfo *image_infos = ARENA_PUSH_ARRAY_ZERO(scratch, VkDescriptorImageInfo, num_paths);
 
   for (u32 i = 0; i < num_paths; i++) {
     image_infos[i] = {
@@ -86,6 +89,7 @@ static inline void load_vulkan_texture_array(
   }
 
   vkUpdateDescriptorSets(ctx->device, num_paths, writes, 0, NULL);
+  arena_reset_to_mark(scratch, scratch_mark);
 }
 
 static inline void
@@ -93,9 +97,10 @@ load_vulkan_textures(VulkanContext *ctx, const StringArray *string_arrs, u32 num
   if (textures == NULL) {
     return;
   }
-  assert(num_textures < MAX_NUM_TEXTURES);
-  STBImage stbs[MAX_NUM_TEXTURES][MAX_LAYERS];
-  u32 max_sizes[MAX_NUM_TEXTURES] = {};
+  MemoryArena *scratch = get_scratch_arena();
+  ArenaMark scratch_mark = arena_mark(scratch);
+  STBImage(*stbs)[MAX_LAYERS] = (STBImage(*)[MAX_LAYERS])ARENA_PUSH_ARRAY(scratch, STBImage, num_textures * MAX_LAYERS);
+  u32 *max_sizes = ARENA_PUSH_ARRAY_ZERO(scratch, u32, num_textures);
 
   // Get max sizes per texture array
   u32 max_dim = 0;
@@ -122,7 +127,7 @@ load_vulkan_textures(VulkanContext *ctx, const StringArray *string_arrs, u32 num
   VkResult result = vkMapMemory(ctx->device, buffer.memory, 0, buffer.memory_requirements.size, 0, &texture_data);
   VK_CHECK(result, "Failed to map staging buffer memory");
 
-  unsigned char *resized = (unsigned char *)malloc(size);
+  unsigned char *resized = ARENA_PUSH_ARRAY(scratch, unsigned char, size);
   // Create textures and free STB data
   for (u32 i = 0; i < num_textures; i++) {
     textures[i] = create_vulkan_texture(ctx, max_sizes[i], max_sizes[i], string_arrs[i].num_paths);
@@ -155,7 +160,7 @@ load_vulkan_textures(VulkanContext *ctx, const StringArray *string_arrs, u32 num
     end_single_use_command_buffer(ctx, cmd);
   }
 
-  free(resized);
   vkUnmapMemory(ctx->device, buffer.memory);
   destroy_vulkan_buffer(ctx, buffer);
+  arena_reset_to_mark(scratch, scratch_mark);
 }
@@ -0,0 +1,272 @@
+#include "ecs.h"
+#include "entity_index.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_POOL_CAPACITY (64)
+#define INITIAL_COMMANDS_CAPACITY (64)
+
+static void reserve_entity_slots(World *world, u32 capacity) {
+  if (capacity <= world->slot_capacity) {
+    return;
+  }
+  assert(capacity <= MAX_NUM_ENTITY_SLOTS);
+
+  world->generations = (u32 *)realloc(world->generations, capacity * sizeof(u32));
+  world->next_free = (u32 *)realloc(world->next_free, capacity * sizeof(u32));
+  world->slot_live = (bool *)realloc(world->slot_live, capacity * sizeof(bool));
+  assert(world->generations && world->next_free && world->slot_live);
+
+  // Sparse arrays cover every slot, new slots have no components
+  for (u32 i = 0; i < world->num_component_types; i++) {
+    ComponentPool *pool = &world->pools[i];
+    pool->sparse = (u32 *)realloc(pool->sparse, capacity * sizeof(u32));
+    assert(pool->sparse);
+    memset(pool->sparse + world->slot_capacity, 0, (capacity - world->slot_capacity) * sizeof(u32));
+  }
+
+  world->slot_capacity = capacity;
+}
+
+World create_world(u32 initial_entity_capacity) {
+  World world;
+  memset(&world, 0, sizeof(World));
+
+  // Room for the nil slot plus at least one entity
+  reserve_entity_slots(&world, initial_entity_capacity < 2 ? 2 : initial_entity_capacity);
+  world.generations[0] = 0;
+  world.next_free[0] = 0;
+  world.slot_live[0] = false;
+  world.num_slots = 1;
+  return world;
+}
+
+void destroy_world(World *world) {
+  free(world->generations);
+  free(world->next_free);
+  free(world->slot_live);
+  for (u32 i = 0; i < world->num_component_types; i++) {
+    free(world->pools[i].data);
+    free(world->pools[i].entities);
+    free(world->pools[i].sparse);
+  }
+  free(world->commands);
+  free(world->command_data);
+  memset(world, 0, sizeof(World));
+}
+
+ComponentID world_register_component(World *world, u32 component_size) {
+  assert(world->num_component_types < ECS_MAX_COMPONENT_TYPES);
+  assert(component_size > 0);
+
+  ComponentID id = world->num_component_types++;
+  ComponentPool *pool = &world->pools[id];
+  pool->component_size = component_size;
+  pool->num_components = 0;
+  pool->capacity = INITIAL_POOL_CAPACITY;
+  pool->data = (u8 *)malloc((u64)INITIAL_POOL_CAPACITY * component_size);
+  pool->entities = (EntityIndex *)malloc(INITIAL_POOL_CAPACITY * sizeof(EntityIndex));
+  pool->sparse = (u32 *)calloc(world->slot_capacity, sizeof(u32));
+  assert(pool->data && pool->entities && pool->sparse);
+  return id;
+}
+
+EntityIndex world_create_entity(World *world) {
+  u32 slot = world->free_head;
+  if (slot != 0) {
+    world->free_head = world->next_free[slot];
+  } else {
+    if (world->num_slots == world->slot_capacity) {
+      assert(world->slot_capacity < MAX_NUM_ENTITY_SLOTS && "Out of entity slots");
+      u32 capacity = 2 * world->slot_capacity;
+      reserve_entity_slots(world, capacity < MAX_NUM_ENTITY_SLOTS ? capacity : MAX_NUM_ENTITY_SLOTS);
+    }
+    slot = world->num_slots++;
+    world->generations[slot] = 0;
+  }
+
+  world->slot_live[slot] = true;
+  world->num_live_entities++;
+  return make_entity_index(slot, world->generations[slot]);
+}
+
+bool world_entity_valid(const World *world, EntityIndex entity) {
+  u32 slot = entity_index_slot(entity);
+  return slot != 0 && slot < world->num_slots && world->slot_live[slot] &&
+         world->generations[slot] == entity_index_generation(entity);
+}
+
+static void pool_remove(ComponentPool *pool, u32 slot) {
+  u32 dense = pool->sparse[slot];
+  if (!dense) {
+    return;
+  }
+  dense -= 1;
+
+  // Swap the last component into the hole
+  u32 last = --pool->num_components;
+  if (dense != last) {
+    memcpy(
+        pool->data + (u64)dense * pool->component_size, pool->data + (u64)last * pool->component_size,
+        pool->component_size
+    );
+    EntityIndex moved = pool->entities[last];
+    pool->entities[dense] = moved;
+    pool->sparse[entity_index_slot(moved)] = dense + 1;
+  }
+  pool->sparse[slot] = 0;
+}
+
+void world_destroy_entity(World *world, EntityIndex entity) {
+  if (!world_entity_valid(world, entity)) {
+    return;
+  }
+
+  u32 slot = entity_index_slot(entity);
+  for (u32 i = 0; i < world->num_component_types; i++) {
+    pool_remove(&world->pools[i], slot);
+  }
+
+  world->generations[slot] = next_entity_generation(world->generations[slot]);
+  world->slot_live[slot] = false;
+  world->next_free[slot] = world->free_head;
+  world->free_head = slot;
+  world->num_live_entities--;
+}
+
+void *world_add_component(World *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!world_entity_valid(world, entity)) {
+    return NULL;
+  }
+
+  ComponentPool *pool = &world->pools[component];
+  u32 slot = entity_index_slot(entity);
+  if (pool->sparse[slot]) {
+    return pool->data + (u64)(pool->sparse[slot] - 1) * pool->component_size;
+  }
+
+  if (pool->num_components == pool->capacity) {
+    pool->capacity *= 2;
+    pool->data = (u8 *)realloc(pool->data, (u64)pool->capacity * pool->component_size);
+    pool->entities = (EntityIndex *)realloc(pool->entities, pool->capacity * sizeof(EntityIndex));
+    assert(pool->data && pool->entities);
+  }
+
+  u32 dense = pool->num_components++;
+  pool->entities[dense] = entity;
+  pool->sparse[slot] = dense + 1;
+
+  u8 *data = pool->data + (u64)dense * pool->component_size;
+  memset(data, 0, pool->component_size);
+  return data;
+}
+
+void world_remove_component(World *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  if (!world_entity_valid(world, entity)) {
+    return;
+  }
+  pool_remove(&world->pools[component], entity_index_slot(entity));
+}
+
+static WorldCommand *
+push_world_command(World *world, WorldCommandType type, EntityIndex entity, ComponentID component) {
+  if (world->num_commands == world->commands_capacity) {
+    u32 capacity = world->commands_capacity ? 2 * world->commands_capacity : INITIAL_COMMANDS_CAPACITY;
+    world->commands = (WorldCommand *)realloc(world->commands, capacity * sizeof(WorldCommand));
+    assert(world->commands);
+    world->commands_capacity = capacity;
+  }
+
+  WorldCommand *command = &world->commands[world->num_commands++];
+  command->type = type;
+  command->entity = entity;
+  command->component = component;
+  command->data_offset = 0;
+  return command;
+}
+
+void world_defer_add_component(World *world, EntityIndex entity, ComponentID component, const void *data) {
+  assert(component < world->num_component_types);
+  WorldCommand *command = push_world_command(world, WORLD_COMMAND_ADD_COMPONENT, entity, component);
+
+  u32 size = world->pools[component].component_size;
+  if (world->command_data_size + size > world->command_data_capacity) {
+    u32 capacity = world->command_data_capacity ? 2 * world->command_data_capacity : 1024;
+    while (capacity < world->command_data_size + size) {
+      capacity *= 2;
+    }
+    world->command_data = (u8 *)realloc(world->command_data, capacity);
+    assert(world->command_data);
+    world->command_data_capacity = capacity;
+  }
+
+  command->data_offset = world->command_data_size;
+  if (data) {
+    memcpy(world->command_data + world->command_data_size, data, size);
+  } else {
+    memset(world->command_data + world->command_data_size, 0, size);
+  }
+  world->command_data_size += size;
+}
+
+void world_defer_remove_component(World *world, EntityIndex entity, ComponentID component) {
+  assert(component < world->num_component_types);
+  push_world_command(world, WORLD_COMMAND_REMOVE_COMPONENT, entity, component);
+}
+
+void world_defer_destroy_entity(World *world, EntityIndex entity) {
+  push_world_command(world, WORLD_COMMAND_DESTROY_ENTITY, entity, 0);
+}
+
+// Commands on entities that were destroyed before the flush, or by an earlier command, are dropped.
+void world_flush_commands(World *world) {
+  for (u32 i = 0; i < world->num_commands; i++) {
+    const WorldCommand *command = &world->commands[i];
+    switch (command->type) {
+    case WORLD_COMMAND_ADD_COMPONENT: {
+      void *component = world_add_component(world, command->entity, command->component);
+      if (component) {
+        memcpy(
+            component, world->command_data + command->data_offset, world->pools[command->component].component_size
+        );
+      }
+      break;
+    }
+    case WORLD_COMMAND_REMOVE_COMPONENT:
+      world_remove_component(world, command->entity, command->component);
+      break;
+    case WORLD_COMMAND_DESTROY_ENTITY:
+      world_destroy_entity(world, command->entity);
+      break;
+    default:
+      assert(false);
+    }
+  }
+
+  world->num_commands = 0;
+  world->command_data_size = 0;
+}
+
+WorldView world_view(World *world, const ComponentID *components, u32 num_components) {
+  assert(num_components > 0 && num_components <= ECS_MAX_VIEW_COMPONENTS);
+
+  WorldView view;
+  memset(&view, 0, sizeof(WorldView));
+  view.world = world;
+  view.num_components = num_components;
+  view.driver = components[0];
+  for (u32 i = 0; i < num_components; i++) {
+    assert(components[i] < world->num_component_types);
+    view.components[i] = components[i];
+    if (world->pools[components[i]].num_components < world->pools[view.driver].num_components) {
+      view.driver = components[i];
+    }
+  }
+  view.cursor = 0;
+  return view;
+}
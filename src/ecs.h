@@ -0,0 +1,155 @@
+#pragma once
+
+// Sparse set ECS.
+//
+// A World hands out generational EntityIndex handles (entity_index.h) and owns one ComponentPool
+// per registered component type. Each pool is a sparse set: components are packed densely, with
+// the owning entity alongside, and a sparse array by entity slot maps back to the dense index.
+// Adding, removing and looking up a component are O(1), and a system over one component type
+// walks a contiguous array.
+//
+// Multi component views iterate the smallest pool in the view and test the others through their
+// sparse arrays, so a view costs the size of its rarest component, not the number of entities.
+//
+// Adding or removing components and destroying entities move components around inside pools, so
+// they must not happen while a view is iterating. Queue them with the world_defer_* functions and
+// apply them with world_flush_commands once the systems are done. Creating entities is always safe.
+//
+// Component types are plain data, copied with memcpy. Added components start zeroed (ZII).
+
+#include "entity_index.h"
+#include "tuke_engine.h"
+
+#include <stddef.h>
+
+#define ECS_MAX_COMPONENT_TYPES (32)
+#define ECS_MAX_VIEW_COMPONENTS (8)
+
+typedef u32 ComponentID;
+
+struct ComponentPool {
+  u32 component_size;
+  u32 num_components;
+  u32 capacity;
+
+  u8 *data;              // Dense, component_size * capacity
+  EntityIndex *entities; // Dense, the owner of each component
+  u32 *sparse;           // By entity slot, dense index + 1. 0 is absent. Sized to the World's slot capacity
+};
+
+enum WorldCommandType {
+  WORLD_COMMAND_ADD_COMPONENT,
+  WORLD_COMMAND_REMOVE_COMPONENT,
+  WORLD_COMMAND_DESTROY_ENTITY,
+};
+
+struct WorldCommand {
+  WorldCommandType type;
+  EntityIndex entity;
+  ComponentID component;
+  u32 data_offset; // Into World::command_data, for WORLD_COMMAND_ADD_COMPONENT
+};
+
+struct World {
+  // Entity slots. Slot 0 is reserved for nil.
+  u32 *generations;
+  u32 *next_free; // Intrusive free list through free slots. 0 ends the list
+  bool *slot_live;
+  u32 free_head;
+  u32 num_slots; // Slots handed out at least once, including slot 0
+  u32 slot_capacity;
+  u32 num_live_entities;
+
+  ComponentPool pools[ECS_MAX_COMPONENT_TYPES];
+  u32 num_component_types;
+
+  // Deferred structural changes, applied in order by world_flush_commands
+  WorldCommand *commands;
+  u32 num_commands;
+  u32 commands_capacity;
+  u8 *command_data;
+  u32 command_data_size;
+  u32 command_data_capacity;
+};
+
+struct WorldView {
+  World *world;
+  ComponentID components[ECS_MAX_VIEW_COMPONENTS];
+  u32 num_components;
+  ComponentID driver; // The smallest pool, the one actually iterated
+  u32 cursor;         // Next dense index into the driver
+};
+
+World create_world(u32 initial_entity_capacity);
+void destroy_world(World *world);
+
+ComponentID world_register_component(World *world, u32 component_size);
+#define WORLD_REGISTER_COMPONENT(world, type) world_register_component((world), sizeof(type))
+
+EntityIndex world_create_entity(World *world);
+void world_destroy_entity(World *world, EntityIndex entity);
+bool world_entity_valid(const World *world, EntityIndex entity);
+
+// Returns the zeroed component. If the entity already has one, returns it unchanged.
+void *world_add_component(World *world, EntityIndex entity, ComponentID component);
+void world_remove_component(World *world, EntityIndex entity, ComponentID component);
+
+// NULL if the entity is stale or does not have the component
+static inline void *world_get_component(const World *world, EntityIndex entity, ComponentID component) {
+  if (!world_entity_valid(world, entity)) {
+    return NULL;
+  }
+  const ComponentPool *pool = &world->pools[component];
+  u32 dense = pool->sparse[entity_index_slot(entity)];
+  return dense ? pool->data + (u64)(dense - 1) * pool->component_size : NULL;
+}
+#define WORLD_GET_COMPONENT(world, entity, component, type) \
+  ((type *)world_get_component((world), (entity), (component)))
+
+// Dense components of a single type, for systems that only need one. Valid until the next structural change.
+static inline void *world_component_array(const World *world, ComponentID component, u32 *count) {
+  *count = world->pools[component].num_components;
+  return world->pools[component].data;
+}
+
+// data may be NULL to add a zeroed component
+void world_defer_add_component(World *world, EntityIndex entity, ComponentID component, const void *data);
+void world_defer_remove_component(World *world, EntityIndex entity, ComponentID component);
+void world_defer_destroy_entity(World *world, EntityIndex entity);
+void world_flush_commands(World *world);
+
+// Entities that have every component in components.
+// WorldView view = world_view(world, ids, 2);
+// EntityIndex e;
+// void *c[2];
+// while (world_view_next(&view, &e, c)) { ... }
+WorldView world_view(World *world, const ComponentID *components, u32 num_components);
+
+static inline bool world_view_next(WorldView *view, EntityIndex *entity, void **components) {
+  const World *world = view->world;
+  const ComponentPool *driver = &world->pools[view->driver];
+
+  while (view->cursor < driver->num_components) {
+    u32 i = view->cursor++;
+    EntityIndex candidate = driver->entities[i];
+    u32 slot = entity_index_slot(candidate);
+
+    bool has_all = true;
+    for (u32 k = 0; k < view->num_components; k++) {
+      const ComponentPool *pool = &world->pools[view->components[k]];
+      u32 dense = pool->sparse[slot];
+      if (!dense) {
+        has_all = false;
+        break;
+      }
+      components[k] = pool->data + (u64)(dense - 1) * pool->component_size;
+    }
+
+    if (has_all) {
+      *entity = candidate;
+      return true;
+    }
+  }
+
+  return false;
+}
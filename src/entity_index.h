@@ -0,0 +1,38 @@
+#pragma once
+
+// Generational entity handles, shared by the topdown Entities pool and the ECS World.
+//
+// An EntityIndex packs a slot and that slot's generation. Slot 0 is never handed out, so a zeroed
+// EntityIndex is nil (ZII). Destroying an entity bumps its slot's generation, so old handles to it
+// stop validating.
+//
+// Generations are ENTITY_GENERATION_BITS wide and wrap. A handle held across 4096 reuses of its
+// slot validates again.
+
+#include "tuke_engine.h"
+
+#include <assert.h>
+
+#define ENTITY_SLOT_BITS (20)
+#define ENTITY_GENERATION_BITS (32 - ENTITY_SLOT_BITS)
+#define ENTITY_SLOT_MASK ((1u << ENTITY_SLOT_BITS) - 1)
+#define ENTITY_GENERATION_MASK ((1u << ENTITY_GENERATION_BITS) - 1)
+#define MAX_NUM_ENTITY_SLOTS (1u << ENTITY_SLOT_BITS)
+
+// Trying out a technique where 0 is a sentinel failure value. ZII.
+// Low ENTITY_SLOT_BITS are the slot, the rest is the generation.
+struct EntityIndex {
+  u32 idx;
+};
+
+const EntityIndex ENTITY_INDEX_NIL = {.idx = 0};
+
+static inline u32 entity_index_slot(EntityIndex e) { return e.idx & ENTITY_SLOT_MASK; }
+static inline u32 entity_index_generation(EntityIndex e) { return e.idx >> ENTITY_SLOT_BITS; }
+
+static inline EntityIndex make_entity_index(u32 slot, u32 generation) {
+  assert(slot != 0 && slot < MAX_NUM_ENTITY_SLOTS);
+  return {.idx = (generation << ENTITY_SLOT_BITS) | slot};
+}
+
+static inline u32 next_entity_generation(u32 generation) { return (generation + 1) & ENTITY_GENERATION_MASK; }
@@ -7,6 +7,7 @@
 // TODO need to include vulkan base after generated headers because opengl cruft
 //      Do I even want to include both of these every time? Where can I be smart and
 //      pick only what I'm using?
+#include "memory_arena.h"
 #include "opengl_base.h"
 #include "vulkan/vulkan_base.h"
 #include <vulkan/vulkan_core.h>
@@ -82,8 +83,9 @@ inline void init_program_spec(
 
 inline void
 update_vulkan_material(const VulkanContext *ctx, const DescriptorWrite *writes, u32 num_writes, VulkanMaterial *mat) {
-  assert(num_writes < 16);
-  VkWriteDescriptorSet vk_writes[16] = {};
+  MemoryArena *scratch = get_scratch_arena();
+  ArenaMark scratch_mark = arena_mark(scratch);
+  VkWriteDescriptorSet *vk_writes = ARENA_PUSH_ARRAY_ZERO(scratch, VkWriteDescriptorSet, num_writes);
 
   for (u32 write_idx = 0; write_idx < num_writes; write_idx++) {
     const DescriptorWrite *write = &writes[write_idx];
@@ -118,6 +120,7 @@ update_vulkan_material(const VulkanContext *ctx, const DescriptorWrite *writes,
   }
 
   vkUpdateDescriptorSets(ctx->device, num_writes, vk_writes, 0, NULL);
+  arena_reset_to_mark(scratch, scratch_mark);
 }
 
 inline void init_gl_vertex_layout(VertexLayoutID vertex_layout_id, GLuint vao, GLuint *vbos, u32 num_vbos, GLuint ebo) {
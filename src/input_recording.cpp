@@ -0,0 +1,283 @@
+#include "input_recording.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_RECORDING_INITIAL_CAPACITY (1024)
+
+// Worst case frame: mask byte, 5 varints of a u32 at 5 bytes each, the hash
+#define MAX_ENCODED_FRAME_SIZE (1 + (1 + INPUT_FRAME_NUM_AXES) * 5 + sizeof(u64))
+
+static_assert(INPUT_FRAME_NUM_AXES + 1 <= 8, "change mask is a single byte");
+
+InputRecording create_input_recording(u64 seed, f32 dt) {
+  InputRecording recording = {
+      .seed = seed,
+      .dt = dt,
+      .frames = (InputFrame *)malloc(INPUT_RECORDING_INITIAL_CAPACITY * sizeof(InputFrame)),
+      .state_hashes = (u64 *)malloc(INPUT_RECORDING_INITIAL_CAPACITY * sizeof(u64)),
+      .num_frames = 0,
+      .capacity = INPUT_RECORDING_INITIAL_CAPACITY,
+  };
+  assert(recording.frames && recording.state_hashes);
+  return recording;
+}
+
+void destroy_input_recording(InputRecording *recording) {
+  free(recording->frames);
+  free(recording->state_hashes);
+  recording->frames = NULL;
+  recording->state_hashes = NULL;
+  recording->num_frames = 0;
+  recording->capacity = 0;
+}
+
+static void reserve_input_frames(InputRecording *recording, u32 capacity) {
+  if (capacity <= recording->capacity) {
+    return;
+  }
+
+  recording->frames = (InputFrame *)realloc(recording->frames, capacity * sizeof(InputFrame));
+  recording->state_hashes = (u64 *)realloc(recording->state_hashes, capacity * sizeof(u64));
+  assert(recording->frames && recording->state_hashes);
+  recording->capacity = capacity;
+}
+
+void record_input_frame(InputRecording *recording, InputFrame frame, u64 state_hash) {
+  if (recording->num_frames == recording->capacity) {
+    u32 capacity = recording->capacity ? 2 * recording->capacity : INPUT_RECORDING_INITIAL_CAPACITY;
+    reserve_input_frames(recording, capacity);
+  }
+
+  recording->frames[recording->num_frames] = frame;
+  recording->state_hashes[recording->num_frames] = state_hash;
+  recording->num_frames++;
+}
+
+static u32 f32_bits(f32 x) {
+  u32 bits;
+  memcpy(&bits, &x, sizeof(u32));
+  return bits;
+}
+
+static f32 bits_f32(u32 bits) {
+  f32 x;
+  memcpy(&x, &bits, sizeof(f32));
+  return x;
+}
+
+// LEB128
+static u32 encode_varint(u32 x, u8 *out) {
+  u32 n = 0;
+  while (x >= 0x80) {
+    out[n++] = (u8)(x | 0x80);
+    x >>= 7;
+  }
+  out[n++] = (u8)x;
+  return n;
+}
+
+static bool decode_varint(const u8 *bytes, u64 size, u64 *pos, u32 *out) {
+  u32 x = 0;
+  for (u32 shift = 0; shift < 35; shift += 7) {
+    if (*pos >= size) {
+      return false;
+    }
+    u8 byte = bytes[(*pos)++];
+    x |= (u32)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *out = x;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void write_u32_le(u32 x, u8 *out) {
+  for (u32 i = 0; i < 4; i++) {
+    out[i] = (u8)(x >> (8 * i));
+  }
+}
+
+static u32 read_u32_le(const u8 *bytes) {
+  u32 x = 0;
+  for (u32 i = 0; i < 4; i++) {
+    x |= (u32)bytes[i] << (8 * i);
+  }
+  return x;
+}
+
+static void write_u64_le(u64 x, u8 *out) {
+  for (u32 i = 0; i < 8; i++) {
+    out[i] = (u8)(x >> (8 * i));
+  }
+}
+
+static u64 read_u64_le(const u8 *bytes) {
+  u64 x = 0;
+  for (u32 i = 0; i < 8; i++) {
+    x |= (u64)bytes[i] << (8 * i);
+  }
+  return x;
+}
+
+static void encode_header(const InputRecordingHeader *header, u8 *out) {
+  write_u32_le(header->magic, out);
+  write_u32_le(header->version, out + 4);
+  write_u64_le(header->seed, out + 8);
+  write_u32_le(f32_bits(header->dt), out + 16);
+  write_u32_le(header->num_frames, out + 20);
+}
+
+static InputRecordingHeader decode_header(const u8 *bytes) {
+  InputRecordingHeader header = {
+      .magic = read_u32_le(bytes),
+      .version = read_u32_le(bytes + 4),
+      .seed = read_u64_le(bytes + 8),
+      .dt = bits_f32(read_u32_le(bytes + 16)),
+      .num_frames = read_u32_le(bytes + 20),
+  };
+  return header;
+}
+
+bool save_input_recording(const InputRecording *recording, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "save_input_recording: could not open %s\n", path);
+    return false;
+  }
+
+  InputRecordingHeader header = {
+      .magic = INPUT_RECORDING_MAGIC,
+      .version = INPUT_RECORDING_VERSION,
+      .seed = recording->seed,
+      .dt = recording->dt,
+      .num_frames = recording->num_frames,
+  };
+  u8 header_bytes[INPUT_RECORDING_HEADER_SIZE];
+  encode_header(&header, header_bytes);
+  bool ok = fwrite(header_bytes, sizeof(header_bytes), 1, f) == 1;
+
+  u8 buffer[MAX_ENCODED_FRAME_SIZE];
+  InputFrame prev = {};
+  for (u32 i = 0; ok && i < recording->num_frames; i++) {
+    const InputFrame *frame = &recording->frames[i];
+    u32 n = 1;
+    u8 mask = 0;
+
+    u32 buttons_delta = frame->buttons ^ prev.buttons;
+    if (buttons_delta) {
+      mask |= 1;
+      n += encode_varint(buttons_delta, buffer + n);
+    }
+    for (u32 axis = 0; axis < INPUT_FRAME_NUM_AXES; axis++) {
+      u32 axis_delta = f32_bits(frame->axes[axis]) ^ f32_bits(prev.axes[axis]);
+      if (axis_delta) {
+        mask |= 1 << (axis + 1);
+        n += encode_varint(axis_delta, buffer + n);
+      }
+    }
+    buffer[0] = mask;
+    write_u64_le(recording->state_hashes[i], buffer + n);
+    n += sizeof(u64);
+
+    ok = fwrite(buffer, n, 1, f) == 1;
+    prev = *frame;
+  }
+
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "save_input_recording: failed writing %s\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+bool load_input_recording(InputRecording *recording, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "load_input_recording: could not open %s\n", path);
+    return false;
+  }
+
+  fseek(f, 0, SEEK_END);
+  long file_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  u8 header_bytes[INPUT_RECORDING_HEADER_SIZE];
+  if (file_size < INPUT_RECORDING_HEADER_SIZE || fread(header_bytes, sizeof(header_bytes), 1, f) != 1) {
+    fprintf(stderr, "load_input_recording: %s is too small to be a recording\n", path);
+    fclose(f);
+    return false;
+  }
+  InputRecordingHeader header = decode_header(header_bytes);
+  if (header.magic != INPUT_RECORDING_MAGIC || header.version != INPUT_RECORDING_VERSION) {
+    fprintf(stderr, "load_input_recording: %s is not a version %d recording\n", path, INPUT_RECORDING_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  u64 size = file_size - INPUT_RECORDING_HEADER_SIZE;
+  u8 *bytes = (u8 *)malloc(size);
+  assert(bytes);
+  bool ok = fread(bytes, 1, size, f) == size;
+  fclose(f);
+
+  *recording = create_input_recording(header.seed, header.dt);
+  reserve_input_frames(recording, header.num_frames);
+
+  u64 pos = 0;
+  InputFrame prev = {};
+  for (u32 i = 0; ok && i < header.num_frames; i++) {
+    InputFrame frame = prev;
+    u8 mask = 0;
+    ok = pos < size;
+    if (ok) {
+      mask = bytes[pos++];
+    }
+
+    u32 delta = 0;
+    if (ok && (mask & 1)) {
+      ok = decode_varint(bytes, size, &pos, &delta);
+      frame.buttons ^= delta;
+    }
+    for (u32 axis = 0; ok && axis < INPUT_FRAME_NUM_AXES; axis++) {
+      if (mask & (1 << (axis + 1))) {
+        ok = decode_varint(bytes, size, &pos, &delta);
+        frame.axes[axis] = bits_f32(f32_bits(frame.axes[axis]) ^ delta);
+      }
+    }
+
+    ok = ok && pos + sizeof(u64) <= size;
+    if (ok) {
+      record_input_frame(recording, frame, read_u64_le(bytes + pos));
+      pos += sizeof(u64);
+    }
+    prev = frame;
+  }
+  free(bytes);
+
+  if (!ok) {
+    fprintf(stderr, "load_input_recording: %s is truncated after %u frames\n", path, recording->num_frames);
+    destroy_input_recording(recording);
+    return false;
+  }
+
+  return true;
+}
+
+bool check_replay_state_hash(const InputRecording *recording, u32 tick, u64 state_hash) {
+  assert(tick < recording->num_frames);
+  u64 expected = recording->state_hashes[tick];
+  if (state_hash != expected) {
+    fprintf(
+        stderr, "check_replay_state_hash: replay diverged at tick %u, expected %016llx got %016llx\n", tick,
+        (unsigned long long)expected, (unsigned long long)state_hash
+    );
+    return false;
+  }
+  return true;
+}
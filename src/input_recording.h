@@ -0,0 +1,76 @@
+#pragma once
+
+// Deterministic input recording and replay.
+//
+// A recording is the per tick input to a fixed timestep sim, plus the seed its RNGs were created
+// with and a hash of the sim state after every tick. Feeding the frames back through the same sim
+// from the same seed must reproduce every hash, and the first mismatching tick is where a replay
+// diverged.
+//
+// InputFrame is deliberately game agnostic: a bitfield of digital inputs and a few analog axes.
+// Each game maps its own Inputs or PlayerIntent onto it.
+//
+// File format, little endian, written field by field:
+//  Header: u32 magic, u32 version, u64 seed, f32 dt, u32 num_frames. INPUT_RECORDING_HEADER_SIZE bytes.
+//  Per frame:
+//    u8 change mask. Bit 0 is the buttons, bits 1..INPUT_FRAME_NUM_AXES are the axes.
+//    For each set bit, a LEB128 varint of (value bits XOR previous frame's value bits).
+//    u64 state hash
+// Held keys and still axes cost nothing but the mask byte.
+
+#include "tuke_engine.h"
+
+#define INPUT_FRAME_NUM_AXES (4)
+#define INPUT_RECORDING_MAGIC (0x52494b54) // "TKIR"
+#define INPUT_RECORDING_VERSION (1)
+#define INPUT_RECORDING_HEADER_SIZE (24)
+
+// FNV-1a offset basis. Start every state hash chain from this.
+#define STATE_HASH_SEED (0xcbf29ce484222325ull)
+
+struct InputFrame {
+  u32 buttons;
+  f32 axes[INPUT_FRAME_NUM_AXES];
+};
+
+struct InputRecordingHeader {
+  u32 magic;
+  u32 version;
+  u64 seed;
+  f32 dt;
+  u32 num_frames;
+};
+
+struct InputRecording {
+  u64 seed;
+  f32 dt;
+
+  InputFrame *frames;
+  u64 *state_hashes;
+  u32 num_frames;
+  u32 capacity;
+};
+
+// FNV-1a. Chain calls to hash several fields, starting from STATE_HASH_SEED.
+// Hash fields one by one rather than whole structs, padding bytes are not deterministic.
+static inline u64 hash_state_bytes(u64 hash, const void *data, u64 size) {
+  const u8 *bytes = (const u8 *)data;
+  for (u64 i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+#define HASH_STATE_FIELD(hash, field) hash_state_bytes((hash), &(field), sizeof(field))
+
+InputRecording create_input_recording(u64 seed, f32 dt);
+void destroy_input_recording(InputRecording *recording);
+void record_input_frame(InputRecording *recording, InputFrame frame, u64 state_hash);
+
+// Both return false and print to stderr on failure
+bool save_input_recording(const InputRecording *recording, const char *path);
+bool load_input_recording(InputRecording *recording, const char *path);
+
+// Returns false and reports the tick if state_hash does not match the recorded hash.
+bool check_replay_state_hash(const InputRecording *recording, u32 tick, u64 state_hash);
@@ -0,0 +1,298 @@
+#include "jobs.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JOB_SPINS_BEFORE_SLEEP (256)
+#define JOB_SPINS_BEFORE_YIELD (64)
+
+struct JobWorkerArgs {
+  JobSystem *jobs;
+  u32 index;
+};
+
+static thread_local const JobSystem *current_job_system = NULL;
+static thread_local u32 current_job_thread_index = 0;
+static thread_local u32 next_victim = 0;
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
+// Chase-Lev deque, with the memory orderings from Le, Pop, Cohen and Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (2013). Fixed capacity, no growth.
+// push publishes with a release store of bottom rather than a release fence, same cost and
+// visible to ThreadSanitizer.
+
+static bool deque_push(JobDeque *deque, const Job *job) {
+  i64 b = deque->bottom.load(std::memory_order_relaxed);
+  i64 t = deque->top.load(std::memory_order_acquire);
+  if (b - t >= JOB_DEQUE_CAPACITY) {
+    return false;
+  }
+
+  JobSlot *slot = &deque->slots[b & (JOB_DEQUE_CAPACITY - 1)];
+  slot->func.store(job->func, std::memory_order_relaxed);
+  slot->data.store(job->data, std::memory_order_relaxed);
+  slot->begin.store(job->begin, std::memory_order_relaxed);
+  slot->end.store(job->end, std::memory_order_relaxed);
+  slot->counter.store(job->counter, std::memory_order_relaxed);
+  deque->bottom.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+static void read_job_slot(const JobSlot *slot, Job *job) {
+  job->func = slot->func.load(std::memory_order_relaxed);
+  job->data = slot->data.load(std::memory_order_relaxed);
+  job->begin = slot->begin.load(std::memory_order_relaxed);
+  job->end = slot->end.load(std::memory_order_relaxed);
+  job->counter = slot->counter.load(std::memory_order_relaxed);
+}
+
+static bool deque_pop(JobDeque *deque, Job *job) {
+  i64 b = deque->bottom.load(std::memory_order_relaxed) - 1;
+  deque->bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  i64 t = deque->top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // Empty
+    deque->bottom.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+
+  read_job_slot(&deque->slots[b & (JOB_DEQUE_CAPACITY - 1)], job);
+  if (t < b) {
+    return true;
+  }
+
+  // Last job, race the thieves for it
+  bool won = deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  deque->bottom.store(b + 1, std::memory_order_relaxed);
+  return won;
+}
+
+static bool deque_steal(JobDeque *deque, Job *job) {
+  i64 t = deque->top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  i64 b = deque->bottom.load(std::memory_order_acquire);
+  if (t >= b) {
+    return false;
+  }
+
+  read_job_slot(&deque->slots[t & (JOB_DEQUE_CAPACITY - 1)], job);
+  return deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+// Single writer, so no need for a locked read-modify-write
+static inline void bump_job_stat(std::atomic<u64> *stat) {
+  stat->store(stat->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static bool take_job(JobSystem *jobs, u32 self, Job *job) {
+  if (deque_pop(&jobs->deques[self], job)) {
+    jobs->num_queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Visit every other thread once, starting from the last successful victim
+  u32 num_others = jobs->num_threads - 1;
+  for (u32 i = 0; i < num_others; i++) {
+    u32 offset = (next_victim + i) % num_others;
+    u32 victim = (self + 1 + offset) % jobs->num_threads;
+    if (deque_steal(&jobs->deques[victim], job)) {
+      next_victim = offset;
+      jobs->num_queued.fetch_sub(1, std::memory_order_relaxed);
+      bump_job_stat(&jobs->stats[self].steals);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void execute_job(JobSystem *jobs, u32 self, const Job *job) {
+  job->func(job->data, job->begin, job->end);
+  bump_job_stat(&jobs->stats[self].jobs_run);
+  if (job->counter) {
+    job->counter->pending.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+static void *job_worker_main(void *arg) {
+  JobWorkerArgs args = *(JobWorkerArgs *)arg;
+  free(arg);
+
+  JobSystem *jobs = args.jobs;
+  current_job_system = jobs;
+  current_job_thread_index = args.index;
+
+  u32 spins = 0;
+  while (!jobs->quit.load(std::memory_order_acquire)) {
+    Job job;
+    if (take_job(jobs, args.index, &job)) {
+      execute_job(jobs, args.index, &job);
+      spins = 0;
+      continue;
+    }
+
+    if (++spins < JOB_SPINS_BEFORE_SLEEP) {
+      cpu_relax();
+      continue;
+    }
+
+    // num_sleeping goes up before num_queued is checked, and submitters bump num_queued before
+    // checking num_sleeping, so either we see the job or the submitter sees us and signals
+    pthread_mutex_lock(&jobs->sleep_mutex);
+    jobs->num_sleeping.fetch_add(1);
+    while (jobs->num_queued.load() <= 0 && !jobs->quit.load()) {
+      bump_job_stat(&jobs->stats[args.index].sleeps);
+      pthread_cond_wait(&jobs->sleep_cond, &jobs->sleep_mutex);
+    }
+    jobs->num_sleeping.fetch_sub(1);
+    pthread_mutex_unlock(&jobs->sleep_mutex);
+    spins = 0;
+  }
+
+  return NULL;
+}
+
+JobSystem *create_job_system(u32 num_threads) {
+  if (num_threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = online > 0 ? (u32)online : 1;
+  }
+  if (num_threads > MAX_NUM_JOB_THREADS) {
+    num_threads = MAX_NUM_JOB_THREADS;
+  }
+
+  // Zeroed atomics are valid atomics holding 0
+  JobSystem *jobs = (JobSystem *)calloc(1, sizeof(JobSystem));
+  assert(jobs);
+  jobs->num_threads = num_threads;
+  jobs->deques = (JobDeque *)aligned_alloc(JOB_CACHE_LINE, num_threads * sizeof(JobDeque));
+  jobs->stats = (JobThreadStats *)aligned_alloc(JOB_CACHE_LINE, num_threads * sizeof(JobThreadStats));
+  assert(jobs->deques && jobs->stats);
+  memset((void *)jobs->deques, 0, num_threads * sizeof(JobDeque));
+  memset((void *)jobs->stats, 0, num_threads * sizeof(JobThreadStats));
+  pthread_mutex_init(&jobs->sleep_mutex, NULL);
+  pthread_cond_init(&jobs->sleep_cond, NULL);
+
+  current_job_system = jobs;
+  current_job_thread_index = 0;
+
+  for (u32 i = 1; i < num_threads; i++) {
+    JobWorkerArgs *args = (JobWorkerArgs *)malloc(sizeof(JobWorkerArgs));
+    assert(args);
+    args->jobs = jobs;
+    args->index = i;
+    if (pthread_create(&jobs->workers[i], NULL, job_worker_main, args) != 0) {
+      fprintf(stderr, "create_job_system: failed to start worker %u\n", i);
+      assert(false);
+    }
+  }
+
+  return jobs;
+}
+
+void destroy_job_system(JobSystem *jobs) {
+  jobs->quit.store(true, std::memory_order_release);
+  pthread_mutex_lock(&jobs->sleep_mutex);
+  pthread_cond_broadcast(&jobs->sleep_cond);
+  pthread_mutex_unlock(&jobs->sleep_mutex);
+
+  for (u32 i = 1; i < jobs->num_threads; i++) {
+    pthread_join(jobs->workers[i], NULL);
+  }
+
+  if (current_job_system == jobs) {
+    current_job_system = NULL;
+  }
+  pthread_mutex_destroy(&jobs->sleep_mutex);
+  pthread_cond_destroy(&jobs->sleep_cond);
+  free(jobs->deques);
+  free(jobs->stats);
+  free(jobs);
+}
+
+u32 job_system_thread_index(const JobSystem *jobs) {
+  assert(current_job_system == jobs && "Only threads of the job system may submit or wait on jobs");
+  (void)jobs;
+  return current_job_thread_index;
+}
+
+void job_system_run(JobSystem *jobs, JobFunc func, void *data, u32 begin, u32 end, JobCounter *counter) {
+  u32 self = job_system_thread_index(jobs);
+  Job job = {.func = func, .data = data, .begin = begin, .end = end, .counter = counter};
+  if (counter) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (jobs->num_threads == 1 || !deque_push(&jobs->deques[self], &job)) {
+    execute_job(jobs, self, &job);
+    return;
+  }
+
+  jobs->num_queued.fetch_add(1);
+  if (jobs->num_sleeping.load() > 0) {
+    pthread_mutex_lock(&jobs->sleep_mutex);
+    pthread_cond_signal(&jobs->sleep_cond);
+    pthread_mutex_unlock(&jobs->sleep_mutex);
+  }
+}
+
+void job_system_wait(JobSystem *jobs, JobCounter *counter) {
+  u32 self = job_system_thread_index(jobs);
+  u32 spins = 0;
+  while (counter->pending.load(std::memory_order_acquire) > 0) {
+    Job job;
+    if (take_job(jobs, self, &job)) {
+      execute_job(jobs, self, &job);
+      spins = 0;
+    } else if (++spins < JOB_SPINS_BEFORE_YIELD) {
+      cpu_relax();
+    } else {
+      // The remaining jobs are running elsewhere, let their threads have the core
+      sched_yield();
+    }
+  }
+}
+
+struct ParallelFor {
+  JobSystem *jobs;
+  JobFunc func;
+  void *data;
+  u32 grain;
+  JobCounter *counter;
+};
+
+// Keeps the first half and offers the second to thieves, until the range is down to the grain
+static void parallel_for_split(void *data, u32 begin, u32 end) {
+  ParallelFor *parallel = (ParallelFor *)data;
+  while (end - begin > parallel->grain) {
+    u32 mid = begin + (end - begin) / 2;
+    job_system_run(parallel->jobs, parallel_for_split, parallel, mid, end, parallel->counter);
+    end = mid;
+  }
+  parallel->func(parallel->data, begin, end);
+}
+
+void parallel_for(JobSystem *jobs, u32 count, u32 grain, JobFunc func, void *data) {
+  assert(grain > 0);
+  if (count == 0) {
+    return;
+  }
+
+  JobCounter counter = {};
+  ParallelFor parallel = {.jobs = jobs, .func = func, .data = data, .grain = grain, .counter = &counter};
+  parallel_for_split(&parallel, 0, count);
+  job_system_wait(jobs, &counter);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Job system: a fixed pool of worker threads, each with a Chase-Lev work-stealing deque.
+//
+// The thread that creates the JobSystem is thread 0 and owns deque 0, workers are threads
+// 1..num_threads-1. A thread pushes and pops jobs on the bottom of its own deque (LIFO, cache
+// warm), idle threads steal from the top of the others' (FIFO, the oldest and usually biggest
+// work). Only threads of the system may submit jobs.
+//
+// Dependencies are JobCounters: every job submitted with a counter increments it, and decrements
+// it when done. job_system_wait does not block, it runs other jobs until the counter reaches zero,
+// so waiting from inside a job is fine and cannot deadlock the pool.
+//
+// Idle workers spin briefly, then sleep until something is submitted.
+//
+// parallel_for splits [0, count) recursively in halves down to the grain size, so the pieces
+// that get stolen are large and the owner keeps the cache warm half.
+
+#include "tuke_engine.h"
+
+#include <atomic>
+#include <pthread.h>
+
+#define MAX_NUM_JOB_THREADS (64)
+#define JOB_DEQUE_CAPACITY (4096) // Power of two. A thread with a full deque runs new jobs inline
+#define JOB_CACHE_LINE (64)
+
+typedef void (*JobFunc)(void *data, u32 begin, u32 end);
+
+struct JobCounter {
+  std::atomic<i32> pending;
+};
+
+struct Job {
+  JobFunc func;
+  void *data;
+  u32 begin;
+  u32 end;
+  JobCounter *counter;
+};
+
+// A queued Job. The fields are relaxed atomics because a thief may read a slot while the owner
+// reuses it. The thief then loses the race for top and throws the torn copy away.
+struct JobSlot {
+  std::atomic<JobFunc> func;
+  std::atomic<void *> data;
+  std::atomic<u32> begin;
+  std::atomic<u32> end;
+  std::atomic<JobCounter *> counter;
+};
+
+struct alignas(JOB_CACHE_LINE) JobDeque {
+  alignas(JOB_CACHE_LINE) std::atomic<i64> top;    // Thieves take from here
+  alignas(JOB_CACHE_LINE) std::atomic<i64> bottom; // The owner pushes and pops here
+  JobSlot slots[JOB_DEQUE_CAPACITY];
+};
+
+// Only written by the owning thread, atomic so other threads may read them while it runs
+struct alignas(JOB_CACHE_LINE) JobThreadStats {
+  std::atomic<u64> jobs_run;
+  std::atomic<u64> steals;
+  std::atomic<u64> sleeps;
+};
+
+struct JobSystem {
+  u32 num_threads;
+  JobDeque *deques; // One per thread, including thread 0
+  pthread_t workers[MAX_NUM_JOB_THREADS];
+  JobThreadStats *stats; // One per thread
+
+  // Jobs pushed but not yet taken, so sleeping workers know when to wake
+  std::atomic<i32> num_queued;
+  std::atomic<i32> num_sleeping;
+  std::atomic<bool> quit;
+  pthread_mutex_t sleep_mutex;
+  pthread_cond_t sleep_cond;
+};
+
+// num_threads includes the calling thread. 0 uses one thread per online CPU.
+JobSystem *create_job_system(u32 num_threads);
+void destroy_job_system(JobSystem *jobs);
+
+// Index of the calling thread within jobs, asserts it belongs to it
+u32 job_system_thread_index(const JobSystem *jobs);
+
+// counter may be NULL for fire and forget, though then nothing can wait on the job
+void job_system_run(JobSystem *jobs, JobFunc func, void *data, u32 begin, u32 end, JobCounter *counter);
+void job_system_wait(JobSystem *jobs, JobCounter *counter);
+
+// Calls func on disjoint ranges covering [0, count), each at most grain long, and waits for all of them
+void parallel_for(JobSystem *jobs, u32 count, u32 grain, JobFunc func, void *data);
+
+// Grain that gives every thread about jobs_per_thread pieces, but never below min_grain
+static inline u32 parallel_for_grain(const JobSystem *jobs, u32 count, u32 jobs_per_thread, u32 min_grain) {
+  u32 grain = count / (jobs->num_threads * jobs_per_thread);
+  return grain < min_grain ? min_grain : grain;
+}
@@ -0,0 +1,102 @@
+#include "memory_arena.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static thread_local MemoryArena scratch_arena = {};
+
+static inline u64 align_up(u64 x, u64 alignment) { return (x + alignment - 1) & ~(alignment - 1); }
+
+MemoryArena create_memory_arena(u64 reserve_size) {
+  MemoryArena arena;
+  memset(&arena, 0, sizeof(MemoryArena));
+
+  reserve_size = align_up(reserve_size, MEMORY_ARENA_COMMIT_SIZE);
+  void *base = mmap(NULL, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "create_memory_arena: failed to reserve %llu bytes\n", (unsigned long long)reserve_size);
+    return arena;
+  }
+
+  arena.base = (u8 *)base;
+  arena.reserved = reserve_size;
+  return arena;
+}
+
+void destroy_memory_arena(MemoryArena *arena) {
+  if (arena->base) {
+    munmap(arena->base, arena->reserved);
+  }
+  memset(arena, 0, sizeof(MemoryArena));
+}
+
+void *arena_push(MemoryArena *arena, u64 size, u64 alignment) {
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  u64 begin = align_up(arena->used, alignment);
+  u64 end = begin + size;
+  if (end > arena->reserved) {
+    fprintf(
+        stderr, "arena_push: %llu bytes over the %llu byte reservation\n", (unsigned long long)(end - arena->reserved),
+        (unsigned long long)arena->reserved
+    );
+    assert(false);
+    return NULL;
+  }
+
+  if (end > arena->committed) {
+    u64 committed = align_up(end, MEMORY_ARENA_COMMIT_SIZE);
+    if (mprotect(arena->base + arena->committed, committed - arena->committed, PROT_READ | PROT_WRITE) != 0) {
+      fprintf(stderr, "arena_push: failed to commit %llu bytes\n", (unsigned long long)(committed - arena->committed));
+      assert(false);
+      return NULL;
+    }
+    arena->committed = committed;
+    arena->stats.num_commits++;
+  }
+
+  arena->used = end;
+  arena->stats.num_pushes++;
+  if (end > arena->stats.peak_used) {
+    arena->stats.peak_used = end;
+  }
+  return arena->base + begin;
+}
+
+void *arena_push_zero(MemoryArena *arena, u64 size, u64 alignment) {
+  void *result = arena_push(arena, size, alignment);
+  if (result) {
+    memset(result, 0, size);
+  }
+  return result;
+}
+
+FrameArena create_frame_arena(u64 reserve_per_frame) {
+  FrameArena frame_arena;
+  frame_arena.arenas[0] = create_memory_arena(reserve_per_frame);
+  frame_arena.arenas[1] = create_memory_arena(reserve_per_frame);
+  frame_arena.frame = 0;
+  return frame_arena;
+}
+
+void destroy_frame_arena(FrameArena *frame_arena) {
+  destroy_memory_arena(&frame_arena->arenas[0]);
+  destroy_memory_arena(&frame_arena->arenas[1]);
+}
+
+MemoryArena *frame_arena_begin(FrameArena *frame_arena) {
+  frame_arena->frame++;
+  MemoryArena *arena = frame_arena_current(frame_arena);
+  arena_reset(arena);
+  return arena;
+}
+
+MemoryArena *get_scratch_arena() {
+  if (scratch_arena.base == NULL) {
+    scratch_arena = create_memory_arena(SCRATCH_ARENA_RESERVE);
+    assert(scratch_arena.base);
+  }
+  return &scratch_arena;
+}
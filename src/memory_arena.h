@@ -0,0 +1,87 @@
+#pragma once
+
+// MemoryArena: a bump allocator over one contiguous range of reserved virtual memory.
+//
+// create_memory_arena reserves the whole range up front without backing it, and pages are
+// committed in MEMORY_ARENA_COMMIT_SIZE steps as pushes reach them. Resetting keeps them
+// committed, so an arena that is reset every frame stops making system calls once it has seen its
+// largest frame. Pointers stay valid until the arena is reset past them, the memory never moves.
+//
+// Nothing is freed individually. Take an ArenaMark before temporary pushes and reset to it after,
+// or reset the whole arena.
+//
+// FrameArena is two arenas used alternately, one per frame. Data pushed during frame N stays
+// valid through frame N + 1, e.g. for a GPU upload or a renderer reading last frame's results.
+//
+// get_scratch_arena is a per thread arena for temporaries that don't outlive a function.
+
+#include "tuke_engine.h"
+
+#include <assert.h>
+
+#define MEMORY_ARENA_COMMIT_SIZE (64 * 1024) // Multiple of the page size
+#define MEMORY_ARENA_DEFAULT_ALIGNMENT (16)
+#define SCRATCH_ARENA_RESERVE (1ull << 30) // Only address space, nothing is committed until used
+
+struct MemoryArenaStats {
+  u64 num_pushes;
+  u64 num_commits; // Calls into the OS. Flat in a steady state.
+  u64 peak_used;
+};
+
+struct MemoryArena {
+  u8 *base;
+  u64 reserved;
+  u64 committed;
+  u64 used;
+  MemoryArenaStats stats;
+};
+
+typedef u64 ArenaMark;
+
+// reserve_size is rounded up to MEMORY_ARENA_COMMIT_SIZE. Returns an arena with base == NULL if
+// the address space can't be reserved.
+MemoryArena create_memory_arena(u64 reserve_size);
+void destroy_memory_arena(MemoryArena *arena);
+
+// alignment must be a power of two. The memory is not cleared. Returns NULL, after an assert in
+// debug builds, when the reservation is exhausted.
+void *arena_push(MemoryArena *arena, u64 size, u64 alignment);
+void *arena_push_zero(MemoryArena *arena, u64 size, u64 alignment);
+
+#define ARENA_PUSH_ARRAY(arena, type, count) ((type *)arena_push((arena), sizeof(type) * (count), alignof(type)))
+#define ARENA_PUSH_ARRAY_ZERO(arena, type, count)                                                                      \
+  ((type *)arena_push_zero((arena), sizeof(type) * (count), alignof(type)))
+
+static inline ArenaMark arena_mark(const MemoryArena *arena) { return arena->used; }
+
+static inline void arena_reset_to_mark(MemoryArena *arena, ArenaMark mark) {
+  assert(mark <= arena->used);
+  arena->used = mark;
+}
+
+static inline void arena_reset(MemoryArena *arena) { arena->used = 0; }
+
+struct FrameArena {
+  MemoryArena arenas[2];
+  u64 frame;
+};
+
+FrameArena create_frame_arena(u64 reserve_per_frame);
+void destroy_frame_arena(FrameArena *frame_arena);
+
+// Call at the start of every frame. Switches to the other arena and empties it, so the previous
+// frame's pushes are still readable this frame.
+MemoryArena *frame_arena_begin(FrameArena *frame_arena);
+
+static inline MemoryArena *frame_arena_current(FrameArena *frame_arena) {
+  return &frame_arena->arenas[frame_arena->frame & 1];
+}
+
+static inline MemoryArena *frame_arena_previous(FrameArena *frame_arena) {
+  return &frame_arena->arenas[(frame_arena->frame + 1) & 1];
+}
+
+// The calling thread's scratch arena, created on first use. Mark before pushing, reset to the mark
+// before returning.
+MemoryArena *get_scratch_arena();
@@ -353,12 +353,19 @@ inline GLMesh create_gl_mesh(const void *arr, u32 num_bytes, u32 num_vertices, u
   GLMesh gl_mesh;
 
   gl_mesh.vbos[0] = allocate_vbo_with_data(arr, num_bytes, draw_mode);
+  gl_mesh.num_vbos = 1;
   gl_mesh.vao = create_vao();
   gl_mesh.num_vertices = num_vertices;
 
   return gl_mesh;
 }
 
+inline void destroy_gl_mesh(GLMesh *gl_mesh) {
+  glDeleteVertexArrays(1, &gl_mesh->vao);
+  glDeleteBuffers(gl_mesh->num_vbos, gl_mesh->vbos);
+  memset(gl_mesh, 0, sizeof(GLMesh));
+}
+
 inline GLMaterial create_gl_material(u32 program) {
   GLMaterial material;
   material.program = program;
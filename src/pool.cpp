@@ -0,0 +1,124 @@
+#include "pool.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline u32 chunks_for(u32 capacity) { return (capacity + POOL_CHUNK_CAPACITY - 1) / POOL_CHUNK_CAPACITY; }
+
+static inline u8 *pool_slot(const Pool *pool, u32 index) {
+  return pool->chunks[index >> POOL_CHUNK_SHIFT].data + (u64)(index & (POOL_CHUNK_CAPACITY - 1)) * pool->stride;
+}
+
+// Free slots hold the index of the next free slot
+static inline u32 *pool_next_free(const Pool *pool, u32 index) { return (u32 *)pool_slot(pool, index); }
+
+// Pushes the chunk's slots onto the free list back to front, so they are handed out in index order
+static void push_chunk_free_list(Pool *pool, u32 chunk_index) {
+  u32 first = chunk_index * POOL_CHUNK_CAPACITY;
+  for (u32 i = POOL_CHUNK_CAPACITY; i-- > 0;) {
+    *pool_next_free(pool, first + i) = pool->free_head;
+    pool->free_head = first + i;
+  }
+}
+
+static bool pool_grow(Pool *pool) {
+  if (pool->num_chunks == pool->max_chunks) {
+    return false;
+  }
+
+  PoolChunk *chunk = &pool->chunks[pool->num_chunks];
+  u64 size = (u64)POOL_CHUNK_CAPACITY * pool->stride;
+  chunk->data = (u8 *)aligned_alloc(POOL_CACHE_LINE, (size + POOL_CACHE_LINE - 1) & ~(u64)(POOL_CACHE_LINE - 1));
+  if (chunk->data == NULL) {
+    fprintf(stderr, "pool_grow: failed to allocate a %llu byte chunk\n", (unsigned long long)size);
+    return false;
+  }
+  memset(chunk->live, 0, sizeof(chunk->live));
+
+  push_chunk_free_list(pool, pool->num_chunks);
+  pool->num_chunks++;
+  return true;
+}
+
+Pool create_pool(u32 element_size, u32 alignment, u32 initial_capacity, u32 max_capacity) {
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= POOL_CACHE_LINE);
+  assert(initial_capacity <= max_capacity);
+
+  Pool pool;
+  memset(&pool, 0, sizeof(Pool));
+  u32 stride = element_size < sizeof(u32) ? sizeof(u32) : element_size;
+  pool.element_size = element_size;
+  pool.stride = (stride + alignment - 1) & ~(alignment - 1);
+  pool.max_chunks = chunks_for(max_capacity);
+  pool.free_head = POOL_INVALID_INDEX;
+  pool.chunks = (PoolChunk *)calloc(pool.max_chunks, sizeof(PoolChunk));
+  assert(pool.chunks);
+
+  for (u32 i = 0; i < chunks_for(initial_capacity); i++) {
+    bool grown = pool_grow(&pool);
+    assert(grown);
+    (void)grown;
+  }
+  return pool;
+}
+
+void destroy_pool(Pool *pool) {
+  for (u32 i = 0; i < pool->num_chunks; i++) {
+    free(pool->chunks[i].data);
+  }
+  free(pool->chunks);
+  memset(pool, 0, sizeof(Pool));
+}
+
+u32 pool_alloc(Pool *pool) {
+  if (pool->free_head == POOL_INVALID_INDEX && !pool_grow(pool)) {
+    return POOL_INVALID_INDEX;
+  }
+
+  u32 index = pool->free_head;
+  pool->free_head = *pool_next_free(pool, index);
+
+  u32 slot = index & (POOL_CHUNK_CAPACITY - 1);
+  pool->chunks[index >> POOL_CHUNK_SHIFT].live[slot / 64] |= 1ull << (slot % 64);
+  pool->num_live++;
+  return index;
+}
+
+void pool_free(Pool *pool, u32 index) {
+  assert(pool_is_live(pool, index));
+  u32 slot = index & (POOL_CHUNK_CAPACITY - 1);
+  pool->chunks[index >> POOL_CHUNK_SHIFT].live[slot / 64] &= ~(1ull << (slot % 64));
+  *pool_next_free(pool, index) = pool->free_head;
+  pool->free_head = index;
+  pool->num_live--;
+}
+
+void pool_clear(Pool *pool) {
+  pool->free_head = POOL_INVALID_INDEX;
+  for (u32 i = pool->num_chunks; i-- > 0;) {
+    memset(pool->chunks[i].live, 0, sizeof(pool->chunks[i].live));
+    push_chunk_free_list(pool, i);
+  }
+  pool->num_live = 0;
+}
+
+// First live index at or after index
+static u32 pool_scan_live(const Pool *pool, u32 index) {
+  u32 capacity = pool_capacity(pool);
+  while (index < capacity) {
+    u32 slot = index & (POOL_CHUNK_CAPACITY - 1);
+    u64 word = pool->chunks[index >> POOL_CHUNK_SHIFT].live[slot / 64] >> (slot % 64);
+    if (word) {
+      return index + __builtin_ctzll(word);
+    }
+    index += 64 - slot % 64;
+  }
+  return POOL_INVALID_INDEX;
+}
+
+u32 pool_first_live(const Pool *pool) { return pool_scan_live(pool, 0); }
+
+u32 pool_next_live(const Pool *pool, u32 index) { return pool_scan_live(pool, index + 1); }
@@ -0,0 +1,70 @@
+#pragma once
+
+// Pool: fixed size elements in cache line aligned chunks, with O(1) alloc and free.
+//
+// An element's index never changes while it is live, and neither does its address, because
+// chunks are never moved or freed until the pool is destroyed. Index i lives in chunk
+// i / POOL_CHUNK_CAPACITY. Free slots form a linked list threaded through the slots themselves.
+//
+// When the free list is empty the pool grows by one chunk, until max_capacity. Past that,
+// pool_alloc returns POOL_INVALID_INDEX and the caller decides what to drop.
+//
+// Live elements can be visited in index order with pool_first_live / pool_next_live, which skip
+// whole empty words of the per chunk live bitset.
+
+#include "tuke_engine.h"
+
+#include <assert.h>
+
+#define POOL_CHUNK_SHIFT (8)
+#define POOL_CHUNK_CAPACITY (1u << POOL_CHUNK_SHIFT)
+#define POOL_CACHE_LINE (64)
+#define POOL_INVALID_INDEX (0xFFFFFFFF)
+
+struct PoolChunk {
+  u8 *data; // POOL_CHUNK_CAPACITY * stride bytes, cache line aligned
+  u64 live[POOL_CHUNK_CAPACITY / 64];
+};
+
+struct Pool {
+  u32 element_size;
+  u32 stride; // element_size rounded up to the alignment, and to at least a u32 for the free list
+  u32 num_chunks;
+  u32 max_chunks;
+  u32 num_live;
+  u32 free_head;
+  PoolChunk *chunks; // max_chunks entries, num_chunks of them allocated
+};
+
+// Capacities are in elements and rounded up to whole chunks. initial_capacity is allocated now.
+Pool create_pool(u32 element_size, u32 alignment, u32 initial_capacity, u32 max_capacity);
+void destroy_pool(Pool *pool);
+
+u32 pool_alloc(Pool *pool);
+void pool_free(Pool *pool, u32 index);
+
+// Frees every element, keeping the chunks
+void pool_clear(Pool *pool);
+
+u32 pool_first_live(const Pool *pool);
+u32 pool_next_live(const Pool *pool, u32 index);
+
+#define CREATE_POOL(type, initial_capacity, max_capacity)                                                              \
+  create_pool(sizeof(type), alignof(type), (initial_capacity), (max_capacity))
+#define POOL_GET(pool, type, index) ((type *)pool_get((pool), (index)))
+
+static inline u32 pool_capacity(const Pool *pool) { return pool->num_chunks * POOL_CHUNK_CAPACITY; }
+
+static inline bool pool_is_live(const Pool *pool, u32 index) {
+  if (index >= pool_capacity(pool)) {
+    return false;
+  }
+  u32 slot = index & (POOL_CHUNK_CAPACITY - 1);
+  return (pool->chunks[index >> POOL_CHUNK_SHIFT].live[slot / 64] >> (slot % 64)) & 1;
+}
+
+static inline void *pool_get(const Pool *pool, u32 index) {
+  assert(pool_is_live(pool, index));
+  const PoolChunk *chunk = &pool->chunks[index >> POOL_CHUNK_SHIFT];
+  return chunk->data + (u64)(index & (POOL_CHUNK_CAPACITY - 1)) * pool->stride;
+}
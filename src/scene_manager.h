@@ -1,5 +1,6 @@
 #pragma once
 
+#include "jobs.h"
 #include "opengl_base.h"
 #include "tuke_engine.h"
 
@@ -15,16 +16,42 @@ typedef void (*UpdateFunction)(void *, void *, f32);
 // FIXME will eventually want to make the GLRenderer here something more generic.
 typedef void (*RenderFunction)(const GLRenderer *, const void *);
 
+// SceneHook's take a pointer to scene specific data and global state, same as UpdateFunction.
+// on_enter runs when the scene becomes current, after its preload has finished, and is where GPU
+// uploads happen. on_exit runs when the scene stops being current.
+typedef void (*SceneHook)(void *, void *);
+
+// PreloadFunction's take a pointer to scene specific data. They run on a job system worker, so they
+// may only prepare CPU side data (vertices, decoded images) and must not touch GL or global state.
+typedef void (*PreloadFunction)(void *);
+
+// A scene goes back to SCENE_UNLOADED when exited, so every enter is preceded by a preload
+enum ScenePreloadState { SCENE_UNLOADED, SCENE_PRELOADING, SCENE_PRELOADED };
+
 struct Scene {
   UpdateFunction update;
   RenderFunction render;
   void *data;
+
+  // All optional
+  SceneHook on_enter;
+  SceneHook on_exit;
+  PreloadFunction on_preload;
+
+  ScenePreloadState preload_state;
+  JobCounter preload_counter;
 };
 
 inline Scene create_scene(UpdateFunction update, RenderFunction render, void *data) {
   return Scene{.update = update, .render = render, .data = data};
 }
 
+inline void scene_set_hooks(Scene *scene, SceneHook on_enter, SceneHook on_exit, PreloadFunction on_preload) {
+  scene->on_enter = on_enter;
+  scene->on_exit = on_exit;
+  scene->on_preload = on_preload;
+}
+
 struct SceneManager {
   Scene *scene_registry[MAX_SCENES];
   Scene *stack[SCENE_STACK_SIZE];
@@ -36,6 +63,9 @@ struct SceneManager {
   // Pending scene should be an enum handle into a scene in the registry.
   u32 pending_scene;
   SceneAction pending_scene_action;
+
+  // Runs preloads. NULL preloads synchronously on request.
+  JobSystem *jobs;
 };
 
 inline Scene *get_current_scene(const SceneManager *scene_manager) { return scene_manager->stack[scene_manager->top]; }
@@ -50,26 +80,103 @@ inline void pop_scene(SceneManager *scene_manager) {
   scene_manager->top--;
 }
 
-inline void handle_scene_action(SceneManager *scene_manager) {
+inline void scene_preload_job(void *data, u32 begin, u32 end) {
+  (void)begin;
+  (void)end;
+  Scene *scene = (Scene *)data;
+  scene->on_preload(scene->data);
+}
+
+inline void start_scene_preload(SceneManager *scene_manager, Scene *scene) {
+  if (scene->preload_state != SCENE_UNLOADED) {
+    return;
+  }
+
+  scene->preload_state = SCENE_PRELOADING;
+  if (scene->on_preload == NULL) {
+    return;
+  } else if (scene_manager->jobs) {
+    job_system_run(scene_manager->jobs, scene_preload_job, scene, 0, 0, &scene->preload_counter);
+  } else {
+    scene->on_preload(scene->data);
+  }
+}
+
+// Start preparing a scene's CPU side assets in the background, typically for the scene a transition
+// could lead to next. Does nothing if the scene is already preloading, preloaded or current.
+inline void request_scene_preload(SceneManager *scene_manager, u32 scene_enum) {
+  Scene *scene = scene_manager->scene_registry[scene_enum];
+  assert(scene != NULL);
+  start_scene_preload(scene_manager, scene);
+}
+
+inline bool scene_preload_finished(const Scene *scene) {
+  return scene->preload_state == SCENE_PRELOADED ||
+         (scene->preload_state == SCENE_PRELOADING &&
+          scene->preload_counter.pending.load(std::memory_order_acquire) == 0);
+}
+
+// Preloads now if nobody asked for it earlier. A preload still in flight is waited on, and the wait
+// runs queued jobs, so at worst this thread does the preload itself.
+inline void enter_scene(SceneManager *scene_manager, Scene *scene, void *global_state) {
+  start_scene_preload(scene_manager, scene);
+  if (scene_manager->jobs) {
+    job_system_wait(scene_manager->jobs, &scene->preload_counter);
+  }
+  scene->preload_state = SCENE_PRELOADED;
+
+  if (scene->on_enter) {
+    scene->on_enter(scene->data, global_state);
+  }
+}
+
+inline void exit_scene(Scene *scene, void *global_state) {
+  if (scene->on_exit) {
+    scene->on_exit(scene->data, global_state);
+  }
+  scene->preload_state = SCENE_UNLOADED;
+}
+
+// Preloads write into their scene's data, so they must finish before it is freed
+inline void wait_for_scene_preloads(SceneManager *scene_manager) {
+  if (scene_manager->jobs == NULL) {
+    return;
+  }
+  for (u32 i = 0; i < MAX_SCENES; i++) {
+    if (scene_manager->scene_registry[i]) {
+      job_system_wait(scene_manager->jobs, &scene_manager->scene_registry[i]->preload_counter);
+    }
+  }
+}
+
+// global_state is passed through to the scenes' on_enter and on_exit hooks
+inline void handle_scene_action(SceneManager *scene_manager, void *global_state) {
   switch (scene_manager->pending_scene_action) {
 
   case SCENE_ACTION_NONE:
     return;
 
   case SCENE_ACTION_SET: {
+    Scene *current_scene = get_current_scene(scene_manager);
     Scene *next_scene = scene_manager->scene_registry[scene_manager->pending_scene];
-    scene_manager->stack[scene_manager->top] = next_scene;
-    // TODO exit current scene, enter next scene
+    if (next_scene != current_scene) {
+      exit_scene(current_scene, global_state);
+      scene_manager->stack[scene_manager->top] = next_scene;
+      enter_scene(scene_manager, next_scene, global_state);
+    }
     break;
   }
 
   case SCENE_ACTION_PUSH: {
+    // The scene underneath stays loaded, it is only paused
     Scene *next_scene = scene_manager->scene_registry[scene_manager->pending_scene];
     push_scene(scene_manager, next_scene);
+    enter_scene(scene_manager, next_scene, global_state);
     break;
   }
 
   case SCENE_ACTION_POP:
+    exit_scene(get_current_scene(scene_manager), global_state);
     pop_scene(scene_manager);
     break;
   }
@@ -77,9 +184,10 @@ inline void handle_scene_action(SceneManager *scene_manager) {
   scene_manager->pending_scene_action = SCENE_ACTION_NONE;
 }
 
-inline void set_base_scene(SceneManager *scene_manager, Scene *scene) {
+inline void set_base_scene(SceneManager *scene_manager, Scene *scene, void *global_state) {
   scene_manager->top = 0;
   scene_manager->stack[0] = scene;
+  enter_scene(scene_manager, scene, global_state);
 }
 
 inline void request_set_scene(SceneManager *scene_manager, u32 scene_enum) {
@@ -0,0 +1,239 @@
+#include "shader_hot_reload.h"
+#include "tuke_engine.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef SHADER_HOT_RELOAD_DIR
+#define SHADER_HOT_RELOAD_DIR "gen/hot_reload"
+#endif
+
+#define SPIRV_MAGIC (0x07230203u)
+#define SPIRV_HEADER_SIZE (5 * sizeof(u32))
+
+ShaderHotReload *create_shader_hot_reload(const char *directory) {
+  // Zeroed atomics are valid atomics holding 0
+  ShaderHotReload *hot_reload = (ShaderHotReload *)calloc(1, sizeof(ShaderHotReload));
+  assert(hot_reload);
+  snprintf(hot_reload->directory, sizeof(hot_reload->directory), "%s", directory ? directory : SHADER_HOT_RELOAD_DIR);
+  pthread_mutex_init(&hot_reload->mutex, NULL);
+  return hot_reload;
+}
+
+void destroy_shader_hot_reload(ShaderHotReload *hot_reload) {
+  if (hot_reload->started) {
+    hot_reload->quit.store(true, std::memory_order_release);
+    pthread_join(hot_reload->watcher, NULL);
+  }
+  for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+    free(hot_reload->shaders[i].pending_spirv);
+    free(hot_reload->shaders[i].spirv);
+  }
+  pthread_mutex_destroy(&hot_reload->mutex);
+  free(hot_reload);
+}
+
+static bool find_or_add_shader(ShaderHotReload *hot_reload, const ShaderSpec *spec, u32 *out_index) {
+  for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+    if (hot_reload->shaders[i].spec == spec) {
+      *out_index = i;
+      return true;
+    }
+  }
+  if (hot_reload->num_shaders == MAX_HOT_RELOAD_SHADERS) {
+    fprintf(stderr, "%s(): More than %d shaders\n", __func__, MAX_HOT_RELOAD_SHADERS);
+    return false;
+  }
+
+  HotReloadShader *shader = &hot_reload->shaders[hot_reload->num_shaders];
+  int n = snprintf(shader->path, sizeof(shader->path), "%s/%s.spv", hot_reload->directory, spec->name);
+  if (n < 0 || n >= HOT_RELOAD_PATH_LENGTH) {
+    fprintf(stderr, "%s(): Path for %s is too long\n", __func__, spec->name);
+    return false;
+  }
+  shader->spec = spec;
+  *out_index = hot_reload->num_shaders++;
+  return true;
+}
+
+bool register_hot_reload_material(
+    ShaderHotReload *hot_reload,
+    const ProgramSpec *spec,
+    VkRenderPass render_pass,
+    const PipelineConfig *config,
+    VulkanMaterial *mat
+) {
+  assert(!hot_reload->started && "Register materials before start_shader_hot_reload()");
+  if (hot_reload->num_materials == MAX_HOT_RELOAD_MATERIALS) {
+    fprintf(stderr, "%s(): More than %d materials\n", __func__, MAX_HOT_RELOAD_MATERIALS);
+    return false;
+  }
+
+  HotReloadMaterial *material = &hot_reload->materials[hot_reload->num_materials];
+  if (!find_or_add_shader(hot_reload, spec->vert_shader_spec, &material->vert_shader) ||
+      !find_or_add_shader(hot_reload, spec->frag_shader_spec, &material->frag_shader)) {
+    return false;
+  }
+  material->mat = mat;
+  material->render_pass = render_pass;
+  material->config = config ? *config : vulkan_pipeline_config();
+  material->vertex_layout_id = spec->vertex_layout_id;
+  material->stale = false;
+  hot_reload->num_materials++;
+  return true;
+}
+
+static bool same_mtime(struct timespec a, struct timespec b) { return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec; }
+
+// NULL if the file can't be read or isn't SPIR-V. The reflector replaces files atomically, so a torn read means the
+// file was replaced again meanwhile, and the next poll sees the new mtime.
+static u32 *load_spirv(const char *path, u32 *out_size) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+  fseek(fp, 0L, SEEK_END);
+  long file_size = ftell(fp);
+  rewind(fp);
+  if (file_size < (long)SPIRV_HEADER_SIZE || file_size % sizeof(u32) != 0) {
+    fprintf(stderr, "Hot reload: %s is not SPIR-V, %ld bytes\n", path, file_size);
+    fclose(fp);
+    return NULL;
+  }
+
+  u32 *spirv = (u32 *)malloc(file_size);
+  assert(spirv);
+  size_t bytes_read = fread(spirv, 1, file_size, fp);
+  fclose(fp);
+  if (bytes_read != (size_t)file_size || spirv[0] != SPIRV_MAGIC) {
+    fprintf(stderr, "Hot reload: %s is not SPIR-V\n", path);
+    free(spirv);
+    return NULL;
+  }
+  *out_size = (u32)file_size;
+  return spirv;
+}
+
+static void *hot_reload_watcher_main(void *arg) {
+  ShaderHotReload *hot_reload = (ShaderHotReload *)arg;
+  const struct timespec poll_interval = {
+      .tv_sec = HOT_RELOAD_POLL_MS / 1000,
+      .tv_nsec = (HOT_RELOAD_POLL_MS % 1000) * 1000000L,
+  };
+
+  while (!hot_reload->quit.load(std::memory_order_acquire)) {
+    for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+      HotReloadShader *shader = &hot_reload->shaders[i];
+      struct stat st;
+      if (stat(shader->path, &st) != 0 || same_mtime(st.st_mtim, shader->mtime)) {
+        continue;
+      }
+      shader->mtime = st.st_mtim;
+
+      u32 spirv_size = 0;
+      u32 *spirv = load_spirv(shader->path, &spirv_size);
+      if (spirv == NULL) {
+        continue;
+      }
+      pthread_mutex_lock(&hot_reload->mutex);
+      free(shader->pending_spirv); // Superseded before the render thread took it
+      shader->pending_spirv = spirv;
+      shader->pending_spirv_size = spirv_size;
+      pthread_mutex_unlock(&hot_reload->mutex);
+      hot_reload->has_pending.store(true, std::memory_order_release);
+    }
+    nanosleep(&poll_interval, NULL);
+  }
+  return NULL;
+}
+
+bool start_shader_hot_reload(ShaderHotReload *hot_reload) {
+  assert(!hot_reload->started);
+  for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+    struct stat st;
+    if (stat(hot_reload->shaders[i].path, &st) == 0) {
+      hot_reload->shaders[i].mtime = st.st_mtim;
+    }
+  }
+
+  if (pthread_create(&hot_reload->watcher, NULL, hot_reload_watcher_main, hot_reload) != 0) {
+    fprintf(stderr, "%s(): Failed to start the watcher thread\n", __func__);
+    return false;
+  }
+  hot_reload->started = true;
+  printf("Hot reloading %u shaders from %s\n", hot_reload->num_shaders, hot_reload->directory);
+  return true;
+}
+
+static VkShaderModule create_hot_reload_shader_module(VkDevice device, const HotReloadShader *shader) {
+  if (shader->spirv != NULL) {
+    return create_shader_module(device, shader->spirv, shader->spirv_size);
+  }
+  return create_shader_module(device, shader->spec->spv, shader->spec->spv_size);
+}
+
+u32 apply_shader_hot_reloads(VulkanContext *ctx, ShaderHotReload *hot_reload) {
+  if (!hot_reload->has_pending.exchange(false, std::memory_order_acquire)) {
+    return 0;
+  }
+
+  // Take whatever the watcher loaded
+  bool reloaded[MAX_HOT_RELOAD_SHADERS] = {};
+  pthread_mutex_lock(&hot_reload->mutex);
+  for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+    HotReloadShader *shader = &hot_reload->shaders[i];
+    if (shader->pending_spirv != NULL) {
+      free(shader->spirv);
+      shader->spirv = shader->pending_spirv;
+      shader->spirv_size = shader->pending_spirv_size;
+      shader->pending_spirv = NULL;
+      reloaded[i] = true;
+    }
+  }
+  pthread_mutex_unlock(&hot_reload->mutex);
+
+  for (u32 i = 0; i < hot_reload->num_materials; i++) {
+    HotReloadMaterial *material = &hot_reload->materials[i];
+    material->stale |= reloaded[material->vert_shader] || reloaded[material->frag_shader];
+  }
+
+  // Rebuild the affected pipelines. The pipeline cache already holds everything but the changed stages.
+  VkDevice device = ctx->device;
+  u32 num_swapped = 0;
+  for (u32 i = 0; i < hot_reload->num_materials; i++) {
+    HotReloadMaterial *material = &hot_reload->materials[i];
+    if (!material->stale) {
+      continue;
+    }
+
+    const HotReloadShader *vert = &hot_reload->shaders[material->vert_shader];
+    const HotReloadShader *frag = &hot_reload->shaders[material->frag_shader];
+    VkShaderModule vert_mod = create_hot_reload_shader_module(device, vert);
+    VkShaderModule frag_mod = create_hot_reload_shader_module(device, frag);
+    VkPipeline pipeline = create_graphics_pipeline(
+        device, material->render_pass, vert_mod, frag_mod, &generated_vulkan_vertex_layouts[material->vertex_layout_id],
+        material->mat->pipeline_layout, ctx->pipeline_cache, &material->config
+    );
+    vkDestroyShaderModule(device, vert_mod, NULL);
+    vkDestroyShaderModule(device, frag_mod, NULL);
+
+    if (!swap_material_pipeline(ctx, material->mat, pipeline)) {
+      // Out of retired slots this frame, try again next frame
+      vkDestroyPipeline(device, pipeline, NULL);
+      hot_reload->has_pending.store(true, std::memory_order_relaxed);
+      break;
+    }
+    material->stale = false;
+    num_swapped++;
+  }
+
+  for (u32 i = 0; i < hot_reload->num_shaders; i++) {
+    if (reloaded[i]) {
+      printf("Hot reloaded %s\n", hot_reload->shaders[i].spec->name);
+    }
+  }
+  return num_swapped;
+}
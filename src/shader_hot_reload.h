@@ -0,0 +1,91 @@
+#pragma once
+
+// Runtime shader hot reload for development.
+//
+// `reflector --watch` recompiles a shader as soon as its .in file is saved and writes the SPIR-V to
+// SHADER_HOT_RELOAD_DIR/<name>.spv, replacing the file atomically and only when the bytes changed. A background thread
+// polls the mtimes of the files belonging to registered materials and loads the ones that changed. The render thread
+// picks them up with apply_shader_hot_reloads() and rebuilds the pipelines of the affected materials only, through the
+// pipeline cache.
+//
+// Nothing waits for the device. The new pipeline is swapped into the material at the start of a frame, once that
+// frame's fence has signalled, and the old one is retired to the frame with swap_material_pipeline().
+//
+// Only the SPIR-V is reloaded. Changes to descriptor sets, push constants or the vertex layout change the generated
+// code, and still need a rebuild.
+
+#include "generated_shader_utils.h"
+#include "tuke_engine.h"
+#include "vulkan/vulkan_base.h"
+
+#include <atomic>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_HOT_RELOAD_MATERIALS (64)
+#define MAX_HOT_RELOAD_SHADERS (2 * MAX_HOT_RELOAD_MATERIALS)
+#define HOT_RELOAD_PATH_LENGTH (512)
+#define HOT_RELOAD_POLL_MS (100)
+
+// One per distinct ShaderSpec. Materials sharing a shader share its entry.
+struct HotReloadShader {
+  const ShaderSpec *spec;
+  char path[HOT_RELOAD_PATH_LENGTH];
+
+  // Watcher thread only
+  struct timespec mtime;
+
+  // Guarded by ShaderHotReload::mutex. Loaded by the watcher, taken by apply_shader_hot_reloads().
+  u32 *pending_spirv;
+  u32 pending_spirv_size;
+
+  // Render thread only. NULL until the first reload, the spec's compiled in SPIR-V is used until then.
+  u32 *spirv;
+  u32 spirv_size;
+};
+
+struct HotReloadMaterial {
+  VulkanMaterial *mat;
+  VkRenderPass render_pass;
+  PipelineConfig config;
+  VertexLayoutID vertex_layout_id;
+  u32 vert_shader; // Indices into ShaderHotReload::shaders
+  u32 frag_shader;
+  bool stale;      // A shader was reloaded but the pipeline not swapped yet
+};
+
+struct ShaderHotReload {
+  char directory[HOT_RELOAD_PATH_LENGTH];
+
+  HotReloadShader shaders[MAX_HOT_RELOAD_SHADERS];
+  u32 num_shaders;
+  HotReloadMaterial materials[MAX_HOT_RELOAD_MATERIALS];
+  u32 num_materials;
+
+  pthread_t watcher;
+  pthread_mutex_t mutex;
+  std::atomic<bool> has_pending;
+  std::atomic<bool> quit;
+  bool started;
+};
+
+// directory is where the reflector writes the .spv files. NULL uses SHADER_HOT_RELOAD_DIR, set by the engine build.
+ShaderHotReload *create_shader_hot_reload(const char *directory);
+void destroy_shader_hot_reload(ShaderHotReload *hot_reload);
+
+// Register every material before starting. mat must stay where it is, and config is copied (NULL for the default, as
+// in init_program_spec). Returns false when the tables are full.
+bool register_hot_reload_material(
+    ShaderHotReload *hot_reload,
+    const ProgramSpec *spec,
+    VkRenderPass render_pass,
+    const PipelineConfig *config,
+    VulkanMaterial *mat
+);
+
+// Starts the watcher thread. Files already on disk are taken as what was compiled in, only later writes reload.
+bool start_shader_hot_reload(ShaderHotReload *hot_reload);
+
+// Call after begin_frame(). Rebuilds and swaps the pipelines of materials whose shaders were reloaded, and returns how
+// many were swapped. Costs one atomic load on frames with nothing to do.
+u32 apply_shader_hot_reloads(VulkanContext *ctx, ShaderHotReload *hot_reload);
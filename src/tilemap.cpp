@@ -1,4 +1,5 @@
 #include "tilemap.h"
+#include "jobs.h"
 #include "linalg.h"
 
 static inline void
@@ -13,11 +14,11 @@ populate_tile_vertex(f32 x, f32 y, f32 z, f32 u, f32 v, u32 texture_id, TileVert
   out_tile_vertex->texture_id = texture_id;
 }
 
-// Populating a pointer to an existing array instead of returning the pointer
-// Anticipating callers will manage the memory, allowing for usage in an arena
-//
-// Each tile in the map gets 6 vertices, BL, TL, TR - TR, BR, BL
-void tilemap_generate_vertices(const Tilemap *tilemap, TileVertex *out_tile_vertices) {
+// Rows [y_begin, y_end). Row y's vertices start at y * level_width * 6, so rows can be generated
+// independently.
+static void tilemap_generate_vertex_rows(
+    const Tilemap *tilemap, u32 y_begin, u32 y_end, TileVertex *out_tile_vertices
+) {
   // centering the tilemap at 0.0
   const f32 dw = TILE_SIDE_LENGTH_METERS;
   const f32 dh = TILE_SIDE_LENGTH_METERS;
@@ -32,8 +33,8 @@ void tilemap_generate_vertices(const Tilemap *tilemap, TileVertex *out_tile_vert
   const f32 v1 = 1.0f;
   const f32 z0 = 0.0f; // TODO
 
-  u32 i = 0;
-  for (u32 y = 0; y < tilemap->level_height; y++) {
+  u32 i = y_begin * tilemap->level_width * 6;
+  for (u32 y = y_begin; y < y_end; y++) {
     for (u32 x = 0; x < tilemap->level_width; x++) {
 
       f32 x1 = x0 + x * dw;
@@ -56,6 +57,32 @@ void tilemap_generate_vertices(const Tilemap *tilemap, TileVertex *out_tile_vert
   }
 }
 
+// Populating a pointer to an existing array instead of returning the pointer
+// Anticipating callers will manage the memory, allowing for usage in an arena
+//
+// Each tile in the map gets 6 vertices, BL, TL, TR - TR, BR, BL
+void tilemap_generate_vertices(const Tilemap *tilemap, TileVertex *out_tile_vertices) {
+  tilemap_generate_vertex_rows(tilemap, 0, tilemap->level_height, out_tile_vertices);
+}
+
+struct TilemapVerticesJob {
+  const Tilemap *tilemap;
+  TileVertex *out_tile_vertices;
+};
+
+static void tilemap_generate_vertices_job(void *data, u32 begin, u32 end) {
+  TilemapVerticesJob *job = (TilemapVerticesJob *)data;
+  tilemap_generate_vertex_rows(job->tilemap, begin, end, job->out_tile_vertices);
+}
+
+void tilemap_generate_vertices_parallel(JobSystem *jobs, const Tilemap *tilemap, TileVertex *out_tile_vertices) {
+  // A few thousand tiles per job keeps the scheduling overhead in the noise
+  u32 min_rows = 4096 / (tilemap->level_width ? tilemap->level_width : 1) + 1;
+  u32 grain = parallel_for_grain(jobs, tilemap->level_height, 4, min_rows);
+  TilemapVerticesJob job = {.tilemap = tilemap, .out_tile_vertices = out_tile_vertices};
+  parallel_for(jobs, tilemap->level_height, grain, tilemap_generate_vertices_job, &job);
+}
+
 // Check if an AABB aligned with xy in screen space collides with a cell marked non-zero in
 // the tilemap.
 // If the AABB overlaps with a cell marked non-zero, return the value of the cell.
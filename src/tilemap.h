@@ -1,5 +1,6 @@
 #pragma once
 
+#include "jobs.h"
 #include "linalg.h"
 #include "tuke_engine.h"
 #include <stdio.h>
@@ -58,3 +59,6 @@ static inline u8 tilemap_get_at(const Tilemap *tilemap, u32 x, u32 y) {
 int tilemap_check_collision(const Tilemap *tilemap, Vec3 pos, Vec3 size);
 
 void tilemap_generate_vertices(const Tilemap *tilemap, TileVertex *out_tile_vertices);
+
+// Same output as tilemap_generate_vertices, rows split across the job system
+void tilemap_generate_vertices_parallel(JobSystem *jobs, const Tilemap *tilemap, TileVertex *out_tile_vertices);
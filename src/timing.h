@@ -0,0 +1,33 @@
+#pragma once
+
+#include "tuke_engine.h"
+
+#include <time.h>
+
+// Monotonic wall clock, for profiling. Not for gameplay time.
+static inline u64 get_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static inline f64 ns_to_ms(u64 ns) { return (f64)ns * 1e-6; }
+
+// Running total/min/max of a repeated measurement, e.g. one system's time per tick.
+struct TimingAccumulator {
+  u64 total_ns;
+  u64 min_ns;
+  u64 max_ns;
+  u32 count;
+};
+
+static inline void timing_accumulate(TimingAccumulator *timing, u64 ns) {
+  timing->total_ns += ns;
+  timing->min_ns = (timing->count == 0 || ns < timing->min_ns) ? ns : timing->min_ns;
+  timing->max_ns = (ns > timing->max_ns) ? ns : timing->max_ns;
+  timing->count++;
+}
+
+static inline f64 timing_mean_ms(const TimingAccumulator *timing) {
+  return timing->count ? ns_to_ms(timing->total_ns) / timing->count : 0.0;
+}
@@ -0,0 +1,277 @@
+#include "vertex_compression.h"
+#include "linalg.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Same operand order as maxps/minps, so NaN clamps to lo like the SSE2 path
+static inline f32 clamp_f32(f32 x, f32 lo, f32 hi) {
+  x = x > lo ? x : lo;
+  return x < hi ? x : hi;
+}
+
+// lrintf rounds to nearest even, like cvtps2dq
+static inline u32 encode_unorm(f32 x, f32 max) { return (u32)lrintf(clamp_f32(x, 0.0f, 1.0f) * max); }
+
+static inline u32 encode_snorm16(f32 x) { return (u32)lrintf(clamp_f32(x, -1.0f, 1.0f) * 32767.0f) & 0xffffu; }
+
+static inline u32 f32_bits(f32 f) {
+  u32 bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+static inline f32 bits_f32(u32 bits) {
+  f32 f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+u32 encode_unorm8x4(Vec4 v) {
+  return encode_unorm(v.x, 255.0f) | (encode_unorm(v.y, 255.0f) << 8) | (encode_unorm(v.z, 255.0f) << 16) |
+         (encode_unorm(v.w, 255.0f) << 24);
+}
+
+u32 encode_snorm16x2(Vec2 v) { return encode_snorm16(v.x) | (encode_snorm16(v.y) << 16); }
+
+u32 encode_half2(Vec2 v) { return (u32)f32_to_f16(v.x) | ((u32)f32_to_f16(v.y) << 16); }
+
+u32 encode_unorm10_10_10_2(Vec4 v) {
+  return encode_unorm(v.x, 1023.0f) | (encode_unorm(v.y, 1023.0f) << 10) | (encode_unorm(v.z, 1023.0f) << 20) |
+         (encode_unorm(v.w, 3.0f) << 30);
+}
+
+u32 encode_octahedral(Vec3 normal) {
+  f32 l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+  f32 inv_l1 = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+  f32 x = normal.x * inv_l1;
+  f32 y = normal.y * inv_l1;
+  if (normal.z * inv_l1 < 0.0f) {
+    // Fold the lower hemisphere over the diagonals
+    f32 folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    f32 folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = folded_x;
+    y = folded_y;
+  }
+  return encode_snorm16(x) | (encode_snorm16(y) << 16);
+}
+
+// Round to nearest even, overflow goes to infinity, NaN stays a quiet NaN
+u16 f32_to_f16(f32 f) {
+  u32 bits = f32_bits(f);
+  u32 sign = bits & 0x80000000u;
+  bits ^= sign;
+
+  u32 half;
+  if (bits >= 0x47800000u) {
+    // Past the largest half, or infinity or NaN
+    half = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+  } else if (bits < 0x38800000u) {
+    // Subnormal half, adding 0.5 lets the FPU round the mantissa into place
+    half = f32_bits(bits_f32(bits) + 0.5f) - 0x3f000000u;
+  } else {
+    // Rebias the exponent and round the 13 dropped mantissa bits
+    u32 mantissa_odd = (bits >> 13) & 1;
+    half = (bits + 0xc8000fffu + mantissa_odd) >> 13;
+  }
+  return (u16)(half | (sign >> 16));
+}
+
+f32 f16_to_f32(u16 h) {
+  u32 sign = (u32)(h & 0x8000u) << 16;
+  u32 exponent = (h >> 10) & 0x1fu;
+  u32 mantissa = h & 0x3ffu;
+  if (exponent == 0x1fu) {
+    return bits_f32(sign | 0x7f800000u | (mantissa << 13));
+  }
+  if (exponent == 0) {
+    f32 subnormal = (f32)mantissa * (1.0f / 16777216.0f); // 2^-24
+    return sign ? -subnormal : subnormal;
+  }
+  return bits_f32(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+Vec3 decode_octahedral(u32 encoded) {
+  f32 x = clamp_f32((f32)(i16)(encoded & 0xffffu) / 32767.0f, -1.0f, 1.0f);
+  f32 y = clamp_f32((f32)(i16)(encoded >> 16) / 32767.0f, -1.0f, 1.0f);
+  Vec3 n = vec3(x, y, 1.0f - fabsf(x) - fabsf(y));
+  f32 t = clamp_f32(-n.z, 0.0f, 1.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize_v3(n);
+}
+
+static inline void store_encoded(u8 *out, u32 out_stride, u32 i, u32 encoded) {
+  memcpy(out + (u64)i * out_stride, &encoded, sizeof(encoded));
+}
+
+#if defined(__SSE2__)
+static inline __m128 clamp_4(__m128 x, __m128 lo, __m128 hi) { return _mm_min_ps(_mm_max_ps(x, lo), hi); }
+
+static inline __m128i encode_unorm_4(__m128 x, f32 max) {
+  return _mm_cvtps_epi32(_mm_mul_ps(clamp_4(x, _mm_setzero_ps(), _mm_set1_ps(1.0f)), _mm_set1_ps(max)));
+}
+
+static inline __m128i encode_snorm16_4(__m128 x) {
+  __m128 clamped = clamp_4(x, _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+  return _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(32767.0f))), _mm_set1_epi32(0xffff));
+}
+
+// f32_to_f16 on four lanes, branches turned into masks
+static inline __m128i f32_to_f16_4(__m128 f) {
+  __m128i bits = _mm_castps_si128(f);
+  __m128i sign = _mm_and_si128(bits, _mm_set1_epi32((i32)0x80000000u));
+  bits = _mm_xor_si128(bits, sign);
+
+  __m128i is_regular = _mm_cmpgt_epi32(_mm_set1_epi32(0x47800000), bits);
+  __m128i is_nan = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x7f800000));
+  __m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(is_nan, _mm_set1_epi32(0x200)));
+
+  __m128i is_subnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), bits);
+  __m128 subnormal_sum = _mm_add_ps(_mm_castsi128_ps(bits), _mm_set1_ps(0.5f));
+  __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(subnormal_sum), _mm_set1_epi32(0x3f000000));
+
+  __m128i mantissa_odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+  __m128i rounded = _mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32((i32)0xc8000fffu)), mantissa_odd);
+  __m128i normal = _mm_srli_epi32(rounded, 13);
+
+  __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+  __m128i half = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, special));
+  return _mm_or_si128(half, _mm_srli_epi32(sign, 16));
+}
+
+// 1 where x >= 0, -1 elsewhere and for NaN, like the scalar ternary
+static inline __m128 sign_not_zero_4(__m128 x) {
+  __m128 not_negative = _mm_cmpge_ps(x, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(not_negative, _mm_set1_ps(1.0f)), _mm_andnot_ps(not_negative, _mm_set1_ps(-1.0f)));
+}
+
+static inline void store_encoded_4(u8 *out, u32 out_stride, u32 i, __m128i encoded) {
+  u32 lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, encoded);
+  for (u32 j = 0; j < 4; j++) {
+    store_encoded(out, out_stride, i + j, lanes[j]);
+  }
+}
+
+// Two Vec2s per load, split into x and y lanes
+static inline void load_vec2_4(const Vec2 *in, __m128 *x, __m128 *y) {
+  __m128 v01 = _mm_loadu_ps(&in[0].x);
+  __m128 v23 = _mm_loadu_ps(&in[2].x);
+  *x = _mm_shuffle_ps(v01, v23, _MM_SHUFFLE(2, 0, 2, 0));
+  *y = _mm_shuffle_ps(v01, v23, _MM_SHUFFLE(3, 1, 3, 1));
+}
+#endif
+
+void encode_unorm8x4_array(const Vec4 *in, u32 count, void *out, u32 out_stride) {
+  u8 *dst = (u8 *)out;
+  u32 i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(&in[i + 0].x);
+    __m128 y = _mm_loadu_ps(&in[i + 1].x);
+    __m128 z = _mm_loadu_ps(&in[i + 2].x);
+    __m128 w = _mm_loadu_ps(&in[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128i encoded = _mm_or_si128(
+        _mm_or_si128(encode_unorm_4(x, 255.0f), _mm_slli_epi32(encode_unorm_4(y, 255.0f), 8)),
+        _mm_or_si128(_mm_slli_epi32(encode_unorm_4(z, 255.0f), 16), _mm_slli_epi32(encode_unorm_4(w, 255.0f), 24))
+    );
+    store_encoded_4(dst, out_stride, i, encoded);
+  }
+#endif
+  for (; i < count; i++) {
+    store_encoded(dst, out_stride, i, encode_unorm8x4(in[i]));
+  }
+}
+
+void encode_snorm16x2_array(const Vec2 *in, u32 count, void *out, u32 out_stride) {
+  u8 *dst = (u8 *)out;
+  u32 i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x, y;
+    load_vec2_4(&in[i], &x, &y);
+    __m128i encoded = _mm_or_si128(encode_snorm16_4(x), _mm_slli_epi32(encode_snorm16_4(y), 16));
+    store_encoded_4(dst, out_stride, i, encoded);
+  }
+#endif
+  for (; i < count; i++) {
+    store_encoded(dst, out_stride, i, encode_snorm16x2(in[i]));
+  }
+}
+
+void encode_half2_array(const Vec2 *in, u32 count, void *out, u32 out_stride) {
+  u8 *dst = (u8 *)out;
+  u32 i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x, y;
+    load_vec2_4(&in[i], &x, &y);
+    __m128i encoded = _mm_or_si128(f32_to_f16_4(x), _mm_slli_epi32(f32_to_f16_4(y), 16));
+    store_encoded_4(dst, out_stride, i, encoded);
+  }
+#endif
+  for (; i < count; i++) {
+    store_encoded(dst, out_stride, i, encode_half2(in[i]));
+  }
+}
+
+void encode_octahedral_array(const Vec3 *in, u32 count, void *out, u32 out_stride) {
+  u8 *dst = (u8 *)out;
+  u32 i = 0;
+#if defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_setr_ps(in[i].x, in[i + 1].x, in[i + 2].x, in[i + 3].x);
+    __m128 y = _mm_setr_ps(in[i].y, in[i + 1].y, in[i + 2].y, in[i + 3].y);
+    __m128 z = _mm_setr_ps(in[i].z, in[i + 1].z, in[i + 2].z, in[i + 3].z);
+
+    __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, abs_mask), _mm_and_ps(y, abs_mask)), _mm_and_ps(z, abs_mask));
+    __m128 inv_l1 = _mm_and_ps(_mm_cmpgt_ps(l1, zero), _mm_div_ps(one, l1));
+    x = _mm_mul_ps(x, inv_l1);
+    y = _mm_mul_ps(y, inv_l1);
+    __m128 is_lower = _mm_cmplt_ps(_mm_mul_ps(z, inv_l1), zero);
+
+    // Fold the lower hemisphere over the diagonals
+    __m128 folded_x = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(y, abs_mask)), sign_not_zero_4(x));
+    __m128 folded_y = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(x, abs_mask)), sign_not_zero_4(y));
+    x = _mm_or_ps(_mm_and_ps(is_lower, folded_x), _mm_andnot_ps(is_lower, x));
+    y = _mm_or_ps(_mm_and_ps(is_lower, folded_y), _mm_andnot_ps(is_lower, y));
+
+    __m128i encoded = _mm_or_si128(encode_snorm16_4(x), _mm_slli_epi32(encode_snorm16_4(y), 16));
+    store_encoded_4(dst, out_stride, i, encoded);
+  }
+#endif
+  for (; i < count; i++) {
+    store_encoded(dst, out_stride, i, encode_octahedral(in[i]));
+  }
+}
+
+void encode_unorm10_10_10_2_array(const Vec4 *in, u32 count, void *out, u32 out_stride) {
+  u8 *dst = (u8 *)out;
+  u32 i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(&in[i + 0].x);
+    __m128 y = _mm_loadu_ps(&in[i + 1].x);
+    __m128 z = _mm_loadu_ps(&in[i + 2].x);
+    __m128 w = _mm_loadu_ps(&in[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128i encoded = _mm_or_si128(
+        _mm_or_si128(encode_unorm_4(x, 1023.0f), _mm_slli_epi32(encode_unorm_4(y, 1023.0f), 10)),
+        _mm_or_si128(_mm_slli_epi32(encode_unorm_4(z, 1023.0f), 20), _mm_slli_epi32(encode_unorm_4(w, 3.0f), 30))
+    );
+    store_encoded_4(dst, out_stride, i, encoded);
+  }
+#endif
+  for (; i < count; i++) {
+    store_encoded(dst, out_stride, i, encode_unorm10_10_10_2(in[i]));
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// CPU encoders for the packed vertex formats the reflector accepts after FORMAT in a location directive, see
+// VertexFormat in reflector/reflector.h. Every format is 4 bytes, so each attribute encodes to one u32 in the byte
+// order the GPU reads it in.
+//
+// The _array versions encode count attributes to out, out_stride bytes apart, so they can write straight into an
+// interleaved vertex buffer. They do four attributes at a time with SSE2 where it is available, and give the same bits
+// as the scalar versions: floats are clamped first, NaN clamps to the low end, and rounding is to nearest even.
+//
+// OCTAHEDRAL stores a unit vector folded onto the octahedron as SNORM16X2. The shader reads a vec2 and unfolds it:
+//   vec3 decode_octahedral(vec2 e) {
+//     vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//     float t = max(-n.z, 0.0);
+//     n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+//     return normalize(n);
+//   }
+
+#include "linalg.h"
+#include "tuke_engine.h"
+
+u32 encode_unorm8x4(Vec4 v);
+u32 encode_snorm16x2(Vec2 v);
+u32 encode_half2(Vec2 v);
+u32 encode_octahedral(Vec3 normal); // normal needn't be normalized, zero encodes +z
+u32 encode_unorm10_10_10_2(Vec4 v);
+
+u16 f32_to_f16(f32 f);
+f32 f16_to_f32(u16 h);
+Vec3 decode_octahedral(u32 encoded);
+
+void encode_unorm8x4_array(const Vec4 *in, u32 count, void *out, u32 out_stride);
+void encode_snorm16x2_array(const Vec2 *in, u32 count, void *out, u32 out_stride);
+void encode_half2_array(const Vec2 *in, u32 count, void *out, u32 out_stride);
+void encode_octahedral_array(const Vec3 *in, u32 count, void *out, u32 out_stride);
+void encode_unorm10_10_10_2_array(const Vec4 *in, u32 count, void *out, u32 out_stride);
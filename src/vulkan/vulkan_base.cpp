@@ -12,6 +12,13 @@ void update_frame_index(VulkanContext *ctx) {
   ctx->current_frame_index = (ctx->current_frame_index + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+static void destroy_retired_pipelines(VulkanContext *ctx, u32 frame_index) {
+  for (u32 i = 0; i < ctx->num_retired_pipelines[frame_index]; i++) {
+    vkDestroyPipeline(ctx->device, ctx->retired_pipelines[frame_index][i], NULL);
+  }
+  ctx->num_retired_pipelines[frame_index] = 0;
+}
+
 void destroy_swapchain(VulkanContext *ctx) {
   SwapchainStorage *storage = &ctx->swapchain_storage;
 
@@ -49,6 +56,10 @@ void destroy_vulkan_context(VulkanContext *ctx) {
   VkResult result = vkDeviceWaitIdle(ctx->device);
   VK_CHECK(result, "Failed to wait idle");
 
+  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    destroy_retired_pipelines(ctx, i);
+  }
+
   // Descriptors set layouts, then pipeline layouts, then pipelines
   reset_descriptor_set_layouts(ctx);
   vkDestroyPipelineCache(ctx->device, ctx->pipeline_cache, NULL);
@@ -1694,6 +1705,9 @@ void begin_frame(VulkanContext *ctx) {
   // Reset fence to unsignalled state, meaning we must wait on it again for the next frame.
   vkResetFences(ctx->device, fence_count, fence);
 
+  // The GPU is done with everything submitted up to this slot's last frame, including pipelines swapped out during it
+  destroy_retired_pipelines(ctx, ctx->current_frame_index);
+
   // https://docs.vulkan.org/refpages/latest/refpages/source/vkAcquireNextImageKHR.html
   VkSemaphore semaphore = ctx->image_available_semaphores[ctx->current_frame_index];
   result = vkAcquireNextImageKHR(ctx->device, ctx->swapchain, timeout, semaphore, VK_NULL_HANDLE, &ctx->image_index);
@@ -2072,6 +2086,18 @@ void destroy_vulkan_material(VkDevice device, VulkanMaterial *mat) {
   vkDestroyPipeline(device, mat->pipeline, NULL);
 }
 
+bool swap_material_pipeline(VulkanContext *ctx, VulkanMaterial *mat, VkPipeline pipeline) {
+  u32 frame_index = ctx->current_frame_index;
+  u32 *num_retired = &ctx->num_retired_pipelines[frame_index];
+  if (*num_retired == MAX_RETIRED_PIPELINES) {
+    fprintf(stderr, "%s(): %d pipelines already retired this frame\n", __func__, MAX_RETIRED_PIPELINES);
+    return false;
+  }
+  ctx->retired_pipelines[frame_index][(*num_retired)++] = mat->pipeline;
+  mat->pipeline = pipeline;
+  return true;
+}
+
 void render_mesh(VkCommandBuffer cmd, const VulkanMesh *mesh, const VulkanMaterial *mat) {
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline);
 
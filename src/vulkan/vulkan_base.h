@@ -63,6 +63,7 @@ typedef int32_t i32;
 
 #define MAX_BUFFER_UPLOADS (32)
 #define MAX_UNIFORMS_PER_BUFFER (256)
+#define MAX_RETIRED_PIPELINES (32) // Per frame in flight, see swap_material_pipeline()
 
 inline const char *vk_result_string(VkResult result) {
 #define ERR(e)                                                                                                         \
@@ -191,6 +192,11 @@ typedef struct {
 
   VkPipelineCache pipeline_cache;
 
+  // Pipelines swapped out of a material while a frame in flight may still use them. Destroyed once the slot's fence
+  // is waited on again.
+  VkPipeline retired_pipelines[MAX_FRAMES_IN_FLIGHT][MAX_RETIRED_PIPELINES];
+  u32 num_retired_pipelines[MAX_FRAMES_IN_FLIGHT];
+
   // Init
   VkInstance instance;
   VkDebugUtilsMessengerEXT debug_messenger;
@@ -444,6 +450,11 @@ VkDescriptorBufferInfo *push_uniform(UniformBufferManager *uniform_buffer_manage
 ////////////////////////////// Materials //////////////////////////////
 void destroy_vulkan_material(VkDevice device, VulkanMaterial *mat);
 
+// Replaces mat->pipeline without waiting for the device. Call between begin_frame() and end_frame(): the old pipeline
+// is retired to the current frame, whose fence covers every earlier frame that bound it, and destroyed the next time
+// that fence is waited on. Returns false, leaving the material alone, if too many swaps are pending.
+bool swap_material_pipeline(VulkanContext *ctx, VulkanMaterial *mat, VkPipeline pipeline);
+
 ////////////////////////////// Rendering APIs //////////////////////////////
 void render_mesh(VkCommandBuffer cmd, const VulkanMesh *mesh, const VulkanMaterial *mat);
 
@@ -5,6 +5,7 @@
 #include <glad/gl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Globals for scroll callback
 f64 scroll_dx, scroll_dy;
@@ -86,6 +87,76 @@ void update_inputs_glfw(Inputs *inputs, GLFWwindow *window) {
   glfwGetCursorPos(window, &inputs->curr_cursor_x, &inputs->curr_cursor_y);
 }
 
+void update_inputs_glfw_unconsumed(Inputs *inputs, GLFWwindow *window) {
+  bool prev_keys[NUM_INPUTS];
+  memcpy(prev_keys, inputs->prev, sizeof(prev_keys));
+  bool prev_lclick = inputs->prev_lclick;
+  bool prev_rclick = inputs->prev_rclick;
+  f64 prev_cursor_x = inputs->prev_cursor_x;
+  f64 prev_cursor_y = inputs->prev_cursor_y;
+  f64 unconsumed_scroll_dx = inputs->scroll_dx;
+  f64 unconsumed_scroll_dy = inputs->scroll_dy;
+
+  update_inputs_glfw(inputs, window);
+
+  memcpy(inputs->prev, prev_keys, sizeof(prev_keys));
+  inputs->prev_lclick = prev_lclick;
+  inputs->prev_rclick = prev_rclick;
+  inputs->prev_cursor_x = prev_cursor_x;
+  inputs->prev_cursor_y = prev_cursor_y;
+  inputs->scroll_dx += unconsumed_scroll_dx;
+  inputs->scroll_dy += unconsumed_scroll_dy;
+}
+
+void clear_input_edges(Inputs *inputs) {
+  memcpy(inputs->prev, inputs->curr, NUM_INPUTS * sizeof(bool));
+  inputs->prev_lclick = inputs->curr_lclick;
+  inputs->prev_rclick = inputs->curr_rclick;
+  inputs->prev_cursor_x = inputs->curr_cursor_x;
+  inputs->prev_cursor_y = inputs->curr_cursor_y;
+  inputs->scroll_dx = 0.0;
+  inputs->scroll_dy = 0.0;
+}
+
+static_assert(NUM_INPUTS + 2 <= 32, "keys and clicks must fit in InputFrame::buttons");
+
+InputFrame inputs_to_input_frame(const Inputs *inputs) {
+  InputFrame frame = {};
+  for (u32 i = 0; i < NUM_INPUTS; i++) {
+    frame.buttons |= (u32)inputs->curr[i] << i;
+  }
+  frame.buttons |= (u32)inputs->curr_lclick << NUM_INPUTS;
+  frame.buttons |= (u32)inputs->curr_rclick << (NUM_INPUTS + 1);
+
+  frame.axes[0] = (f32)inputs->curr_cursor_x;
+  frame.axes[1] = (f32)inputs->curr_cursor_y;
+  frame.axes[2] = (f32)inputs->scroll_dx;
+  frame.axes[3] = (f32)inputs->scroll_dy;
+  return frame;
+}
+
+void apply_input_frame(Inputs *inputs, const InputFrame *frame) {
+  bool *temp = inputs->curr;
+  inputs->curr = inputs->prev;
+  inputs->prev = temp;
+
+  for (u32 i = 0; i < NUM_INPUTS; i++) {
+    inputs->curr[i] = (frame->buttons >> i) & 1;
+  }
+
+  inputs->prev_lclick = inputs->curr_lclick;
+  inputs->curr_lclick = (frame->buttons >> NUM_INPUTS) & 1;
+  inputs->prev_rclick = inputs->curr_rclick;
+  inputs->curr_rclick = (frame->buttons >> (NUM_INPUTS + 1)) & 1;
+
+  inputs->prev_cursor_x = inputs->curr_cursor_x;
+  inputs->prev_cursor_y = inputs->curr_cursor_y;
+  inputs->curr_cursor_x = frame->axes[0];
+  inputs->curr_cursor_y = frame->axes[1];
+  inputs->scroll_dx = frame->axes[2];
+  inputs->scroll_dy = frame->axes[3];
+}
+
 Vec2 get_cursor_position(GLFWwindow *window) {
   double xpos, ypos;
   glfwGetCursorPos(window, &xpos, &ypos);
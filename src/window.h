@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GLFW/glfw3.h"
+#include "input_recording.h"
 #include "linalg.h"
 #include "tuke_engine.h"
 
@@ -65,6 +66,18 @@ GLFWwindow *create_window(bool is_vulkan, const char *title = "Tuke", const int
 void update_inputs_glfw(Inputs *inputs, GLFWwindow *window);
 void init_inputs(Inputs *inputs);
 
+// Fixed timestep loops. Use when the last update ran no sim steps, so its presses, releases and
+// scrolling carry over to the next step instead of being lost.
+void update_inputs_glfw_unconsumed(Inputs *inputs, GLFWwindow *window);
+// Call between sim steps taken for the same window update, so presses only register once.
+void clear_input_edges(Inputs *inputs);
+
+// Inputs <-> InputFrame for recording and replay.
+// Keys are buttons 0..NUM_INPUTS-1, then left and right click. Axes are cursor x, y, then scroll dx, dy.
+InputFrame inputs_to_input_frame(const Inputs *inputs);
+// Advances inputs by one frame as update_inputs_glfw would, from a recording instead of the window.
+void apply_input_frame(Inputs *inputs, const InputFrame *frame);
+
 Vec2 inputs_to_direction_arrow_keys(const Inputs *inputs);
 Vec2 inputs_to_direction_wasd(const Inputs *inputs);
 Vec2 inputs_to_direction(const Inputs *inputs);